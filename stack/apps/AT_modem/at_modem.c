@@ -226,6 +226,13 @@ static void packet_received(hw_radio_packet_t* hw_radio_packet)
     if (hw_radio_packet->rx_meta.crc_status == HW_CRC_UNAVAILABLE)
     {
         uint16_t crc;
+        if (hw_radio_packet->length < 2)
+        {
+            DPRINT("CRC invalid");
+            missed_packets_counter++;
+            return;
+        }
+
         crc = __builtin_bswap16(crc_calculate(hw_radio_packet->data, hw_radio_packet->length - 2));
 
         if(memcmp(&crc, hw_radio_packet->data + hw_radio_packet->length - 2, 2) != 0)
@@ -180,9 +180,11 @@ static void channel_id_to_string(channel_id_t* channel, char* str, size_t len) {
 }
 
 static void packet_received(hw_radio_packet_t* packet) {
-    uint16_t crc = __builtin_bswap16(crc_calculate(packet->data, packet->length + 1 - 2));
+    uint16_t crc = 0;
+    if(packet->length >= 1)
+        crc = __builtin_bswap16(crc_calculate(packet->data, packet->length + 1 - 2));
 
-    if(memcmp(&crc, packet->data + packet->length + 1 - 2, 2) != 0)
+    if(packet->length < 1 || memcmp(&crc, packet->data + packet->length + 1 - 2, 2) != 0)
     {
         DPRINT("CRC error");
         missed_packets_counter++;
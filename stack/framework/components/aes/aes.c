@@ -60,6 +60,8 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 #include <string.h> // CBC mode, for memset
 #include "stdbool.h"
 #include "aes.h"
+#include "aes_cipher.h"
+#include "errors.h"
 
 #ifdef HAL_SUPPORT_HW_AES
 #include "hwaes.h"
@@ -75,7 +77,7 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 // Key length in bytes [128 bit]
 #define KEYLEN 16
 // The number of rounds in AES Cipher.
-#define Nr 10
+#define Nr AES128_ROUNDS
 
 // jcallan@github points out that declaring Multiply as a function
 // reduces code size considerably with the Keil ARM compiler.
@@ -87,18 +89,8 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /*****************************************************************************/
 /* Private variables:                                                        */
 /*****************************************************************************/
-// state - array holding the intermediate results during decryption.
-typedef uint8_t state_t[4][4];
-static state_t *state;
-
-// The array that stores the round keys.
-static uint8_t RoundKey[176];
-
-// The array that stores the 128 bits key
-static uint8_t AES128_key[16];
-
-// The Key input to the AES Program
-static const uint8_t *Key;
+// The key schedule used by the functions which do not take a context, set by AES128_init()
+static aes128_ctx_t default_ctx;
 
 #if defined(CBC) && CBC
     // Initial Vector used only for CBC mode
@@ -108,7 +100,7 @@ static const uint8_t *Key;
 // The lookup-tables are marked const so they can be placed in read-only storage instead of RAM
 // The numbers below can be computed dynamically trading ROM for RAM -
 // This can be useful in (embedded) bootloader applications, where ROM is often limited.
-static const uint8_t sbox[256] = {
+const uint8_t aes_sbox[256] = {
     //0     1    2      3     4    5     6     7      8    9     A      B    C     D     E     F
     0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
     0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
@@ -148,216 +140,74 @@ static const uint8_t rsbox[256] = {
 
 // The round constant word array, Rcon[i], contains the values given by
 // x to th e power (i-1) being powers of x (x is denoted as {02}) in the field GF(2^8)
-// Note that i starts at 1, not 0).
-static const uint8_t Rcon[255] = {
-    0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36, 0x6c, 0xd8, 0xab, 0x4d, 0x9a,
-    0x2f, 0x5e, 0xbc, 0x63, 0xc6, 0x97, 0x35, 0x6a, 0xd4, 0xb3, 0x7d, 0xfa, 0xef, 0xc5, 0x91, 0x39,
-    0x72, 0xe4, 0xd3, 0xbd, 0x61, 0xc2, 0x9f, 0x25, 0x4a, 0x94, 0x33, 0x66, 0xcc, 0x83, 0x1d, 0x3a,
-    0x74, 0xe8, 0xcb, 0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36, 0x6c, 0xd8,
-    0xab, 0x4d, 0x9a, 0x2f, 0x5e, 0xbc, 0x63, 0xc6, 0x97, 0x35, 0x6a, 0xd4, 0xb3, 0x7d, 0xfa, 0xef,
-    0xc5, 0x91, 0x39, 0x72, 0xe4, 0xd3, 0xbd, 0x61, 0xc2, 0x9f, 0x25, 0x4a, 0x94, 0x33, 0x66, 0xcc,
-    0x83, 0x1d, 0x3a, 0x74, 0xe8, 0xcb, 0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b,
-    0x36, 0x6c, 0xd8, 0xab, 0x4d, 0x9a, 0x2f, 0x5e, 0xbc, 0x63, 0xc6, 0x97, 0x35, 0x6a, 0xd4, 0xb3,
-    0x7d, 0xfa, 0xef, 0xc5, 0x91, 0x39, 0x72, 0xe4, 0xd3, 0xbd, 0x61, 0xc2, 0x9f, 0x25, 0x4a, 0x94,
-    0x33, 0x66, 0xcc, 0x83, 0x1d, 0x3a, 0x74, 0xe8, 0xcb, 0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20,
-    0x40, 0x80, 0x1b, 0x36, 0x6c, 0xd8, 0xab, 0x4d, 0x9a, 0x2f, 0x5e, 0xbc, 0x63, 0xc6, 0x97, 0x35,
-    0x6a, 0xd4, 0xb3, 0x7d, 0xfa, 0xef, 0xc5, 0x91, 0x39, 0x72, 0xe4, 0xd3, 0xbd, 0x61, 0xc2, 0x9f,
-    0x25, 0x4a, 0x94, 0x33, 0x66, 0xcc, 0x83, 0x1d, 0x3a, 0x74, 0xe8, 0xcb, 0x8d, 0x01, 0x02, 0x04,
-    0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36, 0x6c, 0xd8, 0xab, 0x4d, 0x9a, 0x2f, 0x5e, 0xbc, 0x63,
-    0xc6, 0x97, 0x35, 0x6a, 0xd4, 0xb3, 0x7d, 0xfa, 0xef, 0xc5, 0x91, 0x39, 0x72, 0xe4, 0xd3, 0xbd,
-    0x61, 0xc2, 0x9f, 0x25, 0x4a, 0x94, 0x33, 0x66, 0xcc, 0x83, 0x1d, 0x3a, 0x74, 0xe8, 0xcb };
+// Note that i starts at 1, not 0). Only the first 11 values are needed for a 128 bit key.
+static const uint8_t Rcon[11] = {
+    0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
 
 
 /*****************************************************************************/
 /* Private functions:                                                        */
 /*****************************************************************************/
-static uint8_t getSBoxValue(uint8_t num)
-{
-    return sbox[num];
-}
-
 static uint8_t getSBoxInvert(uint8_t num)
 {
     return rsbox[num];
 }
 
 // This function produces Nb(Nr+1) round keys. The round keys are used in each round to decrypt the states.
-static void KeyExpansion(void)
+// Every round key word holds a column of the state, the first byte in the most significant position.
+static void KeyExpansion(uint32_t *round_key, const uint8_t *key)
 {
-    uint32_t i, j, k;
-    uint8_t tempa[4]; // Used for the column/row operations
+    uint8_t i;
+    uint32_t temp;
 
     // The first round key is the key itself.
     for (i = 0; i < Nk; ++i)
-    {
-        RoundKey[(i * 4) + 0] = Key[(i * 4) + 0];
-        RoundKey[(i * 4) + 1] = Key[(i * 4) + 1];
-        RoundKey[(i * 4) + 2] = Key[(i * 4) + 2];
-        RoundKey[(i * 4) + 3] = Key[(i * 4) + 3];
-    }
+        round_key[i] = aes_load_be32(key + i * 4);
 
     // All other round keys are found from the previous round keys.
-    for (; (i < (Nb * (Nr + 1))); ++i)
+    for (; i < Nb * (Nr + 1); ++i)
     {
-        for (j = 0; j < 4; ++j)
-        {
-            tempa[j] = RoundKey[(i-1) * 4 + j];
-        }
+        temp = round_key[i - 1];
         if (i % Nk == 0)
         {
-            // This function rotates the 4 bytes in a word to the left once.
-            // [a0,a1,a2,a3] becomes [a1,a2,a3,a0]
-
-            // Function RotWord()
-            {
-                k = tempa[0];
-                tempa[0] = tempa[1];
-                tempa[1] = tempa[2];
-                tempa[2] = tempa[3];
-                tempa[3] = k;
-            }
-
-            // SubWord() is a function that takes a four-byte input word and
-            // applies the S-box to each of the four bytes to produce an output word.
-
-            // Function Subword()
-            {
-                tempa[0] = getSBoxValue(tempa[0]);
-                tempa[1] = getSBoxValue(tempa[1]);
-                tempa[2] = getSBoxValue(tempa[2]);
-                tempa[3] = getSBoxValue(tempa[3]);
-            }
-
-            tempa[0] =  tempa[0] ^ Rcon[i/Nk];
-        }
-        else if (Nk > 6 && i % Nk == 4)
-        {
-            // Function Subword()
-            {
-                tempa[0] = getSBoxValue(tempa[0]);
-                tempa[1] = getSBoxValue(tempa[1]);
-                tempa[2] = getSBoxValue(tempa[2]);
-                tempa[3] = getSBoxValue(tempa[3]);
-            }
+            // RotWord(), SubWord() and the round constant
+            temp = ((uint32_t)aes_sbox[(temp >> 16) & 0xFF] << 24) ^
+                   ((uint32_t)aes_sbox[(temp >> 8) & 0xFF] << 16) ^
+                   ((uint32_t)aes_sbox[temp & 0xFF] << 8) ^
+                   ((uint32_t)aes_sbox[temp >> 24]) ^
+                   ((uint32_t)Rcon[i / Nk] << 24);
         }
-        RoundKey[i * 4 + 0] = RoundKey[(i - Nk) * 4 + 0] ^ tempa[0];
-        RoundKey[i * 4 + 1] = RoundKey[(i - Nk) * 4 + 1] ^ tempa[1];
-        RoundKey[i * 4 + 2] = RoundKey[(i - Nk) * 4 + 2] ^ tempa[2];
-        RoundKey[i * 4 + 3] = RoundKey[(i - Nk) * 4 + 3] ^ tempa[3];
-    }
-}
-
-// This function adds the round key to state.
-// The round key is added to the state by an XOR function.
-static void AddRoundKey(uint8_t round)
-{
-    uint8_t i, j;
-
-    for (i = 0; i < 4; ++i)
-    {
-        for (j = 0; j < 4; ++j)
-        {
-            (*state)[i][j] ^= RoundKey[round * Nb * 4 + i * Nb + j];
-        }
-    }
-}
-
-// The SubBytes Function Substitutes the values in the
-// state matrix with values in an S-box.
-static void SubBytes(void)
-{
-    uint8_t i, j;
 
-    for (i = 0; i < 4; ++i)
-    {
-        for (j = 0; j < 4; ++j)
-        {
-            (*state)[j][i] = getSBoxValue((*state)[j][i]);
-        }
+        round_key[i] = round_key[i - Nk] ^ temp;
     }
 }
 
-// The ShiftRows() function shifts the rows in the state to the left.
-// Each row is shifted with different offset.
-// Offset = Row number. So the first row is not shifted.
-static void ShiftRows(void)
-{
-    uint8_t temp;
-
-    // Rotate first row 1 columns to left
-    temp           = (*state)[0][1];
-    (*state)[0][1] = (*state)[1][1];
-    (*state)[1][1] = (*state)[2][1];
-    (*state)[2][1] = (*state)[3][1];
-    (*state)[3][1] = temp;
-
-    // Rotate second row 2 columns to left
-    temp           = (*state)[0][2];
-    (*state)[0][2] = (*state)[2][2];
-    (*state)[2][2] = temp;
-
-    temp       = (*state)[1][2];
-    (*state)[1][2] = (*state)[3][2];
-    (*state)[3][2] = temp;
-
-    // Rotate third row 3 columns to left
-    temp       = (*state)[0][3];
-    (*state)[0][3] = (*state)[3][3];
-    (*state)[3][3] = (*state)[2][3];
-    (*state)[2][3] = (*state)[1][3];
-    (*state)[1][3] = temp;
-}
-
-static uint8_t xtime(uint8_t x)
-{
-    return ((x<<1) ^ (((x>>7) & 1) * 0x1b));
-}
-
-// MixColumns function mixes the columns of the state matrix
-static void MixColumns(void)
-{
-    uint8_t i;
-    uint8_t Tmp, Tm, t;
-
-    for (i = 0; i < 4; ++i)
-    {
-        t   = (*state)[i][0];
-        Tmp = (*state)[i][0] ^ (*state)[i][1] ^ (*state)[i][2] ^ (*state)[i][3] ;
-        Tm  = (*state)[i][0] ^ (*state)[i][1] ; Tm = xtime(Tm);  (*state)[i][0] ^= Tm ^ Tmp ;
-        Tm  = (*state)[i][1] ^ (*state)[i][2] ; Tm = xtime(Tm);  (*state)[i][1] ^= Tm ^ Tmp ;
-        Tm  = (*state)[i][2] ^ (*state)[i][3] ; Tm = xtime(Tm);  (*state)[i][2] ^= Tm ^ Tmp ;
-        Tm  = (*state)[i][3] ^ t ;        Tm = xtime(Tm);  (*state)[i][3] ^= Tm ^ Tmp ;
-    }
-}
-
-// Multiply is used to multiply numbers in the field GF(2^8)
 #if MULTIPLY_AS_A_FUNCTION
 static uint8_t Multiply(uint8_t x, uint8_t y)
 {
     return (((y & 1) * x) ^
-         ((y>>1 & 1) * xtime(x)) ^
-         ((y>>2 & 1) * xtime(xtime(x))) ^
-         ((y>>3 & 1) * xtime(xtime(xtime(x)))) ^
-         ((y>>4 & 1) * xtime(xtime(xtime(xtime(x))))));
+         ((y>>1 & 1) * aes_xtime(x)) ^
+         ((y>>2 & 1) * aes_xtime(aes_xtime(x))) ^
+         ((y>>3 & 1) * aes_xtime(aes_xtime(aes_xtime(x)))) ^
+         ((y>>4 & 1) * aes_xtime(aes_xtime(aes_xtime(aes_xtime(x))))));
   }
 #else
 #define Multiply(x, y)                                \
       (  ((y & 1) * x) ^                              \
-      ((y>>1 & 1) * xtime(x)) ^                       \
-      ((y>>2 & 1) * xtime(xtime(x))) ^                \
-      ((y>>3 & 1) * xtime(xtime(xtime(x)))) ^         \
-      ((y>>4 & 1) * xtime(xtime(xtime(xtime(x))))))   \
+      ((y>>1 & 1) * aes_xtime(x)) ^                       \
+      ((y>>2 & 1) * aes_xtime(aes_xtime(x))) ^                \
+      ((y>>3 & 1) * aes_xtime(aes_xtime(aes_xtime(x)))) ^         \
+      ((y>>4 & 1) * aes_xtime(aes_xtime(aes_xtime(aes_xtime(x))))))   \
 
 #endif
 
 // MixColumns function mixes the columns of the state matrix.
 // The method used to multiply may be difficult to understand for the inexperienced.
 // Please use the references to gain more information.
-static void InvMixColumns(void)
+static void InvMixColumns(aes_state_t *state)
 {
     int i;
     uint8_t a, b, c, d;
-
     for (i = 0; i < 4; ++i)
     {
         a = (*state)[i][0];
@@ -372,10 +222,9 @@ static void InvMixColumns(void)
     }
 }
 
-
 // The SubBytes Function Substitutes the values in the
 // state matrix with values in an S-box.
-static void InvSubBytes(void)
+static void InvSubBytes(aes_state_t *state)
 {
     uint8_t i, j;
 
@@ -388,7 +237,7 @@ static void InvSubBytes(void)
     }
 }
 
-static void InvShiftRows(void)
+static void InvShiftRows(aes_state_t *state)
 {
     uint8_t temp;
 
@@ -416,119 +265,94 @@ static void InvShiftRows(void)
     (*state)[3][3] = temp;
 }
 
-
-// Cipher is the main function that encrypts the PlainText.
-static void Cipher(void)
+static void InvCipher(aes_state_t *state, const uint32_t *round_key)
 {
     uint8_t round = 0;
 
     // Add the First round key to the state before starting the rounds.
-    AddRoundKey(0);
+    aes_add_round_key(state, round_key + Nr * Nb);
 
     // There will be Nr rounds.
     // The first Nr-1 rounds are identical.
     // These Nr-1 rounds are executed in the loop below.
-    for (round = 1; round < Nr; ++round)
+    for (round = Nr-1; round > 0; round--)
     {
-      SubBytes();
-      ShiftRows();
-      MixColumns();
-      AddRoundKey(round);
+      InvShiftRows(state);
+      InvSubBytes(state);
+      aes_add_round_key(state, round_key + round * Nb);
+      InvMixColumns(state);
     }
 
     // The last round is given below.
     // The MixColumns function is not here in the last round.
-    SubBytes();
-    ShiftRows();
-    AddRoundKey(Nr);
+    InvShiftRows(state);
+    InvSubBytes(state);
+    aes_add_round_key(state, round_key);
 }
 
-static void InvCipher(void)
-{
-    uint8_t round = 0;
 
-    // Add the First round key to the state before starting the rounds.
-    AddRoundKey(Nr);
-
-    // There will be Nr rounds.
-    // The first Nr-1 rounds are identical.
-    // These Nr-1 rounds are executed in the loop below.
-    for (round = Nr-1; round > 0; round--)
-    {
-      InvShiftRows();
-      InvSubBytes();
-      AddRoundKey(round);
-      InvMixColumns();
-    }
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
 
-    // The last round is given below.
-    // The MixColumns function is not here in the last round.
-    InvShiftRows();
-    InvSubBytes();
-    AddRoundKey(0);
+const aes128_ctx_t *aes128_default_ctx(void)
+{
+    return &default_ctx;
 }
 
-static void BlockCopy(uint8_t *output, uint8_t *input)
+void AES128_init_ctx(aes128_ctx_t *ctx, const uint8_t *key)
 {
-    uint8_t i;
-
-    for (i = 0; i < KEYLEN; ++i)
-    {
-      output[i] = input[i];
-    }
+#ifdef HAL_SUPPORT_HW_AES
+    memcpy(ctx->key, key, KEYLEN);
+#endif
+    KeyExpansion(ctx->round_key, key);
 }
 
-
-
-/*****************************************************************************/
-/* Public functions:                                                         */
-/*****************************************************************************/
-
 void AES128_init(const uint8_t *key)
 {
-    memcpy(AES128_key, key, KEYLEN);
-    Key = AES128_key;
-    KeyExpansion();
+    AES128_init_ctx(&default_ctx, key);
 }
 
 #if defined(ECB) && ECB
 
 
-void AES128_ECB_encrypt(uint8_t *input, uint8_t *output)
+void AES128_ECB_encrypt_ctx(const aes128_ctx_t *ctx, const uint8_t *input, uint8_t *output)
 {
 #ifdef HAL_SUPPORT_HW_AES
     /*
      * Hardware AES support for ECB through the low level peripheral library EMLIB
      * The functions AES128_ECB_encrypt() expects inputs of 128 bit length = 16 bytes.
      */
-    hw_aes_ecb128(output, input, 16, Key, true);
+    hw_aes_ecb128(output, input, 16, ctx->key, true);
 #else
-    // Copy input to output, and work in-memory on output
-    BlockCopy(output, input);
-    state = (state_t *)output;
-
-    // The next function call encrypts the PlainText with the Key using AES algorithm.
-    Cipher();
+    aes128_cipher(ctx->round_key, input, output);
 #endif // HAL_SUPPORT_HW_AES
 }
 
-void AES128_ECB_decrypt(uint8_t *input, uint8_t *output)
+void AES128_ECB_decrypt_ctx(const aes128_ctx_t *ctx, const uint8_t *input, uint8_t *output)
 {
 #ifdef HAL_SUPPORT_HW_AES
     /*
      * Hardware AES support for ECB through the low level peripheral library EMLIB
      * The functions AES128_ECB_decrypt() expects inputs of 128 bit length = 16 bytes.
      */
-    hw_aes_ecb128(output, input, 16, Key, false);
+    hw_aes_ecb128(output, input, 16, ctx->key, false);
 #else
     // Copy input to output, and work in-memory on output
-    BlockCopy(output, input);
-    state = (state_t *)output;
-
-    InvCipher();
+    memmove(output, input, KEYLEN);
+    InvCipher((aes_state_t *)output, ctx->round_key);
 #endif // HAL_SUPPORT_HW_AES
 }
 
+void AES128_ECB_encrypt(uint8_t *input, uint8_t *output)
+{
+    AES128_ECB_encrypt_ctx(&default_ctx, input, output);
+}
+
+void AES128_ECB_decrypt(uint8_t *input, uint8_t *output)
+{
+    AES128_ECB_decrypt_ctx(&default_ctx, input, output);
+}
 
 #endif // #if defined(ECB) && ECB
 
@@ -550,7 +374,7 @@ void AES128_CBC_encrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 {
 #ifdef HAL_SUPPORT_HW_AES
     // Hardware AES support for CBC through the low level peripheral library EMLIB
-    hw_aes_cbc128(output, input, length, Key, iv, true);
+    hw_aes_cbc128(output, input, length, default_ctx.key, iv, true);
 #else
     uintptr_t i;
     uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
@@ -562,10 +386,9 @@ void AES128_CBC_encrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 
     for(i = KEYLEN; i <= length; i += KEYLEN)
     {
-        BlockCopy(output, input);
+        memmove(output, input, KEYLEN);
         XorWithIv(output);
-        state = (state_t *)output;
-        Cipher();
+        aes128_cipher(default_ctx.round_key, output, output);
         Iv = output;
         input += KEYLEN;
         output += KEYLEN;
@@ -573,11 +396,10 @@ void AES128_CBC_encrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 
     if (remainders)
     {
-        BlockCopy(output, input);
+        memmove(output, input, remainders);
         memset(output + remainders, 0, KEYLEN - remainders); /* add 0-padding */
         XorWithIv(output);
-        state = (state_t *)output;
-        Cipher();
+        aes128_cipher(default_ctx.round_key, output, output);
     }
 #endif // HAL_SUPPORT_HW_AES
 }
@@ -586,7 +408,7 @@ void AES128_CBC_decrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 {
 #ifdef HAL_SUPPORT_HW_AES
     // Hardware AES support for CBC through the low level peripheral library EMLIB
-    hw_aes_cbc128(output, input, length, Key, iv, false);
+    hw_aes_cbc128(output, input, length, default_ctx.key, iv, false);
 #else
     uintptr_t i;
 
@@ -598,9 +420,8 @@ void AES128_CBC_decrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 
     for(i = KEYLEN; i <= length; i += KEYLEN)
     {
-        BlockCopy(output, input);
-        state = (state_t *)output;
-        InvCipher();
+        memmove(output, input, KEYLEN);
+        InvCipher((aes_state_t *)output, default_ctx.round_key);
         XorWithIv(output);
         Iv = input;
         input += KEYLEN;
@@ -631,25 +452,21 @@ void AES128_CBC_decrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
  * the most significant bits.
  */
 
-void AES128_CTR_encrypt(uint8_t *output, uint8_t *input, uint32_t length, uint8_t *ctr_blk)
+void AES128_CTR_encrypt_ctx(const aes128_ctx_t *ctx, uint8_t *output, const uint8_t *input, uint32_t length, uint8_t *ctr_blk)
 {
 #ifdef HAL_SUPPORT_HW_AES
     // Hardware AES support for CTR through the low level peripheral library EMLIB
-    hw_aes_ctr128(output, input, length, Key, ctr_blk);
+    hw_aes_ctr128(output, input, length, ctx->key, ctr_blk);
 #else
     uintptr_t i, j;
     uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
-    uint8_t ctr[KEYLEN];
-
-    BlockCopy(ctr, ctr_blk);
-    state = (state_t *)ctr;
+    uint8_t keystream[KEYLEN];
 
     for(i = KEYLEN; i <= length; i += KEYLEN)
     {
-        Cipher();
-        BlockCopy(output, input);
+        aes128_cipher(ctx->round_key, ctr_blk, keystream);
         for (j = 0; j < KEYLEN; j++)
-            output[j] ^= ctr[j];
+            output[j] = input[j] ^ keystream[j];
 
         /* Increment block counter */
         for (j = 0; j < KEYLEN; j++)
@@ -661,16 +478,20 @@ void AES128_CTR_encrypt(uint8_t *output, uint8_t *input, uint32_t length, uint8_
 
         input += KEYLEN;
         output += KEYLEN;
-        BlockCopy(ctr, ctr_blk);
     }
 
     if(remainders)
     {
-        Cipher();
+        aes128_cipher(ctx->round_key, ctr_blk, keystream);
         for (i=0; i < remainders; ++i)
-            output[i] = input[i] ^ ctr[i];
+            output[i] = input[i] ^ keystream[i];
     }
 #endif
 }
 
+void AES128_CTR_encrypt(uint8_t *output, uint8_t *input, uint32_t length, uint8_t *ctr_blk)
+{
+    AES128_CTR_encrypt_ctx(&default_ctx, output, input, length, ctr_blk);
+}
+
 #endif // #if defined(CTR) && CTR
@@ -0,0 +1,75 @@
+/*! \file aes_cipher.h
+ *
+ *  \copyright (C) Copyright 2016 University of Antwerp and others (http://oss-7.cosys.be)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal interface between the AES modes of operation and the block cipher implementation,
+ * which is selected with FRAMEWORK_AES_IMPLEMENTATION.
+ */
+
+#ifndef _AES_CIPHER_H_
+#define _AES_CIPHER_H_
+
+#include <stdint.h>
+#include "aes.h"
+
+#define AES128_ROUNDS 10
+
+// state - array holding the intermediate results, indexed by [column][row]
+typedef uint8_t aes_state_t[4][4];
+
+extern const uint8_t aes_sbox[256];
+
+/*! \brief Encrypt a single block, input and output may point to the same buffer */
+void aes128_cipher(const uint32_t *round_key, const uint8_t *input, uint8_t *output);
+
+/*! \brief The key schedule set by AES128_init(), used by the functions which do not take a context */
+const aes128_ctx_t *aes128_default_ctx(void);
+
+static inline uint32_t aes_load_be32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static inline void aes_store_be32(uint8_t *data, uint32_t value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+static inline uint8_t aes_xtime(uint8_t x)
+{
+    return ((x<<1) ^ (((x>>7) & 1) * 0x1b));
+}
+
+// This function adds the round key to state.
+// The round key is added to the state by an XOR function.
+static inline void aes_add_round_key(aes_state_t *state, const uint32_t *round_key)
+{
+    uint8_t i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        (*state)[i][0] ^= round_key[i] >> 24;
+        (*state)[i][1] ^= round_key[i] >> 16;
+        (*state)[i][2] ^= round_key[i] >> 8;
+        (*state)[i][3] ^= round_key[i];
+    }
+}
+
+#endif //_AES_CIPHER_H_
@@ -0,0 +1,117 @@
+/*! \file aes_cipher_byte.c
+ *
+ *  \copyright (C) Copyright 2016 University of Antwerp and others (http://oss-7.cosys.be)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Byte oriented AES-128 block cipher, from the tiny-AES128-C implementation (see aes.c).
+ * This needs no other tables than the S-box, at the cost of speed.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aes_cipher.h"
+
+// The SubBytes Function Substitutes the values in the
+// state matrix with values in an S-box.
+static void SubBytes(aes_state_t *state)
+{
+    uint8_t i, j;
+
+    for (i = 0; i < 4; ++i)
+    {
+        for (j = 0; j < 4; ++j)
+        {
+            (*state)[j][i] = aes_sbox[(*state)[j][i]];
+        }
+    }
+}
+
+// The ShiftRows() function shifts the rows in the state to the left.
+// Each row is shifted with different offset.
+// Offset = Row number. So the first row is not shifted.
+static void ShiftRows(aes_state_t *state)
+{
+    uint8_t temp;
+
+    // Rotate first row 1 columns to left
+    temp           = (*state)[0][1];
+    (*state)[0][1] = (*state)[1][1];
+    (*state)[1][1] = (*state)[2][1];
+    (*state)[2][1] = (*state)[3][1];
+    (*state)[3][1] = temp;
+
+    // Rotate second row 2 columns to left
+    temp           = (*state)[0][2];
+    (*state)[0][2] = (*state)[2][2];
+    (*state)[2][2] = temp;
+
+    temp       = (*state)[1][2];
+    (*state)[1][2] = (*state)[3][2];
+    (*state)[3][2] = temp;
+
+    // Rotate third row 3 columns to left
+    temp       = (*state)[0][3];
+    (*state)[0][3] = (*state)[3][3];
+    (*state)[3][3] = (*state)[2][3];
+    (*state)[2][3] = (*state)[1][3];
+    (*state)[1][3] = temp;
+}
+
+// MixColumns function mixes the columns of the state matrix
+static void MixColumns(aes_state_t *state)
+{
+    uint8_t i;
+    uint8_t Tmp, Tm, t;
+
+    for (i = 0; i < 4; ++i)
+    {
+        t   = (*state)[i][0];
+        Tmp = (*state)[i][0] ^ (*state)[i][1] ^ (*state)[i][2] ^ (*state)[i][3] ;
+        Tm  = (*state)[i][0] ^ (*state)[i][1] ; Tm = aes_xtime(Tm);  (*state)[i][0] ^= Tm ^ Tmp ;
+        Tm  = (*state)[i][1] ^ (*state)[i][2] ; Tm = aes_xtime(Tm);  (*state)[i][1] ^= Tm ^ Tmp ;
+        Tm  = (*state)[i][2] ^ (*state)[i][3] ; Tm = aes_xtime(Tm);  (*state)[i][2] ^= Tm ^ Tmp ;
+        Tm  = (*state)[i][3] ^ t ;        Tm = aes_xtime(Tm);  (*state)[i][3] ^= Tm ^ Tmp ;
+    }
+}
+
+// Cipher is the main function that encrypts the PlainText.
+void aes128_cipher(const uint32_t *round_key, const uint8_t *input, uint8_t *output)
+{
+    uint8_t round = 0;
+    aes_state_t *state = (aes_state_t *)output;
+
+    memmove(output, input, AES_BLOCK_SIZE);
+
+    // Add the First round key to the state before starting the rounds.
+    aes_add_round_key(state, round_key);
+
+    // There will be Nr rounds.
+    // The first Nr-1 rounds are identical.
+    // These Nr-1 rounds are executed in the loop below.
+    for (round = 1; round < AES128_ROUNDS; ++round)
+    {
+      SubBytes(state);
+      ShiftRows(state);
+      MixColumns(state);
+      aes_add_round_key(state, round_key + round * 4);
+    }
+
+    // The last round is given below.
+    // The MixColumns function is not here in the last round.
+    SubBytes(state);
+    ShiftRows(state);
+    aes_add_round_key(state, round_key + AES128_ROUNDS * 4);
+}
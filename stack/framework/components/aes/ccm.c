@@ -29,10 +29,12 @@
 #include <string.h> // CBC mode, for memset
 #include "stdbool.h"
 #include "aes.h"
+#include "aes_cipher.h"
 #include "types.h"
 #include "errors.h"
 #include "log.h"
 #include "framework_defs.h"
+#include "debug.h"
 
 
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_AES_LOG_ENABLED)
@@ -48,32 +50,78 @@
  * block cipher mode
  */
 
-static void xor_aes_block(uint8_t *dst, const uint8_t *src)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * The MAC and the keystream are both computed per block, so the payload is authenticated and
+ * encrypted (or decrypted) in place in a single pass, in segments of any size. The D7A variant
+ * encodes the length of the additional authentication data in a single byte, prepended to it.
+ */
+
+static void mac_absorb(aes128_ccm_ctx_t *ccm, const uint8_t *data, uint16_t length)
 {
-    uint8_t i;
+    while (length > 0)
+    {
+        uint8_t n = MIN(length, AES_BLOCK_SIZE - ccm->mac_fill);
+        for (uint8_t i = 0; i < n; i++)
+            ccm->mac[ccm->mac_fill + i] ^= data[i];
+
+        ccm->mac_fill += n;
+        data += n;
+        length -= n;
+
+        /* X_i+1 = E(K, X_i XOR B_i) */
+        if (ccm->mac_fill == AES_BLOCK_SIZE)
+        {
+            AES128_ECB_encrypt_ctx(ccm->key, ccm->mac, ccm->mac);
+            ccm->mac_fill = 0;
+        }
+    }
+}
 
-    for (i = 0; i < AES_BLOCK_SIZE; ++i)
+// the last block of the additional data and of the payload is zero padded
+static void mac_pad(aes128_ccm_ctx_t *ccm)
+{
+    if (ccm->mac_fill > 0)
     {
-        dst[i] ^= src[i];
+        AES128_ECB_encrypt_ctx(ccm->key, ccm->mac, ccm->mac);
+        ccm->mac_fill = 0;
     }
 }
 
-/*
- * Authentication
- *
- * To secure CBC-MAC for variable length messages, the first block (B_0)
- * contains the length of the message. 
- * 
- */
+static void start_payload(aes128_ccm_ctx_t *ccm)
+{
+    if (ccm->add_remaining != AES128_CCM_PAYLOAD)
+    {
+        mac_pad(ccm);
+        ccm->add_remaining = AES128_CCM_PAYLOAD;
+    }
+}
 
-error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const uint8_t *iv,
-                        const uint8_t *add, uint8_t add_len, uint8_t auth_len )
+// XOR n bytes with the keystream, n does not cross a block boundary of the payload
+static void ctr_crypt(aes128_ccm_ctx_t *ccm, uint8_t *data, uint8_t n)
 {
-    uint8_t blk[AES_BLOCK_SIZE];
-    uint8_t i;
-    uint8_t remainders;
-    uint8_t tag[AES_BLOCK_SIZE];
+    if (ccm->keystream_used == AES_BLOCK_SIZE)
+    {
+        AES128_ECB_encrypt_ctx(ccm->key, ccm->ctr, ccm->keystream);
+        ccm->keystream_used = 0;
+
+        /* Increment block counter */
+        for (uint8_t j = 0; j < AES_BLOCK_SIZE; j++)
+        {
+            ccm->ctr[j]++;
+            if (ccm->ctr[j])
+                break;
+        }
+    }
+
+    for (uint8_t i = 0; i < n; i++)
+        data[i] ^= ccm->keystream[ccm->keystream_used++];
+}
 
+error_t AES128_CCM_init( aes128_ccm_ctx_t *ccm, const aes128_ctx_t *key, const uint8_t *iv,
+                         uint8_t add_len, const uint8_t *ctr_blk, uint8_t auth_len )
+{
     /* sanity checks */
     if (auth_len != 4 && auth_len != 8 && auth_len != 16)
         return EINVAL;
@@ -81,108 +129,138 @@ error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const u
     if (add_len > (2 * AES_BLOCK_SIZE - 1))
         return EINVAL;
 
-    /* For DASH7, the payload length shall be less than 250 - authentication tag len */
-    if (length > (250 - auth_len))
-        return EINVAL;
-
-    /* The CBC-MAC is computed by:
-     *
-     * X_1 := E( K, B_0 )
-     * X_i+1 := E( K, X_i XOR B_i )  for i=1, ..., n
-     * T := first-M-bytes( X_n+1 )
-     */
+    ccm->key = key;
+    ccm->auth_len = auth_len;
+    ccm->encrypt = (ctr_blk != NULL);
+    ccm->add_remaining = add_len;
+    ccm->mac_fill = 0;
+    ccm->keystream_used = AES_BLOCK_SIZE;
 
     /* X_1 = E(K, B_0) */
     DPRINT("Blk0");
     DPRINT_DATA((uint8_t *)iv, AES_BLOCK_SIZE);
-    AES128_ECB_encrypt((uint8_t *)iv, tag);
-    DPRINT("X_1 = AES(B_0)");
-    DPRINT_DATA(tag, AES_BLOCK_SIZE);
+    AES128_ECB_encrypt_ctx(key, iv, ccm->mac);
 
-    // if add_len > 0, add more blocks of authentication data
-    if (add_len > 0)
+    if (ccm->encrypt)
     {
-        uint8_t use_len = add_len < AES_BLOCK_SIZE - 1 ? add_len : AES_BLOCK_SIZE - 1;
-        remainders = add_len - use_len;
+        /* The authentication tag is encrypted with counter 0, the payload starts at counter 1 */
+        memcpy(ccm->ctr, ctr_blk, AES_BLOCK_SIZE);
+        ccm->ctr[0] &= 0xF0;
+        AES128_ECB_encrypt_ctx(key, ccm->ctr, ccm->tag_mask);
+        ccm->ctr[0] += 1;
+    }
+    else
+        memset(ccm->tag_mask, 0, AES_BLOCK_SIZE);
 
-        memset(blk, 0, AES_BLOCK_SIZE);
-        // For DASH7, the additional data length shall be encoded in a field of 1 octet.
-        blk[0] = add_len;
+    // For DASH7, the additional data length shall be encoded in a field of 1 octet.
+    if (add_len > 0)
+        mac_absorb(ccm, &add_len, 1);
 
-        memcpy( blk + 1, add, use_len );
+    return SUCCESS;
+}
 
-        DPRINT("Blk1");
-        DPRINT_DATA(blk, AES_BLOCK_SIZE);
+void AES128_CCM_update_aad( aes128_ccm_ctx_t *ccm, const uint8_t *add, uint8_t add_len )
+{
+    assert(ccm->add_remaining != AES128_CCM_PAYLOAD && add_len <= ccm->add_remaining);
+    mac_absorb(ccm, add, add_len);
+    ccm->add_remaining -= add_len;
+}
 
-        xor_aes_block(blk, tag);
-        DPRINT("X_1 XOR B_1");
-        DPRINT_DATA(blk, AES_BLOCK_SIZE);
-        /* X_2 = E(K, X_1 XOR B_1) */
-        AES128_ECB_encrypt(blk, tag);
-        DPRINT("X_2 = AES(X_1 XOR B_1)");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
+void AES128_CCM_authenticate( aes128_ccm_ctx_t *ccm, const uint8_t *payload, uint16_t length )
+{
+    start_payload(ccm);
+    mac_absorb(ccm, payload, length);
+}
 
-        if (remainders)
-        {
-            memset(blk, 0, AES_BLOCK_SIZE);
-            memcpy(blk, add + use_len, remainders);
-
-            DPRINT("blk2");
-            DPRINT_DATA(blk, AES_BLOCK_SIZE);
-
-            DPRINT("X_2 XOR B_2");
-            xor_aes_block(blk, tag);
-             /* X_3 = E(K, X_2 XOR B_2) */
-            AES128_ECB_encrypt(blk, tag);
-            DPRINT("X_3 = AES(X_1 XOR B_1)");
-            DPRINT_DATA(tag, AES_BLOCK_SIZE);
-        }
+void AES128_CCM_encrypt_update( aes128_ccm_ctx_t *ccm, uint8_t *payload, uint16_t length )
+{
+    assert(ccm->encrypt);
+    start_payload(ccm);
+
+    while (length > 0)
+    {
+        // the MAC and the keystream advance in lock step over the payload blocks
+        uint8_t n = MIN(length, AES_BLOCK_SIZE - ccm->mac_fill);
+        mac_absorb(ccm, payload, n);
+        ctr_crypt(ccm, payload, n);
+        payload += n;
+        length -= n;
     }
+}
 
-    remainders = length % AES_BLOCK_SIZE; /* Remaining bytes in the last non-full block */
-    DPRINT("Remainders %d length %d", remainders, length);
+void AES128_CCM_decrypt_update( aes128_ccm_ctx_t *ccm, uint8_t *payload, uint16_t length )
+{
+    assert(ccm->encrypt);
+    start_payload(ccm);
 
-    for (i = 0; i < length / AES_BLOCK_SIZE; i++)
+    while (length > 0)
     {
-        DPRINT("Xi");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
+        uint8_t n = MIN(length, AES_BLOCK_SIZE - ccm->mac_fill);
+        ctr_crypt(ccm, payload, n);
+        mac_absorb(ccm, payload, n);
+        payload += n;
+        length -= n;
+    }
+}
 
-        DPRINT("B_i");
-        DPRINT_DATA(payload, AES_BLOCK_SIZE);
+void AES128_CCM_finish( aes128_ccm_ctx_t *ccm, uint8_t *auth )
+{
+    assert(ccm->add_remaining == 0 || ccm->add_remaining == AES128_CCM_PAYLOAD);
+    start_payload(ccm);
+    mac_pad(ccm);
 
-        /* X_i+1 = E(K, X_i XOR B_i) */
-        xor_aes_block(tag, payload);
-        DPRINT("X_i XOR B_i");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
+    /* T := first-M-bytes( X_n+1 ), encrypted with counter 0 in case of CCM */
+    for (uint8_t i = 0; i < ccm->auth_len; i++)
+        auth[i] = ccm->mac[i] ^ ccm->tag_mask[i];
 
-        payload += AES_BLOCK_SIZE;
+    DPRINT("Authentication tag:");
+    DPRINT_DATA(auth, ccm->auth_len);
+}
 
-        AES128_ECB_encrypt(tag, tag);
-        DPRINT("X_i+1 = E(K, X_i XOR B_i)");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
-    }
+error_t AES128_CCM_verify( aes128_ccm_ctx_t *ccm, const uint8_t *auth )
+{
+    uint8_t computed[AES_BLOCK_SIZE];
+    uint8_t diff = 0;
 
-    if (remainders)
+    AES128_CCM_finish(ccm, computed);
+
+    // compare all bytes, so the time taken does not reveal the position of a mismatch
+    for (uint8_t i = 0; i < ccm->auth_len; i++)
+        diff |= computed[i] ^ auth[i];
+
+    if (diff != 0)
     {
-        /* XOR zero-padded last block */
-        DPRINT("Xi");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
+        DPRINT("CCM: Auth mismatch");
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
 
-        DPRINT("B_i");
-        DPRINT_DATA(payload, AES_BLOCK_SIZE);
+/*
+ * Authentication
+ *
+ * To secure CBC-MAC for variable length messages, the first block (B_0)
+ * contains the length of the message.
+ *
+ */
 
-        for (i = 0; i < remainders; i++)
-            tag[i] ^= *payload++;
-        DPRINT("X_i XOR B_i");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
+error_t AES128_CBC_MAC_ctx( const aes128_ctx_t *ctx, uint8_t *auth, const uint8_t *payload, uint8_t length,
+                            const uint8_t *iv, const uint8_t *add, uint8_t add_len, uint8_t auth_len )
+{
+    aes128_ccm_ctx_t ccm;
 
-        AES128_ECB_encrypt(tag, tag);
-        DPRINT("X_i+1 = E(K, X_i XOR B_i)");
-        DPRINT_DATA(tag, AES_BLOCK_SIZE);
-    }
+    /* For DASH7, the payload length shall be less than 250 - authentication tag len */
+    if (length > (250 - auth_len))
+        return EINVAL;
 
-    memcpy(auth, tag, auth_len);
+    error_t ret = AES128_CCM_init(&ccm, ctx, iv, add_len, NULL, auth_len);
+    if (ret != SUCCESS)
+        return ret;
 
+    AES128_CCM_update_aad(&ccm, add, add_len);
+    AES128_CCM_authenticate(&ccm, payload, length);
+    AES128_CCM_finish(&ccm, auth);
     return SUCCESS;
 }
 
@@ -192,96 +270,65 @@ error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const u
  * Ensure that the output is sized to contain the encrypted message payload
  * + the encrypted authentication Tag.
  */
-error_t AES128_CCM_encrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
-                            const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
-                            uint8_t auth_len )
+error_t AES128_CCM_encrypt_ctx( const aes128_ctx_t *ctx, uint8_t *payload, uint8_t length, const uint8_t *iv,
+                                const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                                uint8_t auth_len )
 {
-    uint8_t auth[AES_BLOCK_SIZE];
-    uint8_t auth_crypted[AES_BLOCK_SIZE];
-    error_t ret;
-
-    /* sanity checks */
-    if (auth_len != 4 && auth_len != 8 && auth_len != 16)
-        return EINVAL;
+    aes128_ccm_ctx_t ccm;
 
      /* For DASH7, the payload length shall be less than 250 - Security header len - authentication tag len */
     if (length > (250 - 5 - auth_len))
         return EINVAL;
 
-    if (add_len > (2 * AES_BLOCK_SIZE - 1))
-        return EINVAL;
-
-    /* Authentication */
-    ret = AES128_CBC_MAC(auth, payload, length, iv, add, add_len, auth_len);
+    error_t ret = AES128_CCM_init(&ccm, ctx, iv, add_len, ctr_blk, auth_len);
     if (ret != SUCCESS)
         return ret;
 
-    DPRINT("Authentication tag:");
-    DPRINT_DATA(auth, auth_len);
-
-    /* Encryption with Counter (CTR) mode*/
-
-    /* Encryption of the message payload, counter set to 1 */
-    ctr_blk[0] = (ctr_blk[0] & 0xF0) + 1;
-    DPRINT("ctr0");
-    DPRINT_DATA(ctr_blk, AES_BLOCK_SIZE);
-
-    AES128_CTR_encrypt(payload, payload, length, ctr_blk);
-    DPRINT("CTR output:");
-    DPRINT_DATA(payload, length);
-
-    /* Encryption of the authentication tag , reset counter to 0*/
-    ctr_blk[0] = (ctr_blk[0] & 0xF0);
-    AES128_CTR_encrypt(auth_crypted, auth, auth_len, ctr_blk);
-    DPRINT("Encrypted authentication tag:");
-    DPRINT_DATA(auth_crypted, auth_len);
+    AES128_CCM_update_aad(&ccm, add, add_len);
+    AES128_CCM_encrypt_update(&ccm, payload, length);
     // the 4, 8 or 16 MSB of the MAC are then appended to the payload
-    memcpy(payload + length, auth_crypted, auth_len);
-
+    AES128_CCM_finish(&ccm, payload + length);
     return SUCCESS;
 }
 
 /*
  * Authenticated decryption
  */
-error_t AES128_CCM_decrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
-                            const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
-                            const uint8_t *auth, uint8_t auth_len )
+error_t AES128_CCM_decrypt_ctx( const aes128_ctx_t *ctx, uint8_t *payload, uint8_t length, const uint8_t *iv,
+                                const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                                const uint8_t *auth, uint8_t auth_len )
 {
-    uint8_t T[AES_BLOCK_SIZE];
-    uint8_t auth_decrypted[AES_BLOCK_SIZE];
-
-    /* sanity checks */
-    if (auth_len != 4 && auth_len != 8 && auth_len != 16)
-        return EINVAL;
+    aes128_ccm_ctx_t ccm;
 
     /* For DASH7, the payload length shall be less than 250 - Security header len - authentication tag len */
     if (length > (250 - 5 - auth_len))
         return EINVAL;
 
-    if (add_len > (2 * AES_BLOCK_SIZE - 1))
-        return EINVAL;
-
-    /* Decryption of the encrypted authentication Tag */
-    ctr_blk[0] = (ctr_blk[0] & 0xF0);
-    AES128_CTR_encrypt(auth_decrypted, (uint8_t *)auth, auth_len, ctr_blk);
-    DPRINT("Decrypted authentication tag:");
-    DPRINT_DATA(auth_decrypted, auth_len);
+    error_t ret = AES128_CCM_init(&ccm, ctx, iv, add_len, ctr_blk, auth_len);
+    if (ret != SUCCESS)
+        return ret;
 
-    /* Decryption of the message payload, counter set to 1 */
-    ctr_blk[0] = (ctr_blk[0] & 0xF0) + 1;
-    AES128_CTR_encrypt(payload, payload, length, ctr_blk);
+    AES128_CCM_update_aad(&ccm, add, add_len);
+    AES128_CCM_decrypt_update(&ccm, payload, length);
+    return AES128_CCM_verify(&ccm, auth);
+}
 
-    /* Recompute the CBC-MAC and check the authentication Tag */
-    AES128_CBC_MAC(T, payload, length, iv, add, add_len, auth_len);
-    DPRINT("Computed authentication tag:");
-    DPRINT_DATA(T, auth_len);
+error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const uint8_t *iv,
+                        const uint8_t *add, uint8_t add_len, uint8_t auth_len )
+{
+    return AES128_CBC_MAC_ctx(aes128_default_ctx(), auth, payload, length, iv, add, add_len, auth_len);
+}
 
-    if (memcmp(T, auth_decrypted, auth_len) != 0)
-    {
-        DPRINT("CCM: Auth mismatch");
-        return -1;
-    }
+error_t AES128_CCM_encrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
+                            const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                            uint8_t auth_len )
+{
+    return AES128_CCM_encrypt_ctx(aes128_default_ctx(), payload, length, iv, add, add_len, ctr_blk, auth_len);
+}
 
-    return SUCCESS;
+error_t AES128_CCM_decrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
+                            const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                            const uint8_t *auth, uint8_t auth_len )
+{
+    return AES128_CCM_decrypt_ctx(aes128_default_ctx(), payload, length, iv, add, add_len, ctr_blk, auth, auth_len);
 }
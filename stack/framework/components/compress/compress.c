@@ -25,20 +25,22 @@
 
 uint8_t compress_data(uint16_t value, bool ceil)
 {
-    uint8_t mantissa;
-    uint16_t remainder;
-
-    for ( int i = 0; i < 8; i++)
+    // the smallest exponent for which the mantissa fits, after rounding. Exponent 6 is enough for a 16 bit value.
+    uint8_t exp = 0;
+    if (ceil)
+    {
+        while (value > ((uint32_t)CT_MANTISSA_MAX << (2 * exp)))
+            exp++;
+    }
+    else
     {
-        if (value <= (pow(4, i) * 31))
-        {
-            mantissa = value / pow(4, i);
-            remainder = value % (uint16_t)(pow(4, i));
+        while ((value >> (2 * exp)) > CT_MANTISSA_MAX)
+            exp++;
+    }
 
-            if (ceil && remainder)
-                mantissa++;
+    uint8_t mantissa = value >> (2 * exp);
+    if (ceil && (value & ((1 << (2 * exp)) - 1)))
+        mantissa++; // does not overflow, with a remainder the value is less than CT_MANTISSA_MAX << (2 * exp)
 
-            return (uint8_t)( i<<5 | mantissa);
-        }
-    }
+    return (uint8_t)(exp << 5 | mantissa);
 }
@@ -24,29 +24,11 @@
 #include <stdint.h>
 
 #include "crc.h"
-#include "ng.h"
 
-static uint16_t NGDEF(_crc);
-#define crc NG(_crc)
-
-static void update_crc(uint8_t x)
+uint16_t crc_calculate(const uint8_t* data, uint32_t length)
 {
-     uint16_t crc_new = (uint8_t)(crc >> 8) | (crc << 8);
-     crc_new ^= x;
-     crc_new ^= (uint8_t)(crc_new & 0xff) >> 4;
-     crc_new ^= crc_new << 12;
-     crc_new ^= (crc_new & 0xff) << 5;
-     crc = crc_new;
-}
-
-uint16_t crc_calculate(uint8_t* data, uint8_t length)
-{
-    crc = 0xffff;
-    uint8_t i = 0;
-
-    for(; i<length; i++)
-    {
-        update_crc(data[i]);
-    }
-    return crc;
+    crc_ctx_t ctx;
+    crc_init(&ctx);
+    crc_update(&ctx, data, length);
+    return crc_final(&ctx);
 }
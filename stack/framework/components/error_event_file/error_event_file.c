@@ -112,6 +112,8 @@ error_t error_event_file_init(low_level_read_cb_t read_cb, low_level_write_cb_t
     }
     low_level_read_cb_function = read_cb;
     low_level_write_cb_function = write_cb;
+    // the file is also accessed directly on the blockdevice, bypassing the write-back cache
+    fs_set_write_through(ERROR_EVENT_FILE_ID, true);
     d7ap_fs_file_header_t permanent_file_header = { .file_permissions
         = (file_permission_t) { .guest_read = true, .user_read = true, .guest_write = true, .user_write = true}, // other permissions are default false
         .file_properties.storage_class = FS_STORAGE_PERMANENT,
@@ -25,41 +25,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
-#include <stdint.h>
 #include <string.h>
 
 #include "fec.h"
 
-#define INITIAL_FECSTATE 0x00
 #define TRELLIS_TERMINATOR 0x0B
-#define FEC_BUFFER_SIZE 256
+#define INITIAL_COST_UNREACHABLE 100
 
 #define INTERLEAVING
 
-//#ifdef D7_PHY_USE_FEC
-
-static const uint8_t fec_lut[16] = {0, 3, 1, 2, 3, 0, 2, 1, 3, 0, 2, 1, 0, 3, 1, 2};
-static const uint8_t trellis0_lut[8] = {0, 1, 3, 2, 3, 2, 0, 1};
-static const uint8_t trellis1_lut[8] = {3, 2, 0, 1, 0, 1, 3, 2};
-
-static uint8_t data_buffer[FEC_BUFFER_SIZE];
-static uint8_t* input_buffer;
-static uint8_t* output_buffer;
-
-static uint16_t packetlength;
-static uint16_t fecpacketlength;
-static uint16_t output_packet_length;
-
-static uint8_t processedbytes;
-static uint16_t fecprocessedbytes;
-
-static uint16_t pn9;
-static uint16_t fecstate;
-static VITERBISTATE vstate;
-
-static bool fec_decode(uint8_t* input);
-
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_PHY_LOG_ENABLED) // TODO more granular (LOG_PHY_ENABLED)
 #define DPRINT(...) log_print_stack_string(LOG_STACK_PHY, __VA_ARGS__)
 #define DPRINT_DATA(...) log_print_data(__VA_ARGS__)
@@ -68,341 +42,216 @@ static bool fec_decode(uint8_t* input);
 #define DPRINT_DATA(...)
 #endif
 
-//void print_array(uint8_t* buffer, uint8_t length)
-//	for (i = 0; i < length; i++)
-//void print_array(uint8_t* buffer, uint8_t length)
-//{
-//	int i = 0;
-//	for (; i < length; i++)
-//	{
-//	    printf("%02X", buffer[i]);
-//	}
-//	printf(" ");
-//
-//	for (i = 0; i < length; i++)
-//	{
-//		printf("%s", byte_to_binary(buffer[i]));
-//	}
-//}
-
-const char *int_to_binary(uint16_t x)
-{
-    static char b[17];
-    b[0] = '\0';
-
-    uint16_t z;
-    for (z = 0x8000; z > 0; z >>= 1)
-    {
-        strcat(b, ((x & z) == z) ? "1" : "0");
-    }
-
-    return b;
-}
+static const uint8_t fec_lut[16] = {0, 3, 1, 2, 3, 0, 2, 1, 3, 0, 2, 1, 0, 3, 1, 2};
 
-static void print_vstate()
+/*
+ * Branch metrics of the add-compare-select butterflies, indexed by [received symbol][new state].
+ * New state k is reached from state k >> 1 or (k >> 1) + 4 with input bit k & 1, the pair holds the
+ * hamming weight between the received symbol and the symbol expected for each of both transitions.
+ */
+static const uint8_t branch_metrics[4][8][2] = {
+    { {0, 2}, {2, 0}, {1, 1}, {1, 1}, {2, 0}, {0, 2}, {1, 1}, {1, 1} },
+    { {1, 1}, {1, 1}, {0, 2}, {2, 0}, {1, 1}, {1, 1}, {2, 0}, {0, 2} },
+    { {1, 1}, {1, 1}, {2, 0}, {0, 2}, {1, 1}, {1, 1}, {0, 2}, {2, 0} },
+    { {2, 0}, {0, 2}, {1, 1}, {1, 1}, {0, 2}, {2, 0}, {1, 1}, {1, 1} }
+};
+
+// swaps 2 bit symbols between the 4 bytes of a block, interleaving is its own inverse
+static inline void interleave(const uint8_t* input, uint8_t* output)
 {
-//	typedef struct {
-//		uint8_t cost;
-//		uint16_t path;
-//	} VITERBIPATH;
-//	typedef struct {
-//		uint8_t path_size;
-//		VITERBIPATH* old;
-//		VITERBIPATH* new;
-//		VITERBIPATH states1[8];
-//		VITERBIPATH states2[8];
-//	} VITERBISTATE;
-
-  DPRINT("VSTATE:\n");
-  DPRINT(" - path_size: %d\n", vstate.path_size);
-	//printf(" - old: %03d - %s\n", vstate.old->cost, int_to_binary(vstate.old->path));
-	//printf(" - new: %03d - %s\n", vstate.new->cost, int_to_binary(vstate.new->path));
-	int i;
-	for (i=0;i<8;i++)
-    DPRINT(" - states - %d: %03d - %s\n", i, vstate.old[i].cost, int_to_binary(vstate.old[i].path));
-
+#ifdef INTERLEAVING
+	for (uint8_t i = 0; i < 4; i++)
+		output[i] = ((input[0] >> (2 * i)) & 0x03) |
+					(((input[1] >> (2 * i)) & 0x03) << 2) |
+					(((input[2] >> (2 * i)) & 0x03) << 4) |
+					(((input[3] >> (2 * i)) & 0x03) << 6);
+#else
+	memcpy(output, input, 4);
+#endif
 }
 
-
 uint16_t fec_calculated_decoded_length(uint16_t packet_length)
 {
 	return 2* (packet_length + 2 - (packet_length % 2));
 }
 
 /* Convolutional encoder */
-uint16_t fec_encode(uint8_t *data, uint16_t nbytes)
+uint16_t fec_encode_copy(uint8_t *output, const uint8_t *input, uint16_t nbytes)
 {
-	memcpy(data_buffer, data, nbytes);
-	uint8_t *input = data_buffer;
-	unsigned int encstate = 0;
-	int i;
-
-	int termintor_bytes = 2 + nbytes%2;
-	//printf("Length %d -> terminator %d\n", nbytes, termintor_bytes);
-	nbytes+=termintor_bytes;
-	uint16_t length = 0;
-	uint8_t fecbuffer[4] = {0,0,0,0};
-
-	int8_t buffer_pointer = 0;
-	while(nbytes-- > 0){
-		if (nbytes < termintor_bytes) *input = TRELLIS_TERMINATOR;
-
-		//printf("%02X:", *input);
-
-		int j = 6;
-		for(i=7;i>=0;i--){
-				encstate = (encstate << 1) | ((*input >> i) & 1);
-				fecbuffer[buffer_pointer] |= fec_lut[encstate & 0x0F] << j;
-				j -=2;
-
-				//printf("%d: %d - %d -> %s\n",j+2, ((*input >> i) & 1), encstate & 0x0F, byte_to_binary(fec_lut[encstate & 0x0F]));
-				if (j < 0)
-				{
-//						//fecbuffer[buffer_pointer] = 0;
-					buffer_pointer++;
-					j = 6;
-//						length++;
-				}
-		}
+	// Every 2 input bytes (including the trellis terminator) result in 4 encoded bytes, an odd last byte is
+	// dropped. The data is encoded
+	// starting from the end, so when encoding in place every input byte is consumed before its position is
+	// overwritten. The encoder state only depends on the last 3 bits of the previous input byte, which is still intact.
+	uint16_t terminator_bytes = 2 + nbytes % 2;
+	uint16_t total_bytes = nbytes + terminator_bytes;
+
+	for (int32_t pos = (total_bytes & ~1) - 2; pos >= 0; pos -= 2)
+	{
+		uint8_t fecbuffer[4] = {0, 0, 0, 0};
+		unsigned int encstate = (pos == 0) ? 0 : input[pos - 1];
+		if (pos - 1 >= nbytes)
+			encstate = TRELLIS_TERMINATOR;
 
-		if (buffer_pointer == 4)
+		for (uint8_t b = 0; b < 2; b++)
 		{
-#ifdef INTERLEAVING
-			//printf("Non: "); print_array(fecbuffer, 4); printf("\n");
-			//Interleaving and write to output buffer
-			*data++ = ((fecbuffer[0] & 0x03)) |\
-						((fecbuffer[1] & 0x03) << 2) |\
-						((fecbuffer[2] & 0x03) << 4) |\
-						((fecbuffer[3] & 0x03) << 6);
-			*data++ = (((fecbuffer[0] >> 2) & 0x03)) |\
-							(((fecbuffer[1] >> 2) & 0x03) << 2) |\
-							(((fecbuffer[2] >> 2) & 0x03) << 4) |\
-							(((fecbuffer[3] >> 2) & 0x03) << 6);
-			*data++ = (((fecbuffer[0] >> 4) & 0x03)) |\
-							(((fecbuffer[1] >> 4) & 0x03) << 2) |\
-							(((fecbuffer[2] >> 4) & 0x03) << 4) |\
-							(((fecbuffer[3] >> 4) & 0x03) << 6);
-			*data++ = (((fecbuffer[0] >> 6) & 0x03)) |\
-							(((fecbuffer[1] >> 6) & 0x03) << 2) |\
-							(((fecbuffer[2] >> 6) & 0x03) << 4) |\
-							(((fecbuffer[3] >> 6) & 0x03) << 6);
-			//printf("Int: "); print_array(output-4, 4); printf("\n");
-#else
-			*output++ = fecbuffer[0];
-			*output++ = fecbuffer[1];
-			*output++ = fecbuffer[2];
-			*output++ = fecbuffer[3];
-
-#endif
-			buffer_pointer=0;
-			fecbuffer[0] = 0;
-			fecbuffer[1] = 0;
-			fecbuffer[2] = 0;
-			fecbuffer[3] = 0;
-			length+=4;
+			uint8_t byte = (pos + b < nbytes) ? input[pos + b] : TRELLIS_TERMINATOR;
+			for (int8_t i = 7; i >= 0; i--)
+			{
+				encstate = (encstate << 1) | ((byte >> i) & 1);
+				fecbuffer[2 * b + (7 - i) / 4] |= fec_lut[encstate & 0x0F] << (2 * (i % 4));
+			}
 		}
 
-
-		//printf("%02X%02X ", *(output-2), *(output-1));
-
-		input++;
-
+		interleave(fecbuffer, &output[2 * pos]);
 	}
 
-
-	//printf("\n");
-	return length;
+	return 2 * (total_bytes & ~1);
 }
 
-uint16_t fec_decode_packet(uint8_t* data, uint16_t packet_length, uint16_t output_length)
+uint16_t fec_encode(uint8_t *data, uint16_t nbytes)
 {
-	uint8_t* output = data_buffer;
-	if(output_length < packet_length)
-	{
-		DPRINT("FEC decoding error: buffer to small\n");
-		return 0;
-	}
+	return fec_encode_copy(data, data, nbytes);
+}
 
-	if(packet_length % 4 != 0)
-	{
-		DPRINT("FEC decoding error: data 32 bit aligned\n");
-		return 0;
-	}
+void fec_decoder_init(fec_decoder_t* decoder, uint8_t* output, uint16_t output_size)
+{
+	decoder->cost[0] = 0;
+	for (uint8_t i = 1; i < 8; i++)
+		decoder->cost[i] = INITIAL_COST_UNREACHABLE;
+
+	memset(decoder->path, 0, sizeof(decoder->path));
+	decoder->path_size = 0;
+	decoder->block_size = 0;
+	decoder->output = output;
+	decoder->output_size = output_size;
+	decoder->output_length = 0;
+}
 
-	output_buffer = output;
-	packetlength = packet_length;
-	output_packet_length = output_length;
+static inline void output_byte(fec_decoder_t* decoder, uint8_t byte)
+{
+	if (decoder->output_length < decoder->output_size)
+		decoder->output[decoder->output_length] = byte;
 
-	processedbytes = 0;
-	fecprocessedbytes = 0;
+	decoder->output_length++;
+}
 
-	vstate.path_size = 0;
+static inline uint8_t best_state(const uint8_t* cost)
+{
+	uint8_t min_state = 0;
+	for (uint8_t j = 7; j != 0; j--)
+		if (cost[j] < cost[min_state])
+			min_state = j;
 
-	vstate.states1[0].cost = 0;
-	int16_t i;
-	for (i=1;i<8;i++)
-			vstate.states1[i].cost = 100;
+	return min_state;
+}
 
-	vstate.old = vstate.states1;
-	vstate.new = vstate.states2;
+// add-compare-select for new state k from costs c and paths p into nc and np,
+// ties are resolved in favour of the lowest predecessor
+#define ACS(k, bm, c, p, nc, np) do { \
+	uint8_t m0 = c[(k) >> 1] + bm[k][0]; \
+	uint8_t m1 = c[((k) >> 1) + 4] + bm[k][1]; \
+	bool upper = m1 < m0; \
+	nc[k] = upper ? m1 : m0; \
+	np[k] = (p[((k) >> 1) + (upper << 2)] << 1) | ((k) & 1); \
+} while (0)
+
+#define BUTTERFLIES(bm, c, p, nc, np) do { \
+	ACS(0, bm, c, p, nc, np); ACS(1, bm, c, p, nc, np); ACS(2, bm, c, p, nc, np); ACS(3, bm, c, p, nc, np); \
+	ACS(4, bm, c, p, nc, np); ACS(5, bm, c, p, nc, np); ACS(6, bm, c, p, nc, np); ACS(7, bm, c, p, nc, np); \
+} while (0)
+
+static void decode_block(fec_decoder_t* decoder, const uint8_t* input)
+{
+	uint8_t fecbuffer[4];
+	interleave(input, fecbuffer);
 
-	uint16_t decoded_length = 0;
+	// the trellis is stepped twice per iteration, swapping between both sets of states
+	uint8_t c[8], nc[8];
+	uint16_t p[8], np[8];
+	memcpy(c, decoder->cost, sizeof(c));
+	memcpy(p, decoder->path, sizeof(p));
 
-	for(i = 0; i < packet_length; i = i + 4)
+	for (uint8_t i = 0; i < 4; i++)
 	{
-		//printf("FEC encoding i = %d\n", i);
+		uint8_t symbols = fecbuffer[i];
+		for (int8_t shift = 6; shift >= 0; shift -= 4)
+		{
+			const uint8_t (*bm)[2] = branch_metrics[(symbols >> shift) & 0x03];
+			BUTTERFLIES(bm, c, p, nc, np);
+			bm = branch_metrics[(symbols >> (shift - 2)) & 0x03];
+			BUTTERFLIES(bm, nc, np, c, p);
+		}
 
-		bool err = fec_decode(&data[i]);
-		decoded_length+=2;
-		if (!err) 
+		//Flush out the oldest byte once the path is full
+		if ((i & 1) && ++decoder->path_size == 2)
 		{
-			DPRINT("FEC encoding error\n");
+			uint8_t min_state = best_state(c);
+			uint8_t min_cost = c[min_state];
+			for (uint8_t j = 0; j < 8; j++)
+				c[j] -= min_cost;
+
+			output_byte(decoder, p[min_state] >> 8);
+			decoder->path_size--;
 		}
 	}
 
-	memcpy(data, data_buffer, decoded_length);
-
-	return decoded_length;
+	memcpy(decoder->cost, c, sizeof(c));
+	memcpy(decoder->path, p, sizeof(p));
 }
 
-static bool fec_decode(uint8_t* input)
+void fec_decoder_update(fec_decoder_t* decoder, const uint8_t* input, uint16_t length)
 {
-	uint8_t i, k;
-	int8_t j;
-	uint8_t min_state;
-	uint8_t symbol;
-	uint16_t tmppn9;
-	uint8_t fecbuffer[4];
-	VITERBIPATH* vstate_tmp;
-
-	if(fecprocessedbytes >= packetlength)
-		return false;
-
-	//Deinterleaving (symbols are stored in reverse as this is easier for Viterbi decoding)
-
-#ifdef INTERLEAVING
-	//printf("Int: "); print_array(input, 4); printf("\n");
-	fecbuffer[0] = ((input[0] & 0x03)) |\
-					((input[1] & 0x03) << 2) |\
-					((input[2] & 0x03) << 4) |\
-					((input[3] & 0x03) << 6);
-	fecbuffer[1] = (((input[0] >> 2) & 0x03)) |\
-					(((input[1] >> 2) & 0x03) << 2) |\
-					(((input[2] >> 2) & 0x03) << 4) |\
-					(((input[3] >> 2) & 0x03) << 6);
-	fecbuffer[2] = (((input[0] >> 4) & 0x03)) |\
-					(((input[1] >> 4) & 0x03) << 2) |\
-					(((input[2] >> 4) & 0x03) << 4) |\
-					(((input[3] >> 4) & 0x03) << 6);
-	fecbuffer[3] = (((input[0] >> 6) & 0x03)) |\
-					(((input[1] >> 6) & 0x03) << 2) |\
-					(((input[2] >> 6) & 0x03) << 4) |\
-					(((input[3] >> 6) & 0x03) << 6);
-	//printf("DeI: "); print_array(fecbuffer, 4); printf("\n");
-#else
-	fecbuffer[0] = input[0];
-	fecbuffer[1] = input[1];
-	fecbuffer[2] = input[2];
-	fecbuffer[3] = input[3];
-#endif
-	//printf(" input = %04X%04X\n", fecbuffer[0],fecbuffer[1]);
-	fecprocessedbytes +=4;
-
-	for (i = 0; i < 3; i=i+2) {
-		//Viterbi decoding
-		//printf(" Encode i  %d -> %04X %s\n", i, fecbuffer[i], int_to_binary(fecbuffer[i]));
-
-		// todo: fix for loop
-		for (j = 7; j >= 0; j--) {
-			if (j>3)
-				symbol = (fecbuffer[i] >> (j-4)*2) & 0x03;
-			else
-				symbol = (fecbuffer[i+1] >> j*2) & 0x03;
-			//printf(" Symbol %d %x - %s\n", j, symbol, int_to_binary(symbol));
-			//fecbuffer[i] >>= 2;
-
-			for(k = 0; k < 8; k++) {
-				uint8_t cost0, cost1;
-				uint8_t state0, state1;
-				uint8_t hamming0, hamming1;
-
-				state0 = k >> 1;
-				state1 = state0 + 4;
-
-				cost0  = vstate.old[state0].cost;
-				cost1  = vstate.old[state1].cost;
-
-				//butterfly operation for 0
-				hamming0 = cost0 + (((trellis0_lut[state0] ^ symbol) + 1) >> 1);
-				hamming1 = cost1 + (((trellis0_lut[state1] ^ symbol) + 1) >> 1);
-
-				if(hamming0 <= hamming1) {
-					vstate.new[k].cost = hamming0;
-					vstate.new[k].path = vstate.old[state0].path << 1;
-				} else {
-					vstate.new[k].cost = hamming1;
-					vstate.new[k].path = vstate.old[state1].path << 1;
-				}
-
-				//printf("k %d part 1\n");
-				//print_vstate();
-
-				k++;
-
-				//butterfly operation for 1
-				hamming0 = cost0 + (((trellis1_lut[state0] ^ symbol) + 1) >> 1);
-				hamming1 = cost1 + (((trellis1_lut[state1] ^ symbol) + 1) >> 1);
-
-				if(hamming0 <= hamming1) {
-					vstate.new[k].cost = hamming0;
-					vstate.new[k].path = vstate.old[state0].path << 1 | 0x01;
-				} else {
-					vstate.new[k].cost = hamming1;
-					vstate.new[k].path = vstate.old[state1].path << 1 | 0x01;
-				}
-
-				//printf("k %d part 2\n");
-				//print_vstate();
-			}
-
-			//Swap Viterbi paths
-			vstate_tmp = vstate.new;
-			vstate.new = vstate.old;
-			vstate.old = vstate_tmp;
-
-			//print_vstate();
+	// complete a block which was split over the previous chunk
+	while (decoder->block_size > 0 && length > 0)
+	{
+		decoder->block[decoder->block_size++] = *input++;
+		length--;
+		if (decoder->block_size == 4)
+		{
+			decode_block(decoder, decoder->block);
+			decoder->block_size = 0;
 		}
+	}
 
-		vstate.path_size++;
-
-		//Flush out byte if path is full
-		if ((vstate.path_size == 2) && (processedbytes < packetlength)) {
-			//Calculate path with lowest cost
-			min_state = 0;
-			for (j = 7; j != 0; j--) {
-				if(vstate.old[j].cost < vstate.old[min_state].cost)
-					min_state = j;
-			}
-
-	        //Normalize costs
-			if (vstate.old[min_state].cost > 0)
-				for (j = 0; j < 8; j++) vstate.old[j].cost -= vstate.old[min_state].cost;
+	if (decoder->block_size > 0)
+		return;
 
-			*output_buffer++ = vstate.old[min_state].path >> 8;
-			vstate.path_size--;
+	for (; length >= 4; length -= 4, input += 4)
+		decode_block(decoder, input);
 
-			processedbytes++;
+	memcpy(decoder->block, input, length);
+	decoder->block_size = length;
+}
 
-			if (processedbytes+ 2 == packetlength)
-				*output_buffer = (uint8_t) (vstate.old[min_state].path);
-		}
+uint16_t fec_decoder_final(fec_decoder_t* decoder)
+{
+	// the last byte is still in the path of the surviving state
+	if (decoder->path_size > 0)
+	{
+		output_byte(decoder, decoder->path[best_state(decoder->cost)]);
+		decoder->path_size = 0;
 	}
 
-	//print_vstate();
+	return decoder->output_length;
+}
 
+uint16_t fec_decode_packet(uint8_t* data, uint16_t packet_length, uint16_t output_length)
+{
+	if(output_length < packet_length)
+	{
+		DPRINT("FEC decoding error: buffer to small\n");
+		return 0;
+	}
 
+	if(packet_length % 4 != 0)
+	{
+		DPRINT("FEC decoding error: data 32 bit aligned\n");
+		return 0;
+	}
 
-	return true;
+	// the decoded data is written behind the input which is still to be read, so this can be done in place
+	fec_decoder_t decoder;
+	fec_decoder_init(&decoder, data, output_length);
+	fec_decoder_update(&decoder, data, packet_length);
+	return fec_decoder_final(&decoder);
 }
-
-//#endif /* D7_PHY_USE_FEC */
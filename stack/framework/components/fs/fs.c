@@ -29,11 +29,14 @@
 
 #include "framework_defs.h"
 #include "debug.h"
+#include "ng.h"
 #include "log.h"
 #include "fs.h"
 #include "errors.h"
 #include "platform.h"
 #include "hwblockdevice.h"
+#include "scheduler.h"
+#include "timer.h"
 
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_FS_LOG_ENABLED)
   #define DPRINT(...) log_print_string( __VA_ARGS__)
@@ -41,17 +44,76 @@
   #define DPRINT(...)
 #endif
 
-static fs_file_t files[FRAMEWORK_FS_FILE_COUNT] = { 0 }; // TODO do not keep all file metadata in RAM but use smaller MRU cache to save RAM
+#define FS_FULL_HEADER_CACHE (FRAMEWORK_FS_HEADER_CACHE_SIZE >= FRAMEWORK_FS_FILE_COUNT)
+#define FS_NO_FILE 0xFF
 
-static bool is_fs_init_completed = false;  //set in _d7a_verify_magic()
+/*
+ * File metadata layer. A bitmap tells which file ids are defined, without touching the headers.
+ * The headers themselves are either all kept in RAM, or a smaller most recently used cache is
+ * filled on demand from the metadata blockdevice. The headers of volatile files are not stored
+ * on the metadata blockdevice, so they are never evicted from the cache.
+ */
+static uint8_t NGDEF(_defined_files)[(FRAMEWORK_FS_FILE_COUNT + 7) / 8];
+#define defined_files NG(_defined_files)
+
+#if FS_FULL_HEADER_CACHE
+#define FS_HEADER_SLOTS FRAMEWORK_FS_FILE_COUNT
+#else
+#define FS_HEADER_SLOTS FRAMEWORK_FS_HEADER_CACHE_SIZE
+#endif
+
+static fs_file_t NGDEF(_files)[FS_HEADER_SLOTS]; // kept contiguous, so headers can be bulk loaded in here
+#define files NG(_files)
+#if !FS_FULL_HEADER_CACHE
+static uint8_t NGDEF(_cached_file_ids)[FS_HEADER_SLOTS];
+#define cached_file_ids NG(_cached_file_ids)
+static uint32_t NGDEF(_cache_last_used)[FS_HEADER_SLOTS];
+#define cache_last_used NG(_cache_last_used)
+static uint32_t NGDEF(_cache_clock);
+#define cache_clock NG(_cache_clock)
+#endif
+
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+/*
+ * Write-back layer, which applications opt in to with FRAMEWORK_FS_WRITEBACK_SLOTS. Without it every write is
+ * programmed right away. Small writes to files on non-volatile blockdevices are merged in a dirty
+ * range per file, which is programmed when the deadline expires, when the slot is needed for
+ * another file, on fs_sync() or (optionally) when the scheduler becomes idle. Reads are served
+ * from the dirty ranges where they overlap.
+ */
+typedef struct
+{
+    uint32_t addr;          // blockdevice address of the first dirty byte
+    uint32_t dirty_since;   // the order in which the slots became dirty, to flush the oldest first
+    uint16_t length;
+    uint8_t file_id;        // FS_NO_FILE when the slot is clean
+    uint8_t blockdevice_index;
+    uint8_t data[FRAMEWORK_FS_WRITEBACK_BUFFER_SIZE];
+} writeback_slot_t;
+
+static writeback_slot_t NGDEF(_writeback_slots)[FRAMEWORK_FS_WRITEBACK_SLOTS];
+#define writeback_slots NG(_writeback_slots)
+static uint32_t NGDEF(_writeback_clock);
+#define writeback_clock NG(_writeback_clock)
+#endif
+
+static uint8_t NGDEF(_write_through_files)[(FRAMEWORK_FS_FILE_COUNT + 7) / 8];
+#define write_through_files NG(_write_through_files)
+
+static bool NGDEF(_is_fs_init_completed);  //set in _d7a_verify_magic()
+#define is_fs_init_completed NG(_is_fs_init_completed)
 
 #define IS_SYSTEM_FILE(file_id)         (file_id <= 0x3F)
 
-static uint32_t volatile_data_offset = 0;
-static uint32_t permanent_data_offset = 0;
+static uint32_t NGDEF(_volatile_data_offset);
+#define volatile_data_offset NG(_volatile_data_offset)
+static uint32_t NGDEF(_permanent_data_offset);
+#define permanent_data_offset NG(_permanent_data_offset)
 
-static uint32_t bd_data_offset[FRAMEWORK_FS_BLOCKDEVICES_COUNT] = { 0 };
-static blockdevice_t* bd[FRAMEWORK_FS_BLOCKDEVICES_COUNT] = { 0 };
+static uint32_t NGDEF(_bd_data_offset)[FRAMEWORK_FS_BLOCKDEVICES_COUNT];
+#define bd_data_offset NG(_bd_data_offset)
+static blockdevice_t*NGDEF(_bd)[FRAMEWORK_FS_BLOCKDEVICES_COUNT];
+#define bd NG(_bd)
 
 /* forward internal declarations */
 static int _fs_init(void);
@@ -61,8 +123,15 @@ static int _fs_create_file(uint8_t file_id, fs_blockdevice_types_t bd_type, cons
 
 static inline bool _is_file_defined(uint8_t file_id)
 {
-    //return files[file_id].storage == FS_STORAGE_INVALID;
-    return files[file_id].length != 0;
+    if(file_id >= FRAMEWORK_FS_FILE_COUNT)
+        return false;
+
+    return (defined_files[file_id / 8] & (1 << (file_id % 8))) != 0;
+}
+
+static inline void _set_file_defined(uint8_t file_id)
+{
+    defined_files[file_id / 8] |= (1 << (file_id % 8));
 }
 
 static inline uint32_t _get_file_header_address(uint8_t file_id)
@@ -70,6 +139,242 @@ static inline uint32_t _get_file_header_address(uint8_t file_id)
     return FS_FILE_HEADERS_ADDRESS + (file_id * FS_FILE_HEADER_SIZE);
 }
 
+// FS headers are stored in big endian
+static inline void _convert_file_header_endianness(fs_file_t* header)
+{
+#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+    header->addr = __builtin_bswap32(header->addr);
+    header->length = __builtin_bswap32(header->length);
+#endif
+}
+
+#if !FS_FULL_HEADER_CACHE
+static void _invalidate_header_cache()
+{
+    memset(cached_file_ids, FS_NO_FILE, sizeof(cached_file_ids));
+    cache_clock = 0;
+}
+
+static fs_file_t* _allocate_cached_header(uint8_t file_id)
+{
+    int victim = -1;
+    for(int i = 0; i < FS_HEADER_SLOTS; i++)
+    {
+        if(cached_file_ids[i] == FS_NO_FILE)
+        {
+            victim = i;
+            break;
+        }
+
+        if(files[i].blockdevice_index == FS_BLOCKDEVICE_TYPE_VOLATILE)
+            continue;
+
+        if(victim < 0 || cache_last_used[i] < cache_last_used[victim])
+            victim = i;
+    }
+
+    assert(victim >= 0); // FRAMEWORK_FS_HEADER_CACHE_SIZE too small to hold the headers of all volatile files
+    cached_file_ids[victim] = file_id;
+    cache_last_used[victim] = ++cache_clock;
+    return &files[victim];
+}
+#endif
+
+/* Returns a copy of the header of a defined file, a cache slot can be reused by the next header lookup */
+static fs_file_t _get_file_header(uint8_t file_id)
+{
+    assert(_is_file_defined(file_id));
+#if FS_FULL_HEADER_CACHE
+    return files[file_id];
+#else
+    for(int i = 0; i < FS_HEADER_SLOTS; i++)
+    {
+        if(cached_file_ids[i] == file_id)
+        {
+            cache_last_used[i] = ++cache_clock;
+            return files[i];
+        }
+    }
+
+    fs_file_t* header = _allocate_cached_header(file_id);
+    blockdevice_read(bd[FS_BLOCKDEVICE_TYPE_METADATA], (uint8_t*)header, _get_file_header_address(file_id), FS_FILE_HEADER_SIZE);
+    _convert_file_header_endianness(header);
+    assert(header->blockdevice_index != FS_BLOCKDEVICE_TYPE_VOLATILE);
+    return *header;
+#endif
+}
+
+static fs_file_t* _add_file_header(uint8_t file_id)
+{
+    _set_file_defined(file_id);
+#if FS_FULL_HEADER_CACHE
+    return &files[file_id];
+#else
+    return _allocate_cached_header(file_id);
+#endif
+}
+
+// program the data in chunks which do not cross a write block boundary
+static void _program(fs_blockdevice_types_t bd_type, const uint8_t* data, uint32_t address, uint32_t length)
+{
+    uint32_t remaining_length = length;
+    do {
+        // calculate the number of bytes that can be written till the end of the block/page
+        uint32_t bytes_until_end_of_block = bd[bd_type]->driver->write_block_size - ((address + bd[bd_type]->offset) % bd[bd_type]->driver->write_block_size);
+        uint32_t bytes_to_program = remaining_length > bytes_until_end_of_block ? bytes_until_end_of_block : remaining_length;
+        DPRINT("Programming %i bytes", bytes_to_program);
+        blockdevice_program(bd[bd_type], data, address, bytes_to_program);
+        remaining_length -= bytes_to_program;
+        data += bytes_to_program;
+        address += bytes_to_program;
+    } while (remaining_length > 0);
+}
+
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+static void _writeback_flush_slot(writeback_slot_t* slot)
+{
+    if(slot->file_id == FS_NO_FILE)
+        return;
+
+    DPRINT("fs write-back file %i, %i bytes at %i", slot->file_id, slot->length, slot->addr);
+    _program(slot->blockdevice_index, slot->data, slot->addr, slot->length);
+    slot->file_id = FS_NO_FILE;
+}
+
+static writeback_slot_t* _writeback_find_slot(uint8_t file_id)
+{
+    for(int i = 0; i < FRAMEWORK_FS_WRITEBACK_SLOTS; i++)
+    {
+        if(writeback_slots[i].file_id == file_id)
+            return &writeback_slots[i];
+    }
+
+    return NULL;
+}
+
+static void _writeback_deadline_task(void* arg)
+{
+    fs_sync();
+}
+
+/*
+ * Merges the write in the dirty range of the file. Returns false when the write has to be
+ * programmed directly, in which case the file has no dirty range anymore.
+ */
+static bool _writeback_write(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8_t* data, uint32_t address, uint32_t length)
+{
+    writeback_slot_t* slot = _writeback_find_slot(file_id);
+    if(slot != NULL)
+    {
+        uint32_t start = slot->addr < address ? slot->addr : address;
+        uint32_t end = slot->addr + slot->length > address + length ? slot->addr + slot->length : address + length;
+        if(end - start > FRAMEWORK_FS_WRITEBACK_BUFFER_SIZE)
+        {
+            _writeback_flush_slot(slot);
+            slot = NULL;
+        }
+        else
+        {
+            // extend the dirty range, the gap between both ranges is filled with the stored content
+            if(start < slot->addr)
+            {
+                memmove(slot->data + (slot->addr - start), slot->data, slot->length);
+                blockdevice_read(bd[bd_type], slot->data, start, slot->addr - start);
+            }
+
+            uint32_t slot_end = slot->addr + slot->length;
+            if(end > slot_end)
+                blockdevice_read(bd[bd_type], slot->data + (slot_end - start), slot_end, end - slot_end);
+
+            slot->addr = start;
+            slot->length = end - start;
+            memcpy(slot->data + (address - start), data, length);
+            return true;
+        }
+    }
+
+    if(length > FRAMEWORK_FS_WRITEBACK_BUFFER_SIZE)
+        return false;
+
+    // use a clean slot, or flush the slot which is dirty the longest
+    for(int i = 0; i < FRAMEWORK_FS_WRITEBACK_SLOTS; i++)
+    {
+        if(writeback_slots[i].file_id == FS_NO_FILE)
+        {
+            if(slot == NULL || slot->file_id != FS_NO_FILE)
+                slot = &writeback_slots[i];
+        }
+        else
+        {
+            if(slot == NULL || (slot->file_id != FS_NO_FILE && writeback_slots[i].dirty_since < slot->dirty_since))
+                slot = &writeback_slots[i];
+        }
+    }
+
+    _writeback_flush_slot(slot);
+    slot->file_id = file_id;
+    slot->blockdevice_index = bd_type;
+    slot->addr = address;
+    slot->length = length;
+    slot->dirty_since = ++writeback_clock;
+    memcpy(slot->data, data, length);
+
+    if(!timer_is_task_scheduled(&_writeback_deadline_task))
+        timer_post_task_delay(&_writeback_deadline_task, FRAMEWORK_FS_WRITEBACK_DEADLINE * TIMER_TICKS_PER_SEC);
+
+    return true;
+}
+
+// serve the part of a read which overlaps with the dirty range of the file
+static void _writeback_read(uint8_t file_id, uint8_t* data, uint32_t address, uint32_t length)
+{
+    writeback_slot_t* slot = _writeback_find_slot(file_id);
+    if(slot == NULL)
+        return;
+
+    uint32_t start = slot->addr > address ? slot->addr : address;
+    uint32_t end = slot->addr + slot->length < address + length ? slot->addr + slot->length : address + length;
+    if(start < end)
+        memcpy(data + (start - address), slot->data + (start - slot->addr), end - start);
+}
+
+static void _writeback_idle_hook()
+{
+    fs_sync();
+}
+#endif
+
+void fs_sync()
+{
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    bool was_dirty = false;
+    for(int i = 0; i < FRAMEWORK_FS_WRITEBACK_SLOTS; i++)
+    {
+        was_dirty |= (writeback_slots[i].file_id != FS_NO_FILE);
+        _writeback_flush_slot(&writeback_slots[i]);
+    }
+
+    if(was_dirty)
+        timer_cancel_task(&_writeback_deadline_task);
+#endif
+}
+
+void fs_set_write_through(uint8_t file_id, bool write_through)
+{
+    assert(file_id < FRAMEWORK_FS_FILE_COUNT);
+    if(write_through)
+    {
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+        writeback_slot_t* slot = _writeback_find_slot(file_id);
+        if(slot != NULL)
+            _writeback_flush_slot(slot);
+#endif
+        write_through_files[file_id / 8] |= (1 << (file_id % 8));
+    }
+    else
+        write_through_files[file_id / 8] &= ~(1 << (file_id % 8));
+}
+
 error_t fs_register_block_device(blockdevice_t* block_device, uint8_t bd_index)
 {
     //TODO this should be done on a seperate layer and will have to include a metadata block device. This metadata block device should copy all content to the regular meta data device upon initialization.
@@ -85,7 +390,7 @@ error_t fs_register_block_device(blockdevice_t* block_device, uint8_t bd_index)
     
 }
 
-uint32_t fs_get_address(uint8_t file_id) { return files[file_id].addr; }
+uint32_t fs_get_address(uint8_t file_id) { return _get_file_header(file_id).addr; }
 
 void fs_init()
 {
@@ -93,6 +398,19 @@ void fs_init()
         return /*0*/;
 
     memset(files,0,sizeof(files));
+    memset(defined_files,0,sizeof(defined_files));
+#if !FS_FULL_HEADER_CACHE
+    _invalidate_header_cache();
+#endif
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    for(int i = 0; i < FRAMEWORK_FS_WRITEBACK_SLOTS; i++)
+        writeback_slots[i].file_id = FS_NO_FILE;
+
+    sched_register_task(&_writeback_deadline_task);
+#if defined(FRAMEWORK_FS_WRITEBACK_SYNC_ON_IDLE)
+    sched_set_idle_hook(&_writeback_idle_hook);
+#endif
+#endif
 
     // inject the mandatory blockdevice types from the platform
     // for now, only metadata, permanent and volatile storage are supported
@@ -126,27 +444,40 @@ int _fs_init()
 #endif
 
     assert(number_of_files < FRAMEWORK_FS_FILE_COUNT);
-    for(int file_id = 0; file_id < FRAMEWORK_FS_FILE_COUNT; file_id++)
+
+    // bulk load the headers, in chunks which fit in the header cache
+    for(int first_file_id = 0; first_file_id < FRAMEWORK_FS_FILE_COUNT; first_file_id += FS_HEADER_SLOTS)
     {
-        blockdevice_read(bd[FS_BLOCKDEVICE_TYPE_METADATA], (uint8_t*)&files[file_id],
-                         _get_file_header_address(file_id), FS_FILE_HEADER_SIZE);
+        int count = FRAMEWORK_FS_FILE_COUNT - first_file_id;
+        if(count > FS_HEADER_SLOTS)
+            count = FS_HEADER_SLOTS;
 
-#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
-        // FS headers are stored in big endian
-        files[file_id].addr = __builtin_bswap32(files[file_id].addr);
-        files[file_id].length = __builtin_bswap32(files[file_id].length);
-#endif
+        blockdevice_read(bd[FS_BLOCKDEVICE_TYPE_METADATA], (uint8_t*)files,
+                         _get_file_header_address(first_file_id), count * FS_FILE_HEADER_SIZE);
 
-        DPRINT("File %i, bd %i, len %i, addr %i", file_id, files[file_id].blockdevice_index, files[file_id].length, files[file_id].addr);
-        if(_is_file_defined(file_id))
+        for(int i = 0; i < count; i++)
         {
-            if (files[file_id].blockdevice_index == FS_BLOCKDEVICE_TYPE_VOLATILE)
-                DPRINT("volatile file (%i) will not be initialized", file_id);
-            else
-                bd_data_offset[files[file_id].blockdevice_index] += files[file_id].length;
+            _convert_file_header_endianness(&files[i]);
+            DPRINT("File %i, bd %i, len %i, addr %i", first_file_id + i, files[i].blockdevice_index, files[i].length, files[i].addr);
+            if(files[i].length == 0)
+                continue;
+
+            if (files[i].blockdevice_index == FS_BLOCKDEVICE_TYPE_VOLATILE)
+            {
+                DPRINT("volatile file (%i) will not be initialized", first_file_id + i);
+                continue;
+            }
+
+            _set_file_defined(first_file_id + i);
+            bd_data_offset[files[i].blockdevice_index] += files[i].length;
         }
     }
-    
+
+#if !FS_FULL_HEADER_CACHE
+    // the cache was only used as scratch buffer, headers are loaded on demand from now on
+    _invalidate_header_cache();
+#endif
+
     return 0;
 }
 
@@ -190,33 +521,22 @@ int _fs_create_file(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8
     }
 
     // update file caching for stat lookup
-    files[file_id].blockdevice_index = (uint8_t)bd_type;
-    files[file_id].length = length;
+    fs_file_t* header = _add_file_header(file_id);
+    header->blockdevice_index = (uint8_t)bd_type;
+    header->length = length;
+    header->addr = bd_data_offset[bd_type];
+    bd_data_offset[bd_type] += length;
 
-    if (bd_type == FS_BLOCKDEVICE_TYPE_VOLATILE)
+    if (bd_type != FS_BLOCKDEVICE_TYPE_VOLATILE)
     {
-        files[file_id].addr = bd_data_offset[bd_type];
-        bd_data_offset[bd_type] += length;        
-    }
-    else
-    {
-        files[file_id].addr = bd_data_offset[bd_type];
-
-#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
-        fs_file_t file_header_big_endian;
-        memcpy(&file_header_big_endian, (void*)&files[file_id], sizeof (fs_file_t));
-        file_header_big_endian.length = __builtin_bswap32(file_header_big_endian.length);
-        file_header_big_endian.addr = __builtin_bswap32(file_header_big_endian.addr);
+        fs_file_t file_header_big_endian = *header;
+        _convert_file_header_endianness(&file_header_big_endian);
         blockdevice_program(bd[FS_BLOCKDEVICE_TYPE_METADATA], (uint8_t*)&file_header_big_endian, _get_file_header_address(file_id), FS_FILE_HEADER_SIZE);
-#else
-        blockdevice_program(bd[FS_BLOCKDEVICE_TYPE_METADATA], (uint8_t*)&files[file_id], _get_file_header_address(file_id), FS_FILE_HEADER_SIZE);
-#endif
-
-        bd_data_offset[bd_type] += length;
     }
 
+    uint32_t file_address = header->addr;
     if(initial_data != NULL) {
-        uint32_t current_address = files[file_id].addr;
+        uint32_t current_address = file_address;
         uint32_t remaining_length = initial_data_length;
         uint8_t* current_data = (uint8_t*)initial_data;
         do {
@@ -227,7 +547,7 @@ int _fs_create_file(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8
                 blockdevice_program(bd[bd_type], current_data, current_address, remaining_length);
                 remaining_length = 0;
             /* else if this is the starting block, only write untill the end of the first write_block */
-            } else if(current_address == files[file_id].addr) {
+            } else if(current_address == file_address) {
                 remaining_length -= bd[bd_type]->driver->write_block_size - (current_address & (bd[bd_type]->driver->write_block_size - 1));
 
                 DPRINT("program initial length of %i - %i = %i at address %i", initial_data_length, remaining_length, initial_data_length - remaining_length, current_address);
@@ -252,15 +572,15 @@ int _fs_create_file(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8
         uint32_t remaining_length = length;
         int i = 0;
         while(remaining_length > 64) {
-          blockdevice_program(bd[bd_type], default_data, files[file_id].addr + (i * 64), 64);
+          blockdevice_program(bd[bd_type], default_data, file_address + (i * 64), 64);
           remaining_length -= 64;
           i++;
         }
 
-        blockdevice_program(bd[bd_type], default_data, files[file_id].addr  + (i * 64), remaining_length);
+        blockdevice_program(bd[bd_type], default_data, file_address + (i * 64), remaining_length);
     }
 
-    DPRINT("fs init file(file_id %d, bd_type %d, addr %i, length %d)\n",file_id, bd_type, files[file_id].addr, length);
+    DPRINT("fs init file(file_id %d, bd_type %d, addr %i, length %d)\n",file_id, bd_type, file_address, length);
     return 0;
 }
 
@@ -276,53 +596,58 @@ int fs_init_file(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8_t*
 int fs_read_file(uint8_t file_id, uint32_t offset, uint8_t* buffer, uint32_t length)
 {
     if(!_is_file_defined(file_id)) return -ENOENT;
-    if(bd[files[file_id].blockdevice_index] == NULL) return -EFAULT;
+    fs_file_t header = _get_file_header(file_id);
+    if(bd[header.blockdevice_index] == NULL) return -EFAULT;
 
-    if(files[file_id].length < offset + length) return -EINVAL;
+    if(header.length < offset + length) return -EINVAL;
     
-    DPRINT("fs read_file(file_id %d, offset %d, addr %p, bd %i, length %d)\n",file_id, offset, files[file_id].addr, files[file_id].blockdevice_index, length);
-    return blockdevice_read(bd[files[file_id].blockdevice_index], buffer, files[file_id].addr + offset, length);
+    DPRINT("fs read_file(file_id %d, offset %d, addr %p, bd %i, length %d)\n",file_id, offset, header.addr, header.blockdevice_index, length);
+    int rtc = blockdevice_read(bd[header.blockdevice_index], buffer, header.addr + offset, length);
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    if(rtc == 0)
+        _writeback_read(file_id, buffer, header.addr + offset, length);
+#endif
+    return rtc;
 }
 
 int fs_write_file(uint8_t file_id, uint32_t offset, const uint8_t* buffer, uint32_t length)
 {
     if(!_is_file_defined(file_id)) return -ENOENT;
-    if(bd[files[file_id].blockdevice_index] == NULL) return -EFAULT;
-
-    if(files[file_id].length < offset + length) return -ENOBUFS;
+    fs_file_t header = _get_file_header(file_id);
+    if(bd[header.blockdevice_index] == NULL) return -EFAULT;
 
-    uint32_t current_address = files[file_id].addr + offset;
-    uint32_t remaining_length = length;
-    uint8_t* current_data = (uint8_t*)buffer;
-    fs_blockdevice_types_t bd_type = files[file_id].blockdevice_index;
+    if(header.length < offset + length) return -ENOBUFS;
 
-    do {
-        // calculate the number of bytes that can be written till the end of the block/page
-        uint32_t bytes_until_end_of_block = bd[bd_type]->driver->write_block_size - ((current_address + bd[bd_type]->offset) % bd[bd_type]->driver->write_block_size);
-        uint32_t bytes_to_program = remaining_length > bytes_until_end_of_block ? bytes_until_end_of_block : remaining_length;
-        DPRINT("Programming %i bytes", bytes_to_program);
-        blockdevice_program(bd[bd_type], current_data, current_address, bytes_to_program);
-        remaining_length -= bytes_to_program;
-        current_data += bytes_to_program;
-        current_address += bytes_to_program;
+    fs_blockdevice_types_t bd_type = header.blockdevice_index;
+    uint32_t address = header.addr + offset;
 
-    } while (remaining_length > 0);
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    // volatile files are kept in RAM anyway
+    bool write_through = (write_through_files[file_id / 8] & (1 << (file_id % 8))) || bd_type == FS_BLOCKDEVICE_TYPE_VOLATILE;
+    if(write_through || !_writeback_write(file_id, bd_type, buffer, address, length))
+        _program(bd_type, buffer, address, length);
+#else
+    _program(bd_type, buffer, address, length);
+#endif
 
     DPRINT("fs write_file (file_id %d, offset %d, addr %lu, length %d)\n",
-           file_id, offset, files[file_id].addr, length);
+           file_id, offset, header.addr, length);
 
     return 0;
 }
 
-fs_file_stat_t *fs_file_stat(uint8_t file_id)
+int fs_file_stat(uint8_t file_id, fs_file_stat_t* stat)
 {
     assert(is_fs_init_completed);
 
-    if(file_id >= FRAMEWORK_FS_FILE_COUNT)
-        return NULL;
+    if (!_is_file_defined(file_id))
+        return -ENOENT;
 
-    if (_is_file_defined(file_id))
-        return (fs_file_stat_t*)&files[file_id];
-    else
-        return NULL;
+    if (stat == NULL)
+        return 0;
+
+    fs_file_t header = _get_file_header(file_id);
+    stat->length = header.length;
+    stat->storage = header.blockdevice_index == FS_BLOCKDEVICE_TYPE_VOLATILE ? FS_STORAGE_VOLATILE : FS_STORAGE_PERMANENT;
+    return 0;
 }
@@ -34,12 +34,219 @@
 #include "framework_defs.h"
 #include "hwsystem.h"
 #include "SEGGER_RTT.h"
+#include "hwatomic.h"
+#include "scheduler.h"
+#include "errors.h"
 
 #ifdef FRAMEWORK_LOG_ENABLED
 
 
 static uint32_t NGDEF(counter);
 
+#ifdef FRAMEWORK_LOG_BINARY
+
+/*
+ * Binary logging: instead of formatting the message, a log call stores a record with the id of the format string and
+ * the raw arguments. The records are written straight into the RTT up-buffer (FRAMEWORK_LOG_OUTPUT_ON_RTT) or queued
+ * in a ring which is written to stdout by a task of the lowest priority. tools/log_decoder.py formats them on the host,
+ * text which is not part of a record (plain printf output) is passed through.
+ *
+ * ----------------------------RECORD(bytes)------------------------------
+ * |sync|length|kind|layer|counter (2)|format id (4)|arguments ...       |
+ * -----------------------------------------------------------------------
+ * The length counts the bytes after the length field. The format id is the offset of the format string to
+ * log_format_anchor, data records carry the raw bytes instead of the format id and the arguments. How an argument is
+ * stored follows from its type (see LOG_ARG_TYPE in log.h): integer and pointer arguments take 4 bytes (8 for long
+ * long, which the host expects for %ll and %j), floating point arguments 8 bytes and char pointers are copied as a
+ * length byte followed by at most LOG_STRING_ARG_MAX_SIZE characters. Multi byte values are in the byte order of the
+ * MCU.
+ */
+
+#define LOG_RECORD_SYNC 0xA5
+#define LOG_RECORD_HEADER_SIZE 6
+#define LOG_RECORD_FORMAT_ID_SIZE 4
+#define LOG_RECORD_MAX_SIZE 64
+#define LOG_STRING_ARG_MAX_SIZE 24
+
+#define LOG_RECORD_KIND_TRUNCATED    0x80 // not all arguments fit in the record
+
+// the format strings are identified by their offset to this anchor, the host resolves them using the ELF file
+const char log_format_anchor[] = "";
+
+#ifndef FRAMEWORK_LOG_OUTPUT_ON_RTT
+static uint8_t log_buffer[FRAMEWORK_LOG_BINARY_BUFFER_SIZE];
+static volatile uint16_t log_buffer_first = 0;
+static volatile uint16_t log_buffer_used = 0;
+static volatile bool log_flush_posted = false;
+
+/** @brief Writes the queued records to stdout, a contiguous part of the ring at a time
+ */
+static void log_flush(void *arg)
+{
+    start_atomic();
+    uint16_t len = sizeof(log_buffer) - log_buffer_first;
+    if(len > log_buffer_used)
+        len = log_buffer_used;
+    end_atomic();
+
+    fwrite(log_buffer + log_buffer_first, 1, len, stdout);
+
+    start_atomic();
+    log_buffer_first = (log_buffer_first + len) % sizeof(log_buffer);
+    log_buffer_used -= len;
+    log_flush_posted = log_buffer_used > 0
+        && sched_post_task_prio(&log_flush, MIN_PRIORITY, NULL) == SUCCESS;
+    end_atomic();
+
+    if(!log_flush_posted)
+        fflush(stdout);
+}
+#endif
+
+__LINK_C void log_counter_reset()
+{
+	NG(counter) = 0;
+#ifndef FRAMEWORK_LOG_OUTPUT_ON_RTT
+	sched_register_task(&log_flush);
+#endif
+}
+
+static inline uint8_t put_bytes(uint8_t* record, uint8_t offset, const void* data, uint8_t length)
+{
+    if(offset + length > LOG_RECORD_MAX_SIZE)
+    {
+        // the record ends with the last argument which fits completely
+        record[2] |= LOG_RECORD_KIND_TRUNCATED;
+        return offset;
+    }
+
+    memcpy(record + offset, data, length);
+    return offset + length;
+}
+
+/** @brief Stores the arguments of a log call, arg_types holds the LOG_ARG_* code of every argument as determined by
+ *  the log macros at compile time
+ *  @return the length of the record
+ */
+static uint8_t put_args(uint8_t* record, uint8_t offset, uint32_t arg_types, va_list args)
+{
+    for(; arg_types != 0; arg_types >>= LOG_ARG_TYPE_BITS)
+    {
+        switch(arg_types & ((1 << LOG_ARG_TYPE_BITS) - 1))
+        {
+            case LOG_ARG_INT32:
+            {
+                uint32_t value = va_arg(args, uint32_t);
+                offset = put_bytes(record, offset, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_INT64:
+            {
+                uint64_t value = va_arg(args, uint64_t);
+                offset = put_bytes(record, offset, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_WORD64:
+            {
+                uint32_t value = (uint32_t) va_arg(args, uint64_t);
+                offset = put_bytes(record, offset, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_DOUBLE:
+            {
+                double value = va_arg(args, double);
+                offset = put_bytes(record, offset, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_STRING:
+            {
+                const char* string = va_arg(args, const char*);
+                uint8_t string_length = string ? strnlen(string, LOG_STRING_ARG_MAX_SIZE) : 0;
+                uint8_t string_offset = put_bytes(record, offset + 1, string, string_length);
+                if(!(record[2] & LOG_RECORD_KIND_TRUNCATED))
+                {
+                    record[offset] = string_length;
+                    offset = string_offset;
+                }
+                break;
+            }
+        }
+
+        if(record[2] & LOG_RECORD_KIND_TRUNCATED)
+            return offset;
+    }
+
+    return offset;
+}
+
+/** @brief Completes the header of a record and queues it, a record which does not fit is dropped. The host notices
+ *  dropped records by the gap in the counter.
+ */
+static void put_record(uint8_t* record, uint8_t length)
+{
+    record[0] = LOG_RECORD_SYNC;
+    record[1] = length - 2;
+
+    start_atomic();
+    uint16_t counter = NG(counter)++;
+    memcpy(record + 4, &counter, sizeof(counter));
+#ifdef FRAMEWORK_LOG_OUTPUT_ON_RTT
+    SEGGER_RTT_WriteSkipNoLock(0, record, length);
+#else
+    if(sizeof(log_buffer) - log_buffer_used >= length)
+    {
+        uint16_t last = (log_buffer_first + log_buffer_used) % sizeof(log_buffer);
+        uint16_t first_part = sizeof(log_buffer) - last;
+        if(first_part >= length)
+            memcpy(log_buffer + last, record, length);
+        else
+        {
+            memcpy(log_buffer + last, record, first_part);
+            memcpy(log_buffer, record + first_part, length - first_part);
+        }
+
+        log_buffer_used += length;
+        if(!log_flush_posted)
+            log_flush_posted = sched_post_task_prio(&log_flush, MIN_PRIORITY, NULL) == SUCCESS;
+    }
+#endif
+    end_atomic();
+}
+
+__LINK_C void log_print_binary(uint8_t kind, uint8_t layer, uint32_t arg_types, const char* format, ...)
+{
+    uint8_t record[LOG_RECORD_MAX_SIZE];
+    record[2] = kind;
+    record[3] = layer;
+    int32_t format_id = format - log_format_anchor;
+    memcpy(record + LOG_RECORD_HEADER_SIZE, &format_id, sizeof(format_id));
+
+    va_list args;
+    va_start(args, format);
+    put_record(record, put_args(record, LOG_RECORD_HEADER_SIZE + LOG_RECORD_FORMAT_ID_SIZE, arg_types, args));
+    va_end(args);
+}
+
+__LINK_C void log_print_data(uint8_t* message, uint32_t length)
+{
+    // long data is split over several records, the host joins them
+    uint8_t record[LOG_RECORD_MAX_SIZE];
+    do
+    {
+        uint8_t chunk = LOG_RECORD_MAX_SIZE - LOG_RECORD_HEADER_SIZE;
+        if(chunk > length)
+            chunk = length;
+
+        record[2] = LOG_RECORD_KIND_DATA;
+        record[3] = length > chunk; // more data follows
+        memcpy(record + LOG_RECORD_HEADER_SIZE, message, chunk);
+        put_record(record, LOG_RECORD_HEADER_SIZE + chunk);
+        message += chunk;
+        length -= chunk;
+    } while(length > 0);
+}
+
+#else
 
 __LINK_C void log_counter_reset()
 {
@@ -85,5 +292,6 @@ void log_print_error_string(const char* format,...)
     va_end(args);
 }
 
+#endif //FRAMEWORK_LOG_BINARY
 
 #endif //FRAMEWORK_LOG_ENABLED
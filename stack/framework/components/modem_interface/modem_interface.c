@@ -40,20 +40,27 @@
 #include "ng.h"
 #include "crc.h"
 
-#include "log.h"
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+#include "platform.h" // PLATFORM_MODEM_INTERFACE_DMA_RX and PLATFORM_MODEM_INTERFACE_DMA_TX
+#endif
 
+#include "log.h"
 
-#define RX_BUFFER_SIZE 256
 
-#define TX_FIFO_FLUSH_CHUNK_SIZE 10 // at a baudrate of 115200 this ensures completion within 1 ms
-                                    // TODO baudrate dependent
+#define TX_FIFO_FLUSH_CHUNK_TIME_US 1000 // without DMA, each invocation transmits the bytes which fit in 1 ms at the configured baudrate
+#define UART_BITS_PER_BYTE 10 // start and stop bit included
 
-static uart_handle_t* uart;
+static uart_handle_t* NGDEF(_uart);
+#define uart NG(_uart)
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
-static dma_handle_t* dma_rx;
-static dma_handle_t* dma_tx;
-static uint16_t tx_size;
-static bool tx_dma_busy = false;
+static dma_handle_t* NGDEF(_dma_rx);
+#define dma_rx NG(_dma_rx)
+static dma_handle_t* NGDEF(_dma_tx);
+#define dma_tx NG(_dma_tx)
+static volatile uint16_t NGDEF(_tx_size);
+#define tx_size NG(_tx_size)
+static bool NGDEF(_tx_dma_busy);
+#define tx_dma_busy NG(_tx_dma_busy)
 #ifndef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
 _Static_assert(false, "FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES should be defined if FRAMEWORK_MODEM_INTERFACE_USE_DMA is used.");
 #endif
@@ -62,13 +69,19 @@ _Static_assert(false, "FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES should be d
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
 #define MODEM_INTERFACE_TIMEOUT            (5 * TIMER_TICKS_PER_SEC)
 #define MODEM_INTERFACE_TIMEOUT_BLOCK_TIME (5 * TIMER_TICKS_PER_MINUTE)
-static bool modem_interface_timeout_active;
-static timer_tick_t modem_interface_timeout_start_time;
+static bool NGDEF(_modem_interface_timeout_active);
+#define modem_interface_timeout_active NG(_modem_interface_timeout_active)
+static timer_tick_t NGDEF(_modem_interface_timeout_start_time);
+#define modem_interface_timeout_start_time NG(_modem_interface_timeout_start_time)
+// the receiver only processes what it received once the wake-up period ends, so a period carries whole frames and no
+// more than the RX buffer of the receiver holds
+#define SERIAL_FRAME_V0_RX_BUFFER_SIZE 256
+static uint16_t NGDEF(_tx_burst_left);
+#define tx_burst_left NG(_tx_burst_left)
+static bool NGDEF(_tx_burst_started);
+#define tx_burst_started NG(_tx_burst_started)
 #endif
 
-static uint8_t rx_buffer[RX_BUFFER_SIZE];
-static fifo_t rx_fifo;
-
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_MODEM_INTERFACE_LOG_ENABLED)
   #define DPRINT(...) log_print_string(__VA_ARGS__)
   #define DPRINT_DATA(...) log_print_data(__VA_ARGS__)
@@ -79,34 +92,176 @@ static fifo_t rx_fifo;
 
 
 #define SERIAL_FRAME_SYNC_BYTE 0xC0
-#define SERIAL_FRAME_VERSION   0x00
+#define SERIAL_FRAME_VERSION_0 0x00
+#define SERIAL_FRAME_VERSION_1 0x01
+
+// version 0 header, the sync byte is followed by the version in both versions
 #define SERIAL_FRAME_HEADER_SIZE 7
+#define SERIAL_FRAME_VERSION_INDEX 1
 #define SERIAL_FRAME_SIZE 4
 #define SERIAL_FRAME_COUNTER 2
 #define SERIAL_FRAME_TYPE 3
 #define SERIAL_FRAME_CRC1   5
 #define SERIAL_FRAME_CRC2   6
+#define SERIAL_FRAME_V0_MAX_SIZE 255
 
-#define MODEM_INTERFACE_TX_FIFO_SIZE 255
-static uint8_t modem_interface_tx_buffer[MODEM_INTERFACE_TX_FIFO_SIZE];
-static fifo_t modem_interface_tx_fifo;
-static bool request_pending = false;
+// version 1 header, the counter is the sequence number and the type is at the same place as in version 0
+#define SERIAL_FRAME_V1_HEADER_SIZE 9
+#define SERIAL_FRAME_V1_SEQ 2
+#define SERIAL_FRAME_V1_SIZE_HI 4
+#define SERIAL_FRAME_V1_SIZE_LO 5
+#define SERIAL_FRAME_V1_HCS 6
+#define SERIAL_FRAME_V1_CRC1 7
+#define SERIAL_FRAME_V1_CRC2 8
+#define SERIAL_FRAME_V1_ACK_SIZE 2
 
-uint8_t header[SERIAL_FRAME_HEADER_SIZE];
-static uint8_t payload_len = 0;
-static uint8_t packet_up_counter = 0;
-static uint8_t packet_down_counter = 0;
-static pin_id_t uart_state_pin;
-static pin_id_t target_uart_state_pin;
-static volatile uint8_t target_uart_state_isr_count;
+#define MODEM_INTERFACE_TX_FIFO_SIZE FRAMEWORK_MODEM_INTERFACE_TX_BUFFER_SIZE
+#define MODEM_INTERFACE_TX_FRAME_COUNT FRAMEWORK_MODEM_INTERFACE_TX_FRAME_COUNT
 
-static bool modem_listen_uart_inited = false;
-static bool parsed_header = false;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+#define SERIAL_FRAME_VERSION_SUPPORTED SERIAL_FRAME_VERSION_1
+#define SERIAL_FRAME_MAX_HEADER_SIZE SERIAL_FRAME_V1_HEADER_SIZE
+#define MODEM_INTERFACE_MAX_FRAME_SIZE FRAMEWORK_MODEM_INTERFACE_MAX_FRAME_SIZE
+#define MODEM_INTERFACE_WINDOW_SIZE FRAMEWORK_MODEM_INTERFACE_WINDOW_SIZE
+#define MODEM_INTERFACE_MAX_RETRANSMIT_TIMEOUTS 16 // consecutive timeouts without acknowledgement before the peer is considered lost
 
-static cmd_handler_t alp_handler;
-static cmd_handler_t ping_response_handler;
-static cmd_handler_t logging_handler;
-static target_rebooted_callback_t target_rebooted_cb;
+// room for two frames of the maximum size, so the next frame can be received while the previous one is processed
+#define RX_BUFFER_SIZE (2 * (SERIAL_FRAME_V1_HEADER_SIZE + MODEM_INTERFACE_MAX_FRAME_SIZE) > 256 ? \
+                        2 * (SERIAL_FRAME_V1_HEADER_SIZE + MODEM_INTERFACE_MAX_FRAME_SIZE) : 256)
+
+_Static_assert(MODEM_INTERFACE_MAX_FRAME_SIZE >= SERIAL_FRAME_V0_MAX_SIZE && MODEM_INTERFACE_MAX_FRAME_SIZE <= 0xFFFF,
+               "FRAMEWORK_MODEM_INTERFACE_MAX_FRAME_SIZE should be in the range [255, 65535]");
+_Static_assert(MODEM_INTERFACE_WINDOW_SIZE >= 1 && MODEM_INTERFACE_WINDOW_SIZE <= 8
+               && MODEM_INTERFACE_WINDOW_SIZE <= MODEM_INTERFACE_TX_FRAME_COUNT,
+               "FRAMEWORK_MODEM_INTERFACE_WINDOW_SIZE should be in the range [1, 8] and not exceed the TX frame count");
+#else
+// without version 1 a version request is answered with version 0, only the version 0 buffers are needed
+#define SERIAL_FRAME_VERSION_SUPPORTED SERIAL_FRAME_VERSION_0
+#define SERIAL_FRAME_MAX_HEADER_SIZE SERIAL_FRAME_HEADER_SIZE
+#define MODEM_INTERFACE_MAX_FRAME_SIZE SERIAL_FRAME_V0_MAX_SIZE
+#define RX_BUFFER_SIZE 256
+#endif
+
+_Static_assert(MODEM_INTERFACE_TX_FIFO_SIZE >= MODEM_INTERFACE_MAX_FRAME_SIZE,
+               "FRAMEWORK_MODEM_INTERFACE_TX_BUFFER_SIZE should be able to hold a frame of the maximum size");
+
+static uint8_t NGDEF(_rx_buffer)[RX_BUFFER_SIZE];
+#define rx_buffer NG(_rx_buffer)
+static fifo_t NGDEF(_rx_fifo);
+#define rx_fifo NG(_rx_fifo)
+
+// a queued frame, the header is transmitted from here and the payload straight from the TX buffer
+typedef struct
+{
+  uint8_t header[SERIAL_FRAME_MAX_HEADER_SIZE];
+  uint8_t header_len;
+  bool reliable;      // version 1 frame, kept until acknowledged by the peer
+  bool done;          // transmitted (version 0) or acknowledged (version 1), released once it is the oldest frame
+  uint16_t payload_pos; // index of the payload in modem_interface_tx_buffer
+  uint16_t payload_len;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  bool retransmit;
+  uint32_t tx_order;  // value of tx_order_counter when the last transmission of the frame completed
+#endif
+} tx_frame_t;
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+// a frame received ahead of a missing one, kept until the missing frame is retransmitted
+typedef struct
+{
+  bool valid;
+  uint8_t seq;
+  uint8_t type;
+  uint16_t length;
+  uint8_t data[MODEM_INTERFACE_MAX_FRAME_SIZE];
+} rx_reorder_slot_t;
+#endif
+
+#define TX_CURRENT_NONE 0xFF
+#define TX_CURRENT_ACK  0xFE
+
+static uint8_t NGDEF(_modem_interface_tx_buffer)[MODEM_INTERFACE_TX_FIFO_SIZE];
+#define modem_interface_tx_buffer NG(_modem_interface_tx_buffer)
+static fifo_t NGDEF(_modem_interface_tx_fifo); // the payloads of the queued frames
+#define modem_interface_tx_fifo NG(_modem_interface_tx_fifo)
+static tx_frame_t NGDEF(_tx_frames)[MODEM_INTERFACE_TX_FRAME_COUNT];
+#define tx_frames NG(_tx_frames)
+static volatile uint8_t NGDEF(_tx_frame_first);
+#define tx_frame_first NG(_tx_frame_first)
+static volatile uint8_t NGDEF(_tx_frame_count);
+#define tx_frame_count NG(_tx_frame_count)
+static volatile uint8_t NGDEF(_tx_frame_started); // the number of frames, starting from the first, transmitted at least once
+#define tx_frame_started NG(_tx_frame_started)
+static volatile uint8_t NGDEF(_tx_current); // the frame being transmitted
+#define tx_current NG(_tx_current)
+static volatile uint16_t NGDEF(_tx_current_sent); // the number of bytes of the current frame which are already transmitted
+#define tx_current_sent NG(_tx_current_sent)
+static uint16_t NGDEF(_tx_chunk_size);
+#define tx_chunk_size NG(_tx_chunk_size)
+static bool NGDEF(_request_pending);
+#define request_pending NG(_request_pending)
+static uint8_t NGDEF(_protocol_version);
+#define protocol_version NG(_protocol_version)
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+// protocol version 1 state
+static uint32_t NGDEF(_tx_order_counter);
+#define tx_order_counter NG(_tx_order_counter)
+static uint16_t NGDEF(_tx_max_payload);
+#define tx_max_payload NG(_tx_max_payload)
+static uint8_t NGDEF(_tx_seq);       // sequence number of the next queued version 1 frame
+#define tx_seq NG(_tx_seq)
+static uint8_t NGDEF(_tx_ack_seq);   // the oldest sequence number not yet acknowledged by the peer
+#define tx_ack_seq NG(_tx_ack_seq)
+static uint8_t NGDEF(_rx_next_seq);  // the next sequence number to be delivered
+#define rx_next_seq NG(_rx_next_seq)
+static volatile bool NGDEF(_ack_pending);
+#define ack_pending NG(_ack_pending)
+static uint8_t NGDEF(_ack_frame)[SERIAL_FRAME_V1_HEADER_SIZE + SERIAL_FRAME_V1_ACK_SIZE];
+#define ack_frame NG(_ack_frame)
+static uint8_t NGDEF(_retransmit_timeouts);
+#define retransmit_timeouts NG(_retransmit_timeouts)
+static timer_tick_t NGDEF(_retransmit_timeout_ticks);
+#define retransmit_timeout_ticks NG(_retransmit_timeout_ticks)
+#if MODEM_INTERFACE_WINDOW_SIZE > 1
+static rx_reorder_slot_t NGDEF(_rx_reorder_slots)[MODEM_INTERFACE_WINDOW_SIZE - 1];
+#define rx_reorder_slots NG(_rx_reorder_slots)
+#endif
+#endif
+
+static modem_interface_stats_t NGDEF(_stats);
+#define stats NG(_stats)
+
+static uint8_t NGDEF(_rx_header)[SERIAL_FRAME_MAX_HEADER_SIZE];
+#define rx_header NG(_rx_header)
+static uint8_t NGDEF(_rx_header_len);
+#define rx_header_len NG(_rx_header_len)
+static uint16_t NGDEF(_rx_payload_len);
+#define rx_payload_len NG(_rx_payload_len)
+static uint8_t NGDEF(_packet_up_counter);
+#define packet_up_counter NG(_packet_up_counter)
+static uint8_t NGDEF(_packet_down_counter);
+#define packet_down_counter NG(_packet_down_counter)
+static pin_id_t NGDEF(_uart_state_pin);
+#define uart_state_pin NG(_uart_state_pin)
+static pin_id_t NGDEF(_target_uart_state_pin);
+#define target_uart_state_pin NG(_target_uart_state_pin)
+static volatile uint8_t NGDEF(_target_uart_state_isr_count);
+#define target_uart_state_isr_count NG(_target_uart_state_isr_count)
+
+static bool NGDEF(_modem_listen_uart_inited);
+#define modem_listen_uart_inited NG(_modem_listen_uart_inited)
+static bool NGDEF(_parsed_header);
+#define parsed_header NG(_parsed_header)
+
+static cmd_handler_t NGDEF(_alp_handler);
+#define alp_handler NG(_alp_handler)
+static cmd_handler_t NGDEF(_ping_response_handler);
+#define ping_response_handler NG(_ping_response_handler)
+static cmd_handler_t NGDEF(_logging_handler);
+#define logging_handler NG(_logging_handler)
+static target_rebooted_callback_t NGDEF(_target_rebooted_cb);
+#define target_rebooted_cb NG(_target_rebooted_cb)
 
 typedef enum {
   STATE_IDLE,
@@ -118,7 +273,8 @@ typedef enum {
   STATE_REC
 } state_t;
 
-static state_t state = STATE_IDLE;
+static state_t NGDEF(_state);
+#define state NG(_state)
 
 #define SWITCH_STATE(s) do { \
   state = s; \
@@ -127,6 +283,7 @@ static state_t state = STATE_IDLE;
 
 static void process_rx_fifo(void *arg);
 static void execute_state_machine();
+static void flush_modem_interface_tx_fifo(void *arg);
 
 
 /** @Brief Enable UART interface and UART interrupt
@@ -165,48 +322,425 @@ static void modem_interface_disable(void)
 }
 
 /** @brief Lets receiver know that 
- *  all the data has been transfered
+ *  all the data has been transfered. The UART stays enabled until the receiver reacts, the receiver may have
+ *  requested a wake-up period at the same time and still be transmitting.
  *  @return void
  */
 static void release_receiver()
 {
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
   DPRINT("release receiver\n");
-  modem_interface_disable();
   hw_gpio_clr(uart_state_pin);
+  // frames queued from now on wait for the next wake-up period
+  tx_burst_left = 0;
+  tx_burst_started = true;
+#endif
+}
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
+/** @brief Starts a wake-up period of the receiver. Its RX buffer holds two frames of the negotiated size with version
+ *  1, a version 0 peer only has SERIAL_FRAME_V0_RX_BUFFER_SIZE bytes.
+ *  @return void
+ */
+static void start_tx_burst()
+{
+  tx_burst_left = SERIAL_FRAME_V0_RX_BUFFER_SIZE;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(protocol_version == SERIAL_FRAME_VERSION_1)
+    tx_burst_left = 2 * (SERIAL_FRAME_V1_HEADER_SIZE + tx_max_payload);
 #endif
+  tx_burst_started = false;
 }
+#endif
 
-/** @brief transmit data in fifo to UART
+/** @brief Feeds the payload of a queued frame, which can wrap around in the TX buffer, to a CRC calculation
  *  @return void
  */
-static void flush_modem_interface_tx_fifo(void *arg) 
+static void crc_update_tx_payload(crc_ctx_t* crc_ctx, tx_frame_t* frame)
 {
-  uint8_t len = fifo_get_size(&modem_interface_tx_fifo);
+  uint16_t first_part = MODEM_INTERFACE_TX_FIFO_SIZE - frame->payload_pos;
+  if(first_part >= frame->payload_len)
+  {
+    crc_update(crc_ctx, modem_interface_tx_buffer + frame->payload_pos, frame->payload_len);
+  }
+  else
+  {
+    crc_update(crc_ctx, modem_interface_tx_buffer + frame->payload_pos, first_part);
+    crc_update(crc_ctx, modem_interface_tx_buffer, frame->payload_len - first_part);
+  }
+}
 
-#ifdef HAL_UART_USE_DMA_TX
-  // when using DMA we transmit the whole FIFO at once
-  uint8_t buffer[MODEM_INTERFACE_TX_FIFO_SIZE];
-  fifo_pop(&modem_interface_tx_fifo, buffer, len);
-  uart_send_bytes(uart, buffer, len);
-#elif defined(FRAMEWORK_MODEM_INTERFACE_USE_DMA)
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+/** @brief Fills in the header of a version 1 frame, the CRC covers the header fields and the payload
+ *  @return void
+ */
+static void build_v1_header(uint8_t* frame_header, uint8_t seq, uint8_t type, uint16_t length)
+{
+  frame_header[0] = SERIAL_FRAME_SYNC_BYTE;
+  frame_header[SERIAL_FRAME_VERSION_INDEX] = SERIAL_FRAME_VERSION_1;
+  frame_header[SERIAL_FRAME_V1_SEQ] = seq;
+  frame_header[SERIAL_FRAME_TYPE] = type;
+  frame_header[SERIAL_FRAME_V1_SIZE_HI] = length >> 8;
+  frame_header[SERIAL_FRAME_V1_SIZE_LO] = length & 0xFF;
+
+  uint8_t sum = 0;
+  for(uint8_t i = SERIAL_FRAME_VERSION_INDEX; i <= SERIAL_FRAME_V1_SIZE_LO; i++)
+    sum += frame_header[i];
+
+  frame_header[SERIAL_FRAME_V1_HCS] = ~sum;
+}
+#endif
+
+/** @brief Builds the header of a queued frame, for the given protocol version. Version 1 frames get the next
+ *  sequence number.
+ *  @return void
+ */
+static void build_tx_header(tx_frame_t* frame, uint8_t version, uint8_t type)
+{
+  crc_ctx_t crc_ctx;
+  crc_init(&crc_ctx);
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(version == SERIAL_FRAME_VERSION_1)
+  {
+    build_v1_header(frame->header, tx_seq++, type, frame->payload_len);
+    crc_update(&crc_ctx, frame->header + SERIAL_FRAME_VERSION_INDEX, SERIAL_FRAME_V1_SIZE_LO);
+    crc_update_tx_payload(&crc_ctx, frame);
+    uint16_t crc = crc_final(&crc_ctx);
+    frame->header[SERIAL_FRAME_V1_CRC1] = (crc >> 8) & 0x00FF;
+    frame->header[SERIAL_FRAME_V1_CRC2] = crc & 0x00FF;
+    frame->header_len = SERIAL_FRAME_V1_HEADER_SIZE;
+    frame->reliable = true;
+    return;
+  }
+#endif
+
+  crc_update_tx_payload(&crc_ctx, frame);
+  uint16_t crc = crc_final(&crc_ctx);
+  packet_up_counter++;
+  frame->header[0] = SERIAL_FRAME_SYNC_BYTE;
+  frame->header[SERIAL_FRAME_VERSION_INDEX] = SERIAL_FRAME_VERSION_0;
+  frame->header[SERIAL_FRAME_COUNTER] = packet_up_counter;
+  frame->header[SERIAL_FRAME_TYPE] = type;
+  frame->header[SERIAL_FRAME_SIZE] = frame->payload_len;
+  frame->header[SERIAL_FRAME_CRC1] = (crc >> 8) & 0x00FF;
+  frame->header[SERIAL_FRAME_CRC2] = crc & 0x00FF;
+  frame->header_len = SERIAL_FRAME_HEADER_SIZE;
+  frame->reliable = false;
+}
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+/** @brief Builds the acknowledgement of the received version 1 frames: the next expected sequence number, followed by
+ *  a bitmap of the frames received after it (bit i set means next_expected + 1 + i is received).
+ *  @return void
+ */
+static void build_ack_frame()
+{
+  uint8_t* payload = ack_frame + SERIAL_FRAME_V1_HEADER_SIZE;
+  payload[0] = rx_next_seq;
+  payload[1] = 0;
+#if MODEM_INTERFACE_WINDOW_SIZE > 1
+  for(uint8_t i = 0; i < MODEM_INTERFACE_WINDOW_SIZE - 1; i++)
+  {
+    if(rx_reorder_slots[i].valid)
+      payload[1] |= 1 << (uint8_t)(rx_reorder_slots[i].seq - rx_next_seq - 1);
+  }
+#endif
+
+  build_v1_header(ack_frame, 0, SERIAL_MESSAGE_TYPE_ACK, SERIAL_FRAME_V1_ACK_SIZE);
+  crc_ctx_t crc_ctx;
+  crc_init(&crc_ctx);
+  crc_update(&crc_ctx, ack_frame + SERIAL_FRAME_VERSION_INDEX, SERIAL_FRAME_V1_SIZE_LO);
+  crc_update(&crc_ctx, payload, SERIAL_FRAME_V1_ACK_SIZE);
+  uint16_t crc = crc_final(&crc_ctx);
+  ack_frame[SERIAL_FRAME_V1_CRC1] = (crc >> 8) & 0x00FF;
+  ack_frame[SERIAL_FRAME_V1_CRC2] = crc & 0x00FF;
+}
+
+/** @brief Returns true when a version 1 frame does not fit in the window of unacknowledged frames yet
+ *  @return bool
+ */
+static inline bool outside_window(tx_frame_t* frame)
+{
+  return frame->reliable
+         && (uint8_t)(frame->header[SERIAL_FRAME_V1_SEQ] - tx_ack_seq) >= MODEM_INTERFACE_WINDOW_SIZE;
+}
+#endif
+
+/** @brief Releases the oldest frames which are transmitted (version 0) or acknowledged (version 1), in queue order so
+ *  the TX buffer stays a fifo. A frame which is still on the line is kept.
+ *  @return void
+ */
+static void release_done_frames()
+{
+  while(tx_frame_count > 0 && tx_frames[tx_frame_first].done && tx_current != tx_frame_first)
+  {
+    fifo_skip(&modem_interface_tx_fifo, tx_frames[tx_frame_first].payload_len);
+    tx_frame_first = (tx_frame_first + 1) % MODEM_INTERFACE_TX_FRAME_COUNT;
+    tx_frame_count--;
+    if(tx_frame_started > 0)
+      tx_frame_started--; // not started when dropped before its first transmission
+  }
+}
+
+/** @brief Reserves room for a frame in the current wake-up period of the receiver. The first frame of a period is
+ *  always sent, so a frame larger than the RX buffer of a version 0 peer does not block the queue.
+ *  @return true when the frame is sent in this period
+ */
+static bool reserve_tx_burst(uint16_t size)
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
+  if(size > tx_burst_left && tx_burst_started)
+    return false;
+
+  tx_burst_left = size < tx_burst_left ? tx_burst_left - size : 0;
+  tx_burst_started = true;
+#endif
+  return true;
+}
+
+/** @brief Picks the frame to transmit next: a pending acknowledgement first, then frames to retransmit (oldest first)
+ *  and finally the next new frame, as long as it fits in the window of unacknowledged frames and, with interrupt
+ *  lines, in the current wake-up period.
+ *  @return true if a frame is selected
+ */
+static bool select_tx_frame()
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(ack_pending)
+  {
+    if(!reserve_tx_burst(sizeof(ack_frame)))
+      return false;
+
+    ack_pending = false;
+    build_ack_frame();
+    tx_current = TX_CURRENT_ACK;
+    return true;
+  }
+
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    uint8_t index = (tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT;
+    if(tx_frames[index].retransmit)
+    {
+      if(!tx_frames[index].done && !reserve_tx_burst(tx_frames[index].header_len + tx_frames[index].payload_len))
+        return false;
+
+      tx_frames[index].retransmit = false;
+      if(!tx_frames[index].done)
+      {
+        tx_current = index;
+        stats.frames_retransmitted++;
+        return true;
+      }
+    }
+  }
+#endif
+
+  while(tx_frame_started < tx_frame_count)
+  {
+    uint8_t index = (tx_frame_first + tx_frame_started) % MODEM_INTERFACE_TX_FRAME_COUNT;
+    if(tx_frames[index].done)
+    {
+      tx_frame_started++; // dropped before its first transmission
+      continue;
+    }
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+    if(outside_window(&tx_frames[index]))
+      return false; // window full, wait for an acknowledgement
+#endif
+
+    if(!reserve_tx_burst(tx_frames[index].header_len + tx_frames[index].payload_len))
+      return false;
+
+    tx_frame_started++;
+    tx_current = index;
+    stats.frames_transmitted++;
+    return true;
+  }
+
+  return false;
+}
+
+/** @brief Returns true when there is something to transmit, or when a frame is still being transmitted
+ *  @return bool
+ */
+static bool tx_pending()
+{
+  if(tx_current != TX_CURRENT_NONE)
+    return true;
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(ack_pending)
+    return true;
+
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    if(tx_frames[(tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT].retransmit)
+      return true;
+  }
+
+  if(tx_frame_started < tx_frame_count)
+  {
+    tx_frame_t* frame = &tx_frames[(tx_frame_first + tx_frame_started) % MODEM_INTERFACE_TX_FRAME_COUNT];
+    return frame->done || !outside_window(frame);
+  }
+
+  return false;
+#else
+  return tx_frame_started < tx_frame_count;
+#endif
+}
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+/** @brief Returns true when version 1 frames are transmitted but not yet acknowledged
+ *  @return bool
+ */
+static bool frames_in_flight()
+{
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    tx_frame_t* frame = &tx_frames[(tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT];
+    if(frame->reliable && !frame->done)
+      return true;
+  }
+
+  return false;
+}
+#endif
+
+/** @brief Gets the next part of the queued frames to transmit, which is either (the rest of) the header of the current
+ *  frame or a part of its payload which is contiguous in the TX buffer. No data is copied.
+ *  @return the length of the part, 0 when there is nothing to transmit
+ */
+static uint16_t get_tx_segment(uint8_t** data)
+{
+  if(tx_current == TX_CURRENT_NONE && !select_tx_frame())
+    return 0;
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(tx_current == TX_CURRENT_ACK)
+  {
+    *data = ack_frame + tx_current_sent;
+    return sizeof(ack_frame) - tx_current_sent;
+  }
+#endif
+
+  tx_frame_t* frame = &tx_frames[tx_current];
+  if(tx_current_sent < frame->header_len)
+  {
+    *data = frame->header + tx_current_sent;
+    return frame->header_len - tx_current_sent;
+  }
+
+  uint16_t offset = tx_current_sent - frame->header_len;
+  uint16_t pos = (frame->payload_pos + offset) % MODEM_INTERFACE_TX_FIFO_SIZE;
+  uint16_t remaining = frame->payload_len - offset;
+  uint16_t len = MODEM_INTERFACE_TX_FIFO_SIZE - pos;
+  *data = modem_interface_tx_buffer + pos;
+  return len < remaining ? len : remaining;
+}
+
+/** @brief Marks len bytes of the segment returned by get_tx_segment() as transmitted
+ *  @return void
+ */
+static void advance_tx(uint16_t len)
+{
+  tx_current_sent += len;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(tx_current == TX_CURRENT_ACK)
+  {
+    if(tx_current_sent == sizeof(ack_frame))
+    {
+      tx_current = TX_CURRENT_NONE;
+      tx_current_sent = 0;
+    }
+    return;
+  }
+#endif
+
+  tx_frame_t* frame = &tx_frames[tx_current];
+  if(tx_current_sent == frame->header_len + frame->payload_len)
+  {
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+    frame->tx_order = ++tx_order_counter;
+#endif
+    if(!frame->reliable)
+      frame->done = true;
+
+    tx_current = TX_CURRENT_NONE;
+    tx_current_sent = 0;
+    release_done_frames();
+  }
+}
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+/** @brief Starts a DMA transfer of the next segment. Called from the DMA complete interrupt as well, so the segments
+ *  of all queued frames are chained without waiting for the flush task.
+ *  @return void
+ */
+static void start_tx_dma()
+{
+  uint8_t* data;
+  tx_size = get_tx_segment(&data);
+  if(tx_size == 0)
+  {
+    tx_dma_busy = false;
+    return;
+  }
+
+  tx_dma_busy = true;
+  uart_send_bytes_via_DMA(uart, data, tx_size, PLATFORM_MODEM_INTERFACE_DMA_TX);
+}
+#endif
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+static void retransmit_timeout(void *arg);
+#endif
+
+/** @brief Starts the retransmission timer when version 1 frames are waiting for an acknowledgement
+ *  @return void
+ */
+static void arm_retransmit_timer()
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(frames_in_flight() && !timer_is_task_scheduled(&retransmit_timeout))
+    timer_post_task_delay(&retransmit_timeout, retransmit_timeout_ticks);
+#endif
+}
+
+/** @brief Requests a transmission of the queued frames
+ *  @return void
+ */
+static void schedule_tx()
+{
+  request_pending = true;
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
+  sched_post_task_prio(&execute_state_machine, MIN_PRIORITY, NULL);
+#else
+  sched_post_task_prio(&flush_modem_interface_tx_fifo, MIN_PRIORITY, NULL); // state machine is not used when not using interrupt lines
+#endif
+}
+
+/** @brief transmit the queued frames to UART
+ *  @return void
+ */
+static void flush_modem_interface_tx_fifo(void *arg) 
+{
+#if defined(FRAMEWORK_MODEM_INTERFACE_USE_DMA) && !defined(HAL_UART_USE_DMA_TX)
   //Execute atomic, otherwise there is a chance that the DMA complete callback is called during execution of this code.
   // If that would happen a DMA transfer with length 0 is started which will not trigger a complete callback
-  // This means that we have to fetch the data size inside the fifo inside the atomic part again
   start_atomic();
-  len = fifo_get_size(&modem_interface_tx_fifo);
-  if(len > 0)
+  if(!tx_dma_busy && tx_pending())
+  {
+    assert(dma_channel_enable(dma_tx));
+    dma_channel_interrupt_enable(dma_tx);
+    start_tx_dma();
+  }
+
+  // nothing is started when the wake-up period is full, the rest is sent in the next one
+  if(tx_dma_busy)
   {
-    //log_print_string("flush %d", tx_dma_busy);
-    if(!tx_dma_busy)
-    {
-      assert(dma_channel_enable(dma_tx));
-      dma_channel_interrupt_enable(dma_tx);
-      uint8_t* buffer;
-      fifo_get_continuos_raw_data(&modem_interface_tx_fifo, &buffer, &tx_size);
-      uart_send_bytes_via_DMA(uart, buffer, tx_size, PLATFORM_MODEM_INTERFACE_DMA_TX);
-      tx_dma_busy = true;
-    }
     //To keep awake
     sched_post_task_prio(&flush_modem_interface_tx_fifo, MIN_PRIORITY, NULL);
   }
@@ -217,32 +751,188 @@ static void flush_modem_interface_tx_fifo(void *arg)
     release_receiver();
     sched_post_task(&execute_state_machine);
   }
+  arm_retransmit_timer();
   end_atomic();
+#else
+#ifdef HAL_UART_USE_DMA_TX
+  // when the UART driver uses DMA we transmit all queued frames at once
+  uint16_t budget = UINT16_MAX;
 #else
   // only send small chunks over uart each invocation, to make sure
   // we don't interfer with critical stack timings.
   // When there is still data left in the fifo this will be rescheduled
   // with lowest prio
-  uint8_t chunk[TX_FIFO_FLUSH_CHUNK_SIZE];
-  if(len <= TX_FIFO_FLUSH_CHUNK_SIZE)
+  uint16_t budget = tx_chunk_size;
+#endif
+  uint8_t* data;
+  uint16_t len = 0;
+  while(budget > 0 && (len = get_tx_segment(&data)) > 0)
+  {
+    if(len > budget)
+      len = budget;
+
+    uart_send_bytes(uart, data, len);
+    advance_tx(len);
+    budget -= len;
+  }
+
+  arm_retransmit_timer();
+  // done when nothing can be transmitted now, with interrupt lines the rest is sent in the next wake-up period
+  if(len == 0)
   {
-    fifo_pop(&modem_interface_tx_fifo, chunk, len);
-    uart_send_bytes(uart, chunk, len);
     request_pending = false;
     release_receiver();
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
     sched_post_task(&execute_state_machine);
 #endif
-  } 
-  else 
-  {
-    fifo_pop(&modem_interface_tx_fifo, chunk, TX_FIFO_FLUSH_CHUNK_SIZE);
-    uart_send_bytes(uart, chunk, TX_FIFO_FLUSH_CHUNK_SIZE);
+  }
+  else
     sched_post_task_prio(&flush_modem_interface_tx_fifo, MIN_PRIORITY, NULL);
+#endif
+}
+
+/** @brief Drops the version 1 frames which are transmitted but not acknowledged and rebuilds the headers of the
+ *  version 1 frames which are not transmitted yet for the given protocol version. Called when the protocol version
+ *  is (re)negotiated or when the peer is lost, the sequence numbers restart from 0 on both sides.
+ *  @return void
+ */
+static void set_protocol_version(uint8_t version, uint16_t peer_max_frame_size)
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  start_atomic();
+  protocol_version = version;
+  tx_max_payload = SERIAL_FRAME_V0_MAX_SIZE;
+  if(version == SERIAL_FRAME_VERSION_1)
+    tx_max_payload = peer_max_frame_size < MODEM_INTERFACE_MAX_FRAME_SIZE ? peer_max_frame_size : MODEM_INTERFACE_MAX_FRAME_SIZE;
+
+  tx_seq = 0;
+  tx_ack_seq = 0;
+  rx_next_seq = 0;
+  ack_pending = false;
+  retransmit_timeouts = 0;
+#if MODEM_INTERFACE_WINDOW_SIZE > 1
+  for(uint8_t i = 0; i < MODEM_INTERFACE_WINDOW_SIZE - 1; i++)
+    rx_reorder_slots[i].valid = false;
+#endif
+
+  for(uint8_t i = 0; i < tx_frame_count; i++)
+  {
+    tx_frame_t* frame = &tx_frames[(tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT];
+    if(!frame->reliable || frame->done)
+      continue;
+
+    frame->retransmit = false;
+    if(i < tx_frame_started || (version == SERIAL_FRAME_VERSION_0 && frame->payload_len > SERIAL_FRAME_V0_MAX_SIZE))
+    {
+      frame->done = true;
+      stats.frames_dropped++;
+    }
+    else
+      build_tx_header(frame, version, frame->header[SERIAL_FRAME_TYPE]);
   }
+
+  release_done_frames();
+  end_atomic();
+
+  timer_cancel_task(&retransmit_timeout);
+  DPRINT("protocol version %i, max frame size %i", version, tx_max_payload);
 #endif
 }
 
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+
+/** @brief Retransmits all unacknowledged frames when no acknowledgement is received in time. After
+ *  MODEM_INTERFACE_MAX_RETRANSMIT_TIMEOUTS timeouts without progress the peer is considered lost and the interface
+ *  falls back to protocol version 0.
+ *  @return void
+ */
+static void retransmit_timeout(void *arg)
+{
+  if(!frames_in_flight())
+    return;
+
+  if(++retransmit_timeouts > MODEM_INTERFACE_MAX_RETRANSMIT_TIMEOUTS)
+  {
+    log_print_string("modem_interface peer not acknowledging, fall back to protocol version 0");
+    set_protocol_version(SERIAL_FRAME_VERSION_0, 0);
+    return;
+  }
+
+  start_atomic();
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    uint8_t index = (tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT;
+    if(tx_frames[index].reliable && !tx_frames[index].done && index != tx_current)
+      tx_frames[index].retransmit = true;
+  }
+  end_atomic();
+
+  DPRINT("retransmit timeout");
+  timer_post_task_delay(&retransmit_timeout, retransmit_timeout_ticks);
+  schedule_tx();
+}
+
+/** @brief Processes an acknowledgement of the peer. Frames before the next expected sequence number and the frames
+ *  in the selective acknowledgement bitmap are released. Unacknowledged frames which were transmitted before an
+ *  acknowledged one are lost and are retransmitted right away, without waiting for the retransmission timer.
+ *  @return void
+ */
+static void process_ack(uint8_t next_expected, uint8_t sack_bitmap)
+{
+  start_atomic();
+  uint8_t acked = next_expected - tx_ack_seq;
+  if(acked > (uint8_t)(tx_seq - tx_ack_seq))
+  {
+    end_atomic();
+    DPRINT("ignore ack for %i", next_expected);
+    return; // outside of the window, a stale acknowledgement
+  }
+
+  bool progress = false;
+  uint32_t highest_acked_order = 0;
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    tx_frame_t* frame = &tx_frames[(tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT];
+    if(!frame->reliable || frame->done)
+      continue;
+
+    uint8_t seq = frame->header[SERIAL_FRAME_V1_SEQ];
+    uint8_t sack_bit = seq - next_expected - 1;
+    if((uint8_t)(seq - tx_ack_seq) < acked || (sack_bit < 8 && (sack_bitmap & (1 << sack_bit))))
+    {
+      frame->done = true;
+      frame->retransmit = false;
+      progress = true;
+      if(frame->tx_order > highest_acked_order)
+        highest_acked_order = frame->tx_order;
+    }
+  }
+
+  tx_ack_seq = next_expected;
+  for(uint8_t i = 0; i < tx_frame_started; i++)
+  {
+    uint8_t index = (tx_frame_first + i) % MODEM_INTERFACE_TX_FRAME_COUNT;
+    tx_frame_t* frame = &tx_frames[index];
+    if(frame->reliable && !frame->done && index != tx_current && frame->tx_order < highest_acked_order)
+      frame->retransmit = true;
+  }
+
+  release_done_frames();
+  bool pending = tx_pending();
+  end_atomic();
+
+  if(progress)
+  {
+    retransmit_timeouts = 0;
+    timer_cancel_task(&retransmit_timeout);
+    arm_retransmit_timer();
+  }
+
+  if(pending)
+    schedule_tx();
+}
+#endif
+
 /** @Brief Keeps µC awake while receiving UART data
  *  @return void
  */
@@ -293,6 +983,19 @@ static inline void clear_modem_interface_timeout()
 }
 #endif
 
+/** @brief Processes the data received in a wake-up period, once it has ended
+ *  @return void
+ */
+static void process_received_burst()
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+  size_t received_bytes = uart_stop_read_bytes_via_DMA(uart);
+  if(received_bytes > 0)
+    fifo_init_filled(&rx_fifo, rx_buffer, received_bytes, RX_BUFFER_SIZE);
+#endif
+  sched_post_task(&process_rx_fifo);
+}
+
 /** @Brief Handles the different states of the modem interrupt line handshake mechanism
  *  @return void
  */
@@ -323,11 +1026,7 @@ static void execute_state_machine()
     case STATE_RESP:
     {
       // response period completed, process the request
-#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
-      size_t received_bytes = uart_stop_read_bytes_via_DMA(uart);
-      fifo_init_filled(&rx_fifo, rx_buffer, received_bytes, RX_BUFFER_SIZE);
-#endif
-      sched_post_task(&process_rx_fifo);
+      process_received_burst();
       if(request_pending) {
         SWITCH_STATE(STATE_RESP_PENDING_REQ);
         sched_post_task(&execute_state_machine);
@@ -383,6 +1082,7 @@ static void execute_state_machine()
         target_uart_state_isr_count = 0;
         clear_modem_interface_timeout();
         // receiver active
+        start_tx_burst();
         SWITCH_STATE(STATE_REQ_BUSY);
         // fall-through to STATE_REQ_BUSY!
       } else {
@@ -412,6 +1112,10 @@ static void execute_state_machine()
       {
           clear_modem_interface_timeout();
         target_uart_state_isr_count = 0;
+        request_pending = tx_pending(); // what did not fit in the wake-up period is requested again
+        // when both ends requested a wake-up period at the same time, both transmitted and received
+        process_received_burst();
+        modem_interface_disable();
         SWITCH_STATE(STATE_IDLE);
         sched_post_task(&execute_state_machine);
       } else{
@@ -442,28 +1146,50 @@ static void execute_state_machine()
  */
 static bool verify_payload(fifo_t* bytes, uint8_t* frame_header)
 {
-  static uint8_t payload[RX_BUFFER_SIZE - SERIAL_FRAME_HEADER_SIZE]; // statically allocated so this does not end up on stack
-  fifo_peek(bytes, payload, 0, frame_header[SERIAL_FRAME_SIZE]);
+  uint8_t chunk[16];
+  crc_ctx_t crc_ctx;
+  uint8_t crc1 = SERIAL_FRAME_CRC1;
 
-  //check for missing packages
-  packet_down_counter++;
-  if(frame_header[SERIAL_FRAME_COUNTER]!=packet_down_counter)
+  crc_init(&crc_ctx);
+  if(frame_header[SERIAL_FRAME_VERSION_INDEX] == SERIAL_FRAME_VERSION_0)
+  {
+    //check for missing packages, version 1 frames are sequenced and acknowledged instead
+    packet_down_counter++;
+    if(frame_header[SERIAL_FRAME_COUNTER]!=packet_down_counter)
+    {
+      log_print_string("!!! missed packages: %i",(frame_header[SERIAL_FRAME_COUNTER]-packet_down_counter));
+      packet_down_counter=frame_header[SERIAL_FRAME_COUNTER]; //reset package counter
+    }
+  }
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  else
   {
-    //TODO consequence? (save total missing packages?)
-    log_print_string("!!! missed packages: %i",(frame_header[SERIAL_FRAME_COUNTER]-packet_down_counter));
-    packet_down_counter=frame_header[SERIAL_FRAME_COUNTER]; //reset package counter
+    crc_update(&crc_ctx, frame_header + SERIAL_FRAME_VERSION_INDEX, SERIAL_FRAME_V1_SIZE_LO);
+    crc1 = SERIAL_FRAME_V1_CRC1;
   }
+#endif
 
   DPRINT("RX HEADER: ");
-  DPRINT_DATA(frame_header, SERIAL_FRAME_HEADER_SIZE);
+  DPRINT_DATA(frame_header, rx_header_len);
   DPRINT("RX PAYLOAD: ");
-  DPRINT_DATA(payload, frame_header[SERIAL_FRAME_SIZE]);
 
-  uint16_t calculated_crc = crc_calculate(payload, frame_header[SERIAL_FRAME_SIZE]);
+  // the payload is fed to the CRC straight from the fifo, in small chunks
+  uint16_t length = fifo_get_size(bytes);
+  for(uint16_t offset = 0; offset < length; offset += sizeof(chunk))
+  {
+    uint16_t chunk_len = length - offset;
+    if(chunk_len > sizeof(chunk))
+      chunk_len = sizeof(chunk);
+
+    fifo_peek(bytes, chunk, offset, chunk_len);
+    DPRINT_DATA(chunk, chunk_len);
+    crc_update(&crc_ctx, chunk, chunk_len);
+  }
+
+  uint16_t calculated_crc = crc_final(&crc_ctx);
  
-  if(frame_header[SERIAL_FRAME_CRC1]!=((calculated_crc >> 8) & 0x00FF) || frame_header[SERIAL_FRAME_CRC2]!=(calculated_crc & 0x00FF))
+  if(frame_header[crc1]!=((calculated_crc >> 8) & 0x00FF) || frame_header[crc1 + 1]!=(calculated_crc & 0x00FF))
   {
-    //TODO consequence? (request repeat?)
     log_print_string("CRC incorrect!");
     return false;
   }
@@ -480,7 +1206,7 @@ void modem_interface_clear_handler() {
 
     //clear RX
     parsed_header = false;
-    payload_len = 0;
+    rx_payload_len = 0;
     fifo_clear(&rx_fifo);
 
     //clear TX
@@ -491,6 +1217,12 @@ void modem_interface_clear_handler() {
     target_uart_state_isr_count = 0;
     request_pending = false;
     fifo_clear(&modem_interface_tx_fifo);
+    tx_frame_first = 0;
+    tx_frame_count = 0;
+    tx_frame_started = 0;
+    tx_current = TX_CURRENT_NONE;
+    tx_current_sent = 0;
+    set_protocol_version(SERIAL_FRAME_VERSION_0, 0);
     //AL-2305 be sure to clear request pin
     hw_gpio_clr(uart_state_pin);
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
@@ -504,105 +1236,313 @@ static void uart_error_callback(uart_error_t error) {
     log_print_string("UART ERROR %i", error);
     if(error == UART_OVERRUN_ERROR) {
       parsed_header = false;
-      payload_len = 0;
+      rx_payload_len = 0;
       fifo_clear(&rx_fifo);
     }
 }
 
-/** @Brief Processes received uart data
- * 1) Search for sync bytes (always)
- * 2) get header size and parse header
- * 3) Wait for correct # of bytes (length present in header)
- * 4) Execute crc check and check message counter
- * 5) send to corresponding service (alp, ping service, log service)
+/** @Brief Passes a received frame to the corresponding service (alp, ping service, log service)
  *  @return void
  */
-static void process_rx_fifo(void *arg) 
+static void dispatch_frame(uint8_t type, fifo_t* payload_fifo)
 {
-  if(!parsed_header) 
+  if(type==SERIAL_MESSAGE_TYPE_ALP_DATA && alp_handler != NULL)
+    alp_handler(payload_fifo);
+  else if (type==SERIAL_MESSAGE_TYPE_PING_RESPONSE)
   {
-    if(fifo_get_size(&rx_fifo) > SERIAL_FRAME_HEADER_SIZE) 
+    // a response to a version request carries the agreed version and the maximum frame size of the peer
+    uint8_t response[4];
+    if(fifo_get_size(payload_fifo) >= sizeof(response))
     {
-        fifo_peek(&rx_fifo, header, 0, SERIAL_FRAME_HEADER_SIZE);
-
-        if(header[0] != SERIAL_FRAME_SYNC_BYTE || header[1] != SERIAL_FRAME_VERSION) 
-        {
-          fifo_skip(&rx_fifo, 1);
-          DPRINT("skip");
-          parsed_header = false;
-          payload_len = 0;
-          if(fifo_get_size(&rx_fifo) > SERIAL_FRAME_HEADER_SIZE)
-            sched_post_task(&process_rx_fifo);
-          return;
-        }
-        parsed_header = true;
-        fifo_skip(&rx_fifo, SERIAL_FRAME_HEADER_SIZE);
-        payload_len = header[SERIAL_FRAME_SIZE];
-        DPRINT("UART RX, payload size = %i", payload_len);
-        sched_post_task(&process_rx_fifo);
+      fifo_peek(payload_fifo, response, 0, sizeof(response));
+      set_protocol_version(response[1] == SERIAL_FRAME_VERSION_SUPPORTED ? SERIAL_FRAME_VERSION_SUPPORTED : SERIAL_FRAME_VERSION_0,
+                           (response[2] << 8) | response[3]);
     }
+
+    if(ping_response_handler != NULL)
+      ping_response_handler(payload_fifo);
   }
-  else 
+  else if (type==SERIAL_MESSAGE_TYPE_LOGGING && logging_handler != NULL)
+    logging_handler(payload_fifo);
+  else if (type==SERIAL_MESSAGE_TYPE_PING_REQUEST)
   {
-    if(fifo_get_size(&rx_fifo) < payload_len) {
-      return;
-    }
-    // payload complete, start parsing
-    // rx_fifo can be bigger than the current serial packet, init a subview fifo
-    // which is restricted to payload_len so we can't parse past this packet.
-    fifo_t payload_fifo;
-    fifo_init_subview(&payload_fifo, &rx_fifo, 0, payload_len);
-  
-    if(verify_payload(&payload_fifo,header))
-    {
-      if(header[SERIAL_FRAME_TYPE]==SERIAL_MESSAGE_TYPE_ALP_DATA && alp_handler != NULL)
-        alp_handler(&payload_fifo);
-      else if (header[SERIAL_FRAME_TYPE]==SERIAL_MESSAGE_TYPE_PING_RESPONSE  && ping_response_handler != NULL)
-        ping_response_handler(&payload_fifo);
-      else if (header[SERIAL_FRAME_TYPE]==SERIAL_MESSAGE_TYPE_LOGGING && logging_handler != NULL)
-        logging_handler(&payload_fifo);
-      else if (header[SERIAL_FRAME_TYPE]==SERIAL_MESSAGE_TYPE_PING_REQUEST)
-      {
 #ifdef MODULE_ALP
-        // free all alp commands
-        alp_layer_free_commands();
+    // free all alp commands
+    alp_layer_free_commands();
 #endif
-        uint8_t ping_reply[1]={0x02};
-        fifo_skip(&payload_fifo,1);
-        modem_interface_transfer_bytes(ping_reply,1,SERIAL_MESSAGE_TYPE_PING_RESPONSE);
-      }
-      else if(header[SERIAL_FRAME_TYPE]==SERIAL_MESSAGE_TYPE_REBOOTED)
-      {
-        uint8_t reboot_reason;
-        fifo_pop(&payload_fifo, &reboot_reason, 1);
-        DPRINT("target rebooted, reason=%i\n", reboot_reason);
-        if(target_rebooted_cb)
-          target_rebooted_cb(reboot_reason);
-      }
-      else
+    // a plain ping is answered as before and leaves the protocol version as it is,
+    // a version request is answered with the agreed version and our maximum frame size
+    uint8_t request[4];
+    if(fifo_get_size(payload_fifo) < sizeof(request))
+    {
+      uint8_t ping_reply[1]={0x02};
+      modem_interface_transfer_bytes(ping_reply,1,SERIAL_MESSAGE_TYPE_PING_RESPONSE);
+    }
+    else
+    {
+      fifo_pop(payload_fifo, request, sizeof(request));
+      uint8_t version = request[1] >= SERIAL_FRAME_VERSION_SUPPORTED ? SERIAL_FRAME_VERSION_SUPPORTED : SERIAL_FRAME_VERSION_0;
+      uint8_t ping_reply[4]={0x02, version, MODEM_INTERFACE_MAX_FRAME_SIZE >> 8, MODEM_INTERFACE_MAX_FRAME_SIZE & 0xFF};
+      modem_interface_transfer_bytes(ping_reply,sizeof(ping_reply),SERIAL_MESSAGE_TYPE_PING_RESPONSE);
+      set_protocol_version(version, (request[2] << 8) | request[3]);
+    }
+  }
+  else if(type==SERIAL_MESSAGE_TYPE_REBOOTED)
+  {
+    uint8_t reboot_reason;
+    fifo_pop(payload_fifo, &reboot_reason, 1);
+    DPRINT("target rebooted, reason=%i\n", reboot_reason);
+    set_protocol_version(SERIAL_FRAME_VERSION_0, 0);
+    if(target_rebooted_cb)
+      target_rebooted_cb(reboot_reason);
+  }
+  else
+  {
+    DPRINT("!!!FRAME TYPE NOT IMPLEMENTED");
+    return;
+  }
+
+  stats.frames_received++;
+}
+
+#if defined(FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1) && MODEM_INTERFACE_WINDOW_SIZE > 1
+/** @Brief Delivers the frames received ahead of time which are next in sequence
+ *  @return void
+ */
+static void dispatch_reordered_frames()
+{
+  bool dispatched;
+  do
+  {
+    dispatched = false;
+    for(uint8_t i = 0; i < MODEM_INTERFACE_WINDOW_SIZE - 1; i++)
+    {
+      rx_reorder_slot_t* slot = &rx_reorder_slots[i];
+      if(slot->valid && slot->seq == rx_next_seq)
       {
-        fifo_skip(&payload_fifo, payload_len);
-        DPRINT("!!!FRAME TYPE NOT IMPLEMENTED");
+        fifo_t slot_fifo;
+        fifo_init_filled(&slot_fifo, slot->data, slot->length, sizeof(slot->data));
+        slot->valid = false;
+        rx_next_seq++;
+        dispatch_frame(slot->type, &slot_fifo);
+        dispatched = true;
+        break;
       }
-      fifo_skip(&rx_fifo, payload_len - fifo_get_size(&payload_fifo)); // pop parsed bytes from original fifo
     }
-    else 
+  } while(dispatched);
+}
+
+/** @Brief Keeps a frame received ahead of a missing one
+ *  @return void
+ */
+static void store_reordered_frame(uint8_t seq, uint8_t type, fifo_t* payload_fifo)
+{
+  rx_reorder_slot_t* free_slot = NULL;
+  for(uint8_t i = 0; i < MODEM_INTERFACE_WINDOW_SIZE - 1; i++)
+  {
+    if(!rx_reorder_slots[i].valid)
+      free_slot = &rx_reorder_slots[i];
+    else if(rx_reorder_slots[i].seq == seq)
+    {
+      stats.frames_duplicate++;
+      return;
+    }
+  }
+
+  // there is a slot for every sequence number in the window after the next expected one
+  assert(free_slot != NULL);
+  free_slot->valid = true;
+  free_slot->seq = seq;
+  free_slot->type = type;
+  free_slot->length = fifo_get_size(payload_fifo);
+  fifo_peek(payload_fifo, free_slot->data, 0, free_slot->length);
+}
+#endif
+
+/** @Brief Handles a frame with a correct CRC. Version 0 frames are dispatched right away, version 1 frames are
+ *  dispatched in sequence and acknowledged.
+ *  @return void
+ */
+static void process_frame(fifo_t* payload_fifo)
+{
+  uint8_t type = rx_header[SERIAL_FRAME_TYPE];
+  if(rx_header[SERIAL_FRAME_VERSION_INDEX] == SERIAL_FRAME_VERSION_0)
+  {
+    dispatch_frame(type, payload_fifo);
+    return;
+  }
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(protocol_version != SERIAL_FRAME_VERSION_1)
+  {
+    DPRINT("version 1 frame while not negotiated");
+    return;
+  }
+
+  if(type == SERIAL_MESSAGE_TYPE_ACK)
+  {
+    uint8_t ack[SERIAL_FRAME_V1_ACK_SIZE];
+    if(fifo_pop(payload_fifo, ack, sizeof(ack)) == SUCCESS)
+      process_ack(ack[0], ack[1]);
+
+    return;
+  }
+
+  uint8_t distance = rx_header[SERIAL_FRAME_V1_SEQ] - rx_next_seq;
+  if(distance == 0)
+  {
+    rx_next_seq++;
+    dispatch_frame(type, payload_fifo);
+#if MODEM_INTERFACE_WINDOW_SIZE > 1
+    dispatch_reordered_frames();
+#endif
+  }
+#if MODEM_INTERFACE_WINDOW_SIZE > 1
+  else if(distance < MODEM_INTERFACE_WINDOW_SIZE)
+    store_reordered_frame(rx_header[SERIAL_FRAME_V1_SEQ], type, payload_fifo);
+#endif
+  else
+    stats.frames_duplicate++; // already delivered, the acknowledgement got lost
+
+  ack_pending = true;
+  schedule_tx();
+#endif
+}
+
+/** @Brief Searches the received data for a valid header. Everything before a sync byte is skipped at once, a sync
+ *  byte which is not followed by a valid version (and, for version 1, a correct header checksum and length) is
+ *  skipped as well. The header stays in the fifo until the frame is verified.
+ *  @return true when a header is found, it is copied to rx_header
+ */
+static bool find_header()
+{
+  while(fifo_get_size(&rx_fifo) >= SERIAL_FRAME_HEADER_SIZE)
+  {
+    uint8_t* data;
+    uint16_t len;
+    fifo_get_continuos_raw_data(&rx_fifo, &data, &len);
+    uint8_t* sync = memchr(data, SERIAL_FRAME_SYNC_BYTE, len);
+    if(sync != data)
+    {
+      uint16_t skip = sync != NULL ? sync - data : len;
+      fifo_skip(&rx_fifo, skip);
+      stats.bytes_skipped += skip;
+      DPRINT("skip %i", skip);
+      continue;
+    }
+
+    bool valid = false;
+    fifo_peek(&rx_fifo, rx_header, 0, SERIAL_FRAME_HEADER_SIZE);
+    if(rx_header[SERIAL_FRAME_VERSION_INDEX] == SERIAL_FRAME_VERSION_0)
     {
-        DPRINT("!!!PAYLOAD DATA INCORRECT");
+      rx_header_len = SERIAL_FRAME_HEADER_SIZE;
+      rx_payload_len = rx_header[SERIAL_FRAME_SIZE];
+      valid = true;
     }
-      
-    payload_len = 0;
-    parsed_header = false;
-    if(fifo_get_size(&rx_fifo) > SERIAL_FRAME_HEADER_SIZE)
-      sched_post_task(&process_rx_fifo);
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+    else if(rx_header[SERIAL_FRAME_VERSION_INDEX] == SERIAL_FRAME_VERSION_1)
+    {
+      if(fifo_get_size(&rx_fifo) < SERIAL_FRAME_V1_HEADER_SIZE)
+        return false;
+
+      fifo_peek(&rx_fifo, rx_header, 0, SERIAL_FRAME_V1_HEADER_SIZE);
+      uint8_t sum = rx_header[SERIAL_FRAME_V1_HCS];
+      for(uint8_t i = SERIAL_FRAME_VERSION_INDEX; i <= SERIAL_FRAME_V1_SIZE_LO; i++)
+        sum += rx_header[i];
+
+      rx_header_len = SERIAL_FRAME_V1_HEADER_SIZE;
+      rx_payload_len = (rx_header[SERIAL_FRAME_V1_SIZE_HI] << 8) | rx_header[SERIAL_FRAME_V1_SIZE_LO];
+      valid = sum == 0xFF && rx_payload_len <= MODEM_INTERFACE_MAX_FRAME_SIZE;
+    }
+#endif
+
+    if(valid)
+      return true;
+
+    fifo_skip(&rx_fifo, 1);
+    stats.bytes_skipped++;
   }
+
+  return false;
+}
+
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+/** @Brief Drops the rest of a DMA burst which is not a whole frame. The sender only sends whole frames in a wake-up
+ *  period, so the rest is damaged, and the next period is only received once the fifo is empty.
+ *  @return void
+ */
+static void discard_rx_rest()
+{
+  stats.bytes_skipped += fifo_get_size(&rx_fifo);
+  fifo_clear(&rx_fifo);
+  parsed_header = false;
+  rx_payload_len = 0;
+}
+#endif
+
+/** @Brief Processes received uart data
+ * 1) Search for sync bytes (always)
+ * 2) get header size and parse header
+ * 3) Wait for correct # of bytes (length present in header)
+ * 4) Execute crc check and check message counter
+ * 5) send to corresponding service (alp, ping service, log service), in sequence for version 1 frames
+ *  @return void
+ */
+static void process_rx_fifo(void *arg) 
+{
+  if(!parsed_header)
+  {
+    if(!find_header())
+    {
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+      discard_rx_rest();
+#endif
+      return;
+    }
+
+    parsed_header = true;
+    DPRINT("UART RX, payload size = %i", rx_payload_len);
+  }
+
+  if(fifo_get_size(&rx_fifo) < rx_header_len + rx_payload_len)
+  {
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
+    discard_rx_rest();
+#endif
+    return;
+  }
+
+  // payload complete, start parsing
+  // rx_fifo can be bigger than the current serial packet, init a subview fifo
+  // which is restricted to rx_payload_len so we can't parse past this packet.
+  fifo_t payload_fifo;
+  fifo_init_subview(&payload_fifo, &rx_fifo, rx_header_len, rx_payload_len);
+
+  if(verify_payload(&payload_fifo,rx_header))
+  {
+    process_frame(&payload_fifo);
+    fifo_skip(&rx_fifo, rx_header_len + rx_payload_len);
+  }
+  else
+  {
+    // the sync byte could have been part of the data, search again right after it
+    DPRINT("!!!PAYLOAD DATA INCORRECT");
+    stats.crc_errors++;
+    fifo_skip(&rx_fifo, 1);
+    stats.bytes_skipped++;
+  }
+
+  rx_payload_len = 0;
+  parsed_header = false;
+  if(fifo_get_size(&rx_fifo) >= SERIAL_FRAME_HEADER_SIZE)
+    sched_post_task(&process_rx_fifo);
 }
 
 #ifdef FRAMEWORK_MODEM_INTERFACE_USE_DMA
 static void uart_tx_cb()
 {
-  tx_dma_busy = false;
-  fifo_skip(&modem_interface_tx_fifo, tx_size);
+  advance_tx(tx_size);
+  start_tx_dma(); // refill from the complete interrupt, so the UART does not idle between segments
 }
 #else
 /** @Brief put received UART data in fifo
@@ -647,6 +1587,32 @@ static void modem_interface_set_error_callback(uart_error_handler_t uart_error_c
 void modem_interface_init(uint8_t idx, uint32_t baudrate, pin_id_t uart_state_pin_id, pin_id_t target_uart_state_pin_id)
 {
   fifo_init(&modem_interface_tx_fifo, modem_interface_tx_buffer, MODEM_INTERFACE_TX_FIFO_SIZE);
+  tx_frame_first = 0;
+  tx_frame_count = 0;
+  tx_frame_started = 0;
+  tx_current = TX_CURRENT_NONE;
+  tx_current_sent = 0;
+  tx_chunk_size = ((uint64_t) baudrate * TX_FIFO_FLUSH_CHUNK_TIME_US) / (UART_BITS_PER_BYTE * 1000000);
+  if(tx_chunk_size == 0)
+    tx_chunk_size = 1;
+
+  memset(&stats, 0, sizeof(stats));
+  protocol_version = SERIAL_FRAME_VERSION_0;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  // an acknowledgement is expected within the time to transmit two full windows, plus a margin for the processing
+  // and the wake-up handshake of the peer
+  retransmit_timeout_ticks = ((uint64_t) 2 * MODEM_INTERFACE_WINDOW_SIZE
+                              * (SERIAL_FRAME_V1_HEADER_SIZE + MODEM_INTERFACE_MAX_FRAME_SIZE)
+                              * UART_BITS_PER_BYTE * TIMER_TICKS_PER_SEC) / baudrate;
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
+  retransmit_timeout_ticks += TIMER_TICKS_PER_SEC / 10;
+#else
+  retransmit_timeout_ticks += TIMER_TICKS_PER_SEC / 100;
+#endif
+
+  tx_max_payload = SERIAL_FRAME_V0_MAX_SIZE;
+  sched_register_task(&retransmit_timeout);
+#endif
   sched_register_task(&flush_modem_interface_tx_fifo);
   sched_register_task(&execute_state_machine);
   sched_register_task(&process_rx_fifo);
@@ -692,39 +1658,41 @@ void modem_interface_init(uint8_t idx, uint32_t baudrate, pin_id_t uart_state_pi
 #endif
 }
 
-error_t modem_interface_transfer_bytes(uint8_t* bytes, uint8_t length, serial_message_type_t type) 
+error_t modem_interface_transfer_bytes(uint8_t* bytes, uint16_t length, serial_message_type_t type) 
 {
   error_t result;
-  uint8_t frame_header[SERIAL_FRAME_HEADER_SIZE];
-  uint16_t crc=crc_calculate(bytes,length);
 
-  packet_up_counter++;
-  frame_header[0] = SERIAL_FRAME_SYNC_BYTE;
-  frame_header[1] = SERIAL_FRAME_VERSION;
+  // ping and reboot messages are always sent as version 0, so they are understood while (re)negotiating
+  uint8_t version = protocol_version;
+  if(type == SERIAL_MESSAGE_TYPE_PING_REQUEST || type == SERIAL_MESSAGE_TYPE_PING_RESPONSE
+     || type == SERIAL_MESSAGE_TYPE_REBOOTED)
+    version = SERIAL_FRAME_VERSION_0;
+
+  if(length > (version == SERIAL_FRAME_VERSION_0 ? SERIAL_FRAME_V0_MAX_SIZE : modem_interface_get_max_frame_size()))
+    return -ESIZE;
 
-  frame_header[SERIAL_FRAME_COUNTER] = packet_up_counter;
-  frame_header[SERIAL_FRAME_TYPE] = type;
-  frame_header[SERIAL_FRAME_SIZE] = length;
-  frame_header[SERIAL_FRAME_CRC1] = (crc >> 8) & 0x00FF;
-  frame_header[SERIAL_FRAME_CRC2] = crc & 0x00FF;
-
-  DPRINT("TX HEADER:");
-  DPRINT_DATA(frame_header, SERIAL_FRAME_HEADER_SIZE);
-  DPRINT("TX PAYLOAD:");
-  DPRINT_DATA(bytes, length);
-   
   start_atomic();
-  if((sizeof(modem_interface_tx_buffer) - fifo_get_size(&modem_interface_tx_fifo)) >= (uint8_t) (SERIAL_FRAME_HEADER_SIZE + length))
+  if(tx_frame_count < MODEM_INTERFACE_TX_FRAME_COUNT
+     && (sizeof(modem_interface_tx_buffer) - fifo_get_size(&modem_interface_tx_fifo)) >= length)
   {
-    request_pending = true;
-    fifo_put(&modem_interface_tx_fifo, (uint8_t*) &frame_header, SERIAL_FRAME_HEADER_SIZE);
+    // the header is kept with the frame, only the payload is copied into the TX buffer
+    tx_frame_t* frame = &tx_frames[(tx_frame_first + tx_frame_count) % MODEM_INTERFACE_TX_FRAME_COUNT];
+    frame->payload_pos = modem_interface_tx_fifo.tail_idx;
+    frame->payload_len = length;
+    frame->done = false;
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+    frame->retransmit = false;
+#endif
     fifo_put(&modem_interface_tx_fifo, bytes, length);
+    build_tx_header(frame, version, type);
 
-#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
-    sched_post_task_prio(&execute_state_machine, MIN_PRIORITY, NULL);
-#else
-    sched_post_task_prio(&flush_modem_interface_tx_fifo, MIN_PRIORITY, NULL); // state machine is not used when not using interrupt lines
-#endif 
+    DPRINT("TX HEADER:");
+    DPRINT_DATA(frame->header, frame->header_len);
+    DPRINT("TX PAYLOAD:");
+    DPRINT_DATA(bytes, length);
+
+    tx_frame_count++;
+    schedule_tx();
     result = SUCCESS;
   }
   else
@@ -765,3 +1733,29 @@ void modem_interface_set_target_rebooted_callback(target_rebooted_callback_t cb)
 {
   target_rebooted_cb = cb;
 }
+
+error_t modem_interface_negotiate_protocol()
+{
+  uint8_t ping_request[4]={0x01, SERIAL_FRAME_VERSION_SUPPORTED, MODEM_INTERFACE_MAX_FRAME_SIZE >> 8, MODEM_INTERFACE_MAX_FRAME_SIZE & 0xFF};
+  return modem_interface_transfer_bytes(ping_request, sizeof(ping_request), SERIAL_MESSAGE_TYPE_PING_REQUEST);
+}
+
+uint8_t modem_interface_get_protocol_version()
+{
+  return protocol_version;
+}
+
+uint16_t modem_interface_get_max_frame_size()
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+  if(protocol_version == SERIAL_FRAME_VERSION_1)
+    return tx_max_payload;
+#endif
+
+  return SERIAL_FRAME_V0_MAX_SIZE;
+}
+
+const modem_interface_stats_t* modem_interface_get_stats()
+{
+  return &stats;
+}
@@ -48,10 +48,6 @@
 _Static_assert(SCHEDULER_MAX_TASKS < UINT8_MAX,
                "SCHEDULER_MAX_TASKS can not be set larger than 254");
 
-#ifdef NODE_GLOBALS
-    #warning NODE_GLOBALS is defined when using the default scheduler. Are you sure this is what you want ?
-#endif
-
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_SCHED_LOG_ENABLED)
   #define DPRINT(...) log_print_string( __VA_ARGS__)
 #else
@@ -64,8 +60,13 @@ enum
 	NUM_TASKS = SCHEDULER_MAX_TASKS,
 	NOT_SCHEDULED = NUM_PRIORITIES,
 	NO_TASK = SCHEDULER_MAX_TASKS,
+	// the lookup table is kept at least half empty to keep the probe sequences short
+	LOOKUP_SIZE = POW2_CEIL(2 * SCHEDULER_MAX_TASKS),
+	LOOKUP_MASK = LOOKUP_SIZE - 1,
 };
 
+_Static_assert(NUM_PRIORITIES <= 8, "the ready bitmap only holds 8 priorities");
+
 typedef struct
 {
 	task_t task;
@@ -86,19 +87,27 @@ typedef struct
 taskindex_info_t NGDEF(m_index)[NUM_TASKS];
 task_info_t NGDEF(m_info)[NUM_TASKS];
 
+// open addressing (linear probing) table mapping a task onto its first entry in m_index
+uint8_t NGDEF(m_lookup)[LOOKUP_SIZE];
+
 uint8_t NGDEF(m_head)[NUM_PRIORITIES];
 uint8_t NGDEF(m_tail)[NUM_PRIORITIES];
-uint8_t current_task_id;
-volatile uint8_t NGDEF(current_priority);
+uint8_t NGDEF(current_task_id);
+// bit n is set when tasks of priority n are waiting
+volatile uint8_t NGDEF(m_ready);
 uint8_t NGDEF(num_registered_tasks);
-static bool scheduler_active = false;
+static bool NGDEF(scheduler_active);
 #if defined FRAMEWORK_USE_WATCHDOG
 #define WATCHDOG_WARNING_TIMEOUT TIMER_TICKS_PER_SEC * 17
-bool watchdog_wakeup;
-static timer_tick_t last_task_start_time = 0;
+bool NGDEF(watchdog_wakeup);
+static timer_tick_t NGDEF(last_task_start_time);
 #endif
 
-volatile bool task_scheduled_after_sched_loop = false;
+volatile bool NGDEF(task_scheduled_after_sched_loop);
+static uint8_t NGDEF(low_power_mode);
+static sched_idle_hook_t NGDEF(idle_hook);
+
+__LINK_C uint8_t get_task_id(task_t task);
 
 #ifdef SCHEDULER_DEBUG
 void check_structs_are_valid()
@@ -152,9 +161,11 @@ void check_structs_are_valid()
 		assert((visited[i]) || NG(m_info)[i].priority == NOT_SCHEDULED);
 	}
 
-	assert(NG(current_priority) <= NUM_PRIORITIES);
-	for(int i = 0; i < NG(current_priority); i++)
-		assert(NG(m_head)[i] == NO_TASK);
+	for(int prio = 0; prio < NUM_PRIORITIES; prio++)
+		assert(((NG(m_ready) >> prio) & 1) == (NG(m_head)[prio] != NO_TASK));
+
+	for(int i = 0; i < NG(num_registered_tasks); i++)
+		assert(get_task_id(NG(m_index)[i].task) <= i);
 	//INT_Enable();
 	end_atomic();
 }
@@ -163,7 +174,7 @@ static inline void check_structs_are_valid(){}
 #endif
 
 #if defined FRAMEWORK_USE_WATCHDOG
-static void __feed_watchdog_task(void *arg) { watchdog_wakeup = true; }
+static void __feed_watchdog_task(void *arg) { NG(watchdog_wakeup) = true; }
 #endif
 
 __LINK_C void scheduler_init()
@@ -178,10 +189,15 @@ __LINK_C void scheduler_init()
 		NG(m_index)[i].index = NO_TASK;
 		NG(m_index)[i].task = 0x0;
 	}
+	memset(NG(m_lookup), NO_TASK, sizeof(NG(m_lookup)));
 	memset(NG(m_head), NO_TASK, sizeof(NG(m_head)));
 	memset(NG(m_tail), NO_TASK, sizeof(NG(m_tail)));
-	NG(current_priority) = NUM_PRIORITIES;
+	NG(m_ready) = 0;
 	NG(num_registered_tasks) = 0;
+	NG(scheduler_active) = false;
+	NG(task_scheduled_after_sched_loop) = false;
+	NG(low_power_mode) = FRAMEWORK_SCHEDULER_LP_MODE;
+	NG(idle_hook) = NULL;
 	check_structs_are_valid();
 #if defined FRAMEWORK_USE_WATCHDOG
 	__watchdog_init();
@@ -190,31 +206,43 @@ __LINK_C void scheduler_init()
 #endif
 }
 
-__LINK_C uint8_t get_task_id(task_t task)
+static inline uint32_t lookup_hash(task_t task)
 {
-	check_structs_are_valid();
-	assert(NG(num_registered_tasks) <= NUM_TASKS);
-	int begin = 0;
-	int end = NG(num_registered_tasks)-1;
-	uint32_t i = 0;
+	uint32_t h = (uint32_t)(uintptr_t)task;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6dU;
+	h ^= h >> 12;
+	return h & LOOKUP_MASK;
+}
 
-	while (begin <= end)
+// the ids in m_index shift when a task is registered, so the lookup table is rebuilt
+// (this only happens while registering tasks, which is not on the hot path)
+static void rebuild_lookup()
+{
+	memset(NG(m_lookup), NO_TASK, sizeof(NG(m_lookup)));
+	for(uint8_t id = 0; id < NG(num_registered_tasks); id++)
 	{
-		int pivot = begin + ((end - begin) / 2);
-		if (((void*)NG(m_index)[pivot].task) < ((void*)task))
-			begin= pivot+1;
-		else if (((void*)task) < ((void*)NG(m_index)[pivot].task))
-			end = pivot-1;
-		else
-		{
-			while((pivot > 1) && (NG(m_index)[pivot-1].task == task))
-			{
-				pivot--;
-			}
-			return pivot;
-		}
-		i++;
-		assert(i <= NG(num_registered_tasks));
+		if(id > 0 && NG(m_index)[id - 1].task == NG(m_index)[id].task)
+			continue; // only the first entry of a task registered multiple times is stored
+
+		uint32_t slot = lookup_hash(NG(m_index)[id].task);
+		while(NG(m_lookup)[slot] != NO_TASK)
+			slot = (slot + 1) & LOOKUP_MASK;
+
+		NG(m_lookup)[slot] = id;
+	}
+}
+
+__LINK_C uint8_t get_task_id(task_t task)
+{
+	uint32_t slot = lookup_hash(task);
+	uint8_t id;
+	while((id = NG(m_lookup)[slot]) != NO_TASK)
+	{
+		if(NG(m_index)[id].task == task)
+			return id;
+
+		slot = (slot + 1) & LOOKUP_MASK;
 	}
 	return NO_TASK;
 }
@@ -246,6 +274,7 @@ __LINK_C error_t sched_register_task_allow_multiple(task_t task, bool allow)
         }
     }
     NG(num_registered_tasks)++;
+    rebuild_lookup();
     retVal = SUCCESS;
 
 	//INT_Enable();
@@ -259,6 +288,19 @@ static inline bool is_next_task_the_same(uint8_t id)
 	return ((id + 1) < NG(num_registered_tasks)) && (NG(m_index)[id].task == NG(m_index)[id + 1].task);
 }
 
+__LINK_C error_t sched_register_task_handle(task_t task, sched_task_handle_t *handle)
+{
+	error_t retVal = sched_register_task_allow_multiple(task, false);
+	uint8_t id = get_task_id(task);
+	// the index in m_info does not change when other tasks are registered, unlike the id in m_index. A task with
+	// multiple entries is posted on the entry matching its argument, which needs the lookup.
+	if(is_next_task_the_same(id))
+		*handle = SCHED_NO_TASK_HANDLE;
+	else
+		*handle = NG(m_index)[id].index + 1;
+	return retVal;
+}
+
 static inline bool is_scheduled(uint8_t id)
 {
 	assert(id < NUM_TASKS);
@@ -334,6 +376,46 @@ static error_t do_initial_task_checks(uint8_t task_id, void *arg, bool cancel)
 	return SUCCESS;
 }
 
+// append the task to the list of its priority
+static inline void push_task(uint8_t index, uint8_t priority, void *arg)
+{
+	if(NG(m_head)[priority] == NO_TASK)
+	{
+		NG(m_head)[priority] = index;
+		NG(m_tail)[priority] = index;
+	}
+	else
+	{
+		NG(m_info)[NG(m_tail)[priority]].next = index;
+		NG(m_info)[index].prev = NG(m_tail)[priority];
+		NG(m_tail)[priority] = index;
+	}
+	NG(m_info)[index].priority = priority;
+	NG(m_info)[index].arg = arg;
+	NG(m_ready) |= (1 << priority);
+}
+
+// remove the task from the list of its priority
+static inline void unlink_task(uint8_t index)
+{
+	if (NG(m_info)[index].prev == NO_TASK)
+		NG(m_head)[NG(m_info)[index].priority] = NG(m_info)[index].next;
+	else
+		NG(m_info)[NG(m_info)[index].prev].next = NG(m_info)[index].next;
+
+	if (NG(m_info)[index].next == NO_TASK)
+		NG(m_tail)[NG(m_info)[index].priority] = NG(m_info)[index].prev;
+	else
+		NG(m_info)[NG(m_info)[index].next].prev = NG(m_info)[index].prev;
+
+	if (NG(m_head)[NG(m_info)[index].priority] == NO_TASK)
+		NG(m_ready) &= ~(1 << NG(m_info)[index].priority);
+
+	NG(m_info)[index].prev = NO_TASK;
+	NG(m_info)[index].next = NO_TASK;
+	NG(m_info)[index].priority = NOT_SCHEDULED;
+}
+
 __LINK_C error_t sched_post_task_prio(task_t task, uint8_t priority, void *arg)
 {
 	error_t retVal;
@@ -369,28 +451,36 @@ __LINK_C error_t sched_post_task_prio(task_t task, uint8_t priority, void *arg)
 		uint8_t index = NG(m_index)[task_id].index;
 		if(retVal == SUCCESS)
 		{
-			if(NG(m_head)[priority] == NO_TASK)
-			{
-				NG(m_head)[priority] = index;
-				NG(m_tail)[priority] = index;
-			}
-			else
-			{
-				NG(m_info)[NG(m_tail)[priority]].next = index;
-				NG(m_info)[index].prev = NG(m_tail)[priority];
-				NG(m_tail)[priority] = index;
-			}
-			NG(m_info)[index].priority = priority;
-			NG(m_info)[index].arg = arg;
-			//if our priority is higher than the currently known maximum priority
-			if((priority < NG(current_priority)))
-				NG(current_priority) = priority;
+			push_task(index, priority, arg);
 			check_structs_are_valid();
 		}
 	}
 	end_atomic();
 	check_structs_are_valid();
-	task_scheduled_after_sched_loop = true;
+	NG(task_scheduled_after_sched_loop) = true;
+	return retVal;
+}
+
+__LINK_C error_t sched_post_task_handle_prio(sched_task_handle_t handle, uint8_t priority, void *arg)
+{
+	// SCHED_NO_TASK_HANDLE wraps around to an index which is never registered
+	uint8_t index = handle - 1;
+	error_t retVal = -EALREADY;
+	if(index >= NG(num_registered_tasks))
+		return -EINVAL;
+
+	if(priority > MIN_PRIORITY)
+		return -ESIZE;
+
+	start_atomic();
+	if(NG(m_info)[index].priority == NOT_SCHEDULED)
+	{
+		push_task(index, priority, arg);
+		retVal = SUCCESS;
+	}
+	end_atomic();
+	check_structs_are_valid();
+	NG(task_scheduled_after_sched_loop) = true;
 	return retVal;
 }
 
@@ -426,20 +516,7 @@ __LINK_C error_t sched_cancel_task_with_arg(task_t task, void *arg)
 		}
 		if(retVal == SUCCESS)
 		{
-			uint8_t index = NG(m_index)[id].index;
-			if (NG(m_info)[index].prev == NO_TASK)
-				NG(m_head)[NG(m_info)[index].priority] = NG(m_info)[index].next;
-			else
-				NG(m_info)[NG(m_info)[index].prev].next = NG(m_info)[index].next;
-
-			if (NG(m_info)[index].next == NO_TASK)
-				NG(m_tail)[NG(m_info)[index].priority] = NG(m_info)[index].prev;
-			else
-				NG(m_info)[NG(m_info)[index].next].prev = NG(m_info)[index].prev;
-
-			NG(m_info)[index].prev = NO_TASK;
-			NG(m_info)[index].next = NO_TASK;
-			NG(m_info)[index].priority = NOT_SCHEDULED;
+			unlink_task(NG(m_index)[id].index);
 			check_structs_are_valid();
 		}
 	}
@@ -447,17 +524,40 @@ __LINK_C error_t sched_cancel_task_with_arg(task_t task, void *arg)
 	return retVal;
 }
 
-static uint8_t pop_task(int priority)
+__LINK_C error_t sched_cancel_task_handle(sched_task_handle_t handle)
+{
+	uint8_t index = handle - 1;
+	error_t retVal = -EALREADY;
+	if(index >= NG(num_registered_tasks))
+		return -EINVAL;
+
+	start_atomic();
+	if(NG(m_info)[index].priority != NOT_SCHEDULED)
+	{
+		unlink_task(index);
+		retVal = SUCCESS;
+	}
+	end_atomic();
+	check_structs_are_valid();
+	return retVal;
+}
+
+// pop the first task of the highest priority which has tasks waiting
+static uint8_t pop_task()
 {
 	uint8_t id = NO_TASK;
 	check_structs_are_valid();
 	start_atomic();
-	if (NG(m_head)[priority] != NO_TASK)
+	if (NG(m_ready) != 0)
 	{
+		uint8_t priority = __builtin_ctz(NG(m_ready));
 		id = NG(m_head)[priority];
 		NG(m_head)[priority] = NG(m_info)[NG(m_head)[priority]].next;
 		if(NG(m_head)[priority] == NO_TASK)
+		{
 			NG(m_tail)[priority] = NO_TASK;
+			NG(m_ready) &= ~(1 << priority);
+		}
 		else
 			NG(m_info)[NG(m_head)[priority]].prev = NO_TASK;
 
@@ -470,27 +570,24 @@ static uint8_t pop_task(int priority)
 	return id;
 }
 
-static inline bool tasks_waiting(int priority)
-{
-	return NG(m_head)[priority] != NO_TASK;
+void sched_set_idle_hook(sched_idle_hook_t hook) {
+  NG(idle_hook) = hook;
 }
 
-static uint8_t low_power_mode = FRAMEWORK_SCHEDULER_LP_MODE;
-
 uint8_t sched_get_low_power_mode(void) {
-  return low_power_mode;
+  return NG(low_power_mode);
 }
 
 void sched_set_low_power_mode(uint8_t mode) {
-  low_power_mode = mode;
+  NG(low_power_mode) = mode;
 }
 
 // This is in interrupt context
 __LINK_C timer_tick_t sched_check_software_watchdog(task_t task, timer_tick_t current_time) {
 #ifdef FRAMEWORK_USE_WATCHDOG
 	if(task == &__feed_watchdog_task) {
-		if(scheduler_active) {
-			timer_tick_t difference = timer_calculate_difference(last_task_start_time, current_time);
+		if(NG(scheduler_active)) {
+			timer_tick_t difference = timer_calculate_difference(NG(last_task_start_time), current_time);
 			if(difference > WATCHDOG_WARNING_TIMEOUT) {
 				// PANIC
 #if defined(FRAMEWORK_USE_CALLSTACK) && defined(FRAMEWORK_USE_ERROR_EVENT_FILE)
@@ -509,9 +606,9 @@ __LINK_C timer_tick_t sched_check_software_watchdog(task_t task, timer_tick_t cu
 
 __LINK_C task_t sched_get_current_task(void)
 {
-	if(scheduler_active)
+	if(NG(scheduler_active))
 	{
-		return NG(m_info)[current_task_id].task;
+		return NG(m_info)[NG(current_task_id)].task;
 	}
 	else
 	{
@@ -526,56 +623,50 @@ __LINK_C void scheduler_run()
 #if defined FRAMEWORK_USE_WATCHDOG
 		bool task_list_empty = true;
 		uint8_t executed_tasks = 0;
-		watchdog_wakeup = false;
+		NG(watchdog_wakeup) = false;
 #endif
 #if defined FRAMEWORK_USE_POWER_TRACKING
 		timer_tick_t wakeup_time = timer_get_counter_value();
 #endif
-		while(NG(current_priority) < NUM_PRIORITIES)
+		while(NG(m_ready) != 0)
 		{
 			check_structs_are_valid();
-			for(uint8_t id = pop_task((NG(current_priority))); id != NO_TASK; id = pop_task(NG(current_priority)))
+			for(uint8_t id = pop_task(); id != NO_TASK; id = pop_task())
 			{
-				scheduler_active = true;
+				NG(scheduler_active) = true;
 #if defined FRAMEWORK_USE_WATCHDOG
 				executed_tasks++;
 				task_list_empty = false;
 				hw_watchdog_feed();
-				last_task_start_time = timer_get_counter_value();
+				NG(last_task_start_time) = timer_get_counter_value();
 #endif
 				check_structs_are_valid();
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_SCHED_LOG_ENABLED)
         timer_tick_t start = timer_get_counter_value();
         log_print_string("SCHED start %p at %i", NG(m_info)[id].task, start);
 #endif
-		current_task_id = id;
+		NG(current_task_id) = id;
         NG(m_info)[id].task(NG(m_info)[id].arg);
+        if(hw_task_executed)
+          hw_task_executed();
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_SCHED_LOG_ENABLED)
         timer_tick_t stop = timer_get_counter_value();
         timer_tick_t duration = stop - start;
         log_print_string("SCHED stop %p at %i took %i", NG(m_info)[id].task, stop, duration);
 #endif
 			}
-			//this needs to be done atomically since otherwise we risk decrementing the current priority
-			//while a higher priority task is waiting in the queue
 			start_atomic();
-			if (!tasks_waiting(NG(current_priority)))
-				NG(current_priority)++;
-#ifndef NDEBUG
-			for(int i = 0; i < NG(current_priority); i++)
-				assert(!tasks_waiting(i));
-#endif
-			task_scheduled_after_sched_loop = false;
-			end_atomic();	
+			NG(task_scheduled_after_sched_loop) = false;
+			end_atomic();
 		}		
-		scheduler_active = false;
+		NG(scheduler_active) = false;
 #if defined FRAMEWORK_USE_WATCHDOG
 		hw_watchdog_feed();
 #if defined FRAMEWORK_USE_POWER_TRACKING
 		//we don't want to register wake-ups that only trigger the watchdog
 		//we also need to check that the watchdog task was the only task that was executed as there is a small chance that
 		//the watchdog task is triggered when also other tasks are executing. In that case we want to track the time as active.
-		if(!(task_list_empty || (watchdog_wakeup && executed_tasks == 1)))
+		if(!(task_list_empty || (NG(watchdog_wakeup) && executed_tasks == 1)))
 		{
 #endif
 #endif
@@ -586,12 +677,15 @@ __LINK_C void scheduler_run()
 		}
 #endif
 
+		if(NG(idle_hook))
+			NG(idle_hook)();
+
 		//during some oss7-testsuite cases we can see a scheduling of the flushing of the fifos for the UART in between the end of the scheduler 
 		//priority loop, and the call to enter low power mode. This caused the test to fail as the response was received by the testsuite only 
 		//after the watchdog woke up the device. So, task_scheduled_after_sched_loop is used to ensure the tasklist is really empty.
 		start_atomic();
-		if(!task_scheduled_after_sched_loop) {
-			hw_enter_lowpower_mode(low_power_mode);
+		if(!NG(task_scheduled_after_sched_loop)) {
+			hw_enter_lowpower_mode(NG(low_power_mode));
 		}
 		end_atomic();
 	}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shared_buffer.h"
+#include "debug.h"
+#include "ng.h"
+
+// a buffer is free when its reference count is 0, so the zero initialized pool does not need an init function
+static shared_buffer_t NGDEF(_buffers)[FRAMEWORK_SHARED_BUFFER_COUNT];
+#define buffers NG(_buffers)
+
+shared_buffer_t* shared_buffer_alloc(uint16_t headroom)
+{
+    if(headroom > FRAMEWORK_SHARED_BUFFER_SIZE)
+        return NULL;
+
+    for(uint8_t i = 0; i < FRAMEWORK_SHARED_BUFFER_COUNT; i++)
+    {
+        if(buffers[i].ref_count == 0)
+        {
+            buffers[i].ref_count = 1;
+            buffers[i].offset = headroom;
+            buffers[i].length = 0;
+            return &buffers[i];
+        }
+    }
+
+    return NULL;
+}
+
+void shared_buffer_retain(shared_buffer_t* buffer)
+{
+    assert(buffer->ref_count > 0 && buffer->ref_count < UINT8_MAX);
+    buffer->ref_count++;
+}
+
+void shared_buffer_release(shared_buffer_t* buffer)
+{
+    assert(buffer->ref_count > 0);
+    buffer->ref_count--;
+}
+
+uint8_t shared_buffer_get_free_count(void)
+{
+    uint8_t count = 0;
+    for(uint8_t i = 0; i < FRAMEWORK_SHARED_BUFFER_COUNT; i++)
+    {
+        if(buffers[i].ref_count == 0)
+            count++;
+    }
+
+    return count;
+}
+
+uint8_t* shared_buffer_prepend(shared_buffer_t* buffer, uint16_t length)
+{
+    if(length > buffer->offset)
+        return NULL;
+
+    buffer->offset -= length;
+    buffer->length += length;
+    return buffer->storage + buffer->offset;
+}
+
+uint8_t* shared_buffer_append(shared_buffer_t* buffer, uint16_t length)
+{
+    if(length > shared_buffer_get_tailroom(buffer))
+        return NULL;
+
+    uint8_t* appended = buffer->storage + buffer->offset + buffer->length;
+    buffer->length += length;
+    return appended;
+}
+
+void shared_buffer_set_data(shared_buffer_t* buffer, uint8_t* data, uint16_t length)
+{
+    assert(data >= buffer->storage && data + length <= buffer->storage + FRAMEWORK_SHARED_BUFFER_SIZE);
+    buffer->offset = data - buffer->storage;
+    buffer->length = length;
+}
@@ -18,6 +18,7 @@
  */
 
 #include "timer.h"
+#include "timer_queue.h"
 #include "ng.h"
 #include "hwtimer.h"
 #include "hwatomic.h"
@@ -33,10 +34,6 @@
 #endif
 
 
-#ifdef NODE_GLOBALS
-    #warning Default Timer implementation used when NODE_GLOBALS is active. Are you sure this is what you want ??
-#endif
-
 #define HW_TIMER_ID 0
 
 #define COUNTER_OVERFLOW_INCREASE (UINT32_C(1) << (8*sizeof(hwtimer_tick_t)))
@@ -47,34 +44,31 @@ extern inline error_t timer_post_task_prio_delay(task_t task, timer_tick_t delay
 extern inline error_t timer_post_task_delay(task_t task, timer_tick_t delay);
 extern inline error_t timer_add_event(timer_event* event);
 
-static timer_event NGDEF(timers)[FRAMEWORK_TIMER_STACK_SIZE];
+timer_event NGDEF(timers)[FRAMEWORK_TIMER_STACK_SIZE];
 static volatile timer_tick_t NGDEF(next_event);
 static volatile bool NGDEF(hw_event_scheduled);
 static volatile timer_tick_t NGDEF(timer_offset);
-static const hwtimer_info_t* timer_info;
-static bool timer_busy_programming = false;
-static bool fired_by_interrupt = true;
-enum
-{
-    NO_EVENT = FRAMEWORK_TIMER_STACK_SIZE,
-};
+static const hwtimer_info_t* NGDEF(timer_info);
+static bool NGDEF(timer_busy_programming);
+static bool NGDEF(fired_by_interrupt);
 
 static void timer_overflow();
 static void timer_fired();
 
 __LINK_C void timer_init()
 {
-    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
-	NG(timers)[i].f = 0x0;
+    timer_queue_init();
 
     NG(next_event) = NO_EVENT;
     NG(timer_offset) = 0;
     NG(hw_event_scheduled) = false;
+    NG(timer_busy_programming) = false;
+    NG(fired_by_interrupt) = true;
 
     error_t err = hw_timer_init(HW_TIMER_ID, TIMER_RESOLUTION, &timer_fired, &timer_overflow);
     assert(err == SUCCESS);
 
-    timer_info = hw_timer_get_info(HW_TIMER_ID);
+    NG(timer_info) = hw_timer_get_info(HW_TIMER_ID);
 }
 
 error_t timer_init_event(timer_event* event, task_t callback)
@@ -83,11 +77,22 @@ error_t timer_init_event(timer_event* event, task_t callback)
     event->arg = NULL;
     event->priority = MAX_PRIORITY;
     event->period = 0;
-    return (sched_register_task(callback)); // register the function callback to be called at the end of the timeout
+    // register the function callback to be called at the end of the timeout
+    return (sched_register_task_handle(callback, &event->handle));
+}
+
+// the events posted with a timer_event have the handle of their task, the others are looked up by the scheduler
+static inline error_t post_to_scheduler(task_t task, sched_task_handle_t handle, uint8_t priority, void *arg)
+{
+    if (handle != SCHED_NO_TASK_HANDLE)
+        return (sched_post_task_handle_prio(handle, priority, arg));
+
+    return (sched_post_task_prio(task, priority, arg));
 }
 
 static bool configure_next_event();
-__LINK_C error_t timer_post_task_prio(task_t task, timer_tick_t fire_time, uint8_t priority, timer_tick_t period, void *arg)
+static error_t post_task(task_t task, sched_task_handle_t handle, timer_tick_t fire_time, uint8_t priority,
+                         timer_tick_t period, void *arg)
 {
     error_t status = ENOMEM;
     if (priority > MIN_PRIORITY)
@@ -98,44 +103,40 @@ __LINK_C error_t timer_post_task_prio(task_t task, timer_tick_t fire_time, uint8
     if (fire_time == 0)
     {
         DPRINT("No delay, so the timer event callback is scheduled immediately");
-        return (sched_post_task_prio(task, priority, arg));
+        return (post_to_scheduler(task, handle, priority, arg));
     }
 
     bool conf_atomic_ended = false;
     start_atomic();
-    uint32_t empty_index = FRAMEWORK_TIMER_STACK_SIZE;
-    for (uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+    uint32_t empty_index = timer_queue_find(task);
+    if (empty_index != NO_EVENT)
     {
-        if (NG(timers)[i].f == 0x0 && empty_index == FRAMEWORK_TIMER_STACK_SIZE)
-        {
-            empty_index = i;
-        }
-        else if (NG(timers)[i].f == task)
+        // it is allowed to update only the fire time
+        if (NG(timers)[empty_index].priority == priority)
         {
-            // it is allowed to update only the fire time
-            if (NG(timers)[i].priority == priority)
-            {
-                NG(timers)[i].period = period;
-                NG(timers)[i].next_event = fire_time;
-                empty_index = i;
-                goto config;
-            }
-            else
-            //for now: do not allow an event to be scheduled more than once
-            //otherwise we risk having the same task being scheduled twice and only executed once
-            //because the scheduler disallows the same task to be scheduled multiple times
-                status = EALREADY;
-            break;
+            NG(timers)[empty_index].handle = handle;
+            NG(timers)[empty_index].period = period;
+            NG(timers)[empty_index].next_event = fire_time;
+            timer_queue_update(empty_index);
+            goto config;
         }
+        //for now: do not allow an event to be scheduled more than once
+        //otherwise we risk having the same task being scheduled twice and only executed once
+        //because the scheduler disallows the same task to be scheduled multiple times
+        status = EALREADY;
+        goto end;
     }
 
-    if (status != EALREADY && empty_index != FRAMEWORK_TIMER_STACK_SIZE)
+    empty_index = timer_queue_alloc();
+    if (empty_index != NO_EVENT)
     {
         NG(timers)[empty_index].f = task;
         NG(timers)[empty_index].next_event = fire_time;
         NG(timers)[empty_index].priority = priority;
+        NG(timers)[empty_index].handle = handle;
         NG(timers)[empty_index].arg = arg;
         NG(timers)[empty_index].period = period;
+        timer_queue_insert(empty_index);
     }
     else
         goto end;
@@ -179,6 +180,11 @@ end:
     return status;
 }
 
+__LINK_C error_t timer_post_task_prio(task_t task, timer_tick_t fire_time, uint8_t priority, timer_tick_t period, void *arg)
+{
+    return post_task(task, SCHED_NO_TASK_HANDLE, fire_time, priority, period, arg);
+}
+
 __LINK_C error_t timer_cancel_task(task_t task)
 {
     error_t status = EALREADY;
@@ -187,20 +193,16 @@ __LINK_C error_t timer_cancel_task(task_t task)
 
     start_atomic();
 
-    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+    uint32_t index = timer_queue_find(task);
+    if(index != NO_EVENT)
     {
-      if(NG(timers)[i].f == task)
-      {
-        NG(timers)[i].f = 0x0;
+        timer_queue_remove(index);
         //if we were the first event to fire --> trigger a reconfiguration
-        if(NG(next_event) == i) {
+        if(NG(next_event) == index) {
             conf_atomic_ended = configure_next_event();
         }
-          
 
         status = SUCCESS;
-        break;
-      }
     }
     if(!conf_atomic_ended) { //if configure_next_event gets run, then atomic is ended in there. Otherwise we should end it here.
         end_atomic(); 
@@ -212,30 +214,24 @@ __LINK_C error_t timer_cancel_task(task_t task)
 
 error_t timer_add_event(timer_event* event)
 {
-    return timer_post_task_prio(event->f, timer_get_counter_value() + event->next_event, event->priority, event->period, event->arg);
+    return post_task(event->f, event->handle, timer_get_counter_value() + event->next_event, event->priority,
+                     event->period, event->arg);
 }
 
 void timer_cancel_event(timer_event* event)
 {
     timer_cancel_task(event->f);
-    sched_cancel_task(event->f);
+    if (event->handle != SCHED_NO_TASK_HANDLE)
+        sched_cancel_task_handle(event->handle);
+    else
+        sched_cancel_task(event->f);
 }
 
 __LINK_C bool timer_is_task_scheduled(task_t task)
 {
-    bool present = false;
-
     start_atomic();
-
-     for (uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
-     {
-       if (NG(timers)[i].f == task)
-       {
-          present = true;
-          break;
-       }
-     }
-     end_atomic();
+    bool present = (timer_queue_find(task) != NO_EVENT);
+    end_atomic();
 
      return present;
 }
@@ -264,25 +260,7 @@ __LINK_C timer_tick_t timer_get_counter_value()
 static uint32_t get_next_event()
 {
     //this function should only be called from an atomic context
-    int32_t min_delay;
-    uint32_t next_fire_event = NO_EVENT;
-    uint32_t counter = timer_get_counter_value();
-
-    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
-    {
-    	if(NG(timers)[i].f == 0x0)
-    		continue;
-    	//trick borrowed from AODV: by using signed integers in this way
-    	//we know that if the event has already passed delay_ticks will be < 0
-    	// --> events are sorted from past -> future regardless of any (pending) overflows
-    	int32_t delay_ticks = ((int32_t)NG(timers)[i].next_event) - ((int32_t)counter);
-    	if(next_fire_event == NO_EVENT || delay_ticks < min_delay)
-		{
-    		min_delay = delay_ticks;
-			next_fire_event = i;
-		}
-    }
-    return next_fire_event;
+    return timer_queue_peek(timer_get_counter_value());
 }
 
 static bool configure_next_event()
@@ -291,7 +269,7 @@ static bool configure_next_event()
 	timer_tick_t next_fire_time;
     timer_tick_t current_time = timer_get_counter_value();
 
-    timer_busy_programming = true;
+    NG(timer_busy_programming) = true;
 
     do
     {
@@ -302,22 +280,22 @@ static bool configure_next_event()
 		if(NG(next_event) != NO_EVENT)
 		{
 			next_fire_time = NG(timers)[NG(next_event)].next_event;
-      if ( (((int32_t)next_fire_time) - ((int32_t)current_time) - timer_info->min_delay_ticks) <= 0 )
+      if ( (((int32_t)next_fire_time) - ((int32_t)current_time) - NG(timer_info)->min_delay_ticks) <= 0 )
 			{
                 DPRINT("will be late, sched immediately\n\n");
                 if(NG(timers)[NG(next_event)].f == 0)
                     DPRINT("function was empty, skipping");
                 else {
-                    fired_by_interrupt = false;
+                    NG(fired_by_interrupt) = false;
                     timer_fired();
                 }
 			}
 		}
     }
-    while(NG(next_event) != NO_EVENT && ( (((int32_t)next_fire_time) - ((int32_t)current_time)  - timer_info->min_delay_ticks) <= 0  ) );
+    while(NG(next_event) != NO_EVENT && ( (((int32_t)next_fire_time) - ((int32_t)current_time)  - NG(timer_info)->min_delay_ticks) <= 0  ) );
 
     // if recursive event was scheduled immediately, don't set hw timer delay until last time in configure next event
-    if(!fired_by_interrupt)
+    if(!NG(fired_by_interrupt))
         return false;
 
     //at this point NG(next_event) is eiter equal to NO_EVENT (no tasks left)
@@ -347,7 +325,7 @@ static bool configure_next_event()
 #ifndef NDEBUG	    
 			//check that we didn't try to schedule a timer in the past
 			//normally this shouldn't happen but it IS theoretically possible...
-      fire_delay = (next_fire_time - current_time - timer_info->min_delay_ticks);
+      fire_delay = (next_fire_time - current_time - NG(timer_info)->min_delay_ticks);
 			//fire_delay should be in [0,COUNTER_OVERFLOW_INCREASE]. if this is not the case, it is because timer_get_counter() is
 			//now larger than next_fire_event, which means we 'missed' the event
 			assert(((int32_t)fire_delay) > 0);
@@ -363,7 +341,7 @@ static bool configure_next_event()
 		    hw_timer_cancel(HW_TIMER_ID);
 		}
     }
-    timer_busy_programming = false;
+    NG(timer_busy_programming) = false;
     return called_atomic;
 }
 
@@ -393,7 +371,7 @@ static void timer_overflow()
 		timer_tick_t fire_time = (NG(timers)[NG(next_event)].next_event - NG(timer_offset));
 
 		//fire time already passed
-		if(fire_time <= (hw_timer_getvalue(HW_TIMER_ID) + timer_info->min_delay_ticks))
+		if(fire_time <= (hw_timer_getvalue(HW_TIMER_ID) + NG(timer_info)->min_delay_ticks))
 			timer_fired();
 		else
 		{
@@ -409,35 +387,41 @@ static void timer_overflow()
 
 static void timer_fired()
 {
-    if(timer_busy_programming && fired_by_interrupt)
+    if(NG(timer_busy_programming) && NG(fired_by_interrupt))
         return;
     assert(NG(next_event) != NO_EVENT);
     assert(NG(timers)[NG(next_event)].f != 0x0);
     timer_tick_t current_time = timer_get_counter_value();
 #ifdef FRAMEWORK_LOG_ENABLED
     // if event got fired to early, show error logging
-    if((current_time + timer_info->min_delay_ticks) < NG(timers)[NG(next_event)].next_event)
+    if((current_time + NG(timer_info)->min_delay_ticks) < NG(timers)[NG(next_event)].next_event)
         log_print_error_string("timer fired too early with current time %i + min delay ticks %i < next event %i: function 0x%X",
-            current_time, timer_info->min_delay_ticks, NG(timers)[NG(next_event)].next_event, NG(timers)[NG(next_event)].f);
+            current_time, NG(timer_info)->min_delay_ticks, NG(timers)[NG(next_event)].next_event, NG(timers)[NG(next_event)].f);
     else if(current_time > (NG(timers)[NG(next_event)].next_event + 5))
         log_print_error_string("timer fired too late with current time %i > next event %i + 5: function 0x%X",
-            current_time, timer_info->min_delay_ticks, NG(timers)[NG(next_event)].next_event, NG(timers)[NG(next_event)].f);
+            current_time, NG(timer_info)->min_delay_ticks, NG(timers)[NG(next_event)].next_event, NG(timers)[NG(next_event)].f);
 #endif
     // check if the current task is the watchdog bump task and if we're not nearly reaching the reset
     timer_tick_t repost_time_diff = sched_check_software_watchdog(NG(timers)[NG(next_event)].f, current_time);
 
-    sched_post_task_prio(
-        NG(timers)[NG(next_event)].f, NG(timers)[NG(next_event)].priority, NG(timers)[NG(next_event)].arg);
+    post_to_scheduler(NG(timers)[NG(next_event)].f, NG(timers)[NG(next_event)].handle, NG(timers)[NG(next_event)].priority,
+                      NG(timers)[NG(next_event)].arg);
 
     if(repost_time_diff)
+    {
         NG(timers)[NG(next_event)].next_event = current_time + repost_time_diff;
+        timer_queue_update(NG(next_event));
+    }
     else if(NG(timers)[NG(next_event)].period > 0)
+    {
         NG(timers)[NG(next_event)].next_event = current_time + NG(timers)[NG(next_event)].period;
+        timer_queue_update(NG(next_event));
+    }
     else
-        NG(timers)[NG(next_event)].f = 0x0;
+        timer_queue_remove(NG(next_event));
 
-    if(fired_by_interrupt)
+    if(NG(fired_by_interrupt))
         configure_next_event();
     else
-        fired_by_interrupt = true;
+        NG(fired_by_interrupt) = true;
 }
\ No newline at end of file
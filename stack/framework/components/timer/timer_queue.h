@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file timer_queue.h
+ * \brief Internal interface between the framework timer and its event queue backend.
+ *
+ * The framework timer (timer.c) owns the pool of timer events and the interaction with the
+ * hardware timer. The queue backend only keeps track of which pool entries are in use, which
+ * entry belongs to which task and which entry expires first. The backend is selected at build
+ * time through the FRAMEWORK_TIMER_BACKEND CMake property:
+ *  - LINEAR: every operation scans the full pool (smallest footprint, O(n))
+ *  - HEAP: binary min-heap on the fire time combined with a task lookup table,
+ *          O(1) lookup and next deadline, O(log n) insert and cancel
+ *
+ * All functions must be called from an atomic context.
+ */
+#ifndef TIMER_QUEUE_H_
+#define TIMER_QUEUE_H_
+
+#include "timer.h"
+#include "ng.h"
+#include "framework_defs.h"
+
+enum
+{
+    NO_EVENT = FRAMEWORK_TIMER_STACK_SIZE,
+};
+
+/*! \brief The pool of timer events, indexed by the values returned by the queue functions */
+extern timer_event NGDEF(timers)[FRAMEWORK_TIMER_STACK_SIZE];
+
+/*! \brief Initialise the queue, all entries of the pool are considered free */
+void timer_queue_init();
+
+/*! \brief Find the pool entry used by task, or NO_EVENT when the task is not queued */
+uint32_t timer_queue_find(task_t task);
+
+/*! \brief Claim a free pool entry, or NO_EVENT when the pool is exhausted.
+ *
+ * The caller fills in the event and calls timer_queue_insert() afterwards.
+ */
+uint32_t timer_queue_alloc();
+
+/*! \brief Add a filled in pool entry to the queue */
+void timer_queue_insert(uint32_t index);
+
+/*! \brief Reorder the queue after the next_event of a queued entry has changed */
+void timer_queue_update(uint32_t index);
+
+/*! \brief Remove an entry from the queue and release it to the pool */
+void timer_queue_remove(uint32_t index);
+
+/*! \brief Get the entry which expires first, or NO_EVENT when the queue is empty
+ *
+ * \param counter   The current counter value, used to order the events in a circular fashion
+ */
+uint32_t timer_queue_peek(timer_tick_t counter);
+
+#endif /* TIMER_QUEUE_H_ */
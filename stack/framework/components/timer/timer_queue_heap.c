@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file timer_queue_heap.c
+ * \brief Heap based timer queue backend.
+ *
+ * The queued pool entries are kept in a binary min-heap ordered on their fire time, so the next
+ * deadline is always found at the root. A small open addressing table (linear probing, keyed on
+ * the task) maps tasks onto their pool entry and the free pool entries are kept on a stack.
+ * This makes lookup, allocation and next deadline O(1) and insert, update and cancel O(log n),
+ * so the time spent in an atomic section does not grow linearly with the number of pending timers.
+ */
+
+#include "timer_queue.h"
+#include "debug.h"
+
+// the task table is kept at least half empty to keep the probe sequences short
+#define TASK_TABLE_SIZE POW2_CEIL(2 * FRAMEWORK_TIMER_STACK_SIZE)
+#define TASK_TABLE_MASK (TASK_TABLE_SIZE - 1)
+
+_Static_assert(FRAMEWORK_TIMER_STACK_SIZE < 0x8000, "FRAMEWORK_TIMER_STACK_SIZE too large for the heap timer backend");
+
+static uint16_t NGDEF(heap)[FRAMEWORK_TIMER_STACK_SIZE];
+static uint16_t NGDEF(heap_pos)[FRAMEWORK_TIMER_STACK_SIZE];
+static uint16_t NGDEF(heap_size);
+static uint16_t NGDEF(free_stack)[FRAMEWORK_TIMER_STACK_SIZE];
+static uint16_t NGDEF(free_count);
+static uint16_t NGDEF(task_table)[TASK_TABLE_SIZE];
+
+static inline uint32_t task_hash(task_t task)
+{
+    uint32_t h = (uint32_t)(uintptr_t)task;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6dU;
+    h ^= h >> 12;
+    return h & TASK_TABLE_MASK;
+}
+
+static inline bool fires_before(uint16_t a, uint16_t b)
+{
+    // signed difference, to keep the ordering correct when the counter overflows
+    return ((int32_t)(NG(timers)[a].next_event - NG(timers)[b].next_event)) < 0;
+}
+
+static inline void heap_place(uint16_t index, uint32_t pos)
+{
+    NG(heap)[pos] = index;
+    NG(heap_pos)[index] = pos;
+}
+
+static void sift_up(uint32_t pos)
+{
+    uint16_t index = NG(heap)[pos];
+    while(pos > 0)
+    {
+        uint32_t parent = (pos - 1) >> 1;
+        if(!fires_before(index, NG(heap)[parent]))
+            break;
+
+        heap_place(NG(heap)[parent], pos);
+        pos = parent;
+    }
+
+    heap_place(index, pos);
+}
+
+static void sift_down(uint32_t pos)
+{
+    uint16_t index = NG(heap)[pos];
+    for(;;)
+    {
+        uint32_t child = (pos << 1) + 1;
+        if(child >= NG(heap_size))
+            break;
+
+        if(child + 1 < NG(heap_size) && fires_before(NG(heap)[child + 1], NG(heap)[child]))
+            child++;
+
+        if(!fires_before(NG(heap)[child], index))
+            break;
+
+        heap_place(NG(heap)[child], pos);
+        pos = child;
+    }
+
+    heap_place(index, pos);
+}
+
+static void task_table_remove(uint16_t index)
+{
+    uint32_t slot = task_hash(NG(timers)[index].f);
+    while(NG(task_table)[slot] != index)
+    {
+        assert(NG(task_table)[slot] != NO_EVENT);
+        slot = (slot + 1) & TASK_TABLE_MASK;
+    }
+
+    // backward shift deletion: move up entries which would otherwise become unreachable
+    uint32_t hole = slot;
+    for(;;)
+    {
+        slot = (slot + 1) & TASK_TABLE_MASK;
+        uint16_t entry = NG(task_table)[slot];
+        if(entry == NO_EVENT)
+            break;
+
+        uint32_t home = task_hash(NG(timers)[entry].f);
+        if(((slot - home) & TASK_TABLE_MASK) >= ((slot - hole) & TASK_TABLE_MASK))
+        {
+            NG(task_table)[hole] = entry;
+            hole = slot;
+        }
+    }
+
+    NG(task_table)[hole] = NO_EVENT;
+}
+
+void timer_queue_init()
+{
+    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+    {
+        NG(timers)[i].f = 0x0;
+        NG(free_stack)[i] = FRAMEWORK_TIMER_STACK_SIZE - 1 - i;
+    }
+
+    for(uint32_t i = 0; i < TASK_TABLE_SIZE; i++)
+        NG(task_table)[i] = NO_EVENT;
+
+    NG(free_count) = FRAMEWORK_TIMER_STACK_SIZE;
+    NG(heap_size) = 0;
+}
+
+uint32_t timer_queue_find(task_t task)
+{
+    uint32_t slot = task_hash(task);
+    uint16_t entry;
+    while((entry = NG(task_table)[slot]) != NO_EVENT)
+    {
+        if(NG(timers)[entry].f == task)
+            return entry;
+
+        slot = (slot + 1) & TASK_TABLE_MASK;
+    }
+
+    return NO_EVENT;
+}
+
+uint32_t timer_queue_alloc()
+{
+    if(NG(free_count) == 0)
+        return NO_EVENT;
+
+    return NG(free_stack)[--NG(free_count)];
+}
+
+void timer_queue_insert(uint32_t index)
+{
+    uint32_t slot = task_hash(NG(timers)[index].f);
+    while(NG(task_table)[slot] != NO_EVENT)
+        slot = (slot + 1) & TASK_TABLE_MASK;
+
+    NG(task_table)[slot] = index;
+
+    NG(heap)[NG(heap_size)] = index;
+    sift_up(NG(heap_size)++);
+}
+
+void timer_queue_update(uint32_t index)
+{
+    uint32_t pos = NG(heap_pos)[index];
+    if(pos > 0 && fires_before(index, NG(heap)[(pos - 1) >> 1]))
+        sift_up(pos);
+    else
+        sift_down(pos);
+}
+
+void timer_queue_remove(uint32_t index)
+{
+    task_table_remove(index);
+
+    uint32_t pos = NG(heap_pos)[index];
+    uint16_t last = NG(heap)[--NG(heap_size)];
+    if(last != index)
+    {
+        heap_place(last, pos);
+        timer_queue_update(last);
+    }
+
+    NG(timers)[index].f = 0x0;
+    NG(free_stack)[NG(free_count)++] = index;
+}
+
+uint32_t timer_queue_peek(timer_tick_t counter)
+{
+    (void)counter;
+    if(NG(heap_size) == 0)
+        return NO_EVENT;
+
+    return NG(heap)[0];
+}
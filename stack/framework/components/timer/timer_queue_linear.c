@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file timer_queue_linear.c
+ * \brief Linear timer queue backend: the pool itself is the queue and every lookup scans it.
+ */
+
+#include "timer_queue.h"
+
+void timer_queue_init()
+{
+    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+        NG(timers)[i].f = 0x0;
+}
+
+uint32_t timer_queue_find(task_t task)
+{
+    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+    {
+        if(NG(timers)[i].f == task)
+            return i;
+    }
+
+    return NO_EVENT;
+}
+
+uint32_t timer_queue_alloc()
+{
+    return timer_queue_find(0x0);
+}
+
+void timer_queue_insert(uint32_t index)
+{
+    // nothing to do, an entry is queued as soon as its callback is set
+}
+
+void timer_queue_update(uint32_t index)
+{
+    // nothing to do, the order is determined in timer_queue_peek()
+}
+
+void timer_queue_remove(uint32_t index)
+{
+    NG(timers)[index].f = 0x0;
+}
+
+uint32_t timer_queue_peek(timer_tick_t counter)
+{
+    int32_t min_delay;
+    uint32_t next_fire_event = NO_EVENT;
+
+    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+    {
+        if(NG(timers)[i].f == 0x0)
+            continue;
+        //trick borrowed from AODV: by using signed integers in this way
+        //we know that if the event has already passed delay_ticks will be < 0
+        // --> events are sorted from past -> future regardless of any (pending) overflows
+        int32_t delay_ticks = ((int32_t)NG(timers)[i].next_event) - ((int32_t)counter);
+        if(next_fire_event == NO_EVENT || delay_ticks < min_delay)
+        {
+            min_delay = delay_ticks;
+            next_fire_event = i;
+        }
+    }
+    return next_fire_event;
+}
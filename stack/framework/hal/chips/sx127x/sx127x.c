@@ -190,6 +190,7 @@ static release_packet_callback_t release_packet_callback;
 static rx_packet_callback_t rx_packet_callback;
 static tx_packet_callback_t tx_packet_callback;
 static rx_packet_header_callback_t rx_packet_header_callback;
+static rx_packet_chunk_callback_t rx_packet_chunk_callback;
 static tx_refill_callback_t tx_refill_callback;
 
 static tx_lora_packet_callback_t tx_lora_packet_callback;
@@ -644,6 +645,7 @@ static void fifo_threshold_isr() {
    hw_gpio_disable_interrupt(SX127x_DIO1_PIN);
    DPRINT("THR ISR with IRQ %x\n", read_reg(REG_IRQFLAGS2));
    assert(state == STATE_RX);
+   uint16_t chunk_offset = FskPacketHandler_sx127x.NbBytes;
 
    if (FskPacketHandler_sx127x.Size == 0 && FskPacketHandler_sx127x.NbBytes == 0)
    {
@@ -700,6 +702,10 @@ static void fifo_threshold_isr() {
       }
    }
 
+   // let the upper layer process the bytes read so far while the rest is still being received
+   if(rx_packet_chunk_callback && (FskPacketHandler_sx127x.NbBytes > chunk_offset))
+      rx_packet_chunk_callback(current_packet, chunk_offset, FskPacketHandler_sx127x.NbBytes - chunk_offset);
+
    if(remaining_bytes == 0) {
     current_packet->rx_meta.timestamp = timer_get_counter_value();
     current_packet->rx_meta.crc_status = HW_CRC_UNAVAILABLE;
@@ -786,6 +792,7 @@ error_t hw_radio_init(hwradio_init_args_t* init_args) {
   release_packet_callback = init_args->release_packet_cb;
   rx_packet_callback = init_args->rx_packet_cb;
   rx_packet_header_callback = init_args->rx_packet_header_cb;
+  rx_packet_chunk_callback = init_args->rx_packet_chunk_cb;
   tx_packet_callback = init_args->tx_packet_cb;
   tx_refill_callback = init_args->tx_refill_cb;
 
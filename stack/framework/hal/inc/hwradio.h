@@ -227,6 +227,26 @@ typedef void (*rx_packet_callback_t)(hw_radio_packet_t* packet);
 typedef void (*rx_packet_header_callback_t)(uint8_t* data, uint8_t len);
 
 
+/** \brief Type definition for the rx chunk callback function
+ *
+ * The rx_packet_chunk_callback_t function is called by the radio driver every time a new part of the packet is read
+ * from the RX FIFO into the buffer of the packet, so the upper layer can start processing the packet while the rest
+ * of it is still being received. The chunks are delivered in order and the first one starts at offset 0. When the
+ * last chunk has been delivered the rx_packet_callback function is called as usual.
+ *
+ * This callback is optional: drivers which do not support it, or upper layers which supply 0x0, simply deliver the
+ * complete packet through the rx_packet_callback function.
+ *
+ * As with new_packet_callback_t, this function is called from an interrupt context.
+ *
+ * \param    packet  The packet which is being received
+ * \param    offset  The offset of the chunk in packet->data
+ * \param    len     The length of the chunk
+ *
+ */
+typedef void (*rx_packet_chunk_callback_t)(hw_radio_packet_t* packet, uint16_t offset, uint16_t len);
+
+
 /** \brief Type definition for the tx callback function
  *
  * The tx_packet_callback_t function is called by the radio driver upon completion of a packet transmission. 
@@ -321,6 +341,7 @@ typedef struct hwradio_init_args
     release_packet_callback_t release_packet_cb;
     rx_packet_callback_t rx_packet_cb;
     rx_packet_header_callback_t rx_packet_header_cb;
+    rx_packet_chunk_callback_t rx_packet_chunk_cb;
     tx_packet_callback_t tx_packet_cb;
     tx_refill_callback_t tx_refill_cb;
     tx_lora_packet_callback_t tx_lora_packet_cb;
@@ -77,6 +77,12 @@ __LINK_C __attribute__((weak)) void hw_deinit_pheriperals(void);
  */
 __LINK_C __attribute__((weak)) void hw_reinit_pheriperals(void);
 
+/** \brief Called by the scheduler after every task it executed.
+ * This is a weak symbol which can be implemented in the platform if you want to use this, the NATIVE simulator uses it
+ * to let time pass while a node keeps polling without going to low power mode
+ */
+__LINK_C __attribute__((weak)) void hw_task_executed(void);
+
 /*! \brief Get a 64-bit identifier that is unique to the device on which this function is called.
  *
  * The exact manner in which this ID is generated depends on the specific platform. In general however,
@@ -25,18 +25,23 @@
 #include "fs.h"
 #include "hwblockdevice.h"
 #include "blockdevice_ram.h"
+#include "ng.h"
 
 #ifndef PLATFORM_NATIVE
     #error Mismatch between the configured platform and the actual platform. Expected PLATFORM_NATIVE to be defined
 #endif
 
-/** Platform BD drivers*/
-extern blockdevice_t * const metadata_blockdevice;
-extern blockdevice_t * const persistent_files_blockdevice;
-extern blockdevice_t * const volatile_blockdevice;
-#define PLATFORM_METADATA_BLOCKDEVICE metadata_blockdevice
-#define PLATFORM_PERMANENT_BLOCKDEVICE persistent_files_blockdevice
-#define PLATFORM_VOLATILE_BLOCKDEVICE volatile_blockdevice
+/** Platform BD drivers, every simulated node has its own (RAM) storage */
+extern blockdevice_t* NGDEF(_metadata_blockdevice);
+extern blockdevice_t* NGDEF(_persistent_files_blockdevice);
+extern blockdevice_t* NGDEF(_volatile_blockdevice);
+#define PLATFORM_METADATA_BLOCKDEVICE NG(_metadata_blockdevice)
+#define PLATFORM_PERMANENT_BLOCKDEVICE NG(_persistent_files_blockdevice)
+#define PLATFORM_VOLATILE_BLOCKDEVICE NG(_volatile_blockdevice)
+
+/** DMA channels of the modem interface, the simulated UART models the DMA transfers itself */
+#define PLATFORM_MODEM_INTERFACE_DMA_RX 0
+#define PLATFORM_MODEM_INTERFACE_DMA_TX 1
 
 #endif
 
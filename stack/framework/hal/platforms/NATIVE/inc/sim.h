@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file sim.h
+ * \addtogroup NATIVE
+ * \ingroup platforms
+ * @{
+ * \brief Discrete-event simulator driving the NATIVE platform
+ *
+ * On the NATIVE platform every node runs its own copy of the framework (scheduler, timer, ...)
+ * on a dedicated execution context. Time is purely virtual: whenever all nodes are in low power
+ * mode the simulator advances the clock to the next pending hardware event (timer compare/overflow,
+ * radio TX/RX completion, UART bytes) and resumes the node that owns it. No wall-clock time is spent waiting.
+ *
+ * The number of simulated nodes is configured with the PLATFORM_NATIVE_SIM_NODES cmake option, 1 by default.
+ * Every node runs the application, so applications which are not written for several nodes need the default.
+ * When more than one node is simulated the framework is compiled with NODE_GLOBALS, so every
+ * NG() variable gets a separate instance per node.
+ *
+ * Every UART port is wired in loopback: the bytes a node transmits are received by the same port after the time
+ * they take on the line at the configured baudrate, unless sim_uart_connect() wires it to a port of another node.
+ * GPIO pins are unconnected until sim_gpio_connect() wires an output to an input, which can then trigger interrupts.
+ *
+ * The simulation ends when sim_stop() is called or when no more events are pending.
+ */
+
+#ifndef __SIM_H_
+#define __SIM_H_
+
+#include "types.h"
+#include "link_c.h"
+#include "hwgpio.h"
+
+/*! \brief The resolution of the virtual clock, in ticks per second */
+#define SIM_TICKS_PER_SECOND 32768
+
+typedef uint64_t sim_time_t;
+
+typedef struct
+{
+    uint64_t events_processed;      /**< The number of events dispatched to nodes */
+    uint32_t frames_transmitted;    /**< The number of frames put on the medium */
+    uint32_t frames_received;       /**< The number of frames delivered to a receiving node */
+    uint32_t frames_collided;       /**< The number of receptions lost due to overlapping transmissions */
+    uint32_t frames_missed;         /**< The number of receptions aborted because the receiver left RX */
+    uint32_t rssi_measurements;     /**< The number of RSSI measurements, as done for CCA */
+    uint32_t rssi_busy;             /**< The number of RSSI measurements which found another node transmitting */
+    uint64_t uart_bytes_transmitted; /**< The number of bytes sent over the (loopback) UARTs */
+    uint32_t uart_bytes_corrupted;  /**< The number of bytes damaged on the UART lines by sim_uart_set_error_rate() */
+} sim_stats_t;
+
+/*! \brief Returns the number of simulated nodes */
+__LINK_C size_t sim_get_node_count(void);
+
+/*! \brief Returns the index of the node which is currently executing */
+__LINK_C size_t sim_get_node_id(void);
+
+/*! \brief Returns the current virtual time, in SIM_TICKS_PER_SECOND units since the start of the simulation */
+__LINK_C sim_time_t sim_get_time(void);
+
+/*! \brief Stops the simulation once the currently executing node enters low power mode */
+__LINK_C void sim_stop(void);
+
+/*! \brief Returns the statistics collected since the start of the simulation */
+__LINK_C const sim_stats_t* sim_get_stats(void);
+
+/*! \brief Makes the UART lines flip one bit in the given number of bytes per million transmitted bytes (0 disables).
+ * The errors are drawn from a fixed seed, so a simulation stays reproducible.
+ */
+__LINK_C void sim_uart_set_error_rate(uint32_t errors_per_million);
+
+/*! \brief Cross-wires two UART ports, so the bytes transmitted on one port are received on the other one. This
+ * replaces the loopback of both ports, the ports can be of different nodes.
+ */
+__LINK_C void sim_uart_connect(size_t node_a, uint8_t port_a, size_t node_b, uint8_t port_b);
+
+/*! \brief Wires a GPIO output to a GPIO input, possibly of another node. The input reads the level of the output, a
+ * level change triggers the interrupt configured on the input on the node owning it. Pins are numbered from 0 to 7.
+ */
+__LINK_C void sim_gpio_connect(size_t output_node, pin_id_t output_pin, size_t input_node, pin_id_t input_pin);
+
+#endif
+
+/** @}*/
@@ -24,47 +24,53 @@
 #include "debug.h"
 #include "hwdebug.h"
 #include "hwradio.h"
-#include "hwuart.h"
 #include "errors.h"
 #include "error_event_file.h"
 #include "blockdevice_ram.h"
 #include "framework_defs.h"
+#include "platform.h"
+#include "ng.h"
+#include "sim_internal.h"
 
 #define METADATA_SIZE (4 + 4 + (12 * FRAMEWORK_FS_FILE_COUNT))
 
-// on native we use a RAM blockdevice as NVM as well for now
-uint8_t d7ap_fs_metadata[METADATA_SIZE];
-uint8_t d7ap_files_data[FRAMEWORK_FS_PERMANENT_STORAGE_SIZE];
-uint8_t d7ap_volatile_files_data[FRAMEWORK_FS_VOLATILE_STORAGE_SIZE];
+// the scheduler feeds the watchdog every hw_watchdog_get_timeout() seconds. Use the timeout of the stm32 chips
+// (see stm32_common_watchdog.c), so simulated nodes wake up for the watchdog as often as real ones do
+#define WATCHDOG_TIMEOUT_SECONDS 18
 
-static blockdevice_ram_t metadata_bd = (blockdevice_ram_t){
-    .base.driver = &blockdevice_driver_ram,
-    .base.size = METADATA_SIZE,
-    .buffer = d7ap_fs_metadata
-};
+// on native we use a RAM blockdevice as NVM as well for now, every simulated node has its own storage
+static uint8_t NGDEF(_metadata)[METADATA_SIZE];
+static uint8_t NGDEF(_permanent_files_data)[FRAMEWORK_FS_PERMANENT_STORAGE_SIZE];
+static uint8_t NGDEF(_volatile_files_data)[FRAMEWORK_FS_VOLATILE_STORAGE_SIZE];
 
-static blockdevice_ram_t permanent_bd = (blockdevice_ram_t){
-    .base.driver = &blockdevice_driver_ram,
-    .base.size = FRAMEWORK_FS_PERMANENT_STORAGE_SIZE,
-    .buffer = d7ap_files_data
-};
+static blockdevice_ram_t NGDEF(_metadata_bd);
+static blockdevice_ram_t NGDEF(_permanent_bd);
+static blockdevice_ram_t NGDEF(_volatile_bd);
 
-static blockdevice_ram_t volatile_bd = (blockdevice_ram_t){
-    .base.driver = &blockdevice_driver_ram,
-    .base.size = FRAMEWORK_FS_VOLATILE_STORAGE_SIZE,
-    .buffer = d7ap_volatile_files_data
-};
+blockdevice_t* NGDEF(_metadata_blockdevice);
+blockdevice_t* NGDEF(_persistent_files_blockdevice);
+blockdevice_t* NGDEF(_volatile_blockdevice);
 
-blockdevice_t * const metadata_blockdevice = (blockdevice_t* const) &metadata_bd;
-blockdevice_t * const persistent_files_blockdevice = (blockdevice_t* const) &permanent_bd;
-blockdevice_t * const volatile_blockdevice = (blockdevice_t* const) &volatile_bd;
+static void init_ram_blockdevice(blockdevice_ram_t* ram_bd, uint8_t* buffer, uint32_t size)
+{
+    *ram_bd = (blockdevice_ram_t){
+        .base.driver = &blockdevice_driver_ram,
+        .base.size = size,
+        .buffer = buffer
+    };
 
+    blockdevice_init((blockdevice_t*) ram_bd);
+}
 
 void __platform_init()
 {
-    blockdevice_init(metadata_blockdevice);
-    blockdevice_init(persistent_files_blockdevice);
-    blockdevice_init(volatile_blockdevice);
+    init_ram_blockdevice(&NG(_metadata_bd), NG(_metadata), METADATA_SIZE);
+    init_ram_blockdevice(&NG(_permanent_bd), NG(_permanent_files_data), FRAMEWORK_FS_PERMANENT_STORAGE_SIZE);
+    init_ram_blockdevice(&NG(_volatile_bd), NG(_volatile_files_data), FRAMEWORK_FS_VOLATILE_STORAGE_SIZE);
+
+    NG(_metadata_blockdevice) = (blockdevice_t*) &NG(_metadata_bd);
+    NG(_persistent_files_blockdevice) = (blockdevice_t*) &NG(_permanent_bd);
+    NG(_volatile_blockdevice) = (blockdevice_t*) &NG(_volatile_bd);
 }
 
 void __platform_post_framework_init()
@@ -73,15 +79,15 @@ void __platform_post_framework_init()
 
 error_t low_level_read_cb(uint32_t address, uint8_t *data, uint8_t size)
 {
-    return blockdevice_driver_ram.read(persistent_files_blockdevice, data, address, size);
+    return blockdevice_driver_ram.read(PLATFORM_PERMANENT_BLOCKDEVICE, data, address, size);
 }
 
 error_t low_level_write_cb(uint32_t address, const uint8_t *data, uint8_t size)
 {
-    return blockdevice_driver_ram.program(persistent_files_blockdevice, data, address, size);
+    return blockdevice_driver_ram.program(PLATFORM_PERMANENT_BLOCKDEVICE, data, address, size);
 }
 
-int main()
+static void node_main()
 {
     //initialise the platform itself
     __platform_init();
@@ -91,27 +97,19 @@ int main()
     __platform_post_framework_init();
 
     scheduler_run();
+}
+
+int main()
+{
+    // every simulated node runs node_main() on its own context, until no more events are pending
+    sim_run(&node_main);
     return 0;
 }
 
 // empty stubs
-__LINK_C uart_handle_t* uart_init(uint8_t port_idx, uint32_t baudrate, uint8_t pins) {}
-__LINK_C bool uart_enable(uart_handle_t* uart) {}
-__LINK_C bool uart_disable(uart_handle_t* uart) {}
-__LINK_C void uart_send_bytes(uart_handle_t* uart, void const *data, size_t length) {}
-__LINK_C error_t uart_rx_interrupt_enable(uart_handle_t* uart) {}
-__LINK_C void uart_set_rx_interrupt_callback(uart_handle_t* uart, uart_rx_inthandler_t rx_handler) {}
-__LINK_C void uart_set_error_callback(uart_handle_t* uart, uart_error_handler_t error_handler) {}
-__LINK_C error_t hw_gpio_set(pin_id_t pin_id) {}
 system_reboot_reason_t hw_system_reboot_reason(void) {}
-__LINK_C void hw_enter_lowpower_mode(uint8_t mode) {}
-__LINK_C hwtimer_tick_t hw_timer_getvalue(hwtimer_id_t timer_id) {}
-__LINK_C const hwtimer_info_t* hw_timer_get_info(hwtimer_id_t timer_id) {}
-__LINK_C error_t hw_timer_schedule(hwtimer_id_t timer_id, hwtimer_tick_t tick ) {}
-__LINK_C error_t hw_timer_init(hwtimer_id_t timer_id, uint8_t frequency, timer_callback_t compare_callback, timer_callback_t overflow_callback) {}
-__LINK_C bool hw_timer_is_overflow_pending(hwtimer_id_t id) {}
-__LINK_C error_t hw_timer_cancel(hwtimer_id_t timer_id) {}
-__LINK_C uint64_t hw_get_unique_id(void) { return 0xFFFFFFFFFFFFFF;}
+__LINK_C uint64_t hw_get_unique_id(void) { return 0xFFFFFFFFFFFFFF - sim_get_node_id(); }
+__LINK_C void hw_reset(void) { assert(false); } // rebooting a simulated node is not supported
 __LINK_C void hw_watchdog_feed(void) {};
 __LINK_C void __watchdog_init(void) {};
-__LINK_C void hw_watchdog_get_timeout(void) {};
+__LINK_C uint8_t hw_watchdog_get_timeout(void) { return WATCHDOG_TIMEOUT_SECONDS; };
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "debug.h"
+#include "hwsystem.h"
+#include "ng.h"
+#include "platform_defs.h"
+#include "sim_internal.h"
+
+#if !defined(NODE_GLOBALS) && (PLATFORM_NATIVE_SIM_NODES > 1)
+    #error Simulating more than one node requires the framework to be built with NODE_GLOBALS
+#endif
+
+#if defined(NODE_GLOBALS) && (PLATFORM_NATIVE_SIM_NODES > NODE_GLOBALS_MAX_NODES)
+    #error PLATFORM_NATIVE_SIM_NODES exceeds NODE_GLOBALS_MAX_NODES
+#endif
+
+#define SIM_NODE_STACK_SIZE (64 * 1024)
+
+// Tasks take no virtual time, so a node which keeps posting tasks without going to sleep, for example while polling a
+// pin driven by another node, would never let the others run. A node which executes more tasks than this within one
+// tick waits for the next tick, during which the other nodes and the interrupts of the busy node are handled.
+#define SIM_TASKS_PER_TICK 64
+
+typedef struct
+{
+    ucontext_t context;
+    void* stack;
+    sim_event_t event;      // the event which resumed the node
+    sim_time_t task_time;   // the tick in which task_count tasks were executed
+    uint32_t task_count;
+} sim_node_t;
+
+sim_stats_t sim_stats;
+
+static sim_node_t* nodes;
+static size_t current_node = 0;
+static sim_time_t current_time = 0;
+static bool stopped = false;
+static ucontext_t loop_context;
+static void (*node_main_function)(void);
+
+// binary min-heap of pending events, ordered by (time, kind, seq)
+static sim_event_t* queue;
+static size_t queue_size = 0;
+static size_t queue_capacity = 0;
+static uint64_t next_seq = 0;
+
+static inline bool event_before(const sim_event_t* a, const sim_event_t* b)
+{
+    if(a->time != b->time)
+        return a->time < b->time;
+
+    if(a->kind != b->kind)
+        return a->kind < b->kind;
+
+    return a->seq < b->seq;
+}
+
+void sim_post_event(size_t node, sim_time_t time, sim_event_kind_t kind, uint32_t generation, void* data)
+{
+    assert(node < PLATFORM_NATIVE_SIM_NODES);
+    assert(time >= current_time);
+
+    if(queue_size == queue_capacity)
+    {
+        queue_capacity = queue_capacity ? 2 * queue_capacity : 64;
+        queue = realloc(queue, queue_capacity * sizeof(sim_event_t));
+        assert(queue != NULL);
+    }
+
+    sim_event_t event = {
+        .time = time,
+        .seq = next_seq++,
+        .node = node,
+        .generation = generation,
+        .data = data,
+        .kind = kind
+    };
+
+    size_t pos = queue_size++;
+    while(pos > 0)
+    {
+        size_t parent = (pos - 1) / 2;
+        if(!event_before(&event, &queue[parent]))
+            break;
+
+        queue[pos] = queue[parent];
+        pos = parent;
+    }
+
+    queue[pos] = event;
+}
+
+static sim_event_t pop_event()
+{
+    sim_event_t top = queue[0];
+    queue_size--;
+    if(queue_size == 0)
+        return top;
+
+    sim_event_t last = queue[queue_size];
+    size_t pos = 0;
+    while(true)
+    {
+        size_t child = 2 * pos + 1;
+        if(child >= queue_size)
+            break;
+
+        if(child + 1 < queue_size && event_before(&queue[child + 1], &queue[child]))
+            child++;
+
+        if(!event_before(&queue[child], &last))
+            break;
+
+        queue[pos] = queue[child];
+        pos = child;
+    }
+
+    queue[pos] = last;
+    return top;
+}
+
+static void node_entry()
+{
+    node_main_function();
+    assert(false); // the scheduler loop never returns
+}
+
+static void switch_to_node(size_t node)
+{
+    current_node = node;
+#ifdef NODE_GLOBALS
+    set_node_global_id(node);
+#endif
+    swapcontext(&loop_context, &nodes[node].context);
+}
+
+static void dispatch_event(const sim_event_t* event)
+{
+    switch(event->kind)
+    {
+        case SIM_EVENT_TIMER_OVERFLOW:
+        case SIM_EVENT_TIMER_COMPARE:
+            sim_timer_handle_event(event);
+            break;
+        case SIM_EVENT_RADIO_TX_DONE:
+        case SIM_EVENT_RADIO_RX_DONE:
+        case SIM_EVENT_RADIO_TX_START:
+            sim_radio_handle_event(event);
+            break;
+        case SIM_EVENT_UART_RX:
+        case SIM_EVENT_UART_TX_DONE:
+            sim_uart_handle_event(event);
+            break;
+        case SIM_EVENT_GPIO_EDGE:
+            sim_gpio_handle_event(event);
+            break;
+        case SIM_EVENT_BUSY_WAIT_DONE:
+            break;
+        default:
+            assert(false);
+    }
+}
+
+void sim_run(void (*node_main)(void))
+{
+    node_main_function = node_main;
+    nodes = calloc(PLATFORM_NATIVE_SIM_NODES, sizeof(sim_node_t));
+    assert(nodes != NULL);
+
+    sim_timer_init_nodes(PLATFORM_NATIVE_SIM_NODES);
+    sim_radio_init_nodes(PLATFORM_NATIVE_SIM_NODES);
+    sim_uart_init_nodes(PLATFORM_NATIVE_SIM_NODES);
+    sim_gpio_init_nodes(PLATFORM_NATIVE_SIM_NODES);
+
+    for(size_t i = 0; i < PLATFORM_NATIVE_SIM_NODES; i++)
+    {
+        nodes[i].stack = malloc(SIM_NODE_STACK_SIZE);
+        assert(nodes[i].stack != NULL);
+
+        getcontext(&nodes[i].context);
+        nodes[i].context.uc_stack.ss_sp = nodes[i].stack;
+        nodes[i].context.uc_stack.ss_size = SIM_NODE_STACK_SIZE;
+        nodes[i].context.uc_link = &loop_context;
+        makecontext(&nodes[i].context, node_entry, 0);
+
+        sim_post_event(i, 0, SIM_EVENT_BOOT, 0, NULL);
+    }
+
+    while(!stopped && queue_size > 0)
+    {
+        sim_event_t event = pop_event();
+
+        // cancelled or rescheduled timers are dropped without waking up the node
+        if(!sim_timer_event_is_current(&event))
+            continue;
+
+        current_time = event.time;
+        sim_stats.events_processed++;
+        nodes[event.node].event = event;
+        switch_to_node(event.node);
+    }
+}
+
+__LINK_C void hw_enter_lowpower_mode(uint8_t mode)
+{
+    // hand control back to the event loop, we are resumed when the next event for this node is due
+    sim_node_t* node = &nodes[current_node];
+    swapcontext(&node->context, &loop_context);
+    dispatch_event(&node->event);
+}
+
+void sim_wait_until(sim_time_t done_time)
+{
+    // the other nodes keep running while this one waits, and its own interrupts are handled in the meantime
+    sim_post_event(current_node, done_time, SIM_EVENT_BUSY_WAIT_DONE, 0, NULL);
+    while(current_time < done_time)
+        hw_enter_lowpower_mode(0);
+}
+
+__LINK_C void hw_busy_wait(int16_t microseconds)
+{
+    sim_wait_until(current_time + ((sim_time_t) microseconds * SIM_TICKS_PER_SECOND + 999999) / 1000000);
+}
+
+__LINK_C void hw_task_executed()
+{
+    sim_node_t* node = &nodes[current_node];
+    if(node->task_time != current_time)
+    {
+        node->task_time = current_time;
+        node->task_count = 0;
+    }
+
+    if(++node->task_count > SIM_TASKS_PER_TICK)
+        sim_wait_until(current_time + 1);
+}
+
+size_t sim_get_node_count()
+{
+    return PLATFORM_NATIVE_SIM_NODES;
+}
+
+size_t sim_get_node_id()
+{
+    return current_node;
+}
+
+sim_time_t sim_get_time()
+{
+    return current_time;
+}
+
+void sim_stop()
+{
+    stopped = true;
+}
+
+const sim_stats_t* sim_get_stats()
+{
+    return &sim_stats;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "debug.h"
+#include "errors.h"
+#include "hwgpio.h"
+#include "sim_internal.h"
+
+// Every node has SIM_GPIO_PIN_COUNT pins. A pin is only an input when sim_gpio_connect() wires it to an output pin,
+// possibly of another node, its level then follows that output and edges trigger the configured interrupt on the
+// node which owns the input. Unconnected inputs read low.
+#define SIM_GPIO_PIN_COUNT 8
+
+typedef struct sim_gpio sim_gpio_t;
+
+struct sim_gpio
+{
+    size_t node;
+    bool level;                 // the output level set with hw_gpio_set() and hw_gpio_clr()
+    sim_gpio_t* source;         // the output driving this pin, when it is an input
+    sim_gpio_t* sink;           // the input driven by this pin, when it is an output
+    gpio_cb_t callback;
+    void* arg;
+    uint8_t event_mask;
+    bool interrupt_enabled;
+};
+
+static sim_gpio_t* pins;
+
+void sim_gpio_init_nodes(size_t node_count)
+{
+    pins = calloc(node_count * SIM_GPIO_PIN_COUNT, sizeof(sim_gpio_t));
+    assert(pins != NULL);
+    for(size_t i = 0; i < node_count * SIM_GPIO_PIN_COUNT; i++)
+        pins[i].node = i / SIM_GPIO_PIN_COUNT;
+}
+
+static sim_gpio_t* get_pin(size_t node, pin_id_t pin_id)
+{
+    assert(pins != NULL && pin_id < SIM_GPIO_PIN_COUNT);
+    return &pins[node * SIM_GPIO_PIN_COUNT + pin_id];
+}
+
+void sim_gpio_connect(size_t output_node, pin_id_t output_pin, size_t input_node, pin_id_t input_pin)
+{
+    sim_gpio_t* output = get_pin(output_node, output_pin);
+    sim_gpio_t* input = get_pin(input_node, input_pin);
+    output->sink = input;
+    input->source = output;
+}
+
+static void set_level(pin_id_t pin_id, bool level)
+{
+    sim_gpio_t* pin = get_pin(sim_get_node_id(), pin_id);
+    if(pin->level == level)
+        return;
+
+    pin->level = level;
+    sim_gpio_t* input = pin->sink;
+    uint8_t edge = level ? GPIO_RISING_EDGE : GPIO_FALLING_EDGE;
+    if(input != NULL && input->interrupt_enabled && (input->event_mask & edge))
+        sim_post_event(input->node, sim_get_time(), SIM_EVENT_GPIO_EDGE, 0, input);
+}
+
+void sim_gpio_handle_event(const sim_event_t* event)
+{
+    sim_gpio_t* input = event->data;
+    if(input->interrupt_enabled)
+        input->callback(input->arg);
+}
+
+__LINK_C error_t hw_gpio_set(pin_id_t pin_id)
+{
+    set_level(pin_id, true);
+    return SUCCESS;
+}
+
+__LINK_C error_t hw_gpio_clr(pin_id_t pin_id)
+{
+    set_level(pin_id, false);
+    return SUCCESS;
+}
+
+__LINK_C error_t hw_gpio_toggle(pin_id_t pin_id)
+{
+    set_level(pin_id, !hw_gpio_get_out(pin_id));
+    return SUCCESS;
+}
+
+__LINK_C bool hw_gpio_get_out(pin_id_t pin_id)
+{
+    return get_pin(sim_get_node_id(), pin_id)->level;
+}
+
+__LINK_C bool hw_gpio_get_in(pin_id_t pin_id)
+{
+    sim_gpio_t* source = get_pin(sim_get_node_id(), pin_id)->source;
+    return source != NULL && source->level;
+}
+
+__LINK_C error_t hw_gpio_configure_interrupt(pin_id_t pin_id, uint8_t event_mask, gpio_cb_t callback, void *arg)
+{
+    sim_gpio_t* pin = get_pin(sim_get_node_id(), pin_id);
+    if(callback == NULL)
+        return EINVAL;
+
+    if(pin->callback != NULL && pin->callback != callback)
+        return EBUSY;
+
+    pin->callback = callback;
+    pin->arg = arg;
+    pin->event_mask = event_mask;
+    pin->interrupt_enabled = false;
+    return SUCCESS;
+}
+
+__LINK_C error_t hw_gpio_enable_interrupt(pin_id_t pin_id)
+{
+    sim_gpio_t* pin = get_pin(sim_get_node_id(), pin_id);
+    if(pin->callback == NULL)
+        return EOFF;
+
+    pin->interrupt_enabled = true;
+    return SUCCESS;
+}
+
+__LINK_C error_t hw_gpio_disable_interrupt(pin_id_t pin_id)
+{
+    sim_gpio_t* pin = get_pin(sim_get_node_id(), pin_id);
+    if(pin->callback == NULL)
+        return EOFF;
+
+    pin->interrupt_enabled = false;
+    return SUCCESS;
+}
+
+__LINK_C error_t hw_gpio_set_edge_interrupt(pin_id_t pin_id, uint8_t edge)
+{
+    get_pin(sim_get_node_id(), pin_id)->event_mask = edge;
+    return SUCCESS;
+}
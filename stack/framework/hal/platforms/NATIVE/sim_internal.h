@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SIM_INTERNAL_H_
+#define __SIM_INTERNAL_H_
+
+#include "sim.h"
+
+typedef enum
+{
+    // the order defines which event is dispatched first when several events are due at the same time
+    SIM_EVENT_BOOT,
+    SIM_EVENT_TIMER_OVERFLOW,
+    SIM_EVENT_TIMER_COMPARE,
+    SIM_EVENT_RADIO_TX_DONE,
+    SIM_EVENT_RADIO_RX_DONE,
+    SIM_EVENT_RADIO_TX_START,
+    SIM_EVENT_UART_RX,
+    SIM_EVENT_UART_TX_DONE,
+    SIM_EVENT_GPIO_EDGE,
+    SIM_EVENT_BUSY_WAIT_DONE,
+} sim_event_kind_t;
+
+typedef struct
+{
+    sim_time_t time;
+    uint64_t seq;
+    uint32_t node;
+    uint32_t generation;
+    void* data;
+    uint8_t kind;
+} sim_event_t;
+
+extern sim_stats_t sim_stats;
+
+void sim_post_event(size_t node, sim_time_t time, sim_event_kind_t kind, uint32_t generation, void* data);
+void sim_run(void (*node_main)(void));
+void sim_wait_until(sim_time_t time);
+
+void sim_timer_init_nodes(size_t node_count);
+bool sim_timer_event_is_current(const sim_event_t* event);
+void sim_timer_handle_event(const sim_event_t* event);
+
+void sim_radio_init_nodes(size_t node_count);
+void sim_radio_handle_event(const sim_event_t* event);
+
+void sim_uart_init_nodes(size_t node_count);
+void sim_uart_handle_event(const sim_event_t* event);
+
+void sim_gpio_init_nodes(size_t node_count);
+void sim_gpio_handle_event(const sim_event_t* event);
+
+#endif
@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "errors.h"
+#include "hwradio.h"
+#include "hwsystem.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim_internal.h"
+
+// All nodes share a single collision domain: every node hears every other node on the same center frequency.
+// Frames are exchanged as a whole, overlapping transmissions on the same frequency corrupt each other (no capture effect).
+#define SIM_RSSI_LINK -70
+#define SIM_RSSI_NOISE_FLOOR -120
+// the time the radio needs to settle in RX before the RSSI is valid, in the order of the sx127x at low rates
+#define SIM_RSSI_MEASUREMENT_US 500
+#define SIM_DEFAULT_BITRATE 55555
+#define SIM_PREAMBLE_BYTE 0xAA
+#define SIM_SYNC_WORD_SIZE 2
+#define SIM_HEADER_SIZE 4
+#define SIM_TX_STARTUP_TIME 5 // ~150 us between the TX request and the first bit on the air
+#define SIM_RX_FIFO_SIZE 64 // chunk size in which received packets are handed to the upper layer
+
+typedef struct
+{
+    size_t sender;
+    uint32_t center_freq;
+    sim_time_t end;
+    uint16_t sync_word;
+    uint16_t airtime_bytes;
+    uint16_t refs;
+    bool has_sync;      // false for a chunk which only contains preamble bytes (carrier)
+    bool on_air;
+    bool collided;
+    bool aborted;
+    uint16_t length;
+    uint8_t data[];
+} sim_frame_t;
+
+typedef struct
+{
+    hwradio_init_args_t callbacks;
+    hw_radio_state_t opmode;
+    uint32_t center_freq;
+    uint32_t bitrate;
+    uint16_t preamble_size;
+    uint16_t payload_length;
+    uint16_t sync_word;
+    bool initialized;
+    bool refill;
+    bool preloading;
+    bool refilling;             // set while the tx_refill callback runs, chunks sent then continue the transmission
+    sim_frame_t* tx_frame;      // the frame currently on the air
+    sim_frame_t* preloaded;     // the frame which is sent by hw_radio_set_opmode(HW_STATE_TX)
+    sim_frame_t* rx_frame;      // the frame the receiver is synchronized on
+} sim_radio_t;
+
+static sim_radio_t* radios;
+static size_t radio_count;
+
+static sim_frame_t** active_frames;
+static size_t active_count = 0;
+static size_t active_capacity = 0;
+
+static void rx_timeout(void *arg);
+
+static inline sim_radio_t* current_radio()
+{
+    return &radios[sim_get_node_id()];
+}
+
+static void release_frame(sim_frame_t* frame)
+{
+    assert(frame->refs > 0);
+    if(--frame->refs == 0)
+        free(frame);
+}
+
+static sim_frame_t* create_frame(sim_radio_t* radio, const uint8_t* data, uint16_t len, bool continuation)
+{
+    uint16_t offset = 0;
+    uint16_t overhead = 0;
+    uint16_t sync_word = radio->sync_word;
+    bool has_sync = true;
+
+    if(continuation)
+    {
+        // refilled chunks carry their own preamble and sync word (or only preamble bytes as padding)
+        while(offset < len && data[offset] == SIM_PREAMBLE_BYTE)
+            offset++;
+
+        if(len - offset >= SIM_SYNC_WORD_SIZE)
+        {
+            sync_word = (data[offset] << 8) | data[offset + 1];
+            offset += SIM_SYNC_WORD_SIZE;
+        }
+        else
+            has_sync = false;
+    }
+    else
+        overhead = radio->preamble_size + SIM_SYNC_WORD_SIZE; // added by the radio itself
+
+    sim_frame_t* frame = malloc(sizeof(sim_frame_t) + len - offset);
+    assert(frame != NULL);
+    *frame = (sim_frame_t){
+        .sender = sim_get_node_id(),
+        .center_freq = radio->center_freq,
+        .sync_word = sync_word,
+        .airtime_bytes = overhead + len,
+        .refs = 1,
+        .has_sync = has_sync,
+        .length = len - offset
+    };
+
+    memcpy(frame->data, data + offset, len - offset);
+    return frame;
+}
+
+static void add_active_frame(sim_frame_t* frame)
+{
+    if(active_count == active_capacity)
+    {
+        active_capacity = active_capacity ? 2 * active_capacity : 16;
+        active_frames = realloc(active_frames, active_capacity * sizeof(sim_frame_t*));
+        assert(active_frames != NULL);
+    }
+
+    active_frames[active_count++] = frame;
+    frame->on_air = true;
+}
+
+static void remove_active_frame(sim_frame_t* frame)
+{
+    if(!frame->on_air)
+        return;
+
+    for(size_t i = 0; i < active_count; i++)
+    {
+        if(active_frames[i] == frame)
+        {
+            active_frames[i] = active_frames[--active_count];
+            break;
+        }
+    }
+
+    frame->on_air = false;
+}
+
+static void put_on_air(sim_frame_t* frame)
+{
+    sim_radio_t* radio = &radios[frame->sender];
+    uint32_t bitrate = radio->bitrate ? radio->bitrate : SIM_DEFAULT_BITRATE;
+    sim_time_t airtime = ((sim_time_t) frame->airtime_bytes * 8 * SIM_TICKS_PER_SECOND + bitrate - 1) / bitrate;
+    frame->end = sim_get_time() + (airtime ? airtime : 1);
+
+    for(size_t i = 0; i < active_count; i++)
+    {
+        if(active_frames[i]->center_freq == frame->center_freq)
+        {
+            active_frames[i]->collided = true;
+            frame->collided = true;
+        }
+    }
+
+    add_active_frame(frame);
+    frame->refs++; // released by the TX_DONE event
+    sim_post_event(frame->sender, frame->end, SIM_EVENT_RADIO_TX_DONE, 0, frame);
+
+    if(!frame->has_sync)
+        return;
+
+    sim_stats.frames_transmitted++;
+
+    // receivers listening on the same channel and sync word synchronize on the preamble of this frame
+    for(size_t i = 0; i < radio_count; i++)
+    {
+        sim_radio_t* receiver = &radios[i];
+        if(i == frame->sender || receiver->opmode != HW_STATE_RX || receiver->rx_frame != NULL
+           || receiver->center_freq != frame->center_freq || receiver->sync_word != frame->sync_word)
+            continue;
+
+        receiver->rx_frame = frame;
+        frame->refs++;
+        sim_post_event(i, frame->end, SIM_EVENT_RADIO_RX_DONE, 0, frame);
+    }
+}
+
+static void start_transmission(sim_radio_t* radio, sim_frame_t* frame, bool continuation)
+{
+    radio->opmode = HW_STATE_TX;
+    radio->tx_frame = frame;
+    radio->rx_frame = NULL; // a half-duplex radio loses the frame it was receiving
+
+    if(continuation)
+    {
+        // refilled chunks follow the previous one without interruption
+        put_on_air(frame);
+        return;
+    }
+
+    // this delay is what allows two nodes which both found the channel free to collide
+    frame->refs++; // released by the TX_START event
+    sim_post_event(frame->sender, sim_get_time() + SIM_TX_STARTUP_TIME, SIM_EVENT_RADIO_TX_START, 0, frame);
+}
+
+static void abort_transmission(sim_radio_t* radio)
+{
+    if(radio->tx_frame == NULL)
+        return;
+
+    radio->tx_frame->aborted = true;
+    remove_active_frame(radio->tx_frame);
+    release_frame(radio->tx_frame);
+    radio->tx_frame = NULL;
+}
+
+static void deliver_frame(sim_radio_t* radio, sim_frame_t* frame)
+{
+    uint16_t length = radio->payload_length;
+    if(length == 0)
+    {
+        // unlimited length mode: the upper layer decodes the header and configures the payload length
+        if(frame->length < SIM_HEADER_SIZE)
+            return;
+
+        uint8_t header[SIM_HEADER_SIZE];
+        memcpy(header, frame->data, SIM_HEADER_SIZE);
+        radio->callbacks.rx_packet_header_cb(header, SIM_HEADER_SIZE);
+        length = radio->payload_length;
+        radio->payload_length = 0;
+        if(length == 0)
+            return;
+    }
+
+    hw_radio_packet_t* packet = radio->callbacks.alloc_packet_cb(length);
+    if(packet == NULL)
+        return;
+
+    uint16_t copy_length = frame->length < length ? frame->length : length;
+    memcpy(packet->data, frame->data, copy_length);
+    memset(packet->data + copy_length, 0, length - copy_length);
+    packet->length = length;
+
+    // the packet is handed over in FIFO sized chunks, as a real driver drains the RX FIFO
+    if(radio->callbacks.rx_packet_chunk_cb)
+    {
+        for(uint16_t offset = 0; offset < length; offset += SIM_RX_FIFO_SIZE)
+        {
+            uint16_t chunk = length - offset < SIM_RX_FIFO_SIZE ? length - offset : SIM_RX_FIFO_SIZE;
+            radio->callbacks.rx_packet_chunk_cb(packet, offset, chunk);
+        }
+    }
+
+    packet->rx_meta.timestamp = timer_get_counter_value();
+    packet->rx_meta.rssi = SIM_RSSI_LINK;
+    packet->rx_meta.lqi = 0;
+    packet->rx_meta.crc_status = HW_CRC_UNAVAILABLE;
+
+    sim_stats.frames_received++;
+    radio->callbacks.rx_packet_cb(packet);
+}
+
+static void handle_tx_done(sim_radio_t* radio, sim_frame_t* frame)
+{
+    remove_active_frame(frame);
+    bool current = (radio->tx_frame == frame);
+    release_frame(frame);
+    if(!current)
+        return; // aborted
+
+    radio->tx_frame = NULL;
+    release_frame(frame);
+
+    if(radio->refill)
+    {
+        radio->refilling = true;
+        radio->callbacks.tx_refill_cb(0);
+        radio->refilling = false;
+        if(radio->tx_frame != NULL)
+            return; // the transmission continues with the next chunk
+    }
+
+    radio->opmode = HW_STATE_STANDBY;
+    radio->callbacks.tx_packet_cb(timer_get_counter_value());
+}
+
+static void handle_rx_done(sim_radio_t* radio, sim_frame_t* frame)
+{
+    if(radio->rx_frame != frame || frame->aborted)
+    {
+        sim_stats.frames_missed++;
+    }
+    else if(frame->collided)
+    {
+        sim_stats.frames_collided++;
+        radio->rx_frame = NULL;
+    }
+    else
+    {
+        radio->rx_frame = NULL;
+        timer_cancel_task(&rx_timeout);
+        deliver_frame(radio, frame);
+    }
+
+    if(radio->rx_frame == frame)
+        radio->rx_frame = NULL;
+
+    release_frame(frame);
+}
+
+void sim_radio_init_nodes(size_t node_count)
+{
+    radios = calloc(node_count, sizeof(sim_radio_t));
+    assert(radios != NULL);
+    radio_count = node_count;
+}
+
+void sim_radio_handle_event(const sim_event_t* event)
+{
+    sim_radio_t* radio = &radios[event->node];
+    sim_frame_t* frame = event->data;
+    switch(event->kind)
+    {
+        case SIM_EVENT_RADIO_TX_START:
+            if(radio->tx_frame == frame)
+                put_on_air(frame);
+
+            release_frame(frame);
+            break;
+        case SIM_EVENT_RADIO_TX_DONE:
+            handle_tx_done(radio, frame);
+            break;
+        default:
+            handle_rx_done(radio, frame);
+    }
+}
+
+static void rx_timeout(void *arg)
+{
+    hw_radio_set_idle();
+}
+
+error_t hw_radio_init(hwradio_init_args_t* init_args)
+{
+    sim_radio_t* radio = current_radio();
+    if(radio->initialized)
+        return EALREADY;
+
+    if(init_args == NULL || init_args->alloc_packet_cb == NULL || init_args->release_packet_cb == NULL
+       || init_args->rx_packet_cb == NULL || init_args->tx_packet_cb == NULL)
+        return EINVAL;
+
+    radio->callbacks = *init_args;
+    radio->opmode = HW_STATE_SLEEP;
+    radio->bitrate = SIM_DEFAULT_BITRATE;
+    radio->initialized = true;
+    sched_register_task(&rx_timeout);
+    return SUCCESS;
+}
+
+void hw_radio_stop()
+{
+    hw_radio_set_idle();
+}
+
+error_t hw_radio_set_idle()
+{
+    sim_radio_t* radio = current_radio();
+    abort_transmission(radio);
+    radio->rx_frame = NULL;
+    radio->opmode = HW_STATE_SLEEP;
+    return SUCCESS;
+}
+
+bool hw_radio_is_idle()
+{
+    hw_radio_state_t opmode = current_radio()->opmode;
+    return opmode == HW_STATE_SLEEP || opmode == HW_STATE_OFF;
+}
+
+bool hw_radio_is_rx()
+{
+    return current_radio()->opmode == HW_STATE_RX;
+}
+
+bool hw_radio_tx_busy()
+{
+    return current_radio()->tx_frame != NULL;
+}
+
+bool hw_radio_rx_busy()
+{
+    return current_radio()->rx_frame != NULL;
+}
+
+error_t hw_radio_send_payload(uint8_t* data, uint16_t len)
+{
+    if(len == 0)
+        return ESIZE;
+
+    sim_radio_t* radio = current_radio();
+    bool continuation = radio->refilling;
+    sim_frame_t* frame = create_frame(radio, data, len, continuation);
+
+    if(radio->preloading && !continuation)
+    {
+        // held back until the transmission is started by hw_radio_set_opmode(HW_STATE_TX)
+        radio->preloading = false;
+        if(radio->preloaded)
+            release_frame(radio->preloaded);
+
+        radio->preloaded = frame;
+        return SUCCESS;
+    }
+
+    if(!continuation)
+        abort_transmission(radio);
+
+    start_transmission(radio, frame, continuation);
+    return SUCCESS;
+}
+
+hw_radio_state_t hw_radio_get_opmode()
+{
+    return current_radio()->opmode;
+}
+
+void hw_radio_set_opmode(hw_radio_state_t opmode)
+{
+    sim_radio_t* radio = current_radio();
+    if(opmode == HW_STATE_TX)
+    {
+        if(radio->preloaded)
+        {
+            sim_frame_t* frame = radio->preloaded;
+            radio->preloaded = NULL;
+            abort_transmission(radio);
+            start_transmission(radio, frame, false);
+        }
+
+        return;
+    }
+
+    abort_transmission(radio);
+    if(opmode == HW_STATE_IDLE)
+        opmode = HW_STATE_RX; // idle means listening
+
+    if(opmode != HW_STATE_RX || radio->opmode != HW_STATE_RX)
+        radio->rx_frame = NULL;
+
+    radio->opmode = opmode;
+}
+
+bool hw_radio_rssi_valid()
+{
+    return current_radio()->opmode == HW_STATE_RX;
+}
+
+int16_t hw_radio_get_rssi()
+{
+    // a measurement takes time, without it CSMA-CA would retry on a busy channel without the clock ever advancing
+    hw_busy_wait(SIM_RSSI_MEASUREMENT_US);
+
+    sim_radio_t* radio = current_radio();
+    sim_stats.rssi_measurements++;
+    for(size_t i = 0; i < active_count; i++)
+    {
+        if(active_frames[i]->center_freq == radio->center_freq && active_frames[i]->sender != sim_get_node_id())
+        {
+            sim_stats.rssi_busy++;
+            return SIM_RSSI_LINK;
+        }
+    }
+
+    return SIM_RSSI_NOISE_FLOOR;
+}
+
+void hw_radio_set_center_freq(uint32_t center_freq)
+{
+    sim_radio_t* radio = current_radio();
+    if(radio->center_freq != center_freq)
+        radio->rx_frame = NULL;
+
+    radio->center_freq = center_freq;
+}
+
+void hw_radio_set_bitrate(uint32_t bps)
+{
+    current_radio()->bitrate = bps;
+}
+
+void hw_radio_set_preamble_size(uint16_t size)
+{
+    current_radio()->preamble_size = size;
+}
+
+void hw_radio_set_sync_word(uint8_t* sync_word, uint8_t sync_size)
+{
+    uint16_t value = sync_word[0];
+    if(sync_size > 1)
+        value |= ((uint16_t) sync_word[1]) << 8;
+
+    current_radio()->sync_word = value;
+}
+
+void hw_radio_set_payload_length(uint16_t length)
+{
+    current_radio()->payload_length = length;
+}
+
+void hw_radio_enable_refill(bool enable)
+{
+    current_radio()->refill = enable;
+}
+
+void hw_radio_enable_preloading(bool enable)
+{
+    current_radio()->preloading = enable;
+}
+
+void hw_radio_set_rx_timeout(uint32_t timeout)
+{
+    timer_post_task_delay(&rx_timeout, timeout);
+}
+
+// modem settings which do not influence the simulated medium
+void hw_radio_set_rx_bw_hz(uint32_t bw_hz) {}
+void hw_radio_set_tx_fdev(uint32_t fdev) {}
+void hw_radio_set_preamble_detector(uint8_t preamble_detector_size, uint8_t preamble_tol) {}
+void hw_radio_set_rssi_config(uint8_t rssi_smoothing, uint8_t rssi_offset) {}
+void hw_radio_set_modulation_shaping(uint8_t shaping) {}
+void hw_radio_set_preamble_polarity(uint8_t polarity) {}
+void hw_radio_set_rssi_threshold(uint8_t rssi_thr) {}
+void hw_radio_set_rssi_smoothing(uint8_t rssi_samples) {}
+void hw_radio_set_sync_word_size(uint8_t sync_size) {}
+void hw_radio_set_sync_on(uint8_t enable) {}
+void hw_radio_set_preamble_detect_on(uint8_t enable) {}
+void hw_radio_set_dc_free(uint8_t scheme) {}
+void hw_radio_set_crc_on(uint8_t enable) {}
+void hw_radio_set_tx_power(int8_t eirp) {}
+
+// LoRa is not simulated
+void hw_radio_switch_longRangeMode(bool use_lora) {}
+void hw_radio_set_lora_mode(uint32_t lora_bw, uint8_t lora_SF) {}
+void hw_lora_set_tx_continuous_wave(uint32_t freq, int8_t power, uint16_t time) {}
+void hw_lora_set_public_network(bool enable) {}
+void hw_lora_set_max_payload_length(uint8_t max) {}
+void hw_radio_set_lora_cont_tx(bool activate) {}
+uint32_t hw_lora_random() { return rand(); }
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "debug.h"
+#include "errors.h"
+#include "hwtimer.h"
+#include "sim_internal.h"
+
+// the simulated hardware timers count up from the start of the simulation and wrap like a 16 bit counter
+#define SIM_TIMER_COUNT 1
+#define COUNTER_WRAP (UINT64_C(1) << (8 * sizeof(hwtimer_tick_t)))
+
+typedef struct
+{
+    timer_callback_t compare_callback;
+    timer_callback_t overflow_callback;
+    sim_time_t counter_start;       // the virtual time at which the counter was zero
+    sim_time_t next_overflow;
+    uint32_t compare_generation;    // bumped on every (re)schedule or cancel, stale events are ignored
+    uint32_t overflow_generation;
+    uint8_t shift;                  // log2 of the number of virtual clock ticks per timer tick
+    bool initialized;
+} sim_timer_t;
+
+static const hwtimer_info_t timer_info = { .min_delay_ticks = 0 };
+
+static sim_timer_t* timers;
+
+static inline sim_timer_t* get_timer(size_t node, hwtimer_id_t timer_id)
+{
+    return &timers[node * SIM_TIMER_COUNT + timer_id];
+}
+
+static inline uint64_t get_ticks(sim_timer_t* timer)
+{
+    return (sim_get_time() - timer->counter_start) >> timer->shift;
+}
+
+static void schedule_overflow(sim_timer_t* timer, hwtimer_id_t timer_id)
+{
+    uint64_t ticks = get_ticks(timer);
+    timer->next_overflow = timer->counter_start + (((ticks | (COUNTER_WRAP - 1)) + 1) << timer->shift);
+    sim_post_event(sim_get_node_id(), timer->next_overflow, SIM_EVENT_TIMER_OVERFLOW, ++timer->overflow_generation, (void*)(uintptr_t) timer_id);
+}
+
+void sim_timer_init_nodes(size_t node_count)
+{
+    timers = calloc(node_count * SIM_TIMER_COUNT, sizeof(sim_timer_t));
+    assert(timers != NULL);
+}
+
+bool sim_timer_event_is_current(const sim_event_t* event)
+{
+    if(event->kind != SIM_EVENT_TIMER_COMPARE && event->kind != SIM_EVENT_TIMER_OVERFLOW)
+        return true;
+
+    sim_timer_t* timer = get_timer(event->node, (hwtimer_id_t)(uintptr_t) event->data);
+    if(event->kind == SIM_EVENT_TIMER_COMPARE)
+        return event->generation == timer->compare_generation;
+    else
+        return event->generation == timer->overflow_generation;
+}
+
+void sim_timer_handle_event(const sim_event_t* event)
+{
+    hwtimer_id_t timer_id = (hwtimer_id_t)(uintptr_t) event->data;
+    sim_timer_t* timer = get_timer(event->node, timer_id);
+    if(event->kind == SIM_EVENT_TIMER_OVERFLOW)
+    {
+        schedule_overflow(timer, timer_id);
+        if(timer->overflow_callback)
+            timer->overflow_callback();
+    }
+    else
+    {
+        // the compare interrupt fires only once
+        timer->compare_generation++;
+        if(timer->compare_callback)
+            timer->compare_callback();
+    }
+}
+
+error_t hw_timer_init(hwtimer_id_t timer_id, uint8_t frequency, timer_callback_t compare_callback, timer_callback_t overflow_callback)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return ESIZE;
+
+    if(frequency != HWTIMER_FREQ_1MS && frequency != HWTIMER_FREQ_32K)
+        return EINVAL;
+
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    if(timer->initialized)
+        return EALREADY;
+
+    timer->compare_callback = compare_callback;
+    timer->overflow_callback = overflow_callback;
+    timer->shift = (frequency == HWTIMER_FREQ_1MS) ? 5 : 0; // 32768 / 1024
+    timer->counter_start = sim_get_time();
+    timer->initialized = true;
+    schedule_overflow(timer, timer_id);
+    return SUCCESS;
+}
+
+const hwtimer_info_t* hw_timer_get_info(hwtimer_id_t timer_id)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return NULL;
+
+    return &timer_info;
+}
+
+hwtimer_tick_t hw_timer_getvalue(hwtimer_id_t timer_id)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return 0;
+
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    if(!timer->initialized)
+        return 0;
+
+    return (hwtimer_tick_t) get_ticks(timer);
+}
+
+error_t hw_timer_schedule(hwtimer_id_t timer_id, hwtimer_tick_t tick)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return ESIZE;
+
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    if(!timer->initialized)
+        return EOFF;
+
+    // fire at the first moment the counter equals tick, which is after a wrap when tick has already passed
+    uint64_t ticks = get_ticks(timer);
+    uint64_t target = (ticks & ~(COUNTER_WRAP - 1)) | tick;
+    if(target < ticks)
+        target += COUNTER_WRAP;
+
+    sim_time_t fire_time = timer->counter_start + (target << timer->shift);
+    if(fire_time < sim_get_time())
+        fire_time = sim_get_time();
+
+    sim_post_event(sim_get_node_id(), fire_time, SIM_EVENT_TIMER_COMPARE, ++timer->compare_generation, (void*)(uintptr_t) timer_id);
+    return SUCCESS;
+}
+
+error_t hw_timer_cancel(hwtimer_id_t timer_id)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return ESIZE;
+
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    if(!timer->initialized)
+        return EOFF;
+
+    timer->compare_generation++;
+    return SUCCESS;
+}
+
+error_t hw_timer_counter_reset(hwtimer_id_t timer_id)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return ESIZE;
+
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    if(!timer->initialized)
+        return EOFF;
+
+    timer->compare_generation++;
+    timer->counter_start = sim_get_time();
+    schedule_overflow(timer, timer_id);
+    return SUCCESS;
+}
+
+bool hw_timer_is_overflow_pending(hwtimer_id_t timer_id)
+{
+    if(timer_id >= SIM_TIMER_COUNT)
+        return false;
+
+    // time does not advance while a node executes, so an overflow can only be pending when it is due right now
+    sim_timer_t* timer = get_timer(sim_get_node_id(), timer_id);
+    return timer->initialized && sim_get_time() >= timer->next_overflow;
+}
+
+bool hw_timer_is_interrupt_pending(hwtimer_id_t timer_id)
+{
+    return false;
+}
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "errors.h"
+#include "hwdma.h"
+#include "hwuart.h"
+#include "sim_internal.h"
+
+// Every UART port is wired in loopback: the bytes a node transmits are received again by the same port, after the
+// time they take on the line at the configured baudrate. This lets serial protocols (like the modem interface) talk
+// to themselves on the simulator. sim_uart_connect() cross-wires two ports instead, to let two nodes talk.
+#define SIM_UART_PORT_COUNT 4
+#define SIM_UART_BITS_PER_BYTE 10 // start and stop bit included
+#define SIM_UART_RX_CHUNK_SIZE 16 // received bytes are handed to the node in chunks, spread over the transfer
+#define SIM_DMA_CHANNEL_COUNT 8
+
+struct uart_handle
+{
+    size_t node;
+    uart_handle_t* peer;        // the port receiving the transmitted bytes, NULL for loopback
+    uint8_t port_idx;
+    uint32_t baudrate;
+    bool enabled;
+    bool rx_interrupt_enabled;
+    uart_rx_inthandler_t rx_cb;
+    uart_tx_inthandler_t tx_cb;
+    uart_error_handler_t error_cb;
+    sim_time_t line_free;       // the time the last byte queued for transmission has left the line
+    uint8_t* rx_dma_buffer;     // set while a DMA reception is active
+    size_t rx_dma_length;
+    size_t rx_dma_received;
+};
+
+struct dma_handle
+{
+    uint8_t channel_idx;
+    bool enabled;
+};
+
+typedef struct
+{
+    uart_handle_t* uart;    // the receiving port
+    sim_time_t start;
+    uint16_t length;
+    uint8_t data[];
+} sim_uart_transfer_t;
+
+static uart_handle_t* uarts;
+static size_t uart_node_count;
+static dma_handle_t dma_channels[SIM_DMA_CHANNEL_COUNT];
+static uint32_t error_rate; // bit errors per million bytes
+static uint32_t error_rng_state = 0x2545F491;
+
+void sim_uart_set_error_rate(uint32_t errors_per_million)
+{
+    error_rate = errors_per_million;
+}
+
+static uint32_t error_rng_next()
+{
+    // xorshift32, independent of rand() so the application keeps its own random sequence
+    error_rng_state ^= error_rng_state << 13;
+    error_rng_state ^= error_rng_state >> 17;
+    error_rng_state ^= error_rng_state << 5;
+    return error_rng_state;
+}
+
+static void corrupt(uint8_t* data, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        uint32_t r = error_rng_next();
+        if(r % 1000000 < error_rate)
+        {
+            data[i] ^= 1 << ((r >> 24) & 0x07);
+            sim_stats.uart_bytes_corrupted++;
+        }
+    }
+}
+
+void sim_uart_init_nodes(size_t node_count)
+{
+    uart_node_count = node_count;
+    uarts = calloc(node_count * SIM_UART_PORT_COUNT, sizeof(uart_handle_t));
+    assert(uarts != NULL);
+    for(size_t i = 0; i < node_count * SIM_UART_PORT_COUNT; i++)
+        uarts[i].node = i / SIM_UART_PORT_COUNT;
+}
+
+void sim_uart_connect(size_t node_a, uint8_t port_a, size_t node_b, uint8_t port_b)
+{
+    assert(node_a < uart_node_count && node_b < uart_node_count);
+    assert(port_a < SIM_UART_PORT_COUNT && port_b < SIM_UART_PORT_COUNT);
+    uart_handle_t* a = &uarts[node_a * SIM_UART_PORT_COUNT + port_a];
+    uart_handle_t* b = &uarts[node_b * SIM_UART_PORT_COUNT + port_b];
+    a->peer = b;
+    b->peer = a;
+}
+
+static inline sim_time_t line_time(const uart_handle_t* uart, size_t bytes)
+{
+    uint64_t bits_per_second = uart->baudrate ? uart->baudrate : 115200;
+    return ((sim_time_t) bytes * SIM_UART_BITS_PER_BYTE * SIM_TICKS_PER_SECOND + bits_per_second - 1) / bits_per_second;
+}
+
+static void queue_transfer(uart_handle_t* uart, const uint8_t* data, size_t length, bool dma)
+{
+    if(length == 0)
+    {
+        if(dma && uart->tx_cb)
+            uart->tx_cb();
+
+        return;
+    }
+
+    uart_handle_t* receiver = uart->peer != NULL ? uart->peer : uart;
+    sim_uart_transfer_t* transfer = malloc(sizeof(sim_uart_transfer_t) + length);
+    assert(transfer != NULL);
+    *transfer = (sim_uart_transfer_t){
+        .uart = receiver,
+        .start = uart->line_free > sim_get_time() ? uart->line_free : sim_get_time(),
+        .length = length
+    };
+
+    memcpy(transfer->data, data, length);
+    if(error_rate)
+        corrupt(transfer->data, length);
+
+    uart->line_free = transfer->start + line_time(uart, length);
+    sim_stats.uart_bytes_transmitted += length;
+
+    for(uint16_t end = 0; end < length;)
+    {
+        end = end + SIM_UART_RX_CHUNK_SIZE < length ? end + SIM_UART_RX_CHUNK_SIZE : length;
+        sim_post_event(receiver->node, transfer->start + line_time(uart, end), SIM_EVENT_UART_RX, end, transfer);
+    }
+
+    // the TX complete callback is called once the last byte has left the line, after it is received on loopback.
+    // Without DMA the bytes are sent by polling the UART, so the node is busy until then.
+    if(dma)
+        sim_post_event(uart->node, uart->line_free, SIM_EVENT_UART_TX_DONE, 0, uart);
+    else
+        sim_wait_until(uart->line_free);
+}
+
+void sim_uart_handle_event(const sim_event_t* event)
+{
+    if(event->kind == SIM_EVENT_UART_TX_DONE)
+    {
+        uart_handle_t* uart = event->data;
+        if(uart->tx_cb != NULL)
+            uart->tx_cb();
+
+        return;
+    }
+
+    sim_uart_transfer_t* transfer = event->data;
+    uart_handle_t* uart = transfer->uart;
+    uint16_t end = event->generation;
+    uint16_t start = end > SIM_UART_RX_CHUNK_SIZE ? ((end - 1) / SIM_UART_RX_CHUNK_SIZE) * SIM_UART_RX_CHUNK_SIZE : 0;
+
+    if(uart->rx_dma_buffer != NULL)
+    {
+        for(uint16_t i = start; i < end && uart->rx_dma_received < uart->rx_dma_length; i++)
+            uart->rx_dma_buffer[uart->rx_dma_received++] = transfer->data[i];
+    }
+    else if(uart->enabled && uart->rx_interrupt_enabled && uart->rx_cb != NULL)
+    {
+        for(uint16_t i = start; i < end; i++)
+            uart->rx_cb(transfer->data[i]);
+    }
+
+    if(end == transfer->length)
+        free(transfer);
+}
+
+uart_handle_t* uart_init(uint8_t port_idx, uint32_t baudrate, uint8_t pins)
+{
+    assert(port_idx < SIM_UART_PORT_COUNT);
+    uart_handle_t* uart = uart_get_handle(port_idx);
+    uart->port_idx = port_idx;
+    uart->baudrate = baudrate;
+    return uart;
+}
+
+uart_handle_t* uart_get_handle(uint8_t port_idx)
+{
+    assert(sim_get_node_id() < uart_node_count && port_idx < SIM_UART_PORT_COUNT);
+    return &uarts[sim_get_node_id() * SIM_UART_PORT_COUNT + port_idx];
+}
+
+bool uart_is_enabled(uart_handle_t* uart)
+{
+    return uart->enabled;
+}
+
+bool uart_enable(uart_handle_t* uart)
+{
+    uart->enabled = true;
+    return true;
+}
+
+bool uart_disable(uart_handle_t* uart)
+{
+    uart->enabled = false;
+    return true;
+}
+
+bool uart_get_rx_port_state(uart_handle_t* uart)
+{
+    return true; // an idle line is high
+}
+
+void uart_pull_down_rx(uart_handle_t* uart)
+{
+}
+
+void uart_send_byte(uart_handle_t* uart, uint8_t data)
+{
+    queue_transfer(uart, &data, 1, false);
+}
+
+void uart_send_bytes(uart_handle_t* uart, void const *data, size_t length)
+{
+    queue_transfer(uart, data, length, false);
+}
+
+void uart_send_string(uart_handle_t* uart, const char *string)
+{
+    queue_transfer(uart, (const uint8_t*) string, strlen(string), false);
+}
+
+void uart_send_bytes_via_DMA(uart_handle_t* uart, void const *data, size_t length, uint8_t dma_channel_idx)
+{
+    queue_transfer(uart, data, length, true);
+}
+
+void uart_start_read_bytes_via_DMA(uart_handle_t* uart, void *data, size_t length, uint8_t dma_channel_idx)
+{
+    uart->rx_dma_buffer = data;
+    uart->rx_dma_length = length;
+    uart->rx_dma_received = 0;
+}
+
+size_t uart_stop_read_bytes_via_DMA(uart_handle_t* uart)
+{
+    size_t received = uart->rx_dma_buffer != NULL ? uart->rx_dma_received : 0;
+    uart->rx_dma_buffer = NULL;
+    return received;
+}
+
+error_t uart_rx_interrupt_enable(uart_handle_t* uart)
+{
+    if(uart->rx_cb == NULL)
+        return EOFF;
+
+    uart->rx_interrupt_enabled = true;
+    return SUCCESS;
+}
+
+void uart_rx_interrupt_disable(uart_handle_t* uart)
+{
+    uart->rx_interrupt_enabled = false;
+}
+
+error_t uart_tx_interrupt_enable(uart_handle_t* uart)
+{
+    return uart->tx_cb == NULL ? EOFF : SUCCESS;
+}
+
+void uart_tx_interrupt_disable(uart_handle_t* uart)
+{
+}
+
+void uart_set_rx_interrupt_callback(uart_handle_t* uart, uart_rx_inthandler_t rx_handler)
+{
+    uart->rx_cb = rx_handler;
+}
+
+void uart_set_tx_interrupt_callback(uart_handle_t* uart, uart_tx_inthandler_t tx_handler)
+{
+    uart->tx_cb = tx_handler;
+}
+
+void uart_set_error_callback(uart_handle_t* uart, uart_error_handler_t error_handler)
+{
+    uart->error_cb = error_handler;
+}
+
+// DMA transfers are modelled by the UART itself, the channels only keep their state
+dma_handle_t* dma_channel_init(uint8_t channel_idx)
+{
+    return dma_channel_get_handle(channel_idx);
+}
+
+dma_handle_t* dma_channel_get_handle(uint8_t channel_idx)
+{
+    assert(channel_idx < SIM_DMA_CHANNEL_COUNT);
+    dma_channels[channel_idx].channel_idx = channel_idx;
+    return &dma_channels[channel_idx];
+}
+
+void* dma_channel_get_hal_handle(uint8_t channel_idx)
+{
+    return dma_channel_get_handle(channel_idx);
+}
+
+bool dma_channel_enable(dma_handle_t* dma_handle)
+{
+    dma_handle->enabled = true;
+    return true;
+}
+
+bool dma_channel_disable(dma_handle_t* dma_handle)
+{
+    dma_handle->enabled = false;
+    return true;
+}
+
+void dma_channel_interrupt_enable(dma_handle_t* dma_handle)
+{
+}
+
+void dma_channel_interrupt_disable(dma_handle_t* dma_handle)
+{
+}
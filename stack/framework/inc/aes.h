@@ -30,6 +30,7 @@
 #define _AES_H_
 
 #include <types.h>
+#include "framework_defs.h"
 
 #define AES_BLOCK_SIZE 16
 
@@ -51,6 +52,22 @@
   #define CTR 1
 #endif
 
+/*! \brief An expanded AES-128 key.
+ *
+ * All functions taking a context are reentrant, so different keys can be used without re-expanding them.
+ */
+typedef struct
+{
+    uint32_t round_key[44];
+#ifdef HAL_SUPPORT_HW_AES
+    uint8_t key[16];
+#endif
+} aes128_ctx_t;
+
+/*! \brief Expand the key into the context */
+void AES128_init_ctx(aes128_ctx_t *ctx, const uint8_t *key);
+
+/*! \brief Set the key used by the functions which do not take a context */
 void AES128_init(const uint8_t *key);
 
 #if defined(ECB) && ECB
@@ -58,6 +75,8 @@ void AES128_init(const uint8_t *key);
 // The two functions AES128_ECB_xxcrypt() do most of the work, and they expect inputs of 128 bit length.
 void AES128_ECB_encrypt(uint8_t *input, uint8_t *output);
 void AES128_ECB_decrypt(uint8_t *input, uint8_t *output);
+void AES128_ECB_encrypt_ctx(const aes128_ctx_t *ctx, const uint8_t *input, uint8_t *output);
+void AES128_ECB_decrypt_ctx(const aes128_ctx_t *ctx, const uint8_t *input, uint8_t *output);
 
 #endif // #if defined(ECB) && ECB
 
@@ -71,6 +90,7 @@ void AES128_CBC_decrypt_buffer(uint8_t *output, uint8_t *input, uint32_t length,
 
 #if defined(CTR) && CTR
 void AES128_CTR_encrypt(uint8_t *output, uint8_t *input, uint32_t length, uint8_t* ctr_blk);
+void AES128_CTR_encrypt_ctx(const aes128_ctx_t *ctx, uint8_t *output, const uint8_t *input, uint32_t length, uint8_t* ctr_blk);
 // Decryption is exactly the same operation as encryption
 
 #endif // #if defined(CTR) && CTR
@@ -87,7 +107,51 @@ void AES128_CTR_encrypt(uint8_t *output, uint8_t *input, uint32_t length, uint8_
  */
 error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const uint8_t *iv,
                         const uint8_t *add, uint8_t add_len, uint8_t auth_len );
+error_t AES128_CBC_MAC_ctx( const aes128_ctx_t *ctx, uint8_t *auth, const uint8_t *payload, uint8_t length,
+                            const uint8_t *iv, const uint8_t *add, uint8_t add_len, uint8_t auth_len );
+
 
+#define AES128_CCM_PAYLOAD 0xFF
+
+/*! \brief State of an incremental CCM (or CBC-MAC) computation
+ *
+ * The additional authentication data and the payload can be supplied in segments of any size, the payload is
+ * authenticated and encrypted or decrypted in place in a single pass. Usage: AES128_CCM_init(), AES128_CCM_update_aad()
+ * until add_len bytes are supplied, AES128_CCM_encrypt_update() or AES128_CCM_decrypt_update() for the payload and
+ * finally AES128_CCM_finish() or AES128_CCM_verify().
+ */
+typedef struct
+{
+    const aes128_ctx_t *key;
+    uint8_t mac[AES_BLOCK_SIZE];        /**< The running CBC-MAC */
+    uint8_t ctr[AES_BLOCK_SIZE];        /**< The next counter block */
+    uint8_t keystream[AES_BLOCK_SIZE];  /**< The keystream of the current payload block */
+    uint8_t tag_mask[AES_BLOCK_SIZE];   /**< The keystream which encrypts the authentication tag */
+    uint8_t mac_fill;
+    uint8_t keystream_used;
+    uint8_t add_remaining;              /**< The additional data still to be supplied, AES128_CCM_PAYLOAD once the payload started */
+    uint8_t auth_len;
+    bool encrypt;
+} aes128_ccm_ctx_t;
+
+/*! \brief Start a CCM computation.
+ *
+ * \param iv		The first block (B_0) for the CBC-MAC
+ * \param add_len	The total length of the additional authentication data, at most 31 bytes
+ * \param ctr_blk	The initial counter block for the CTR encryption, or NULL to compute only the (unencrypted) CBC-MAC
+ * \param auth_len	MIC length of 4, 8 or 16 bytes
+ */
+error_t AES128_CCM_init( aes128_ccm_ctx_t *ccm, const aes128_ctx_t *key, const uint8_t *iv,
+                         uint8_t add_len, const uint8_t *ctr_blk, uint8_t auth_len );
+void AES128_CCM_update_aad( aes128_ccm_ctx_t *ccm, const uint8_t *add, uint8_t add_len );
+/*! \brief Authenticate payload without encrypting it, as used for CBC-MAC */
+void AES128_CCM_authenticate( aes128_ccm_ctx_t *ccm, const uint8_t *payload, uint16_t length );
+void AES128_CCM_encrypt_update( aes128_ccm_ctx_t *ccm, uint8_t *payload, uint16_t length );
+void AES128_CCM_decrypt_update( aes128_ccm_ctx_t *ccm, uint8_t *payload, uint16_t length );
+/*! \brief Write the auth_len bytes of the (encrypted) authentication tag to auth */
+void AES128_CCM_finish( aes128_ccm_ctx_t *ccm, uint8_t *auth );
+/*! \brief Check the received authentication tag, returns SUCCESS if it matches */
+error_t AES128_CCM_verify( aes128_ccm_ctx_t *ccm, const uint8_t *auth );
 
 /*! \brief AES Counter with CBC-MAC (CCM), 128 bit key.
  *
@@ -102,6 +166,9 @@ error_t AES128_CBC_MAC( uint8_t *auth, uint8_t *payload, uint8_t length, const u
 error_t AES128_CCM_encrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
                             const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
                             uint8_t auth_len );
+error_t AES128_CCM_encrypt_ctx( const aes128_ctx_t *ctx, uint8_t *payload, uint8_t length, const uint8_t *iv,
+                                const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                                uint8_t auth_len );
 
 /*! \brief AES Counter with CBC-MAC (CCM), 128 bit key.
  *
@@ -117,6 +184,9 @@ error_t AES128_CCM_encrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
 error_t AES128_CCM_decrypt( uint8_t *payload, uint8_t length, const uint8_t *iv,
                             const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
                             const uint8_t *auth, uint8_t auth_len );
+error_t AES128_CCM_decrypt_ctx( const aes128_ctx_t *ctx, uint8_t *payload, uint8_t length, const uint8_t *iv,
+                                const uint8_t *add, uint8_t add_len, uint8_t *ctr_blk,
+                                const uint8_t *auth, uint8_t auth_len );
 
 #endif //_AES_H_
 
@@ -39,6 +39,7 @@
 #include "dae.h"
 
 #include "fifo.h"
+#include "shared_buffer.h"
 
 #include "modules_defs.h"
 
@@ -107,6 +108,10 @@ typedef enum {
 #define ALP_OP_SIZE_REQUEST_TAG (1 + 1)
 #define ALP_OP_SIZE_READ_FILE_DATA (1 + 5 + 4)
 
+// the headroom reserved in front of a command in its shared buffer, for the request tag D7ASP prepends when it sends
+// requests together in one transaction
+#define ALP_COMMAND_HEADROOM ALP_OP_SIZE_REQUEST_TAG
+
 typedef enum {
   ALP_STATUS_OK = 0x00,
   ALP_STATUS_PARTIALLY_COMPLETED = 0x01,
@@ -262,9 +267,39 @@ typedef struct __attribute__((packed)) {
         };
     } code;
     uint32_t compare_operand_length;
-    uint8_t compare_body[ALP_QUERY_COMPARE_BODY_MAX_SIZE];
+    uint8_t compare_body[ALP_QUERY_COMPARE_BODY_MAX_SIZE]; // the mask, values and bitmap, followed by the file offset operand(s) when parsed
+    uint8_t body_length; // the number of bytes in compare_body, set by alp_parse_action()
 } alp_operand_query_t;
 
+#define ALP_QUERY_MAX_WORDS (ALP_QUERY_COMPARE_BODY_MAX_SIZE / 4 + 3)
+
+/*! \brief A query operand compiled by alp_query_compile(), which can be evaluated repeatedly by alp_query_evaluate()
+ * without parsing the operand again.
+ *
+ * Values are stored as big-endian words with the mask and the sign bias already applied, so the file data can be
+ * compared a word at a time. The first word of a value holds the bytes which do not fill a complete word.
+ */
+typedef struct {
+    alp_query_code_type_t type;
+    alp_query_arithmetic_comparison_type_t comp_type;
+    bool is_signed;
+    bool has_mask;
+    uint8_t length;         /**< The compare length in bytes */
+    uint8_t word_count;     /**< The number of words a value of length bytes takes */
+    uint8_t max_errors;     /**< The number of bytes which may differ from the token in a string token search */
+    uint8_t mask_index;     /**< The index of the mask in data, in bytes for a string token search and in words otherwise */
+    uint8_t value_index;    /**< The index of the compare value, the range minimum or the token in data */
+    uint8_t bound_index;    /**< The index of the range maximum in data.words */
+    uint16_t bitmap_index;  /**< The index of the range bitmap in data.bytes */
+    uint16_t bitmap_length; /**< The length of the range bitmap, 0 when the range has no bitmap */
+    alp_operand_file_offset_t file_a;
+    alp_operand_file_offset_t file_b; /**< The second file of an arithmetic comparison between files */
+    union {
+        uint32_t words[ALP_QUERY_MAX_WORDS];
+        uint8_t bytes[ALP_QUERY_MAX_WORDS * 4];
+    } data;
+} alp_query_t;
+
 typedef struct __attribute__((packed)) {
     uint8_t tag_id;
 } alp_operand_tag_id_t;
@@ -303,7 +338,8 @@ typedef struct {
     alp_itf_id_t itf_id;
     uint8_t itf_cfg_len;
     uint8_t itf_status_len;
-    error_t (*send_command)(uint8_t* payload, uint8_t payload_length, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* itf_cfg);
+    // the command is the data of the buffer, an interface which still needs it after returning takes a reference
+    error_t (*send_command)(shared_buffer_t* command, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* itf_cfg);
     interface_init init;
     interface_deinit deinit;
     bool unique; // TODO
@@ -328,9 +364,36 @@ typedef struct {
     alp_interface_config_t d7aactp_interface_config;
 #endif
     fifo_t alp_command_fifo;
-    uint8_t alp_command[ALP_PAYLOAD_MAX_SIZE];
+    uint8_t* alp_command; // the storage of alp_command_fifo, ALP_PAYLOAD_MAX_SIZE bytes
+    shared_buffer_t* buffer; // the buffer containing alp_command, NULL when the storage is not a shared buffer
 } alp_command_t;
 
+/*! \brief Describes one action of a command indexed by alp_index_command(). The offsets are relative to the start of the
+ * command, so the operands can be accessed directly without parsing the command again.
+ */
+typedef struct {
+    alp_control_t ctrl;
+    uint16_t offset;        /**< The offset of the control byte of the action */
+    uint16_t length;        /**< The length of the action, including the control byte */
+    uint8_t file_id;        /**< The file ID, interface ID or tag ID operand, if the action has one */
+    uint32_t file_offset;   /**< The byte offset in the file given by the file offset operand, if the action has one */
+    uint32_t data_length;   /**< The (requested or provided) data length, or the length of the compare body, interface status or configuration */
+    uint16_t data_offset;   /**< The offset of the data described by data_length, if it is part of the action */
+} alp_action_index_t;
+
+/*! \brief Validates a complete command in one pass and describes each action.
+ *
+ * \param command                   The command
+ * \param length                    The length of the command
+ * \param actions                   The array which is filled with a descriptor per action, can be NULL to only validate the command
+ * \param max_actions               The number of elements of actions
+ * \param expected_response_length  Set to the length of the response the command will result in
+ * \return The number of actions, -EFAULT for a malformed or truncated command, -ENOEXEC for an unsupported operation,
+ * -EPERM when the length of the command cannot be determined or -ENOMEM when there are more than max_actions actions
+ */
+int alp_index_command(const uint8_t* command, uint16_t length, alp_action_index_t* actions, uint16_t max_actions,
+    uint8_t* expected_response_length);
+
 int alp_get_expected_response_length(alp_command_t* command);
 
 alp_status_codes_t alp_register_interface(alp_interface_t* itf);
@@ -348,6 +411,35 @@ bool alp_append_start_itf_action(alp_command_t* command);
 bool alp_append_stop_itf_action(alp_command_t* command);
 bool alp_append_break_query_action(alp_command_t* command, uint8_t file_id, uint32_t offset, alp_operand_query_t* query);
 
+/*! \brief Returns the number of bytes of the mask and the compare values of a query operand, which follow the compare
+ * length operand, or -1 when the query code is not supported
+ */
+int16_t alp_query_value_length(uint8_t code, uint32_t compare_length);
+
+/*! \brief Returns the length of the bitmap of a range comparison, which follows the range boundaries in values, 0 when
+ * the query has no bitmap or -1 when the boundaries are invalid
+ */
+int16_t alp_query_bitmap_length(uint8_t code, uint32_t compare_length, const uint8_t* values);
+
+/*! \brief Returns the number of file offset operands which end a query operand */
+uint8_t alp_query_file_offset_count(uint8_t code);
+
+/*! \brief Compiles a query operand parsed by alp_parse_action().
+ *
+ * Supported are the non-void check, arithmetic comparisons with zero, a value or another file (optionally masked and
+ * signed), range comparisons (param 1 for in range, 0 for out of range, with an optional bitmap of allowed values) and
+ * string token searches in the file data following the file offset, allowing param bytes to differ.
+ * \return false when the operand is invalid or not supported
+ */
+bool alp_query_compile(const alp_operand_query_t* operand, alp_query_t* query);
+
+/*! \brief Evaluates a compiled query against the current content of the file system.
+ *
+ * \param result  Set to the outcome of the query, a file which is too short for the comparison fails the query
+ * \return SUCCESS or the error returned by d7ap_fs_read_file()
+ */
+int alp_query_evaluate(const alp_query_t* query, authentication_t auth, bool* result);
+
 bool alp_parse_action(alp_command_t* command, alp_action_t* action);
 bool alp_parse_length_operand(fifo_t* cmd_fifo, uint32_t* length);
 bool alp_parse_file_offset_operand(fifo_t* cmd_fifo, alp_operand_file_offset_t* operand);
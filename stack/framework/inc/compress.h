@@ -29,7 +29,8 @@
  *
  * The compressed format allows compressing a unit ranged from 0 to 507904 to 1 byte with variable resolution.
  *
- * It can be converted back to units using the formula T = (4^EXP)·(MANT).
+ * It can be converted back to units using the formula T = (4^EXP)·(MANT). Since 4^EXP equals 1 << (2·EXP), both
+ * directions only need shifts, which keeps floating point out of the timing calculations of the stack.
  * \author philippe.nunes@cortus.com
  */
 
@@ -37,7 +38,7 @@
 #define COMPRESS_H_
 
 #include <stdbool.h>
-#include "math.h"
+#include <stdint.h>
 
 typedef union{
   uint8_t raw;
@@ -47,8 +48,24 @@ typedef union{
   };
 } compressed_time_t;
 
-#define CT_DECOMPRESS(ct) (pow(4, ct >> 5) * (ct & 0b11111))
+#define CT_EXPONENT_MAX 7
+#define CT_MANTISSA_MAX 31
 
+/*! \brief Convert a compressed value back to units: (4^EXP)·(MANT) */
+static inline uint32_t decompress_data(uint8_t ct)
+{
+    return (uint32_t)(ct & CT_MANTISSA_MAX) << (2 * (ct >> 5));
+}
+
+#define CT_DECOMPRESS(ct) decompress_data(ct)
+
+/*! \brief Compress a value using the smallest possible exponent
+ *
+ * \param value The value to compress
+ * \param ceil  When true the result is the smallest compressed value which is not less than value (e.g. for
+ *              timeouts), otherwise the largest compressed value which is not more than value.
+ * \return The compressed value
+ */
 uint8_t compress_data(uint16_t value, bool ceil);
 
 #endif /* COMPRESS_H_ */
@@ -34,7 +34,39 @@
 
 #include <stdint.h>
 
-uint16_t crc_calculate(uint8_t* data, uint8_t length);
+#define CRC_INITIAL_VALUE 0xFFFF
+
+/*! \brief The state of an incremental CRC calculation
+ *
+ * A context is owned by the caller, so multiple calculations can be in progress at the same time
+ * (for example while the bytes of several frames are still arriving).
+ */
+typedef struct
+{
+    uint16_t crc;
+} crc_ctx_t;
+
+/*! \brief Start a new CRC calculation */
+static inline void crc_init(crc_ctx_t* ctx)
+{
+    ctx->crc = CRC_INITIAL_VALUE;
+}
+
+/*! \brief Feed the next length bytes into the CRC calculation
+ *
+ * Splitting the data over multiple calls results in the same CRC as a single call over the whole data.
+ * The implementation (bitwise, 256-entry table or slice-by-4/8) is selected with FRAMEWORK_CRC_IMPLEMENTATION.
+ */
+void crc_update(crc_ctx_t* ctx, const uint8_t* data, uint32_t length);
+
+/*! \brief Returns the CRC of all the data fed to the context so far */
+static inline uint16_t crc_final(const crc_ctx_t* ctx)
+{
+    return ctx->crc;
+}
+
+/*! \brief Calculate the CRC of length bytes in a single call */
+uint16_t crc_calculate(const uint8_t* data, uint32_t length);
 
 #endif /* CRC_H_ */
 
@@ -36,6 +36,7 @@
 #include "types.h"
 #include "debug.h"
 #include "hwblockdevice.h"
+#include "shared_buffer.h"
 
 #define ID_TYPE_NBID_ID_LENGTH 1
 #define ID_TYPE_NOID_ID_LENGTH 0
@@ -45,6 +46,7 @@
 #define ID_TYPE_IS_BROADCAST(id_type) (id_type == ID_TYPE_NBID || id_type == ID_TYPE_NOID)
 
 #define D7A_PAYLOAD_MAX_SIZE 255 // TODO confirm this value when FEC and security are disabled
+#define D7AP_SEND_BUFFER_HEADROOM 2 // room for the ALP request tag D7ASP prepends to a request sent together with others
 
 
 typedef enum {
@@ -220,7 +222,8 @@ uint8_t d7ap_get_payload_max_size(nls_method_t nls_method);
  *
  * @param[in] clientID  The registered client Id
  * @param[in] config    The configuration for the d7a session. Set to NULL to use the current config
- * @param[in] payload   The pointer to the payload buffer
+ * @param[in] payload   The pointer to the payload buffer. The payload is copied into a shared buffer, so the buffer can
+ *                      be reused when this function returns. Use d7ap_send_buffer() to avoid this copy.
  * @param[in] len       The length of the payload
  * @param[in] expected_response_len The length of the expected response
  * @param[in,out] trans_id   Set the value of this parameter to NULL to cause the function to execute synchronously.
@@ -233,6 +236,26 @@ error_t d7ap_send(uint8_t clientId, d7ap_session_config_t* config, uint8_t* payl
                    uint8_t len, uint8_t expected_response_len, uint16_t* trans_id);
 
 
+/**
+ * @brief   Send the data of a shared buffer over DASH7 network
+ *
+ * The request FIFO of the session keeps a reference to the buffer until the session is completed, so the payload is
+ * only copied when the frame is assembled. The data should not be changed until then. A request tag can be prepended
+ * to the data.
+ *
+ * @param[in] clientID  The registered client Id
+ * @param[in] config    The configuration for the d7a session. Set to NULL to use the current config
+ * @param[in] buffer    The buffer containing the payload, with at least D7AP_SEND_BUFFER_HEADROOM bytes of headroom.
+ *                      Its tailroom is used to send requests of the session together.
+ * @param[in] expected_response_len The length of the expected response
+ * @param[in,out] trans_id   See d7ap_send()
+ * @return 0 on success
+ * @return an error (errno.h) in case of failure
+ */
+error_t d7ap_send_buffer(uint8_t clientId, d7ap_session_config_t* config, shared_buffer_t* buffer,
+                         uint8_t expected_response_len, uint16_t* trans_id);
+
+
 /**
  * @brief   Sets the channels TX power index
  *
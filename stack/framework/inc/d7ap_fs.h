@@ -84,7 +84,12 @@
 #define D7A_FILE_NWL_SECURITY_STATE_REG			0x0F
 #define D7A_FILE_NWL_SECURITY_STATE_REG_SIZE	2 + (FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE)*(D7A_FILE_NWL_SECURITY_SIZE + D7A_FILE_UID_SIZE)
 
-#define D7AP_FS_SYSTEMFILES_COUNT 0x2F // reserved up until 0x3F but used only until 0x2F so use this for limiting memory usage
+// not part of the spec, a system file in the reserved range which remembers the nodes evicted from the register. The
+// number of entries follows from the file length.
+#define D7A_FILE_NWL_SSR_EVICTED_NODES          0x2F
+#define D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE      (D7A_FILE_UID_SIZE + sizeof(uint32_t))
+
+#define D7AP_FS_SYSTEMFILES_COUNT 0x30 // reserved up until 0x3F but used only until 0x2F so use this for limiting memory usage
 #define D7AP_FS_USERFILES_COUNT (FRAMEWORK_FS_FILE_COUNT - D7AP_FS_SYSTEMFILES_COUNT)
 
 #define USER_FILE_ALP_CTRL_FILE_ID 0x40
@@ -128,6 +133,12 @@ bool d7ap_fs_unregister_file_modified_callback(uint8_t file_id);
 bool d7ap_fs_register_file_modifying_callback(uint8_t file_id, d7ap_fs_modifying_file_callback_t callback);
 bool d7ap_fs_unregister_file_modifying_callback(uint8_t file_id);
 
+typedef struct
+{
+  uint32_t hits;    // header lookups answered from the decoded header cache
+  uint32_t misses;  // header lookups which required reading the header from the filesystem
+} d7ap_fs_header_cache_stats_t;
+
 void d7ap_fs_init();
 int d7ap_fs_init_file(uint8_t file_id, const d7ap_fs_file_header_t* file_header, const uint8_t* initial_data);
 int d7ap_fs_init_file_on_blockdevice(uint8_t file_id, uint8_t blockdevice_index, const d7ap_fs_file_header_t* file_header, const uint8_t* initial_data);
@@ -157,8 +168,12 @@ int d7ap_fs_write_nwl_security(dae_nwl_security_t *nwl_security);
 int d7ap_fs_read_nwl_security_state_register(dae_nwl_ssr_t *node_security_state);
 int d7ap_fs_add_nwl_security_state_register_entry(dae_nwl_trusted_node_t *trusted_node, uint8_t trusted_node_nb);
 int d7ap_fs_update_nwl_security_state_register(dae_nwl_trusted_node_t *trusted_node, uint8_t trusted_node_index);
+int d7ap_fs_get_nwl_ssr_evicted_node_count(void);
+int d7ap_fs_read_nwl_ssr_evicted_node(dae_nwl_evicted_node_t *evicted_node, uint16_t index);
+int d7ap_fs_write_nwl_ssr_evicted_node(const dae_nwl_evicted_node_t *evicted_node, uint16_t index);
 
 uint32_t d7ap_fs_get_file_length(uint8_t file_id);
+const d7ap_fs_header_cache_stats_t* d7ap_fs_get_header_cache_stats(void);
 int d7ap_fs_change_file_length(uint8_t file_id, uint32_t length);
 
 #endif /* D7AP_FS_H_ */
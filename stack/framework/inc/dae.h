@@ -147,6 +147,11 @@ typedef struct {
     //bool used;  /* to be used if it is possible to remove a trusted node from the table */
 } dae_nwl_trusted_node_t;
 
+typedef struct {
+    uint8_t addr[8];
+    uint32_t next_frame_counter; /* the lowest frame counter still accepted from this node, 0 when unused */
+} dae_nwl_evicted_node_t;
+
 typedef struct {
     uint8_t filter_mode;
     uint8_t trusted_node_nb;
@@ -46,25 +46,62 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 
+/*! \brief State of a (streaming) Viterbi decoder
+ *
+ * The decoder context is owned by the caller, so several frames can be decoded at the same time.
+ */
 typedef struct {
-	uint8_t cost;
-	uint16_t path;
-} VITERBIPATH;
+	uint8_t cost[8];			/**< The accumulated path metric of every trellis state */
+	uint16_t path[8];			/**< The most recent decoded bits of the surviving path into every state */
+	uint8_t path_size;			/**< The number of bytes in the path which are not flushed to the output yet */
+	uint8_t block[4];			/**< Input bytes of an interleaving block which is not complete yet */
+	uint8_t block_size;
+	uint8_t* output;
+	uint16_t output_size;
+	uint16_t output_length;		/**< The number of decoded bytes so far */
+} fec_decoder_t;
 
-typedef struct {
-	uint8_t path_size;
-	VITERBIPATH* old;
-	VITERBIPATH* new;
-	VITERBIPATH states1[8];
-	VITERBIPATH states2[8];
-} VITERBISTATE;
+/*! \brief Encode nbytes of data in place, data must be able to hold fec_calculated_decoded_length(nbytes) bytes
+ *
+ * \return the length of the encoded data
+ */
+uint16_t fec_encode(uint8_t *data, uint16_t nbytes);
 
-//void print_array(uint8_t* buffer, uint8_t length);
+/*! \brief Encode nbytes of input into output, output must be able to hold fec_calculated_decoded_length(nbytes) bytes.
+ * Encoding in place (output == input) is allowed, any other overlap is not.
+ *
+ * \return the length of the encoded data
+ */
+uint16_t fec_encode_copy(uint8_t *output, const uint8_t *input, uint16_t nbytes);
 
-uint16_t fec_encode(uint8_t *data, uint16_t nbytes);
+/*! \brief Decode a complete packet in place
+ *
+ * \param packet_length the length of the encoded data, a multiple of 4
+ * \return the length of the decoded data (including the trellis terminator), or 0 on error
+ */
 uint16_t fec_decode_packet(uint8_t* data, uint16_t packet_length, uint16_t output_length);
+
 uint16_t fec_calculated_decoded_length(uint16_t packet_length);
 
+/*! \brief Start decoding a new packet into output
+ *
+ * The output may point to the same buffer as the input which is fed afterwards, since the decoder
+ * never writes beyond the input it has already consumed.
+ */
+void fec_decoder_init(fec_decoder_t* decoder, uint8_t* output, uint16_t output_size);
+
+/*! \brief Feed the next chunk of encoded data, the chunk does not need to be a multiple of 4 bytes
+ *
+ * All but the last decoded byte are available in the output after this call (see output_length).
+ */
+void fec_decoder_update(fec_decoder_t* decoder, const uint8_t* input, uint16_t length);
+
+/*! \brief Flush the last decoded byte
+ *
+ * \return the total number of decoded bytes
+ */
+uint16_t fec_decoder_final(fec_decoder_t* decoder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,14 @@
 #define FRAMEWORK_FS_FILE_COUNT 70
 #endif
 
+#ifndef FRAMEWORK_FS_HEADER_CACHE_SIZE
+#define FRAMEWORK_FS_HEADER_CACHE_SIZE FRAMEWORK_FS_FILE_COUNT
+#endif
+
+#ifndef FRAMEWORK_FS_WRITEBACK_SLOTS
+#define FRAMEWORK_FS_WRITEBACK_SLOTS 0
+#endif
+
 #ifndef FRAMEWORK_FS_BLOCKDEVICES_COUNT
 #define FRAMEWORK_FS_BLOCKDEVICES_COUNT 3
 #endif
@@ -91,7 +99,22 @@ void fs_init();
 int fs_init_file(uint8_t file_id, fs_blockdevice_types_t bd_type, const uint8_t* initial_data, uint32_t initial_data_length, uint32_t length);
 int fs_read_file(uint8_t file_id, uint32_t offset, uint8_t* buffer, uint32_t length);
 int fs_write_file(uint8_t file_id, uint32_t offset, const uint8_t* buffer, uint32_t length);
-fs_file_stat_t *fs_file_stat(uint8_t file_id);
+/*! \brief Get the length and storage class of a file
+ *
+ * \param stat   Filled in with the file information, can be NULL to only check whether the file exists
+ * \return 0 on success, -ENOENT when the file does not exist
+ */
+int fs_file_stat(uint8_t file_id, fs_file_stat_t* stat);
+
+/*! \brief Program all writes which are still pending in the write-back cache */
+void fs_sync();
+
+/*! \brief Select whether writes to a file bypass the write-back cache
+ *
+ * Files which are accessed directly on the blockdevice (see fs_get_address()) or which must survive an unexpected
+ * reset, like security frame counters, should be write-through. Making a file write-through flushes its pending writes.
+ */
+void fs_set_write_through(uint8_t file_id, bool write_through);
 
 uint32_t fs_get_address(uint8_t file_id);
 
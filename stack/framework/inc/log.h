@@ -30,6 +30,13 @@
  * Logging can be globally enabled or disabled by setting or clearing the 
  * 'FRAMEWORK_LOG_ENABLED' CMake option.
  *
+ * When the 'FRAMEWORK_LOG_BINARY' CMake option is set, the messages are not formatted
+ * on the target. A log call only stores the id of the format string and the raw
+ * arguments, which are decoded on the host by tools/log_decoder.py using the ELF file
+ * of the application. In this mode the format strings have to be string literals, the log
+ * functions are macros which determine how every argument is stored from its type at compile
+ * time (see LOG_ARG_TYPE), so the format is not parsed on the target.
+ *
  * \author maarten.weyn@uantwerpen.be
  * \author glenn.ergeerts@uantwerpen.be
  * \author daniel.vandenakker@uantwerpen.be
@@ -62,6 +69,69 @@ typedef enum
 /*! \brief Reset the log counter back to zero */
 __LINK_C void log_counter_reset(void);
 
+/*! \brief Log raw data */
+__LINK_C void log_print_data(uint8_t* message, uint32_t length);
+
+#ifdef FRAMEWORK_LOG_BINARY
+
+#define LOG_RECORD_KIND_STRING       0x01
+#define LOG_RECORD_KIND_STACK_STRING 0x02
+#define LOG_RECORD_KIND_ERROR_STRING 0x03
+#define LOG_RECORD_KIND_DATA         0x04
+
+/*! \brief How an argument of a binary log call is stored, determined at compile time from its type.
+ *
+ * char pointers are logged as strings, floating point values as double and long long as 8 bytes. All
+ * other arguments (including pointers) take 4 bytes, like on the MCU, which is what the host expects for
+ * their conversion specifier. On a 64-bit target long and pointers are passed as 8 bytes and truncated. */
+#define LOG_ARG_INT32   1
+#define LOG_ARG_INT64   2
+#define LOG_ARG_WORD64  3 // passed as 8 bytes, stored as 4
+#define LOG_ARG_DOUBLE  4
+#define LOG_ARG_STRING  5
+#define LOG_ARG_TYPE_BITS 3
+
+#define LOG_ARG_TYPE(arg) _Generic((arg),                                                         \
+    float: LOG_ARG_DOUBLE, double: LOG_ARG_DOUBLE,                                              \
+    long long: LOG_ARG_INT64, unsigned long long: LOG_ARG_INT64,                                \
+    char*: LOG_ARG_STRING, const char*: LOG_ARG_STRING,                                         \
+    void*: (sizeof(void*) > 4 ? LOG_ARG_WORD64 : LOG_ARG_INT32),                                \
+    const void*: (sizeof(void*) > 4 ? LOG_ARG_WORD64 : LOG_ARG_INT32),                          \
+    default: (sizeof((arg) + 0) > 4 ? LOG_ARG_WORD64 : LOG_ARG_INT32))
+
+// the number of arguments after the format, a log call takes at most 10 of them
+#define LOG_ARG_COUNT(...) LOG_ARG_COUNT_(__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_ARG_COUNT_(format, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, count, ...) count
+
+#define LOG_ARG_TYPES_0(format) 0
+#define LOG_ARG_TYPES_1(format, arg) LOG_ARG_TYPE(arg)
+#define LOG_ARG_TYPES_2(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_1(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_3(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_2(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_4(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_3(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_5(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_4(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_6(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_5(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_7(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_6(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_8(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_7(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_9(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_8(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_10(format, arg, ...) (LOG_ARG_TYPE(arg) | LOG_ARG_TYPES_9(format, __VA_ARGS__) << LOG_ARG_TYPE_BITS)
+#define LOG_ARG_TYPES_(count, ...) LOG_ARG_TYPES_##count(__VA_ARGS__)
+#define LOG_ARG_TYPES__(count, ...) LOG_ARG_TYPES_(count, __VA_ARGS__)
+
+/*! \brief The types of the arguments after the format, LOG_ARG_TYPE_BITS per argument starting from the lowest bits */
+#define LOG_ARG_TYPES(...) ((uint32_t)LOG_ARG_TYPES__(LOG_ARG_COUNT(__VA_ARGS__), __VA_ARGS__))
+
+/*! \brief Stores a record with the id of the format and the arguments described by arg_types, used by the macros below */
+__LINK_C void log_print_binary(uint8_t kind, uint8_t layer, uint32_t arg_types, const char* format, ...);
+
+#define log_print_string(...) \
+    log_print_binary(LOG_RECORD_KIND_STRING, 0, LOG_ARG_TYPES(__VA_ARGS__), __VA_ARGS__)
+#define log_print_stack_string(type, ...) \
+    log_print_binary(LOG_RECORD_KIND_STACK_STRING, type, LOG_ARG_TYPES(__VA_ARGS__), __VA_ARGS__)
+#define log_print_error_string(...) \
+    log_print_binary(LOG_RECORD_KIND_ERROR_STRING, 0, LOG_ARG_TYPES(__VA_ARGS__), __VA_ARGS__)
+
+#else
+
 /*! \brief Log a string which can be optionally formatted using printf() style
  * format specifiers. */
 __LINK_C void log_print_string(const char* format,...);
@@ -70,12 +140,11 @@ __LINK_C void log_print_string(const char* format,...);
  * format specifiers. Note: this is only to be used from within stack code, not from application level code. */
 __LINK_C void log_print_stack_string(log_stack_layer_t type, const char* format, ...);
 
-/*! \brief Log raw data */
-__LINK_C void log_print_data(uint8_t* message, uint32_t length);
-
 /*! \brief Log a string using a bright red background to note an error */
 void log_print_error_string(const char* format,...);
 
+#endif
+
 #else
     #define log_counter_reset() ((void)0)
     #define log_print_string(...) ((void)0)
@@ -33,15 +33,38 @@ typedef enum
     SERIAL_MESSAGE_TYPE_PING_RESPONSE=0X03,
     SERIAL_MESSAGE_TYPE_LOGGING=0X04,
     SERIAL_MESSAGE_TYPE_REBOOTED=0X05,
+    SERIAL_MESSAGE_TYPE_ACK=0X06, // protocol version 1 only, used internally by the modem interface
 } serial_message_type_t;
 
+typedef struct
+{
+    uint32_t frames_transmitted;   /**< The number of frames transmitted for the first time */
+    uint32_t frames_retransmitted; /**< The number of retransmissions of version 1 frames */
+    uint32_t frames_received;      /**< The number of frames passed to a handler */
+    uint32_t frames_duplicate;     /**< The number of received version 1 frames which were already received */
+    uint32_t frames_dropped;       /**< The number of queued version 1 frames given up without acknowledgement */
+    uint32_t crc_errors;           /**< The number of received frames with an incorrect CRC */
+    uint32_t bytes_skipped;        /**< The number of received bytes skipped while searching a header */
+} modem_interface_stats_t;
+
 typedef void (*cmd_handler_t)(fifo_t* cmd_fifo);
 typedef void (*target_rebooted_callback_t)(system_reboot_reason_t reboot_reason);
 
 /*
+Protocol version 0
 ---------------HEADER(bytes)---------------------
 |sync|sync|counter|message type|length|crc1|crc2|
 -------------------------------------------------
+
+Protocol version 1, negotiated with modem_interface_negotiate_protocol()
+------------------------------------HEADER(bytes)----------------------------------
+|sync|version|sequence number|message type|length (MSB)|length (LSB)|hcs|crc1|crc2|
+-----------------------------------------------------------------------------------
+The second sync byte is the version (0x00 or 0x01). The header checksum (hcs) is the inverted sum of the version up
+to the length, the CRC covers these fields and the payload. Version 1 frames are acknowledged by the receiver with an
+ACK frame carrying the next expected sequence number and a bitmap of the frames received after it, a window of
+FRAMEWORK_MODEM_INTERFACE_WINDOW_SIZE frames is transmitted without waiting and lost frames are retransmitted.
+Ping and reboot messages are always sent as version 0 frames, version 0 frames are accepted at any time.
 */
 
 /** @brief Initialize the modem interface by registering
@@ -54,13 +77,16 @@ typedef void (*target_rebooted_callback_t)(system_reboot_reason_t reboot_reason)
  */
 void modem_interface_init(uint8_t idx, uint32_t baudrate, pin_id_t uart_state_pin_id, pin_id_t target_uart_state_pin_id);
 
-/** @brief  Adds header to bytes containing sync bytes, counter, length and crc and puts it in UART fifo
+/** @brief  Queues a frame for transmission, with a header containing sync bytes, counter, length and crc.
+ *  The payload is copied into the TX fifo, the header is transmitted from the frame queue.
  *  @param bytes Bytes that need to be transmitted
- *  @param length Length of bytes
+ *  @param length Length of bytes, at most modem_interface_get_max_frame_size()
  *  @param type type of message (SERIAL_MESSAGE_TYPE_ALP, SERIAL_MESSAGE_TYPE_PING_REQUEST, SERIAL_MESSAGE_TYPE_LOGGING, ...)
- *  @return Void.
+ *  @return error_t 	SUCCESS if the frame is queued.
+ *                      ENOMEM if the frame queue or the Tx buffer is full.
+ *                      ESIZE if the frame is too long for the negotiated protocol version.
  */
-error_t modem_interface_transfer_bytes(uint8_t* bytes, uint8_t length, serial_message_type_t type);
+error_t modem_interface_transfer_bytes(uint8_t* bytes, uint16_t length, serial_message_type_t type);
 /** @brief Transmits a string by adding a header and putting it in the UART fifo
  *  @param string Bytes that need to be transmitted
  *  @return error_t 	SUCCESS if the data is put into the Tx buffer.
@@ -84,4 +110,25 @@ void modem_interface_set_target_rebooted_callback(target_rebooted_callback_t cb)
 
 void modem_interface_clear_handler();
 
+/** @brief Requests protocol version 1 by sending a ping request carrying the version and the maximum frame size.
+ *  The version is switched when the ping response of the peer arrives, a peer which only supports version 0 answers
+ *  with a plain ping response and the interface stays at version 0. The ping response handler is called as before.
+ *  When FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1 is disabled version 0 is requested, and version requests of the peer are
+ *  answered with version 0 as well.
+ *  @return error_t the result of queueing the ping request
+ */
+error_t modem_interface_negotiate_protocol();
+
+/** @brief Returns the protocol version used for transmission (0 or 1)
+ */
+uint8_t modem_interface_get_protocol_version();
+
+/** @brief Returns the maximum payload length accepted by modem_interface_transfer_bytes()
+ */
+uint16_t modem_interface_get_max_frame_size();
+
+/** @brief Returns the statistics collected since modem_interface_init()
+ */
+const modem_interface_stats_t* modem_interface_get_stats();
+
 #endif //MODEM_INTERFACE_H
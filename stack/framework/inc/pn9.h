@@ -34,12 +34,26 @@
 #include <stdint.h>
 
 #define PN9_INITIALIZER (0x1ff)
+#define PN9_PERIOD (511) // the keystream repeats every 511 bytes
 
 /*
- * PN9 Encoder used for data whitening
+ * PN9 Encoder used for data whitening. Encoding and decoding are the same operation.
  */
 void pn9_encode(uint8_t *data, uint16_t length);
 
+/*
+ * Whiten data as if it is located at the given offset from the start of the frame. This allows the frame
+ * to be processed in separate parts (e.g. the header first and the body later):
+ * pn9_encode(data, n) is equal to pn9_encode_offset(data, k, 0) followed by pn9_encode_offset(data + k, n - k, k)
+ */
+void pn9_encode_offset(uint8_t *data, uint16_t length, uint16_t offset);
+
+/*
+ * Whiten length bytes of input into output, which saves a separate copy when the plain data has to be kept.
+ * output and input may be the same buffer but may not overlap otherwise.
+ */
+void pn9_encode_copy(uint8_t *output, const uint8_t *input, uint16_t length);
+
 #endif // PN9_H_
 
 /** @}*/
@@ -37,6 +37,15 @@
  */
 typedef void (*task_t)(void *arg);
 
+/*! \brief Handle of a registered task, which is posted and cancelled without looking up the task
+ *
+ * A handle is obtained once with sched_register_task_handle(), typically into a static variable. Zero
+ * (SCHED_NO_TASK_HANDLE) is never a valid handle, so a zero initialised handle means the task has no handle.
+ */
+typedef uint8_t sched_task_handle_t;
+
+#define SCHED_NO_TASK_HANDLE 0
+
 /*! \brief Initialise the scheduler sub system. 
  *
  * This function is called while bootstrapping the framework. On no account should you call this function 
@@ -99,6 +108,19 @@ __LINK_C error_t sched_register_task_allow_multiple(task_t task, bool allow);
  */
 static inline error_t sched_register_task(task_t task) { return sched_register_task_allow_multiple(task, false);}
 
+/*! \brief Register a task with the task scheduler and get its handle.
+ *
+ *  The task can still be posted as a task_t as well. A task which was registered multiple times with
+ *  sched_register_task_allow_multiple() has no handle, it is posted with the task_t API.
+ *
+ * \param task		The task to register
+ * \param handle	Set to the handle of the task, also when the task was already registered
+ *
+ * \return error_t 	SUCCESS if the task was registered successfully
+ *                  EALREADY if the task was already registered
+ */
+__LINK_C error_t sched_register_task_handle(task_t task, sched_task_handle_t *handle);
+
 /*! \brief Post a task with the given priority
  *
  * \param task		The task to be executed by the scheduler
@@ -123,6 +145,23 @@ __LINK_C error_t sched_post_task_prio(task_t task, uint8_t priority, void *arg);
  */
 static inline error_t sched_post_task(task_t task) { return sched_post_task_prio(task,DEFAULT_PRIORITY, NULL);}
 
+/*! \brief Post a task by its handle with the given priority, this takes constant time
+ *
+ * \param handle	The handle of the task to be executed by the scheduler
+ * \param priority	The priority of the task
+ * \param arg		The argument passed to the task
+ *
+ * \return error_t	SUCCESS if the task was successfully scheduled
+ *			EINVAL if the handle is not a handle of a registered task
+ *			ESIZE if the priority is not between MAX_PRIORITY and MIN_PRIORITY
+ *			EALREADY if the task was already scheduled. If this is the case,
+ *			the task will be executed but only once.
+ */
+__LINK_C error_t sched_post_task_handle_prio(sched_task_handle_t handle, uint8_t priority, void *arg);
+
+/*! \brief Post a task by its handle at the default priority */
+static inline error_t sched_post_task_handle(sched_task_handle_t handle) { return sched_post_task_handle_prio(handle, DEFAULT_PRIORITY, NULL);}
+
 /*! \brief Cancel an already scheduled task
  *
  * \param task		The task to cancel
@@ -144,6 +183,16 @@ __LINK_C error_t sched_cancel_task_with_arg(task_t task, void *arg);
  */
 static inline error_t sched_cancel_task(task_t task) { return sched_cancel_task_with_arg(task, NULL);}
 
+/*! \brief Cancel an already scheduled task by its handle
+ *
+ * \param handle	The handle of the task to cancel
+ *
+ * \return error_t	SUCCESS if the task was cancelled successfully
+ * 			EINVAL if the handle is not a handle of a registered task
+ *			EALREADY if the task was not scheduled or has already been executed
+ */
+__LINK_C error_t sched_cancel_task_handle(sched_task_handle_t handle);
+
 /*! \brief Check whether a task is scheduled with the given argument to be executed
  *
  * \param task		The task to check
@@ -160,6 +209,15 @@ __LINK_C bool sched_is_scheduled_with_arg(task_t task, void *arg);
  */
 static inline bool sched_is_scheduled(task_t task) { return sched_is_scheduled_with_arg(task, NULL);}
 
+typedef void (*sched_idle_hook_t)(void);
+
+/*! \brief Set a function which is called every time the scheduler runs out of tasks, right before it enters low power
+ * mode. Only a single hook is supported.
+ *
+ * \param hook		The function to call, or NULL to remove the hook
+ */
+__LINK_C void sched_set_idle_hook(sched_idle_hook_t hook);
+
 __LINK_C uint8_t sched_get_low_power_mode(void);
 __LINK_C void    sched_set_low_power_mode(uint8_t mode);
 
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file shared_buffer.h
+ * \addtogroup shared_buffer
+ * \ingroup framework
+ * @{
+ * \brief Reference counted buffers with headroom, which are passed between the layers of the stack instead of copying
+ * their data.
+ *
+ * A buffer is allocated from a static pool of FRAMEWORK_SHARED_BUFFER_COUNT buffers, with a number of bytes reserved
+ * in front of the data. A lower layer can prepend its header in this headroom, in place. Every layer which keeps the
+ * buffer after returning to its caller holds a reference, the buffer returns to the pool when the last reference is
+ * released.
+ */
+
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "framework_defs.h"
+
+typedef struct {
+    uint8_t ref_count;  /**< The number of references, 0 when the buffer is free */
+    uint16_t offset;    /**< The index in storage of the first data byte, this is the size of the headroom */
+    uint16_t length;    /**< The number of data bytes */
+    uint8_t storage[FRAMEWORK_SHARED_BUFFER_SIZE];
+} shared_buffer_t;
+
+/*! \brief Allocates a buffer without data from the pool
+ * \param headroom  The number of bytes reserved in front of the data
+ * \return The buffer, holding one reference for the caller, or NULL when all buffers are in use or the headroom does
+ *         not fit in the buffer
+ */
+shared_buffer_t* shared_buffer_alloc(uint16_t headroom);
+
+/*! \brief Takes an additional reference to the buffer */
+void shared_buffer_retain(shared_buffer_t* buffer);
+
+/*! \brief Releases a reference to the buffer, the buffer returns to the pool when this was the last reference */
+void shared_buffer_release(shared_buffer_t* buffer);
+
+/*! \brief Returns the number of buffers which are not in use */
+uint8_t shared_buffer_get_free_count(void);
+
+static inline uint8_t* shared_buffer_get_data(shared_buffer_t* buffer)
+{
+    return buffer->storage + buffer->offset;
+}
+
+static inline uint16_t shared_buffer_get_length(shared_buffer_t* buffer)
+{
+    return buffer->length;
+}
+
+/*! \brief Returns the number of bytes which can be prepended to the data */
+static inline uint16_t shared_buffer_get_headroom(shared_buffer_t* buffer)
+{
+    return buffer->offset;
+}
+
+/*! \brief Returns the number of bytes which can be appended to the data */
+static inline uint16_t shared_buffer_get_tailroom(shared_buffer_t* buffer)
+{
+    return FRAMEWORK_SHARED_BUFFER_SIZE - buffer->offset - buffer->length;
+}
+
+/*! \brief Extends the data with length bytes in front of it, taken from the headroom
+ * \return A pointer to the prepended bytes, which is the new start of the data, or NULL when the headroom is too small
+ */
+uint8_t* shared_buffer_prepend(shared_buffer_t* buffer, uint16_t length);
+
+/*! \brief Extends the data with length bytes behind it, taken from the tailroom
+ * \return A pointer to the appended bytes, or NULL when the tailroom is too small
+ */
+uint8_t* shared_buffer_append(shared_buffer_t* buffer, uint16_t length);
+
+/*! \brief Sets the data of a buffer which was filled through a pointer to its storage
+ * \param data    The start of the data, in the storage of the buffer. The bytes in front of it become the headroom.
+ * \param length  The number of data bytes
+ */
+void shared_buffer_set_data(shared_buffer_t* buffer, uint8_t* data, uint16_t length);
+
+#endif // SHARED_BUFFER_H
+
+/** @}*/
@@ -63,6 +63,7 @@ typedef struct
     task_t f;
     timer_tick_t next_event;
     uint8_t priority;
+    sched_task_handle_t handle; // set by timer_init_event(), the task is posted without looking it up
     void *arg;
     timer_tick_t period;
 } timer_event;
@@ -39,4 +39,13 @@ typedef int error_t;	//use 'int' since it matches the value expected for errors
 
 typedef const char * string_t;
 
+/* \brief Round a compile time constant (up to 16 bit) up to the next power of 2, to size lookup tables
+ *
+ */
+#define __POW2_SMEAR1(x) ((x) | ((x) >> 1))
+#define __POW2_SMEAR2(x) (__POW2_SMEAR1(x) | (__POW2_SMEAR1(x) >> 2))
+#define __POW2_SMEAR4(x) (__POW2_SMEAR2(x) | (__POW2_SMEAR2(x) >> 4))
+#define __POW2_SMEAR8(x) (__POW2_SMEAR4(x) | (__POW2_SMEAR4(x) >> 8))
+#define POW2_CEIL(x) (__POW2_SMEAR8((x) - 1) + 1)
+
 #endif // __FRM_TYPES_H__
@@ -102,6 +102,10 @@ lorawan_antenna_gain_in_db = 1 #dBm #in EU868 the MAX_EIRP is 16dBm so this corr
 lorawan_antenna_gain = [int(bytes(lorawan_antenna_gain_in_db & 0xff))] #dBm
 lorawan_antenna_gain_file_size = 1
 
+# the nodes evicted from the security state register (see d7anp_ssr.h), each entry holds the UID and the next frame counter
+ssr_evicted_node_count = 32
+ssr_evicted_nodes_file_size = ssr_evicted_node_count * (8 + 4)
+
 ctrl_stack_file_size = 2
 ctrl_stack_file = [0x00, 0xd7]
 ctrl_stack_file.extend([0] * (ctrl_stack_file_size - len(ctrl_stack_file)))
@@ -173,7 +177,7 @@ system_files = [
   (AccessProfileFile(12, ap_no_scan),                                           sys_file_prop_perm, sys_file_permission_read_only),
   (AccessProfileFile(13, ap_no_scan),                                           sys_file_prop_perm, sys_file_permission_read_only),
   (AccessProfileFile(14, ap_no_scan),                                           sys_file_prop_perm, sys_file_permission_read_only),
-  (NotImplementedFile(SystemFileIds.RFU_2F.value, 20),                          sys_file_prop_perm, sys_file_permission_read_only),
+  (NotImplementedFile(SystemFileIds.RFU_2F.value, ssr_evicted_nodes_file_size), sys_file_prop_perm, sys_file_permission_read_only),  # NWL SSR evicted nodes, not part of the spec
   (NotImplementedFile(0x40, ctrl_stack_file_size, data=ctrl_stack_file),        sys_file_prop_perm, sys_file_permission_read_only),
   (NotImplementedFile(0x41, len(LoRaWAN_OTAA_Keys), data=LoRaWAN_OTAA_Keys),    sys_file_prop_perm, sys_file_permission_locked),
   (NotImplementedFile(0x46, lorawan_antenna_gain_file_size, data=lorawan_antenna_gain), sys_file_prop_perm, sys_file_permission_all_write),
@@ -366,8 +370,8 @@ __attribute__((used)) uint8_t d7ap_fs_metadata[4 + 4 + (256 * 9)] LINKER_SECTION
   0x01, 0x0, 0x0, 0x0, 0x4d, 0x0, 0x0, 0x7, 0x4a, 
   // ACCESS_PROFILE_14 - 46 (length 77)
   0x01, 0x0, 0x0, 0x0, 0x4d, 0x0, 0x0, 0x7, 0x97, 
-  // RFU_2F - 47 (length 32)
-  0x01, 0x0, 0x0, 0x0, 0x20, 0x0, 0x0, 0x7, 0xe4, 
+  // RFU_2F - 47 (length 396)
+  0x01, 0x0, 0x0, 0x1, 0x8c, 0x0, 0x0, 0x7, 0xe4, 
   //	RFU - 48
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   //	RFU - 49
@@ -401,9 +405,9 @@ __attribute__((used)) uint8_t d7ap_fs_metadata[4 + 4 + (256 * 9)] LINKER_SECTION
   //	RFU - 63
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   // User File - 64 (length 14)
-  0x01, 0x0, 0x0, 0x0, 0xe, 0x0, 0x0, 0x8, 0x4, 
+  0x01, 0x0, 0x0, 0x0, 0xe, 0x0, 0x0, 0x9, 0x70, 
   // User File - 65 (length 52)
-  0x01, 0x0, 0x0, 0x0, 0x34, 0x0, 0x0, 0x8, 0x12, 
+  0x01, 0x0, 0x0, 0x0, 0x34, 0x0, 0x0, 0x9, 0x7e, 
   //	RFU - 66
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   //	RFU - 67
@@ -413,7 +417,7 @@ __attribute__((used)) uint8_t d7ap_fs_metadata[4 + 4 + (256 * 9)] LINKER_SECTION
   //	RFU - 69
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   // User File - 70 (length 13)
-  0x01, 0x0, 0x0, 0x0, 0xd, 0x0, 0x0, 0x8, 0x46, 
+  0x01, 0x0, 0x0, 0x0, 0xd, 0x0, 0x0, 0x9, 0xb2, 
   //	RFU - 71
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   //	RFU - 72
@@ -784,7 +788,7 @@ __attribute__((used)) uint8_t d7ap_fs_metadata[4 + 4 + (256 * 9)] LINKER_SECTION
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
   //	RFU - 255
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-  //[[[end]]] (checksum: c75d6280031a5e95d95ddcffd0dd7775)
+  //[[[end]]] (checksum: 13f6d388092c3c0ce3a93bfeda2546fb)
 };
 
 __attribute__((used)) uint8_t d7ap_files_data[FRAMEWORK_FS_PERMANENT_STORAGE_SIZE] LINKER_SECTION_FS_PERMANENT_FILES = {
@@ -933,9 +937,9 @@ __attribute__((used)) uint8_t d7ap_files_data[FRAMEWORK_FS_PERMANENT_STORAGE_SIZ
       // ACCESS_PROFILE_14 - 46 (length 65)
       0x24, 0x23, 0xff, 0xff, 0x0, 0x0, 0x0, 0x41, 0x0, 0x0, 0x0, 0x41, 
       0x32, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 0x0, 0x0, 0x0, 0x0, 0xe, 0x50, 0xff, 
-      // RFU_2F - 47 (length 20)
-      0x24, 0x23, 0xff, 0xff, 0x0, 0x0, 0x0, 0x14, 0x0, 0x0, 0x0, 0x14, 
-      0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 
+      // RFU_2F - 47 (length 384)
+      0x24, 0x23, 0xff, 0xff, 0x0, 0x0, 0x1, 0x80, 0x0, 0x0, 0x1, 0x80, 
+      0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 
       // User File - 64 (length 2)
       0x24, 0x23, 0xff, 0xff, 0x0, 0x0, 0x0, 0x2, 0x0, 0x0, 0x0, 0x2, 
       0x0, 0xd7, 
@@ -945,7 +949,7 @@ __attribute__((used)) uint8_t d7ap_files_data[FRAMEWORK_FS_PERMANENT_STORAGE_SIZ
       // User File - 70 (length 1)
       0x36, 0x23, 0xff, 0xff, 0x0, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x1, 
       0x1, 
-      //[[[end]]] (checksum: 27081de40e95a8a0082534042846d7b1)
+      //[[[end]]] (checksum: fd59fed5bf8bdd904a9db83988b16ad2)
   };
 
 #endif
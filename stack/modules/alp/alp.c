@@ -232,33 +232,6 @@ static bool parse_operand_status(alp_command_t* command, alp_action_t* action, b
     return true;
 }
 
-static bool parse_op_forward(alp_command_t* command, alp_action_t* action)
-{
-    fifo_t* cmd_fifo = &command->alp_command_fifo;
-    if(fifo_pop(cmd_fifo, &action->interface_config.itf_id, 1) != SUCCESS)
-        return false;
-
-    if (action->interface_config.itf_id == ALP_ITF_ID_D7ASP) {
-        uint8_t min_size = sizeof (d7ap_session_config_t) - 8; // substract max size of responder ID
-        if(fifo_pop(cmd_fifo, action->interface_config.itf_config, min_size) != SUCCESS)
-            return false;
-        uint8_t id_len = d7ap_addressee_id_length(((alp_interface_config_d7ap_t*)&(action->interface_config))->d7ap_session_config.addressee.ctrl.id_type);
-        return (fifo_pop(cmd_fifo, action->interface_config.itf_config + min_size, id_len) == SUCCESS);
-    }
-
-    for (uint8_t i = 0; i < MODULE_ALP_INTERFACE_CNT; i++) {
-        if (action->interface_config.itf_id == interfaces[i]->itf_id) {
-            if(fifo_pop(cmd_fifo, action->interface_config.itf_config, interfaces[i]->itf_cfg_len) != SUCCESS)
-                return false;
-            DPRINT("FORWARD %02X", action->interface_config.itf_id);
-            return true;
-        }
-    }
-
-    DPRINT("FORWARD interface %02X not found", action->interface_config.itf_id);
-    return false;
-}
-
 static bool parse_operand_file_id(alp_command_t* command, alp_action_t* action)
 {
     if(fifo_pop(&command->alp_command_fifo, &action->file_id_operand.file_id, 1) != SUCCESS)
@@ -286,11 +259,19 @@ static bool parse_operand_file_header(alp_command_t* command, alp_action_t* acti
 
 bool alp_append_break_query_action(alp_command_t* command, uint8_t file_id, uint32_t offset, alp_operand_query_t* query) {
     fifo_t* cmd_fifo = &command->alp_command_fifo;
+    int16_t value_length = alp_query_value_length(query->code.raw, query->compare_operand_length);
+    if(value_length < 0 || alp_query_file_offset_count(query->code.raw) != 1)
+        return false;
+
+    int16_t bitmap_length = alp_query_bitmap_length(query->code.raw, query->compare_operand_length, query->compare_body);
+    if(bitmap_length < 0 || value_length + bitmap_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE)
+        return false;
+
     int rc;
     rc = fifo_put_byte(cmd_fifo, ALP_OP_BREAK_QUERY);
     rc += fifo_put_byte(cmd_fifo, query->code.raw);
     rc += !alp_append_length_operand(command, query->compare_operand_length);
-    rc += fifo_put(cmd_fifo, query->compare_body, query->compare_operand_length);
+    rc += fifo_put(cmd_fifo, query->compare_body, value_length + bitmap_length);
     rc += !alp_append_file_offset_operand(command, file_id, offset);
     return rc == SUCCESS;
 }
@@ -298,42 +279,51 @@ bool alp_append_break_query_action(alp_command_t* command, uint8_t file_id, uint
 static bool parse_operand_query(alp_command_t* command, alp_action_t* action)
 {
     fifo_t* cmd_fifo = &command->alp_command_fifo;
-    error_t err;
+    alp_operand_query_t* query = &action->query_operand;
     DPRINT("BREAK QUERY");
-    if(fifo_pop(cmd_fifo, &action->query_operand.code.raw, 1) != SUCCESS)
-        return false;
-
-    if(action->query_operand.code.type != QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY)
-        return false;
-    
-    // TODO assuming no compare mask for now + assume compare value present + only 1 file offset operand
-    if(action->query_operand.code.mask)
+    if(fifo_pop(cmd_fifo, &query->code.raw, 1) != SUCCESS)
         return false;
 
     uint32_t temp;
     if(!alp_parse_length_operand(cmd_fifo, &temp))
         return false;
 
-    action->query_operand.compare_operand_length = temp;
+    query->compare_operand_length = temp;
 
-    if (action->query_operand.compare_operand_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE)
+    // the mask and compare value(s), followed by the bitmap of a range comparison
+    int16_t value_length = alp_query_value_length(query->code.raw, query->compare_operand_length);
+    if(value_length < 0 || value_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE)
         return false;
 
-    if(fifo_pop(cmd_fifo, action->query_operand.compare_body, (uint16_t)action->query_operand.compare_operand_length) != SUCCESS)
+    if(fifo_pop(cmd_fifo, query->compare_body, value_length) != SUCCESS)
         return false;
-    
-    // parse the file offset operand(s), using a temp fifo
-    fifo_t temp_fifo;
-    uint16_t subset_size = sizeof(alp_operand_file_offset_t) > fifo_get_size(cmd_fifo) ? fifo_get_size(cmd_fifo) : sizeof(alp_operand_file_offset_t);
-    fifo_init_subview(&temp_fifo, cmd_fifo, 0, subset_size);
 
-    alp_operand_file_offset_t temp_offset;
-    if(!alp_parse_file_offset_operand(&temp_fifo, &temp_offset)) // TODO assuming only 1 file offset operant. Why does this get discarded?
+    int16_t bitmap_length = alp_query_bitmap_length(query->code.raw, query->compare_operand_length, query->compare_body);
+    if(bitmap_length < 0 || value_length + bitmap_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE)
         return false;
-    if (fifo_pop(cmd_fifo, action->query_operand.compare_body + action->query_operand.compare_operand_length,
-        temp_fifo.head_idx - cmd_fifo->head_idx) != SUCCESS)
+
+    if(fifo_pop(cmd_fifo, query->compare_body + value_length, bitmap_length) != SUCCESS)
         return false;
 
+    // the file offset operand(s) are stored in the compare body as well, parsed using a temp fifo
+    query->body_length = value_length + bitmap_length;
+    for(uint8_t i = 0; i < alp_query_file_offset_count(query->code.raw); i++) {
+        fifo_t temp_fifo;
+        uint16_t subset_size = sizeof(alp_operand_file_offset_t) > fifo_get_size(cmd_fifo) ? fifo_get_size(cmd_fifo) : sizeof(alp_operand_file_offset_t);
+        fifo_init_subview(&temp_fifo, cmd_fifo, 0, subset_size);
+
+        alp_operand_file_offset_t temp_offset;
+        if(!alp_parse_file_offset_operand(&temp_fifo, &temp_offset))
+            return false;
+
+        uint16_t offset_length = temp_fifo.head_idx - cmd_fifo->head_idx;
+        if(query->body_length + offset_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE
+            || fifo_pop(cmd_fifo, query->compare_body + query->body_length, offset_length) != SUCCESS)
+            return false;
+
+        query->body_length += offset_length;
+    }
+
     return true;
 }
 
@@ -477,95 +467,235 @@ bool alp_parse_action(alp_command_t* command, alp_action_t* action)
     return succeeded;
 }
 
-int alp_get_expected_response_length(alp_command_t* command)
+typedef struct {
+    const uint8_t* data;
+    uint16_t size;
+    uint16_t pos;
+} command_reader_t;
+
+static inline bool read_byte(command_reader_t* reader, uint8_t* byte)
 {
-    uint8_t expected_response_length = 0;
-    static alp_command_t command_copy;
-    memcpy(&command_copy, command, sizeof(alp_command_t)); // use a copy, so we don't pop from the original command
-    fifo_t* command_copy_fifo = &command_copy.alp_command_fifo;
-    error_t e = 0;
-    uint32_t length = 0;
-    
-    while (fifo_get_size(command_copy_fifo) > 0) {
-        alp_control_t control;
-        if(fifo_pop(command_copy_fifo, &control.raw, 1) != SUCCESS)
-            return -EINVAL;
-        
-        switch (control.operation) {
-        case ALP_OP_READ_FILE_DATA:
-            e += fifo_skip(command_copy_fifo, 1); // skip file ID
-            uint32_t offset;
-            e += !alp_parse_length_operand(command_copy_fifo, &offset);
-            e += !alp_parse_length_operand(command_copy_fifo, &length);
-            expected_response_length += alp_length_operand_coded_length(length); // the length of the provided data operand
-            expected_response_length += alp_length_operand_coded_length(offset) + 1; // the length of the offset operand
-            expected_response_length += 1; // the opcode
-            break;
-        case ALP_OP_READ_FILE_PROPERTIES:
-            e += fifo_skip(command_copy_fifo, 1); //skip file ID
-            break;
-        case ALP_OP_REQUEST_TAG:
-            e += fifo_skip(command_copy_fifo, 1); // skip tag ID operand
-            expected_response_length += 2;
-            break;
-        case ALP_OP_RESPONSE_TAG:
-            e += fifo_skip(command_copy_fifo, 1); // skip tag ID operand
-            break;
-        case ALP_OP_RETURN_FILE_DATA:
-        case ALP_OP_WRITE_FILE_DATA:
-            e += fifo_skip(command_copy_fifo, 1); // skip file ID
-            uint32_t data_len;
-            uint8_t error = 0;
-            e += !alp_parse_length_operand(command_copy_fifo, &data_len); // offset
-            e += !alp_parse_length_operand(command_copy_fifo, &data_len);
-            e += fifo_skip(command_copy_fifo, data_len);
-            break;
-        case ALP_OP_FORWARD:;
-            static alp_action_t action;
-            e += !parse_op_forward(&command_copy, &action);
-            break;
-        case ALP_OP_INDIRECT_FORWARD:;
-            e += fifo_skip(command_copy_fifo, 1); // skip interface file id
-            if(control.b7)
-                return -EPERM;
-            break;
-        case ALP_OP_WRITE_FILE_PROPERTIES:
-        case ALP_OP_CREATE_FILE:
-        case ALP_OP_RETURN_FILE_PROPERTIES:
-            e += fifo_skip(command_copy_fifo, (1 + sizeof(d7ap_fs_file_header_t))); // skip file ID & header
-            break;
-        case ALP_OP_BREAK_QUERY:
-        case ALP_OP_ACTION_QUERY:
-            e += fifo_skip(command_copy_fifo, 1);
-            e += !alp_parse_length_operand(command_copy_fifo, &length);
-            e += fifo_skip(command_copy_fifo, (uint16_t)length);
-            e += fifo_skip(command_copy_fifo, 1);
-            e += !alp_parse_length_operand(command_copy_fifo, &length);
-            break;
-        case ALP_OP_STATUS:
-            if (!control.b6 && !control.b7) {
-                // action status
-                e += fifo_skip(command_copy_fifo, 1); // skip status code
-            } else if (control.b6 && !control.b7) {
-                // interface status
-                e += fifo_skip(command_copy_fifo, 1); // skip status code
-                e += !alp_parse_length_operand(command_copy_fifo, &length);
-                e += fifo_skip(command_copy_fifo, (uint16_t)length); // itf_status_len + itf status
-            } else
-                return -ENOEXEC; 
-
-            break;
-        case ALP_OP_START_ITF:
-        case ALP_OP_STOP_ITF:
-            break;
-        // TODO other operations
-        default:
+    if(reader->pos >= reader->size)
+        return false;
+
+    *byte = reader->data[reader->pos++];
+    return true;
+}
+
+static inline bool skip_bytes(command_reader_t* reader, uint32_t length)
+{
+    if(length > (uint32_t)(reader->size - reader->pos))
+        return false;
+
+    reader->pos += length;
+    return true;
+}
+
+// same encoding as alp_parse_length_operand()
+static bool read_length_operand(command_reader_t* reader, uint32_t* length)
+{
+    uint8_t byte;
+    if(!read_byte(reader, &byte))
+        return false;
+
+    uint8_t field_len = byte >> 6;
+    *length = byte & 0x3F;
+    if(field_len > reader->size - reader->pos)
+        return false;
+
+    for(; field_len > 0; field_len--)
+        *length = (*length << 8) + reader->data[reader->pos++];
+
+    return true;
+}
+
+static bool read_file_offset_operand(command_reader_t* reader, alp_action_index_t* action)
+{
+    return read_byte(reader, &action->file_id) && read_length_operand(reader, &action->file_offset);
+}
+
+static bool read_interface_config(command_reader_t* reader, alp_action_index_t* action)
+{
+    if(!read_byte(reader, &action->file_id))
+        return false;
+
+    action->data_offset = reader->pos;
+    if(action->file_id == ALP_ITF_ID_D7ASP) {
+        // the length of the addressee ID depends on the addressee control byte
+        d7ap_session_config_t session_config;
+        uint8_t min_size = sizeof(d7ap_session_config_t) - 8; // substract max size of responder ID
+        if(min_size > reader->size - reader->pos)
+            return false;
+
+        memcpy(&session_config, reader->data + reader->pos, min_size);
+        action->data_length = min_size + d7ap_addressee_id_length(session_config.addressee.ctrl.id_type);
+        return skip_bytes(reader, action->data_length);
+    }
+
+    for(uint8_t i = 0; i < MODULE_ALP_INTERFACE_CNT; i++) {
+        if(interfaces[i] != NULL && interfaces[i]->itf_id == action->file_id) {
+            action->data_length = interfaces[i]->itf_cfg_len;
+            return skip_bytes(reader, action->data_length);
+        }
+    }
+
+    DPRINT("FORWARD interface %02X not found", action->file_id);
+    return false;
+}
+
+static int index_action(command_reader_t* reader, alp_action_index_t* action, uint8_t* expected_response_length)
+{
+    memset(action, 0, sizeof(alp_action_index_t));
+    action->offset = reader->pos;
+    if(!read_byte(reader, &action->ctrl.raw))
+        return -EFAULT;
+
+    bool valid;
+    switch(action->ctrl.operation) {
+    case ALP_OP_READ_FILE_DATA:
+        valid = read_file_offset_operand(reader, action) && read_length_operand(reader, &action->data_length);
+        if(valid) {
+            *expected_response_length += alp_length_operand_coded_length(action->data_length); // the length of the provided data operand
+            *expected_response_length += alp_length_operand_coded_length(action->file_offset) + 1; // the length of the offset operand
+            *expected_response_length += 1; // the opcode
+        }
+        break;
+    case ALP_OP_READ_FILE_PROPERTIES:
+        valid = read_byte(reader, &action->file_id);
+        break;
+    case ALP_OP_REQUEST_TAG:
+        valid = read_byte(reader, &action->file_id); // the tag ID
+        *expected_response_length += 2;
+        break;
+    case ALP_OP_RESPONSE_TAG:
+        valid = read_byte(reader, &action->file_id); // the tag ID
+        break;
+    case ALP_OP_RETURN_FILE_DATA:
+    case ALP_OP_WRITE_FILE_DATA:
+        valid = read_file_offset_operand(reader, action) && read_length_operand(reader, &action->data_length);
+        action->data_offset = reader->pos;
+        valid = valid && skip_bytes(reader, action->data_length);
+        break;
+    case ALP_OP_FORWARD:
+        valid = read_interface_config(reader, action);
+        break;
+    case ALP_OP_INDIRECT_FORWARD:
+        valid = read_byte(reader, &action->file_id); // the interface file ID
+        if(action->ctrl.b7)
+            return -EPERM; // the overload length depends on the interface file
+        break;
+    case ALP_OP_WRITE_FILE_PROPERTIES:
+    case ALP_OP_CREATE_FILE:
+    case ALP_OP_RETURN_FILE_PROPERTIES:
+        valid = read_byte(reader, &action->file_id);
+        action->data_offset = reader->pos;
+        action->data_length = sizeof(d7ap_fs_file_header_t);
+        valid = valid && skip_bytes(reader, action->data_length);
+        break;
+    case ALP_OP_BREAK_QUERY:
+    case ALP_OP_ACTION_QUERY:
+    {
+        // the query code, the compare length, the mask, value(s) and bitmap and one or two file offset operands
+        uint8_t code;
+        uint32_t compare_length;
+        if(!read_byte(reader, &code) || !read_length_operand(reader, &compare_length))
+            return -EFAULT;
+
+        int16_t value_length = alp_query_value_length(code, compare_length);
+        if(value_length < 0)
             return -ENOEXEC;
+
+        action->data_offset = reader->pos;
+        if(!skip_bytes(reader, value_length))
+            return -EFAULT;
+
+        int16_t bitmap_length = alp_query_bitmap_length(code, compare_length, reader->data + action->data_offset);
+        if(bitmap_length < 0)
+            return -ENOEXEC;
+
+        action->data_length = value_length + bitmap_length;
+        valid = skip_bytes(reader, bitmap_length) && read_file_offset_operand(reader, action);
+        if(valid && alp_query_file_offset_count(code) == 2) {
+            alp_action_index_t second_file;
+            valid = read_file_offset_operand(reader, &second_file);
         }
+
+        break;
     }
-    if(e != SUCCESS)
+    case ALP_OP_STATUS:
+        if(!action->ctrl.b6 && !action->ctrl.b7) {
+            valid = skip_bytes(reader, 1); // the action status code
+        } else if(action->ctrl.b6 && !action->ctrl.b7) {
+            valid = read_byte(reader, &action->file_id) && read_length_operand(reader, &action->data_length);
+            action->data_offset = reader->pos;
+            valid = valid && skip_bytes(reader, action->data_length);
+        } else
+            return -ENOEXEC;
+
+        break;
+    case ALP_OP_START_ITF:
+    case ALP_OP_STOP_ITF:
+        valid = true;
+        break;
+    // TODO other operations
+    default:
+        return -ENOEXEC;
+    }
+
+    if(!valid)
         return -EFAULT;
 
+    action->length = reader->pos - action->offset;
+    return SUCCESS;
+}
+
+int alp_index_command(const uint8_t* command, uint16_t length, alp_action_index_t* actions, uint16_t max_actions,
+    uint8_t* expected_response_length)
+{
+    command_reader_t reader = { .data = command, .size = length, .pos = 0 };
+    alp_action_index_t action;
+    uint16_t count = 0;
+    *expected_response_length = 0;
+
+    while(reader.pos < reader.size) {
+        int rc = index_action(&reader, &action, expected_response_length);
+        if(rc != SUCCESS)
+            return rc;
+
+        if(actions != NULL) {
+            if(count == max_actions)
+                return -ENOMEM;
+
+            actions[count] = action;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+int alp_get_expected_response_length(alp_command_t* command)
+{
+    fifo_t* cmd_fifo = &command->alp_command_fifo;
+    uint16_t size = fifo_get_size(cmd_fifo);
+    uint8_t* data;
+    uint16_t continuous_size;
+    fifo_get_continuos_raw_data(cmd_fifo, &data, &continuous_size);
+    if(continuous_size < size) {
+        // the command wraps around the end of the fifo buffer
+        static uint8_t command_copy[ALP_PAYLOAD_MAX_SIZE];
+        if(size > sizeof(command_copy) || fifo_peek(cmd_fifo, command_copy, 0, size) != SUCCESS)
+            return -EFAULT;
+
+        data = command_copy;
+    }
+
+    uint8_t expected_response_length;
+    int rc = alp_index_command(data, size, NULL, 0, &expected_response_length);
+    if(rc < 0)
+        return rc;
+
     DPRINT("Expected ALP response length=%i", expected_response_length);
     return (int)expected_response_length;
 }
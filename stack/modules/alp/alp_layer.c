@@ -74,7 +74,6 @@ static uint8_t previous_interface_file_id = 0;
 static bool interface_file_changed = true;
 static alp_interface_config_t session_config_saved;
 static uint8_t alp_data[ALP_PAYLOAD_MAX_SIZE]; // temp buffer statically allocated to prevent runtime stackoverflows
-static uint8_t alp_data2[ALP_QUERY_COMPARE_BODY_MAX_SIZE]; // temp buffer statically allocated to prevent runtime stackoverflows
 
 extern alp_interface_t* interfaces[MODULE_ALP_INTERFACE_CNT];
 
@@ -87,11 +86,35 @@ static uint8_t next_tag_id = 0;
 static fifo_t command_fifo;
 static alp_command_t* command_fifo_buffer[MODULE_ALP_MAX_ACTIVE_COMMAND_COUNT];
 
+_Static_assert(FRAMEWORK_SHARED_BUFFER_SIZE >= ALP_COMMAND_HEADROOM + ALP_PAYLOAD_MAX_SIZE,
+    "a shared buffer should hold a command of ALP_PAYLOAD_MAX_SIZE bytes behind the headroom");
+
 static void free_command(alp_command_t* command) {
   DPRINT("!!! Free cmd %02x %p", command->trans_id, command);
+  if (command->buffer != NULL)
+    shared_buffer_release(command->buffer);
+
   memset(command, 0, sizeof (alp_command_t));
   command->is_active = false;
-  fifo_init(&command->alp_command_fifo, command->alp_command, ALP_PAYLOAD_MAX_SIZE);
+  fifo_init(&command->alp_command_fifo, NULL, 0);
+}
+
+/*
+ * Sets the data of the buffer of the command to the content of its FIFO, so it can be passed to an interface without
+ * copying it. Only the content of a FIFO which wrapped around is moved to the start of the storage first.
+ */
+static shared_buffer_t* get_command_buffer(alp_command_t* command)
+{
+    fifo_t* fifo = &command->alp_command_fifo;
+    uint16_t size = fifo_get_size(fifo);
+    if (fifo->head_idx + size > fifo->max_size) {
+        fifo_pop(fifo, alp_data, size);
+        memcpy(command->alp_command, alp_data, size);
+        fifo_init_filled(fifo, command->alp_command, size, ALP_PAYLOAD_MAX_SIZE);
+    }
+
+    shared_buffer_set_data(command->buffer, command->alp_command + fifo->head_idx, size);
+    return command->buffer;
 }
 
 void alp_layer_free_commands()
@@ -105,12 +128,22 @@ alp_command_t* alp_layer_command_alloc(bool with_tag_request, bool always_respon
 {
     for (uint8_t i = 0; i < MODULE_ALP_MAX_ACTIVE_COMMAND_COUNT; i++) {
         if (commands[i].is_active == false) {
+            commands[i].buffer = shared_buffer_alloc(ALP_COMMAND_HEADROOM);
+            if (commands[i].buffer == NULL) {
+                DPRINT("Could not alloc command, all shared buffers in use");
+                return NULL;
+            }
+
             commands[i].is_active = true;
+            commands[i].alp_command = shared_buffer_get_data(commands[i].buffer);
+            fifo_init(&commands[i].alp_command_fifo, commands[i].alp_command, ALP_PAYLOAD_MAX_SIZE);
             DPRINT("alloc cmd %p in slot %i", &commands[i], i);
             if (with_tag_request) {
                 next_tag_id++;
-                if(!alp_append_tag_request_action(&commands[i], next_tag_id, always_respond))
+                if(!alp_append_tag_request_action(&commands[i], next_tag_id, always_respond)) {
+                    free_command(&commands[i]);
                     return NULL;
+                }
 
                 commands[i].tag_id = next_tag_id;
             }
@@ -328,7 +361,7 @@ void alp_layer_init(alp_init_args_t* alp_init_args, bool forward_unsollicited_ov
 
   sched_register_task(&process_async);
 
-  if(fs_file_stat(USER_FILE_ALP_CTRL_FILE_ID)) {
+  if(fs_file_stat(USER_FILE_ALP_CTRL_FILE_ID, NULL) == 0) {
     d7ap_fs_register_file_modified_callback(USER_FILE_ALP_CTRL_FILE_ID, &itf_ctrl_file_callback);
     itf_ctrl_file_callback(USER_FILE_ALP_CTRL_FILE_ID);
   } else
@@ -339,6 +372,63 @@ void alp_layer_register_interface(alp_interface_t* interface) {
   alp_register_interface(interface);
 }
 
+static bool can_coalesce_reads(uint8_t file_id)
+{
+    // a file which triggers an action protocol on read has to be read once per action
+    d7ap_fs_file_header_t header;
+    if(d7ap_fs_read_file_header(file_id, &header) != SUCCESS)
+        return false;
+
+    return !(header.file_properties.action_protocol_enabled && header.file_properties.action_condition == D7A_ACT_COND_READ);
+}
+
+/*
+ * Pops the next action of the command when it is a READ_FILE_DATA action. Only the control byte and the operand are
+ * parsed, which is all a READ_FILE_DATA action consists of, so no complete alp_action_t is needed.
+ */
+static bool pop_read_file_data_action(fifo_t* cmd_fifo, alp_operand_file_data_request_t* operand)
+{
+    alp_control_t ctrl;
+    if(fifo_pop(cmd_fifo, &ctrl.raw, 1) != SUCCESS || ctrl.operation != ALP_OP_READ_FILE_DATA)
+        return false;
+
+    return alp_parse_file_offset_operand(cmd_fifo, &operand->file_offset)
+        && alp_parse_length_operand(cmd_fifo, &operand->requested_data_length);
+}
+
+/*
+ * Pops the READ_FILE_DATA actions directly following the current one which continue where the previous one ends in the
+ * same file, so the data of all of them can be read at once. The lengths of all actions (including the current one) are
+ * stored in requested_lengths, the number of actions is returned.
+ */
+static uint8_t pop_adjacent_reads(alp_command_t* command, alp_operand_file_data_request_t* operand, uint8_t* requested_lengths, uint32_t* total_length)
+{
+    uint8_t count = 1;
+    requested_lengths[0] = operand->requested_data_length;
+    *total_length = operand->requested_data_length;
+    if(MODULE_ALP_MAX_COALESCED_READS < 2 || !can_coalesce_reads(operand->file_offset.file_id))
+        return count;
+
+    while(count < MODULE_ALP_MAX_COALESCED_READS && fifo_get_size(&command->alp_command_fifo) > 0) {
+        fifo_t fifo_state = command->alp_command_fifo;
+        alp_operand_file_data_request_t next;
+        if(!pop_read_file_data_action(&command->alp_command_fifo, &next)
+           || next.file_offset.file_id != operand->file_offset.file_id
+           || next.file_offset.offset != operand->file_offset.offset + *total_length
+           || next.requested_data_length == 0
+           || *total_length + next.requested_data_length > ALP_PAYLOAD_MAX_SIZE) {
+            // not part of the range, it is parsed and processed by itself
+            command->alp_command_fifo = fifo_state;
+            break;
+        }
+
+        requested_lengths[count++] = next.requested_data_length;
+        *total_length += next.requested_data_length;
+    }
+
+    return count;
+}
+
 static alp_status_codes_t process_op_read_file_data(alp_action_t* action, alp_command_t* resp_command, alp_command_t* command, authentication_t origin_auth)
 {
     alp_operand_file_data_request_t operand = action->file_data_request_operand;
@@ -347,19 +437,38 @@ static alp_status_codes_t process_op_read_file_data(alp_action_t* action, alp_co
     if (operand.requested_data_length <= 0 || operand.requested_data_length > ALP_PAYLOAD_MAX_SIZE)
         return ALP_STATUS_EXCEEDS_MAX_ALP_SIZE;
 
-    int rc = d7ap_fs_read_file(operand.file_offset.file_id, operand.file_offset.offset, alp_data, &operand.requested_data_length, origin_auth);
+    // consecutive reads of adjacent data are served by one read of the file, with a single header lookup and
+    // permission check, but are answered by a return file data action each
+    uint8_t requested_lengths[MODULE_ALP_MAX_COALESCED_READS > 1 ? MODULE_ALP_MAX_COALESCED_READS : 1];
+    uint32_t total_length;
+    uint8_t count = pop_adjacent_reads(command, &operand, requested_lengths, &total_length);
+    DPRINT("reading %i action(s) at once, LEN %i", count, total_length);
+
+    uint32_t read_length = total_length;
+    int rc = d7ap_fs_read_file(operand.file_offset.file_id, operand.file_offset.offset, alp_data, &read_length, origin_auth);
     
-    if (rc == -ENOENT && init_args != NULL && init_args->alp_unhandled_read_action_cb != NULL) // give the application layer the chance to fullfill this request ...
+    if (rc == -ENOENT && init_args != NULL && init_args->alp_unhandled_read_action_cb != NULL) { // give the application layer the chance to fullfill this request ...
+        assert(count == 1); // only files which exist are coalesced
         rc = init_args->alp_unhandled_read_action_cb(&command->origin_itf_status, operand, alp_data);
+        read_length = operand.requested_data_length;
+    }
 
-    if (rc == SUCCESS) {
-        // fill response
-        if(!alp_append_return_file_data_action(resp_command, operand.file_offset.file_id, operand.file_offset.offset, operand.requested_data_length, alp_data))
-            return ALP_STATUS_FIFO_OUT_OF_BOUNDS;
-
-    } else
+    if (rc != SUCCESS)
         return alp_translate_error(rc);
 
+    // fill response. The read is truncated at the end of the file, like the read of a single action would be
+    uint32_t offset = operand.file_offset.offset;
+    uint32_t end = operand.file_offset.offset + read_length;
+    for (uint8_t i = 0; i < count; i++) {
+        if (offset > end)
+            return alp_translate_error(-EINVAL); // starts beyond the end of the file
+
+        uint32_t length = (end - offset < requested_lengths[i]) ? end - offset : requested_lengths[i];
+        if(!alp_append_return_file_data_action(resp_command, operand.file_offset.file_id, offset, length, alp_data + (offset - operand.file_offset.offset)))
+            return ALP_STATUS_FIFO_OUT_OF_BOUNDS;
+
+        offset += requested_lengths[i];
+    }
 
     return ALP_STATUS_OK;
 }
@@ -405,77 +514,74 @@ static alp_status_codes_t process_op_write_file_data(alp_action_t* action, authe
     return rc == SUCCESS ? ALP_STATUS_OK : alp_translate_error(rc);
 }
 
-bool process_arithm_predicate(uint8_t* value1, uint8_t* value2, uint32_t len, alp_query_arithmetic_comparison_type_t comp_type) {
-  // TODO assuming unsigned for now
-  DPRINT("ARITH PREDICATE COMP TYPE %i LEN %i", comp_type, len);
-  // first check for equality/inequality
-  bool is_equal = memcmp(value1, value2, len) == 0;
-  if(is_equal) {
-    if(comp_type == ARITH_COMP_TYPE_EQUALITY || comp_type == ARITH_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO || comp_type == ARITH_COMP_TYPE_LESS_THAN_OR_EQUAL_TO)
-      return true;
-    else
-      return false;
-  } else if(comp_type == ARITH_COMP_TYPE_INEQUALITY) {
-    return true;
-  }
+#if MODULE_ALP_QUERY_CACHE_SIZE > 0
+// the compiled queries of the most recently evaluated query operands, so repeated queries are not compiled again
+typedef struct {
+    alp_query_t query;
+    uint32_t last_used;
+    uint32_t compare_operand_length;
+    uint8_t code;
+    uint8_t body_length;
+    uint8_t compare_body[ALP_QUERY_COMPARE_BODY_MAX_SIZE];
+} query_cache_entry_t;
+
+static query_cache_entry_t query_cache[MODULE_ALP_QUERY_CACHE_SIZE];
+static uint32_t query_cache_clock = 0;
+#endif
 
-  // since we don't know length in advance compare byte per byte starting from MSB
-  for(uint32_t i = 0; i < len; i++) {
-    if(value1[i] == value2[i])
-      continue;
-
-    if(value1[i] > value2[i] && (comp_type == ARITH_COMP_TYPE_GREATER_THAN || comp_type == ARITH_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO))
-      return true;
-    else if(value1[i] < value2[i] && (comp_type == ARITH_COMP_TYPE_LESS_THAN || comp_type == ARITH_COMP_TYPE_LESS_THAN_OR_EQUAL_TO))
-      return true;
-    else
-      return false;
-  }
+static const alp_query_t* get_compiled_query(const alp_operand_query_t* operand)
+{
+#if MODULE_ALP_QUERY_CACHE_SIZE > 0
+    query_cache_entry_t* entry = &query_cache[0];
+    for(uint8_t i = 0; i < MODULE_ALP_QUERY_CACHE_SIZE; i++) {
+        query_cache_entry_t* candidate = &query_cache[i];
+        if(candidate->last_used != 0 && candidate->code == operand->code.raw
+            && candidate->compare_operand_length == operand->compare_operand_length
+            && candidate->body_length == operand->body_length
+            && memcmp(candidate->compare_body, operand->compare_body, operand->body_length) == 0) {
+            candidate->last_used = ++query_cache_clock;
+            return &candidate->query;
+        }
 
-  log_print_error_string("process_arithm_predicate type %i got to unreachable code", comp_type);
-  return false; //not implemented type should always fail
+        // evict the least recently used entry, unused entries have the lowest timestamp
+        if(candidate->last_used < entry->last_used)
+            entry = candidate;
+    }
+
+    if(!alp_query_compile(operand, &entry->query)) {
+        entry->last_used = 0;
+        return NULL;
+    }
+
+    entry->code = operand->code.raw;
+    entry->compare_operand_length = operand->compare_operand_length;
+    entry->body_length = operand->body_length;
+    memcpy(entry->compare_body, operand->compare_body, operand->body_length);
+    entry->last_used = ++query_cache_clock;
+    return &entry->query;
+#else
+    static alp_query_t query;
+    return alp_query_compile(operand, &query) ? &query : NULL;
+#endif
 }
 
 static alp_status_codes_t process_op_break_query(alp_action_t* action, authentication_t origin_auth)
 {
-    
     DPRINT("BREAK QUERY");
-    if(action->query_operand.code.type != QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY)
+    const alp_query_t* query = get_compiled_query(&action->query_operand);
+    if(query == NULL)
         return ALP_STATUS_NOT_YET_IMPLEMENTED;
-    
-    if(action->query_operand.code.mask)
-        return ALP_STATUS_NOT_YET_IMPLEMENTED;
-    
-    // parse arithm query params
-    bool use_signed_comparison = true;
-    if((action->query_operand.code.param & 0x08) == 0)
-        use_signed_comparison = false;
-    
-    alp_query_arithmetic_comparison_type_t comp_type = action->query_operand.code.param & 0x07;
-
-    // TODO assuming no compare mask for now + assume compare value present + only 1 file offset operand
-    fifo_t temp_fifo;
-    fifo_init_filled(&temp_fifo, action->query_operand.compare_body, ALP_QUERY_COMPARE_BODY_MAX_SIZE, ALP_QUERY_COMPARE_BODY_MAX_SIZE);
-    
-    memset(alp_data, 0, action->query_operand.compare_operand_length);
-    if(fifo_pop(&temp_fifo, alp_data, action->query_operand.compare_operand_length) != SUCCESS)
-        return ALP_STATUS_FIFO_OUT_OF_BOUNDS;
-    alp_operand_file_offset_t offset_a;
-    if(!alp_parse_file_offset_operand(&temp_fifo, &offset_a))
-        return ALP_STATUS_FIFO_OUT_OF_BOUNDS;
-
-    // make sure the uint32_t is word-aligned before passing it as a pointer
-    uint32_t length = action->query_operand.compare_operand_length;
 
-    int rc = d7ap_fs_read_file(offset_a.file_id, offset_a.offset, alp_data2, &length, origin_auth);
+    bool result;
+    int rc = alp_query_evaluate(query, origin_auth, &result);
     if(rc != SUCCESS)
         return alp_translate_error(rc);
-    
-    if(!process_arithm_predicate(alp_data2, alp_data, action->query_operand.compare_operand_length, comp_type)) {
+
+    if(!result) {
         //clear command?
         return ALP_STATUS_BREAK_QUERY_FAILED;
     }
-    
+
     return ALP_STATUS_OK;
 }
 
@@ -496,7 +602,7 @@ static alp_status_codes_t process_op_indirect_forward(
         re_read = true;
         interface_file_changed = false;
         if (previous_interface_file_id != action->indirect_interface_operand.interface_file_id) {
-            if (fs_file_stat(action->indirect_interface_operand.interface_file_id) != NULL) {
+            if (fs_file_stat(action->indirect_interface_operand.interface_file_id, NULL) == 0) {
                 d7ap_fs_unregister_file_modified_callback(previous_interface_file_id);
                 d7ap_fs_register_file_modified_callback(action->indirect_interface_operand.interface_file_id, &interface_file_changed_callback);
                 uint32_t length = 1;
@@ -656,16 +762,23 @@ static bool forward_command(alp_command_t* command, alp_interface_config_t* itf_
             if(forwarded_alp_size > ALP_PAYLOAD_MAX_SIZE)
                 return false;
 
-            fifo_pop(&command->alp_command_fifo, command->alp_command, forwarded_alp_size);
+            // the interface gets the buffer of the command, an interface which queues the command keeps a reference
+            shared_buffer_t* buffer = get_command_buffer(command);
             DPRINT("Forwarding command:");
-            DPRINT_DATA(command->alp_command, forwarded_alp_size);
-            int expected_response_length = alp_get_expected_response_length(command);
-            if(expected_response_length < 0) {
+            DPRINT_DATA(shared_buffer_get_data(buffer), forwarded_alp_size);
+            uint8_t expected_response_length;
+            if(alp_index_command(shared_buffer_get_data(buffer), forwarded_alp_size, NULL, 0, &expected_response_length) < 0) {
                 free_command(command);
                 return false;
             }
             command->forward_itf_id = itf_config->itf_id;
-            error_t error = interfaces[i]->send_command(command->alp_command, forwarded_alp_size, expected_response_length, &command->trans_id, itf_config);
+            error_t error = interfaces[i]->send_command(buffer, expected_response_length, &command->trans_id, itf_config);
+
+            // the command is kept until the interface responds, but its content is not needed anymore
+            shared_buffer_release(buffer);
+            command->buffer = NULL;
+            command->alp_command = NULL;
+            fifo_init(&command->alp_command_fifo, NULL, 0);
             if (command->trans_id == 0)
                 command->trans_id = command->tag_id; // interface does not provide transaction tracking, using tag_id
 
@@ -718,11 +831,9 @@ static error_t transmit_response(
                        // interface
     }
 
-    uint8_t alp_response_length = (uint8_t)fifo_get_size(&resp->alp_command_fifo);
     uint8_t expected_response_length = 0; // TODO alp_get_expected_response_length(&resp->alp_command_fifo);
-    DPRINT("interface found, sending len %i, expect %i answer", alp_response_length, expected_response_length);
-    return interface->send_command(
-        resp->alp_command, alp_response_length, expected_response_length, &resp->trans_id, NULL);
+    DPRINT("interface found, sending len %i, expect %i answer", fifo_get_size(&resp->alp_command_fifo), expected_response_length);
+    return interface->send_command(get_command_buffer(resp), expected_response_length, &resp->trans_id, NULL);
 }
 
 static void process_async(void* arg)
@@ -817,6 +928,14 @@ static void process_async(void* arg)
             alp_status = process_op_indirect_forward(&action, &command->forward_itf_id, &forward_interface_config);
             break;
         case ALP_OP_REQUEST_TAG:;
+            // a command received over an interface can contain several tagged requests, for example the requests
+            // D7ASP sends together in one transaction, the response of the previous one is ended by its tag response
+            if (command->is_tag_requested && command->respond_when_completed && command->origin_itf_id != ALP_ITF_ID_HOST
+                && !alp_append_tag_response_action(resp_command, command->tag_id, true, false)) {
+                alp_status = ALP_STATUS_FIFO_OUT_OF_BOUNDS;
+                break;
+            }
+
             alp_status = process_op_request_tag(&action, &command->tag_id, &command->respond_when_completed);
             command->is_tag_requested = true;
             break;
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+#include "debug.h"
+#include "errors.h"
+
+#include "alp.h"
+#include "d7ap_fs.h"
+#include "log.h"
+
+#if defined(FRAMEWORK_LOG_ENABLED) && defined(FRAMEWORK_ALP_LOG_ENABLED)
+  #define DPRINT(...) log_print_stack_string(LOG_STACK_ALP, __VA_ARGS__)
+#else
+  #define DPRINT(...)
+#endif
+
+#define QUERY_PARAM_SIGNED 0x08
+#define QUERY_PARAM_COMP_TYPE 0x07
+
+// the file data compared by a query, or searched for a token
+static uint8_t file_data[ALP_QUERY_COMPARE_BODY_MAX_SIZE];
+
+static inline bool is_arithmetic(alp_query_code_type_t type)
+{
+    return type == QUERY_CODE_TYPE_ARITHM_COMP_WITH_ZERO || type == QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY
+        || type == QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES;
+}
+
+static inline uint8_t first_word_length(uint8_t length)
+{
+    return (length - 1) % 4 + 1;
+}
+
+// reads word index of a big-endian value of length bytes, the first word holds the bytes which do not fill a complete word
+static uint32_t load_word(const uint8_t* bytes, uint8_t length, uint8_t index)
+{
+    uint8_t first = first_word_length(length);
+    const uint8_t* src = bytes;
+    uint8_t count = first;
+    if(index > 0) {
+        src += first + 4 * (index - 1);
+        count = 4;
+    }
+
+    uint32_t word = 0;
+    for(uint8_t i = 0; i < count; i++)
+        word = (word << 8) | src[i];
+
+    return word;
+}
+
+// the bias which maps signed values on unsigned ones with the same ordering, applied to the first word
+static inline uint32_t sign_bias(const alp_query_t* query)
+{
+    return query->is_signed ? 1UL << (8 * first_word_length(query->length) - 1) : 0;
+}
+
+static inline uint32_t masked_word(const alp_query_t* query, const uint8_t* bytes, uint8_t index)
+{
+    uint32_t word = load_word(bytes, query->length, index);
+    if(query->has_mask)
+        word &= query->data.words[query->mask_index + index];
+
+    return index == 0 ? word ^ sign_bias(query) : word;
+}
+
+static void compile_value(alp_query_t* query, uint8_t value_index, const uint8_t* bytes)
+{
+    for(uint8_t i = 0; i < query->word_count; i++)
+        query->data.words[value_index + i] = bytes ? masked_word(query, bytes, i) : (i == 0 ? sign_bias(query) : 0);
+}
+
+// compares the file data with the compiled value at value_index, or with other file data when other is not NULL
+static int compare_words(const alp_query_t* query, const uint8_t* data, const uint8_t* other, uint8_t value_index)
+{
+    for(uint8_t i = 0; i < query->word_count; i++) {
+        uint32_t a = masked_word(query, data, i);
+        uint32_t b = other ? masked_word(query, other, i) : query->data.words[value_index + i];
+        if(a != b)
+            return a < b ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static bool comparison_matches(alp_query_arithmetic_comparison_type_t comp_type, int comparison)
+{
+    switch(comp_type) {
+    case ARITH_COMP_TYPE_INEQUALITY:
+        return comparison != 0;
+    case ARITH_COMP_TYPE_EQUALITY:
+        return comparison == 0;
+    case ARITH_COMP_TYPE_LESS_THAN:
+        return comparison < 0;
+    case ARITH_COMP_TYPE_LESS_THAN_OR_EQUAL_TO:
+        return comparison <= 0;
+    case ARITH_COMP_TYPE_GREATER_THAN:
+        return comparison > 0;
+    case ARITH_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO:
+        return comparison >= 0;
+    }
+
+    return false;
+}
+
+static bool is_in_range(const alp_query_t* query, const uint8_t* data)
+{
+    if(compare_words(query, data, NULL, query->value_index) < 0 || compare_words(query, data, NULL, query->bound_index) > 0)
+        return false;
+
+    if(query->bitmap_length == 0)
+        return true;
+
+    // a range with a bitmap has a compare length of at most 4 bytes, so the values fit in one word
+    uint32_t bit = masked_word(query, data, 0) - query->data.words[query->value_index];
+    return query->data.bytes[query->bitmap_index + bit / 8] & (1 << (bit & 7));
+}
+
+static bool contains_token(const alp_query_t* query, const uint8_t* data, uint32_t length)
+{
+    const uint8_t* token = query->data.bytes + query->value_index;
+    const uint8_t* mask = query->data.bytes + query->mask_index;
+    for(uint32_t pos = 0; pos + query->length <= length; pos++) {
+        if(!query->has_mask && query->max_errors == 0) {
+            if(memcmp(data + pos, token, query->length) == 0)
+                return true;
+
+            continue;
+        }
+
+        uint8_t errors = 0;
+        uint8_t i;
+        for(i = 0; i < query->length; i++) {
+            uint8_t difference = data[pos + i] ^ token[i];
+            if(query->has_mask)
+                difference &= mask[i];
+
+            if(difference && ++errors > query->max_errors)
+                break;
+        }
+
+        if(i == query->length)
+            return true;
+    }
+
+    return false;
+}
+
+int16_t alp_query_value_length(uint8_t code, uint32_t compare_length)
+{
+    alp_operand_query_t operand = { .code.raw = code };
+    if(compare_length > ALP_QUERY_COMPARE_BODY_MAX_SIZE || (compare_length == 0 && operand.code.type != QUERY_CODE_TYPE_NON_VOID_CHECK))
+        return -1;
+
+    uint8_t mask_length = operand.code.mask ? compare_length : 0;
+    switch(operand.code.type) {
+    case QUERY_CODE_TYPE_NON_VOID_CHECK:
+        return operand.code.mask ? -1 : 0;
+    case QUERY_CODE_TYPE_ARITHM_COMP_WITH_ZERO:
+    case QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES:
+        return mask_length;
+    case QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY:
+    case QUERY_CODE_TYPE_STRING_TOKEN_SEARCH:
+        return mask_length + compare_length;
+    case QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP:
+        // the mask flag signals the bitmap following the minimum and maximum
+        return 2 * compare_length;
+    default:
+        return -1;
+    }
+}
+
+int16_t alp_query_bitmap_length(uint8_t code, uint32_t compare_length, const uint8_t* values)
+{
+    alp_operand_query_t operand = { .code.raw = code };
+    if(operand.code.type != QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP || !operand.code.mask)
+        return 0;
+
+    if(compare_length == 0 || compare_length > 4)
+        return -1;
+
+    alp_query_t query = { .length = compare_length, .is_signed = operand.code.param & QUERY_PARAM_SIGNED };
+    uint32_t min = masked_word(&query, values, 0);
+    uint32_t max = masked_word(&query, values + compare_length, 0);
+    if(max < min || max - min >= 8 * ALP_QUERY_COMPARE_BODY_MAX_SIZE)
+        return -1;
+
+    return (max - min) / 8 + 1;
+}
+
+uint8_t alp_query_file_offset_count(uint8_t code)
+{
+    alp_operand_query_t operand = { .code.raw = code };
+    return operand.code.type == QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES ? 2 : 1;
+}
+
+bool alp_query_compile(const alp_operand_query_t* operand, alp_query_t* query)
+{
+    int16_t value_length = alp_query_value_length(operand->code.raw, operand->compare_operand_length);
+    if(value_length < 0)
+        return false;
+
+    int16_t bitmap_length = alp_query_bitmap_length(operand->code.raw, operand->compare_operand_length, operand->compare_body);
+    if(bitmap_length < 0 || value_length + bitmap_length > operand->body_length)
+        return false;
+
+    *query = (alp_query_t){
+        .type = operand->code.type,
+        .comp_type = operand->code.param & QUERY_PARAM_COMP_TYPE,
+        .is_signed = operand->code.param & QUERY_PARAM_SIGNED,
+        .has_mask = operand->code.mask && operand->code.type != QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP,
+        .length = operand->compare_operand_length,
+        .word_count = (operand->compare_operand_length + 3) / 4,
+    };
+
+    const uint8_t* values = operand->compare_body + (query->has_mask ? query->length : 0);
+    if(is_arithmetic(query->type)) {
+        if(query->comp_type > ARITH_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO || 3 * query->word_count > ALP_QUERY_MAX_WORDS)
+            return false;
+
+        if(query->has_mask) {
+            // the mask itself is stored without the sign bias
+            for(uint8_t i = 0; i < query->word_count; i++)
+                query->data.words[query->mask_index + i] = load_word(operand->compare_body, query->length, i);
+
+            query->value_index = query->word_count;
+        }
+
+        if(query->type != QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES)
+            compile_value(query, query->value_index,
+                query->type == QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY ? values : NULL);
+    } else if(query->type == QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP) {
+        if(query->comp_type > ARITH_COMP_TYPE_EQUALITY
+            || 2 * query->word_count * 4 + bitmap_length > sizeof(query->data))
+            return false;
+
+        query->bound_index = query->word_count;
+        compile_value(query, query->value_index, values);
+        compile_value(query, query->bound_index, values + query->length);
+        query->bitmap_index = 2 * query->word_count * 4;
+        query->bitmap_length = bitmap_length;
+        memcpy(query->data.bytes + query->bitmap_index, values + 2 * query->length, bitmap_length);
+    } else if(query->type == QUERY_CODE_TYPE_STRING_TOKEN_SEARCH) {
+        query->max_errors = operand->code.param & QUERY_PARAM_COMP_TYPE;
+        if(query->has_mask) {
+            memcpy(query->data.bytes, operand->compare_body, query->length);
+            query->value_index = query->length;
+        }
+
+        // the token is stored masked, so only the file data has to be masked while searching
+        for(uint8_t i = 0; i < query->length; i++)
+            query->data.bytes[query->value_index + i] = values[i] & (query->has_mask ? operand->compare_body[i] : 0xFF);
+    }
+
+    fifo_t offset_fifo;
+    uint16_t offsets_start = value_length + bitmap_length;
+    fifo_init_filled(&offset_fifo, (uint8_t*)operand->compare_body + offsets_start, operand->body_length - offsets_start,
+        operand->body_length - offsets_start);
+    if(!alp_parse_file_offset_operand(&offset_fifo, &query->file_a))
+        return false;
+
+    if(alp_query_file_offset_count(operand->code.raw) == 2 && !alp_parse_file_offset_operand(&offset_fifo, &query->file_b))
+        return false;
+
+    DPRINT("compiled query type %i length %i", query->type, query->length);
+    return true;
+}
+
+int alp_query_evaluate(const alp_query_t* query, authentication_t auth, bool* result)
+{
+    uint32_t length = query->type == QUERY_CODE_TYPE_STRING_TOKEN_SEARCH ? sizeof(file_data) : query->length;
+    int rc = d7ap_fs_read_file(query->file_a.file_id, query->file_a.offset, file_data, &length, auth);
+    if(query->type == QUERY_CODE_TYPE_NON_VOID_CHECK && (rc == -ENOENT || rc == -EINVAL)) {
+        *result = false;
+        return SUCCESS;
+    }
+
+    if(rc != SUCCESS)
+        return rc;
+
+    if(query->type == QUERY_CODE_TYPE_STRING_TOKEN_SEARCH) {
+        *result = contains_token(query, file_data, length);
+        return SUCCESS;
+    }
+
+    *result = false;
+    if(length < query->length)
+        return SUCCESS;
+
+    switch(query->type) {
+    case QUERY_CODE_TYPE_NON_VOID_CHECK:
+        *result = true;
+        break;
+    case QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES: {
+        // compile limits the compare length to a third of the compare body, so both files fit in file_data
+        uint8_t* other = file_data + query->length;
+        rc = d7ap_fs_read_file(query->file_b.file_id, query->file_b.offset, other, &length, auth);
+        if(rc != SUCCESS)
+            return rc;
+
+        if(length == query->length)
+            *result = comparison_matches(query->comp_type, compare_words(query, file_data, other, 0));
+
+        break;
+    }
+    case QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP:
+        *result = is_in_range(query, file_data) == (query->comp_type == ARITH_COMP_TYPE_EQUALITY);
+        break;
+    default:
+        *result = comparison_matches(query->comp_type, compare_words(query, file_data, NULL, query->value_index));
+    }
+
+    return SUCCESS;
+}
@@ -93,7 +93,7 @@ static void lorawan_status_callback(lorawan_stack_status_t status, uint8_t attem
     alp_layer_forwarded_command_completed(lorawan_trans_id, NULL, &result, (status == LORAWAN_STACK_JOIN_FAILED) || (status == LORAWAN_STACK_JOINED)); 
 }
 
-static error_t lorawan_send_otaa(uint8_t* payload, uint8_t payload_length, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* itf_cfg)
+static error_t lorawan_send_otaa(shared_buffer_t* command, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* itf_cfg)
 {
     (void)expected_response_length; // suppress unused warning
     
@@ -104,7 +104,7 @@ static error_t lorawan_send_otaa(uint8_t* payload, uint8_t payload_length, uint8
     lorawan_stack_status_t status = lorawan_otaa_is_joined(&lorawan_itf_cfg.lorawan_session_config_otaa);
     if(status == LORAWAN_STACK_ERROR_OK) {
         DPRINT("sending otaa payload");
-        status = lorawan_stack_send(payload, payload_length, lorawan_itf_cfg.lorawan_session_config_otaa.application_port, lorawan_itf_cfg.lorawan_session_config_otaa.request_ack);
+        status = lorawan_stack_send(shared_buffer_get_data(command), shared_buffer_get_length(command), lorawan_itf_cfg.lorawan_session_config_otaa.application_port, lorawan_itf_cfg.lorawan_session_config_otaa.request_ack);
         if(status != LORAWAN_STACK_ERROR_OK)
             lorawan_trans_id--; // we don't need to keep track of this new transid as it is completed immediately
     } else { 
@@ -53,7 +53,7 @@ static uint8_t alp_command[ALP_CMD_MAX_SIZE] = { 0x00 };
 
 alp_interface_t alp_modem_interface;
 
-static error_t serial_interface_send(uint8_t* payload, uint8_t payload_length, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* session_config);
+static error_t serial_interface_send(shared_buffer_t* command, uint8_t expected_response_length, uint16_t* trans_id, alp_interface_config_t* session_config);
 
 static alp_interface_status_t serial_itf_status = {
     .itf_id = ALP_ITF_ID_SERIAL,
@@ -98,13 +98,13 @@ void serial_interface_register() {
     modem_interface_register_handler(&serial_interface_cmd_handler, SERIAL_MESSAGE_TYPE_ALP_DATA);
 }
 
-static error_t serial_interface_send(uint8_t* payload, uint8_t payload_length,
+static error_t serial_interface_send(shared_buffer_t* command,
     __attribute__((__unused__)) uint8_t expected_response_length,
     __attribute__((__unused__)) uint16_t* trans_id,
     __attribute__((__unused__)) alp_interface_config_t* session_config)
 {
     DPRINT("sending payload to serial interface");
-    DPRINT_DATA(payload, payload_length);
-    return modem_interface_transfer_bytes(payload, payload_length, SERIAL_MESSAGE_TYPE_ALP_DATA);
+    DPRINT_DATA(shared_buffer_get_data(command), shared_buffer_get_length(command));
+    return modem_interface_transfer_bytes(shared_buffer_get_data(command), shared_buffer_get_length(command), SERIAL_MESSAGE_TYPE_ALP_DATA);
 }
 
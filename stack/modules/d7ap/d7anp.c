@@ -23,10 +23,10 @@
 #include "debug.h"
 #include "packet.h"
 #include "d7anp.h"
+#include "d7anp_ssr.h"
 #include "d7ap_fs.h"
 #include "ng.h"
 #include "log.h"
-#include "math.h"
 #include "hwdebug.h"
 #include "aes.h"
 #include "packet_queue.h"
@@ -43,10 +43,6 @@
 
 #define CRC_SIZE 2
 
-#if FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE == 0
-    #pragma GCC diagnostic ignored "-Wtype-limits"
-#endif
-
 typedef enum {
     D7ANP_STATE_STOPPED,
     D7ANP_STATE_IDLE,
@@ -54,7 +50,7 @@ typedef enum {
     D7ANP_STATE_FOREGROUND_SCAN,
 } state_t;
 
-static state_t NGDEF(_d7anp_state) = D7ANP_STATE_STOPPED;
+static state_t NGDEF(_d7anp_state);
 #define d7anp_state NG(_d7anp_state)
 
 static state_t NGDEF(_d7anp_prev_state);
@@ -67,18 +63,23 @@ static timer_tick_t NGDEF(_fg_scan_timeout_ticks);
 static dae_nwl_security_t NGDEF(_security_state);
 #define security_state NG(_security_state)
 
-static dae_nwl_ssr_t NGDEF(_node_security_state);
-#define node_security_state NG(_node_security_state)
-
 static dae_nwl_trusted_node_t* NGDEF(_latest_node);
 #define latest_node NG(_latest_node)
+
+// the NWL security key is the only key used for the frames, it is kept expanded
+static aes128_ctx_t NGDEF(_nwl_key);
+#define nwl_key NG(_nwl_key)
 #endif
 
-static timer_event d7anp_fg_scan_expired_timer;
-static timer_event d7anp_start_fg_scan_after_d7aadvp_timer;
+static timer_event NGDEF(_d7anp_fg_scan_expired_timer);
+#define d7anp_fg_scan_expired_timer NG(_d7anp_fg_scan_expired_timer)
+static timer_event NGDEF(_d7anp_start_fg_scan_after_d7aadvp_timer);
+#define d7anp_start_fg_scan_after_d7aadvp_timer NG(_d7anp_start_fg_scan_after_d7aadvp_timer)
 
-d7ap_addressee_id_type_t address_id_type;
-uint8_t address_id[8];
+static d7ap_addressee_id_type_t NGDEF(_address_id_type);
+#define address_id_type NG(_address_id_type)
+static uint8_t NGDEF(_address_id)[8];
+#define address_id NG(_address_id)
 
 #if defined(MODULE_D7AP_NLS_ENABLED)
 static inline uint8_t get_auth_len(uint8_t nls_method)
@@ -214,14 +215,17 @@ void d7anp_set_address_id(uint8_t file_id)
     d7ap_fs_read_uid(address_id);
 }
 
+#if defined(MODULE_D7AP_NLS_ENABLED)
 static void set_key(uint8_t file_id)
 {
     uint8_t key[AES_BLOCK_SIZE];
     assert(d7ap_fs_read_nwl_security_key(key) == SUCCESS);
     DPRINT("KEY");
     DPRINT_DATA(key, AES_BLOCK_SIZE);
-    AES128_init(key);
+    AES128_init_ctx(&nwl_key, key);
+    memset(key, 0, sizeof(key));
 }
+#endif
 
 void d7anp_init()
 {
@@ -261,8 +265,7 @@ void d7anp_init()
     d7ap_fs_read_nwl_security(&security_state);
     DPRINT("Initial Key counter %d", security_state.key_counter);
     DPRINT("Initial Frame counter %ld", security_state.frame_counter);
-    /* Read the NWL security state of the successfully decrypted and authenticated devices */
-    d7ap_fs_read_nwl_security_state_register(&node_security_state);
+    d7anp_ssr_init();
     latest_node = NULL;
 #endif
 }
@@ -272,6 +275,9 @@ void d7anp_stop()
     d7anp_state = D7ANP_STATE_STOPPED;
     timer_cancel_event(&d7anp_fg_scan_expired_timer);
     timer_cancel_event(&d7anp_start_fg_scan_after_d7aadvp_timer);
+#if defined(MODULE_D7AP_NLS_ENABLED)
+    d7anp_ssr_persist();
+#endif
 }
 
 error_t d7anp_tx_foreground_frame(packet_t* packet, bool should_include_origin_template)
@@ -394,20 +400,22 @@ static void build_iv(packet_t *packet, uint8_t payload_len, uint8_t *iv)
 #endif
 }
 
-uint8_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload_len)
+error_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload_len, uint8_t *auth_len_out)
 {
     uint8_t nls_method;
     uint8_t ctr_blk[AES_BLOCK_SIZE];
     uint8_t header[AES_BLOCK_SIZE];
-    uint8_t auth[AES_BLOCK_SIZE];
     uint8_t auth_len;
-    uint8_t add[AES_BLOCK_SIZE];
+    const uint8_t *add = NULL;
     uint8_t add_len = 0;
+    aes128_ccm_ctx_t ccm;
+    error_t rtc;
 
     DPRINT("Start Secure payload (len %d) ", payload_len );
     timer_tick_t time_elapsed = timer_get_counter_value();
 
 
+    const aes128_ctx_t* key = &nwl_key;
     nls_method = packet->d7anp_ctrl.nls_method;
     auth_len = get_auth_len(nls_method);
 
@@ -415,7 +423,7 @@ uint8_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload
     if(auth_len && !ID_TYPE_IS_BROADCAST(packet->d7anp_addressee->ctrl.id_type))
     {
         add_len = packet->d7anp_addressee->ctrl.id_type == ID_TYPE_VID ? 2 : 8;
-        memcpy(add, packet->d7anp_addressee->id, add_len);
+        add = packet->d7anp_addressee->id;
     }
 
     switch (nls_method)
@@ -425,7 +433,7 @@ uint8_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload
         build_iv(packet, payload_len, ctr_blk);
 
         // the encrypted payload replaces the plaintext
-        AES128_CTR_encrypt(payload, payload, payload_len, ctr_blk);
+        AES128_CTR_encrypt_ctx(key, payload, payload, payload_len, ctr_blk);
         break;
     case AES_CBC_MAC_128:
     case AES_CBC_MAC_64:
@@ -436,11 +444,18 @@ uint8_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload
         /* Set Header flags */
         header[0] |= ( add_len > 0 );
 
-        /* Compute the CBC-MAC */
-        AES128_CBC_MAC(auth, payload, payload_len, header, add, add_len, auth_len);
+        /* For DASH7, the payload length shall be less than 250 - authentication tag len */
+        if (payload_len > (250 - auth_len))
+            return EINVAL;
 
-        /* Insert the authentication Tag */
-        memcpy(payload + payload_len, auth, auth_len);
+        /* Compute the CBC-MAC and insert the authentication Tag */
+        rtc = AES128_CCM_init(&ccm, key, header, add_len, NULL, auth_len);
+        if (rtc != SUCCESS)
+            return rtc;
+
+        AES128_CCM_update_aad(&ccm, add, add_len);
+        AES128_CCM_authenticate(&ccm, payload, payload_len);
+        AES128_CCM_finish(&ccm, payload + payload_len);
         break;
     case AES_CCM_128:
     case AES_CCM_64:
@@ -455,14 +470,25 @@ uint8_t d7anp_secure_payload(packet_t *packet, uint8_t *payload, uint8_t payload
         /* Set Header flags */
         header[0] |= ( add_len > 0 );
 
-        // TODO check that the payload length does not exceed the maximum size
-        AES128_CCM_encrypt(payload, payload_len, header, add, add_len, ctr_blk, auth_len);
+        /* For DASH7, the payload length shall be less than 250 - Security header len - authentication tag len */
+        if (payload_len > (250 - 5 - auth_len))
+            return EINVAL;
+
+        // authenticate and encrypt the payload in a single pass, the tag is appended to the payload
+        rtc = AES128_CCM_init(&ccm, key, header, add_len, ctr_blk, auth_len);
+        if (rtc != SUCCESS)
+            return rtc;
+
+        AES128_CCM_update_aad(&ccm, add, add_len);
+        AES128_CCM_encrypt_update(&ccm, payload, payload_len);
+        AES128_CCM_finish(&ccm, payload + payload_len);
         break;
     }
 
     time_elapsed = timer_get_counter_value() - time_elapsed;
     DPRINT("Payload secured in %i Ti", time_elapsed);
-    return auth_len;
+    *auth_len_out = auth_len;
+    return SUCCESS;
 }
 
 bool d7anp_unsecure_payload(packet_t *packet, uint8_t index)
@@ -470,13 +496,14 @@ bool d7anp_unsecure_payload(packet_t *packet, uint8_t index)
     uint8_t nls_method;
     uint8_t ctr_blk[AES_BLOCK_SIZE];
     uint8_t header[AES_BLOCK_SIZE];
-    uint8_t auth[AES_BLOCK_SIZE];
     uint8_t auth_len;
     uint32_t payload_len;
     uint8_t *tag;
     uint8_t add[AES_BLOCK_SIZE];
     uint8_t add_len = 0;
+    aes128_ccm_ctx_t ccm;
 
+    const aes128_ctx_t* key = &nwl_key;
     nls_method = packet->d7anp_ctrl.nls_method;
 
     //this said payload_len = packet->hw_radio_packet.length + 1 - index - CRC_SIZE; but I don't know why we would add 1 and it seems to only work without it.
@@ -512,9 +539,9 @@ bool d7anp_unsecure_payload(packet_t *packet, uint8_t index)
         build_iv(packet, payload_len, ctr_blk);
 
         // the decrypted payload replaces the encrypted data
-        AES128_CTR_encrypt(packet->hw_radio_packet.data + index,
-                           packet->hw_radio_packet.data + index,
-                           payload_len, ctr_blk);
+        AES128_CTR_encrypt_ctx(key, packet->hw_radio_packet.data + index,
+                               packet->hw_radio_packet.data + index,
+                               payload_len, ctr_blk);
         break;
     case AES_CBC_MAC_128:
     case AES_CBC_MAC_64:
@@ -525,11 +552,18 @@ bool d7anp_unsecure_payload(packet_t *packet, uint8_t index)
         /* Set Header flags */
         header[0] |= ( add_len > 0 );
 
+        /* For DASH7, the payload length shall be less than 250 - authentication tag len */
+        if (payload_len > (250 - auth_len))
+            return false;
+
         /* Compute the CBC-MAC and check the authentication Tag */
-        AES128_CBC_MAC(auth, packet->hw_radio_packet.data + index,
-                       payload_len, header, add, add_len, auth_len);
+        if (AES128_CCM_init(&ccm, key, header, add_len, NULL, auth_len) != SUCCESS)
+            return false;
+
+        AES128_CCM_update_aad(&ccm, add, add_len);
+        AES128_CCM_authenticate(&ccm, packet->hw_radio_packet.data + index, payload_len);
 
-        if (memcmp(auth, tag, auth_len) != 0)
+        if (AES128_CCM_verify(&ccm, tag) != SUCCESS)
         {
             DPRINT("CBC-MAC: Auth mismatch");
             return false;
@@ -548,9 +582,18 @@ bool d7anp_unsecure_payload(packet_t *packet, uint8_t index)
         /* Set Header flags */
         header[0] |= ( add_len > 0 );
 
-        if (AES128_CCM_decrypt(packet->hw_radio_packet.data + index,
-                               payload_len, header, add, add_len, ctr_blk,
-                               tag, auth_len) != 0)
+        /* For DASH7, the payload length shall be less than 250 - Security header len - authentication tag len */
+        if (payload_len > (250 - 5 - auth_len))
+            return false;
+
+        // decrypt and authenticate the payload in a single pass
+        if (AES128_CCM_init(&ccm, key, header, add_len, ctr_blk, auth_len) != SUCCESS)
+            return false;
+
+        AES128_CCM_update_aad(&ccm, add, add_len);
+        AES128_CCM_decrypt_update(&ccm, packet->hw_radio_packet.data + index, payload_len);
+
+        if (AES128_CCM_verify(&ccm, tag) != SUCCESS)
             return false;
 
         /* remove the authentication Tag */
@@ -608,45 +651,6 @@ uint8_t d7anp_assemble_packet_header(packet_t *packet, uint8_t *data_ptr)
     return data_ptr - d7anp_header_start;
 }
 
-#if defined(MODULE_D7AP_NLS_ENABLED)
-dae_nwl_trusted_node_t *get_trusted_node(uint8_t *address)
-{
-    //look up the sender's address in the trusted node table
-    for(uint8_t i = 0; i < node_security_state.trusted_node_nb; i++)
-    {
-        if(memcmp(node_security_state.trusted_node_table[i].addr, address, 8) == 0)
-            return &(node_security_state.trusted_node_table[i]);
-    }
-
-    return NULL;
-}
-
-dae_nwl_trusted_node_t *add_trusted_node(uint8_t *address, uint32_t frame_counter,
-                                       uint8_t key_counter)
-{
-    uint8_t index = node_security_state.trusted_node_nb;
-    dae_nwl_trusted_node_t *node;
-
-    if (node_security_state.trusted_node_nb < FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE)
-        node_security_state.trusted_node_nb++;
-    else
-    {
-        DPRINT("SSR is full !");
-        return NULL;
-    }
-
-    node = &node_security_state.trusted_node_table[index];
-    memcpy(node->addr, address, 8);
-    node->frame_counter = frame_counter;
-    node->key_counter = key_counter;
-
-    DPRINT("Add node <%p> total number <%d>", node, node_security_state.trusted_node_nb);
-    /* Update the FS */
-    d7ap_fs_add_nwl_security_state_register_entry(node, node_security_state.trusted_node_nb);
-    return node;
-}
-#endif
-
 bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t *data_idx)
 {
     packet->d7anp_ctrl.raw = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
@@ -672,7 +676,7 @@ bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t *data_idx)
 #if defined(MODULE_D7AP_NLS_ENABLED)
     if (packet->d7anp_ctrl.nls_method)
     {
-        dae_nwl_trusted_node_t *node;
+        dae_nwl_trusted_node_t *node = NULL;
         uint8_t nls_method = packet->d7anp_ctrl.nls_method;
         bool create_node = false;
         bool prevent_replay_attack = false;
@@ -689,7 +693,7 @@ bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t *data_idx)
 
             DPRINT("Received key counter <%d>, frame counter <%ld>", packet->d7anp_security.key_counter, packet->d7anp_security.frame_counter);
 
-            if (node_security_state.filter_mode & ENABLE_SSR_FILTER)
+            if (d7anp_ssr_get_filter_mode() & ENABLE_SSR_FILTER)
                 prevent_replay_attack = true;
         }
 
@@ -705,26 +709,28 @@ bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t *data_idx)
                 node = latest_node;
             }
             else
-                node = get_trusted_node(packet->origin_access_id);
+                node = d7anp_ssr_get_node(packet->origin_access_id);
 
-            if (node && (node->frame_counter > packet->d7anp_security.frame_counter ||
-                         node->frame_counter == (uint32_t)~0))
+            // the frame counter has to go up, a frame with the counter of the last accepted frame is a replay as well
+            if (node && node->frame_counter >= packet->d7anp_security.frame_counter)
             {
                 DPRINT("Replay attack detected cnt %ld->%ld shift back", node->frame_counter, packet->d7anp_security.frame_counter);
                 return false;
             }
 
-            // update the node
-            if (node)
-                node->frame_counter = packet->d7anp_security.frame_counter;
-            else
+            if (!node)
             {
                 if (ID_TYPE_IS_BROADCAST(packet->dll_header.control_target_id_type) &&
-                     !(node_security_state.filter_mode & ALLOW_NEW_SSR_ENTRY_IN_BCAST))
+                     !(d7anp_ssr_get_filter_mode() & ALLOW_NEW_SSR_ENTRY_IN_BCAST))
                 {
                     DPRINT("New SSR entry not authorized in broadcast");
                     return false;
                 }
+                else if (!d7anp_ssr_may_add_node(packet->origin_access_id, packet->d7anp_security.frame_counter))
+                {
+                    DPRINT("Replay attack detected, the frame counter %ld may belong to an evicted node", packet->d7anp_security.frame_counter);
+                    return false;
+                }
                 else
                     create_node = true;
             }
@@ -733,9 +739,12 @@ bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t *data_idx)
         if (!d7anp_unsecure_payload(packet, *data_idx))
             return false;
 
+        // the state is only updated for authenticated frames
         if (create_node)
-             add_trusted_node(packet->origin_access_id, packet->d7anp_security.frame_counter,
-                              packet->d7anp_security.key_counter);
+             d7anp_ssr_add_node(packet->origin_access_id, packet->d7anp_security.frame_counter,
+                                packet->d7anp_security.key_counter);
+        else if (node)
+            d7anp_ssr_update_frame_counter(node, packet->d7anp_security.frame_counter);
     }
 #endif
 
@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "d7anp_ssr.h"
+#include "MODULE_D7AP_defs.h"
+#include "d7ap_fs.h"
+#include "bitmap.h"
+#include "debug.h"
+#include "log.h"
+#include "ng.h"
+#include "scheduler.h"
+#include "timer.h"
+
+#include <string.h>
+
+#if defined(MODULE_D7AP_NLS_ENABLED)
+
+#if defined(FRAMEWORK_LOG_ENABLED) && defined(MODULE_D7AP_NP_LOG_ENABLED)
+#define DPRINT(...) log_print_stack_string(LOG_STACK_NWL, __VA_ARGS__)
+#else
+#define DPRINT(...)
+#endif
+
+#if FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE == 0
+    #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+
+#if FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE > 255
+#error "the security state register can hold at most 255 trusted nodes"
+#endif
+
+#define SSR_SIZE FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE
+#define SLOT_NONE 0xFF
+
+// the index has at least twice as many buckets as there are nodes, so the probe sequences stay short
+#if SSR_SIZE <= 8
+#define INDEX_SIZE 16
+#elif SSR_SIZE <= 16
+#define INDEX_SIZE 32
+#elif SSR_SIZE <= 32
+#define INDEX_SIZE 64
+#elif SSR_SIZE <= 64
+#define INDEX_SIZE 128
+#elif SSR_SIZE <= 128
+#define INDEX_SIZE 256
+#else
+#define INDEX_SIZE 512
+#endif
+
+#define INDEX_MASK (INDEX_SIZE - 1)
+
+// the results of a lookup in the evicted nodes which did not find the node, or failed because the file can not be read
+#define EVICTED_NODE_NONE -1
+#define EVICTED_NODE_UNKNOWN -2
+
+static dae_nwl_ssr_t NGDEF(_node_security_state);
+#define node_security_state NG(_node_security_state)
+
+// the slot in the trusted node table of each bucket, open addressing with linear probing
+static uint8_t NGDEF(_node_index)[INDEX_SIZE];
+#define node_index NG(_node_index)
+
+// doubly linked list of the slots, from the most to the least recently used node
+static uint8_t NGDEF(_lru_prev)[SSR_SIZE];
+#define lru_prev NG(_lru_prev)
+
+static uint8_t NGDEF(_lru_next)[SSR_SIZE];
+#define lru_next NG(_lru_next)
+
+static uint8_t NGDEF(_lru_first);
+#define lru_first NG(_lru_first)
+
+static uint8_t NGDEF(_lru_last);
+#define lru_last NG(_lru_last)
+
+// the entries of the evicted nodes file and the number of them which are in use. The file is a hash table on the UID
+// with linear probing, it is accessed in place so it can be much larger than the register. One entry is always kept
+// free: the probe sequences end on it, and a node which comes back can swap with the least recently used node.
+static uint16_t NGDEF(_evicted_node_count);
+#define evicted_node_count NG(_evicted_node_count)
+
+static uint16_t NGDEF(_evicted_node_nb);
+#define evicted_node_nb NG(_evicted_node_nb)
+
+// the evicted nodes file failed, so it is not known which nodes were evicted and no node is added anymore
+static bool NGDEF(_evicted_nodes_failed);
+#define evicted_nodes_failed NG(_evicted_nodes_failed)
+
+// the slots which changed since the register was last written, and the node count in the file system
+static uint8_t NGDEF(_dirty_slots)[(SSR_SIZE + 7) / 8];
+#define dirty_slots NG(_dirty_slots)
+
+static uint8_t NGDEF(_persisted_node_nb);
+#define persisted_node_nb NG(_persisted_node_nb)
+
+static uint32_t hash_address(const uint8_t* address)
+{
+    uint32_t low, high;
+    memcpy(&low, address, sizeof(low));
+    memcpy(&high, address + sizeof(low), sizeof(high));
+
+    uint32_t hash = low ^ (high * 0x9E3779B1);
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static inline uint16_t home_bucket(uint32_t hash)
+{
+    return hash & INDEX_MASK;
+}
+
+static inline uint16_t evicted_home_entry(const uint8_t* address)
+{
+    return hash_address(address) % evicted_node_count;
+}
+
+static inline uint16_t next_evicted_entry(uint16_t index)
+{
+    return index + 1 == evicted_node_count ? 0 : index + 1;
+}
+
+static bool read_evicted_node(dae_nwl_evicted_node_t* entry, uint16_t index)
+{
+    if (d7ap_fs_read_nwl_ssr_evicted_node(entry, index) == 0)
+        return true;
+
+    DPRINT("Evicted nodes can not be read, no new node is added anymore");
+    evicted_nodes_failed = true;
+    return false;
+}
+
+static bool write_evicted_node(const dae_nwl_evicted_node_t* entry, uint16_t index)
+{
+    if (d7ap_fs_write_nwl_ssr_evicted_node(entry, index) == 0)
+        return true;
+
+    DPRINT("Evicted nodes can not be written, no new node is added anymore");
+    evicted_nodes_failed = true;
+    return false;
+}
+
+/** @brief The entry of an evicted node, which is also read into entry
+ *
+ * @return The index of the entry, EVICTED_NODE_NONE when the node was not evicted or EVICTED_NODE_UNKNOWN when the
+ *         evicted nodes can not be read
+ */
+static int32_t find_evicted_node(const uint8_t* address, dae_nwl_evicted_node_t* entry)
+{
+    if (evicted_nodes_failed)
+        return EVICTED_NODE_UNKNOWN;
+
+    if (evicted_node_count == 0)
+        return EVICTED_NODE_NONE;
+
+    uint16_t index = evicted_home_entry(address);
+    while (true)
+    {
+        if (!read_evicted_node(entry, index))
+            return EVICTED_NODE_UNKNOWN;
+
+        if (entry->next_frame_counter == 0)
+            return EVICTED_NODE_NONE;
+
+        if (memcmp(entry->addr, address, D7A_FILE_UID_SIZE) == 0)
+            return index;
+
+        index = next_evicted_entry(index);
+    }
+}
+
+/** @brief Stores an evicted node in the first free entry of its probe sequence, there has to be a free entry */
+static bool evict_node(const dae_nwl_trusted_node_t* node)
+{
+    dae_nwl_evicted_node_t entry;
+    uint16_t index = evicted_home_entry(node->addr);
+    while (true)
+    {
+        if (!read_evicted_node(&entry, index))
+            return false;
+
+        if (entry.next_frame_counter == 0)
+            break;
+
+        index = next_evicted_entry(index);
+    }
+
+    // a node evicted with the highest frame counter can not be added again
+    memcpy(entry.addr, node->addr, D7A_FILE_UID_SIZE);
+    entry.next_frame_counter = node->frame_counter == UINT32_MAX ? UINT32_MAX : node->frame_counter + 1;
+    if (!write_evicted_node(&entry, index))
+        return false;
+
+    evicted_node_nb++;
+    return true;
+}
+
+/** @brief Frees the entry of a node which is back in the register, the nodes further in the probe sequence are moved
+ *  back so no lookup passes a free entry before finding its node.
+ */
+static void remove_evicted_node(uint16_t index)
+{
+    // the file can be full while a node which comes back swaps with the least recently used node
+    dae_nwl_evicted_node_t entry;
+    uint16_t next = index;
+    for (uint16_t probes = 1; probes < evicted_node_count; probes++)
+    {
+        next = next_evicted_entry(next);
+        if (!read_evicted_node(&entry, next))
+            return;
+
+        if (entry.next_frame_counter == 0)
+            break;
+
+        uint16_t home = evicted_home_entry(entry.addr);
+        if ((next + evicted_node_count - home) % evicted_node_count
+            >= (next + evicted_node_count - index) % evicted_node_count)
+        {
+            if (!write_evicted_node(&entry, index))
+                return;
+
+            index = next;
+        }
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    if (write_evicted_node(&entry, index))
+        evicted_node_nb--;
+}
+
+/** @brief The bucket of the node, or the empty bucket where it would be inserted when it is not in the register
+ */
+static uint16_t find_bucket(const uint8_t* address)
+{
+    uint16_t bucket = home_bucket(hash_address(address));
+    while (node_index[bucket] != SLOT_NONE
+           && memcmp(node_security_state.trusted_node_table[node_index[bucket]].addr, address, D7A_FILE_UID_SIZE) != 0)
+        bucket = (bucket + 1) & INDEX_MASK;
+
+    return bucket;
+}
+
+/** @brief Empties a bucket, the nodes further in the probe sequence are moved back so no lookup passes an empty bucket
+ *  before finding its node.
+ */
+static void remove_bucket(uint16_t bucket)
+{
+    uint16_t next = bucket;
+    while (true)
+    {
+        next = (next + 1) & INDEX_MASK;
+        if (node_index[next] == SLOT_NONE)
+            break;
+
+        uint16_t home = home_bucket(hash_address(node_security_state.trusted_node_table[node_index[next]].addr));
+        if (((next - home) & INDEX_MASK) >= ((next - bucket) & INDEX_MASK))
+        {
+            node_index[bucket] = node_index[next];
+            bucket = next;
+        }
+    }
+
+    node_index[bucket] = SLOT_NONE;
+}
+
+static void lru_unlink(uint8_t slot)
+{
+    if (lru_prev[slot] != SLOT_NONE)
+        lru_next[lru_prev[slot]] = lru_next[slot];
+    else
+        lru_first = lru_next[slot];
+
+    if (lru_next[slot] != SLOT_NONE)
+        lru_prev[lru_next[slot]] = lru_prev[slot];
+    else
+        lru_last = lru_prev[slot];
+}
+
+static void lru_push_first(uint8_t slot)
+{
+    lru_prev[slot] = SLOT_NONE;
+    lru_next[slot] = lru_first;
+    if (lru_first != SLOT_NONE)
+        lru_prev[lru_first] = slot;
+    else
+        lru_last = slot;
+
+    lru_first = slot;
+}
+
+static void persist_task(void *arg)
+{
+    d7anp_ssr_persist();
+}
+
+static void mark_dirty(uint8_t slot)
+{
+    bitmap_set(dirty_slots, slot);
+    if (MODULE_D7AP_SSR_PERSIST_DELAY == 0)
+        d7anp_ssr_persist();
+    else if (!timer_is_task_scheduled(&persist_task))
+        timer_post_task_delay(&persist_task, MODULE_D7AP_SSR_PERSIST_DELAY * TIMER_TICKS_PER_SEC);
+}
+
+void d7anp_ssr_init(void)
+{
+    memset(&node_security_state, 0, sizeof(node_security_state));
+    memset(node_index, SLOT_NONE, sizeof(node_index));
+    memset(dirty_slots, 0, sizeof(dirty_slots));
+    lru_first = SLOT_NONE;
+    lru_last = SLOT_NONE;
+
+    sched_register_task(&persist_task);
+    timer_cancel_task(&persist_task);
+
+    /* Read the NWL security state of the successfully decrypted and authenticated devices */
+    d7ap_fs_read_nwl_security_state_register(&node_security_state);
+    persisted_node_nb = node_security_state.trusted_node_nb;
+
+    // the nodes in use are counted, the file is read again for every lookup
+    int count = d7ap_fs_get_nwl_ssr_evicted_node_count();
+    evicted_node_count = count > 0 ? count : 0;
+    evicted_node_nb = 0;
+    evicted_nodes_failed = false;
+
+    dae_nwl_evicted_node_t entry;
+    for (uint16_t index = 0; index < evicted_node_count && read_evicted_node(&entry, index); index++)
+    {
+        if (entry.next_frame_counter != 0)
+            evicted_node_nb++;
+    }
+
+    // without a free entry the lookups do not end
+    if (evicted_node_count > 0 && evicted_node_nb == evicted_node_count)
+        evicted_nodes_failed = true;
+
+    // without usage information, the order of the register is taken as the order of use
+    for (uint8_t slot = 0; slot < node_security_state.trusted_node_nb; slot++)
+    {
+        dae_nwl_trusted_node_t* node = &node_security_state.trusted_node_table[slot];
+        node_index[find_bucket(node->addr)] = slot;
+        lru_push_first(slot);
+
+        // after an unclean reset, a node can be evicted while its slot was not written yet. Like a node which comes
+        // back, it is written to the register before it is removed from the evicted nodes.
+        int32_t index = find_evicted_node(node->addr, &entry);
+        if (index >= 0)
+        {
+            uint32_t frame_counter = entry.next_frame_counter == UINT32_MAX ? UINT32_MAX : entry.next_frame_counter - 1;
+            if (frame_counter > node->frame_counter)
+                node->frame_counter = frame_counter;
+
+            bitmap_set(dirty_slots, slot);
+            d7anp_ssr_persist();
+            remove_evicted_node(index);
+        }
+    }
+
+    DPRINT("%d trusted nodes loaded, %d of %d evicted nodes", node_security_state.trusted_node_nb, evicted_node_nb,
+           evicted_node_count);
+}
+
+void d7anp_ssr_persist(void)
+{
+    timer_cancel_task(&persist_task);
+
+    for (uint8_t slot = 0; slot < node_security_state.trusted_node_nb; slot++)
+    {
+        if (!bitmap_get(dirty_slots, slot))
+            continue;
+
+        bitmap_clear(dirty_slots, slot);
+        // the node count only grows, so the new last node is dirty whenever the count changed
+        if (slot + 1 == node_security_state.trusted_node_nb && persisted_node_nb != node_security_state.trusted_node_nb)
+            d7ap_fs_add_nwl_security_state_register_entry(&node_security_state.trusted_node_table[slot], slot + 1);
+        else
+            d7ap_fs_update_nwl_security_state_register(&node_security_state.trusted_node_table[slot], slot + 1);
+    }
+
+    persisted_node_nb = node_security_state.trusted_node_nb;
+}
+
+uint8_t d7anp_ssr_get_filter_mode(void)
+{
+    return node_security_state.filter_mode;
+}
+
+dae_nwl_trusted_node_t* d7anp_ssr_get_node(const uint8_t* address)
+{
+    uint8_t slot = node_index[find_bucket(address)];
+    if (slot == SLOT_NONE)
+        return NULL;
+
+    return &node_security_state.trusted_node_table[slot];
+}
+
+bool d7anp_ssr_may_add_node(const uint8_t* address, uint32_t frame_counter)
+{
+    // same rule as for the nodes in the register, the counter of an evicted node has to go up
+    dae_nwl_evicted_node_t entry;
+    int32_t index = find_evicted_node(address, &entry);
+    if (index >= 0)
+        return frame_counter >= entry.next_frame_counter && entry.next_frame_counter != UINT32_MAX;
+
+    // a node which can not be tracked is refused, otherwise its frames could be replayed
+    return index == EVICTED_NODE_NONE
+           && (node_security_state.trusted_node_nb < SSR_SIZE || evicted_node_nb + 1 < evicted_node_count);
+}
+
+dae_nwl_trusted_node_t* d7anp_ssr_add_node(const uint8_t* address, uint32_t frame_counter, uint8_t key_counter)
+{
+    dae_nwl_evicted_node_t entry;
+    int32_t index = find_evicted_node(address, &entry);
+    if (index == EVICTED_NODE_UNKNOWN)
+        return NULL;
+
+    uint8_t slot;
+    if (node_security_state.trusted_node_nb < SSR_SIZE)
+        slot = node_security_state.trusted_node_nb++;
+    else
+    {
+        // a node which comes back uses the free entry, which it frees again when it is removed from the evicted nodes
+        if (lru_last == SLOT_NONE || (index == EVICTED_NODE_NONE && evicted_node_nb + 1 >= evicted_node_count))
+            return NULL;
+
+        slot = lru_last;
+        dae_nwl_trusted_node_t* evicted = &node_security_state.trusted_node_table[slot];
+        if (!evict_node(evicted))
+            return NULL;
+
+        DPRINT("SSR is full, evict the least recently used node");
+        remove_bucket(find_bucket(evicted->addr));
+        lru_unlink(slot);
+    }
+
+    dae_nwl_trusted_node_t* node = &node_security_state.trusted_node_table[slot];
+    memcpy(node->addr, address, D7A_FILE_UID_SIZE);
+    node->frame_counter = frame_counter;
+    node->key_counter = key_counter;
+    node_index[find_bucket(address)] = slot;
+    lru_push_first(slot);
+
+    DPRINT("Add node <%p> total number <%d>", node, node_security_state.trusted_node_nb);
+    if (index >= 0)
+    {
+        // the node is written to the register before it is removed from the evicted nodes, so it is never missing
+        // from both after an unclean reset
+        bitmap_set(dirty_slots, slot);
+        d7anp_ssr_persist();
+        remove_evicted_node(index);
+    }
+    else
+        mark_dirty(slot);
+
+    return node;
+}
+
+void d7anp_ssr_update_frame_counter(dae_nwl_trusted_node_t* node, uint32_t frame_counter)
+{
+    uint8_t slot = node - node_security_state.trusted_node_table;
+    assert(slot < node_security_state.trusted_node_nb);
+
+    node->frame_counter = frame_counter;
+    if (lru_first != slot)
+    {
+        lru_unlink(slot);
+        lru_push_first(slot);
+    }
+
+    mark_dirty(slot);
+}
+
+#endif
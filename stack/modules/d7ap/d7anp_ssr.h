@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file d7anp_ssr.h
+ * \addtogroup D7ANP
+ * \ingroup D7AP
+ * @{
+ * \brief Security State Register: the frame counters of the trusted nodes, used by the network layer security to
+ *        detect replayed frames.
+ *
+ * The nodes are found through a hash index on their UID. When the register is full, the least recently used node is
+ * evicted to make room for a new one. The UID and the next frame counter of each evicted node are stored in the
+ * D7A_FILE_NWL_SSR_EVICTED_NODES system file, a hash table which is only searched for nodes that are not in the
+ * register. An evicted node is only added again with a higher frame counter than the last one it used, and takes the
+ * place of the least recently used node. Every node keeps its own counter, so honest nodes are never refused because
+ * of the frames of other nodes.
+ *
+ * The number of evicted nodes follows from the length of the file, one entry is kept free. When the file is full, or
+ * it is not defined, nodes which are not in a full register and not in the file are refused. When the file can not be
+ * read or written, all nodes which are not in the register are refused.
+ *
+ * Changes are written to the file system in batches, at most MODULE_D7AP_SSR_PERSIST_DELAY seconds after the first
+ * change, and always on d7anp_stop(). An unclean reset loses the changes of this window: the frame counters of the
+ * nodes go back to their last written value and the nodes added in the window are forgotten. The frames accepted in
+ * the window can then be replayed until the node sends a new frame.
+ * Set MODULE_D7AP_SSR_PERSIST_DELAY to 0 to close the window at the cost of a write for every accepted frame. The
+ * evicted nodes file is written immediately, an evicted node is stored before its slot is reused and a node which
+ * comes back is written to the register before it is removed from the file.
+ */
+
+#ifndef D7ANP_SSR_H_
+#define D7ANP_SSR_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "dae.h"
+
+/*! \brief Load the register from the file system */
+void d7anp_ssr_init(void);
+
+/*! \brief Write the pending changes to the file system */
+void d7anp_ssr_persist(void);
+
+/*! \brief The filter mode of the register (ENABLE_SSR_FILTER, ALLOW_NEW_SSR_ENTRY_IN_BCAST) */
+uint8_t d7anp_ssr_get_filter_mode(void);
+
+/*! \brief Look up a node by its UID
+ *
+ * \return The node, or NULL when the node is not in the register
+ */
+dae_nwl_trusted_node_t* d7anp_ssr_get_node(const uint8_t* address);
+
+/*! \brief Check whether a node which is not in the register may be added with this frame counter
+ *
+ * \return false when the frame counter is not higher than the last one used by an evicted node, or when the register
+ *         is full and a new node can not be remembered when it is evicted
+ */
+bool d7anp_ssr_may_add_node(const uint8_t* address, uint32_t frame_counter);
+
+/*! \brief Add a node to the register, evicting the least recently used node when the register is full
+ *
+ * \return The new node, or NULL when the register is full and the evicted node can not be stored, or
+ *         FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE is 0
+ */
+dae_nwl_trusted_node_t* d7anp_ssr_add_node(const uint8_t* address, uint32_t frame_counter, uint8_t key_counter);
+
+/*! \brief Store the frame counter of an accepted frame, this also marks the node as most recently used */
+void d7anp_ssr_update_frame_counter(dae_nwl_trusted_node_t* node, uint32_t frame_counter);
+
+#endif /* D7ANP_SSR_H_ */
+
+/** @}*/
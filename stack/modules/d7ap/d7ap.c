@@ -19,10 +19,13 @@
  *  \author philippe.nunes@cortus.com
  */
 
+#include <string.h>
+
 #include "d7ap.h"
 #include "d7ap_stack.h"
 
 #include "d7ap_fs.h"
+#include "ng.h"
 #include "phy.h"
 #include "hwradio.h"
 #include "errors.h"
@@ -47,9 +50,12 @@
 
 #define D7A_SECURITY_HEADER_SIZE 5
 
-d7ap_resource_desc_t registered_client[MODULE_D7AP_MAX_CLIENT_COUNT];
-uint8_t registered_client_nb = 0;
-bool inited = false;
+d7ap_resource_desc_t NGDEF(_registered_client)[MODULE_D7AP_MAX_CLIENT_COUNT];
+#define registered_client NG(_registered_client)
+uint8_t NGDEF(_registered_client_nb);
+#define registered_client_nb NG(_registered_client_nb)
+static bool NGDEF(_inited);
+#define inited NG(_inited)
 
 
 void d7ap_init()
@@ -162,7 +168,7 @@ uint8_t d7ap_get_payload_max_size(nls_method_t nls_method)
  *
  * @param[in] clientID  The registered client Id
  * @param[in] config    The configuration for the d7a session. Set to NULL to use the current config
- * @param[in] payload   The pointer to the payload buffer
+ * @param[in] payload   The pointer to the payload buffer, which is copied into a shared buffer
  * @param[in] len       The length of the payload
  * @param[in] expected_response_len The length of the expected response
  * @param[in,out] trans_id   Set the value of this parameter to NULL to cause the function to execute synchronously.
@@ -173,13 +179,47 @@ uint8_t d7ap_get_payload_max_size(nls_method_t nls_method)
  */
 error_t d7ap_send(uint8_t client_id, d7ap_session_config_t* config, uint8_t* payload,
                   uint8_t len, uint8_t expected_response_len, uint16_t *trans_id)
+{
+    shared_buffer_t* buffer = shared_buffer_alloc(D7AP_SEND_BUFFER_HEADROOM);
+    if (buffer == NULL)
+        return -ENOMEM;
+
+    uint8_t* data = shared_buffer_append(buffer, len);
+    if (data == NULL)
+    {
+        shared_buffer_release(buffer);
+        return -ESIZE;
+    }
+
+    memcpy(data, payload, len);
+    error_t error = d7ap_send_buffer(client_id, config, buffer, expected_response_len, trans_id);
+    shared_buffer_release(buffer);
+    return error;
+}
+
+/**
+ * @brief   Send the data of a shared buffer over DASH7 network
+ *
+ * @param[in] clientID  The registered client Id
+ * @param[in] config    The configuration for the d7a session. Set to NULL to use the current config
+ * @param[in] buffer    The buffer containing the payload, the request FIFO of the session keeps a reference
+ * @param[in] expected_response_len The length of the expected response
+ * @param[in,out] trans_id   See d7ap_send()
+ * @return 0 on success
+ * @return an error (errno.h) in case of failure
+ */
+error_t d7ap_send_buffer(uint8_t client_id, d7ap_session_config_t* config, shared_buffer_t* buffer,
+                         uint8_t expected_response_len, uint16_t *trans_id)
 {
     error_t error;
 
     if (client_id >= registered_client_nb)
         return -ESIZE;
 
-    error = d7ap_stack_send(client_id, config, payload, len, expected_response_len, trans_id);
+    if (shared_buffer_get_headroom(buffer) < D7AP_SEND_BUFFER_HEADROOM || shared_buffer_get_length(buffer) > D7A_PAYLOAD_MAX_SIZE)
+        return -EINVAL;
+
+    error = d7ap_stack_send(client_id, config, buffer, expected_response_len, trans_id);
     if (error > 0)
     {
         DPRINT("d7ap_stack_send failed with error %x", error);
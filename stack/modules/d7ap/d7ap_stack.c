@@ -24,6 +24,7 @@
 #include "bitmap.h"
 #include "errors.h"
 #include "debug.h"
+#include "ng.h"
 
 #include "packet_queue.h"
 #include "d7ap_stack.h"
@@ -54,7 +55,8 @@ typedef struct {
     uint16_t trans_id[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT];
 } session_t;
 
-static session_t sessions[MODULE_D7AP_MAX_SESSION_COUNT];
+static session_t NGDEF(_sessions)[MODULE_D7AP_MAX_SESSION_COUNT];
+#define sessions NG(_sessions)
 
 typedef struct {
     bool active;
@@ -62,14 +64,13 @@ typedef struct {
     uint8_t token;
 } slave_session_t;
 
-static slave_session_t slave_session = {
-    .active = false,
-    .expected_response = false,
-    .token = 0
-};
+static slave_session_t NGDEF(_slave_session);
+#define slave_session NG(_slave_session)
 
-extern d7ap_resource_desc_t registered_client[MODULE_D7AP_MAX_CLIENT_COUNT];
-extern uint8_t registered_client_nb;
+extern d7ap_resource_desc_t NGDEF(_registered_client)[MODULE_D7AP_MAX_CLIENT_COUNT];
+#define registered_client NG(_registered_client)
+extern uint8_t NGDEF(_registered_client_nb);
+#define registered_client_nb NG(_registered_client_nb)
 
 typedef enum {
     D7AP_STACK_STATE_STOPPED,
@@ -79,7 +80,8 @@ typedef enum {
     D7AP_STACK_STATE_WAIT_APP_ANSWER
 } state_t;
 
-static state_t d7ap_stack_state = D7AP_STACK_STATE_STOPPED;
+static state_t NGDEF(_d7ap_stack_state);
+#define d7ap_stack_state NG(_d7ap_stack_state)
 
 // TODO document state diagram
 static void switch_state(state_t new_state)
@@ -231,9 +233,11 @@ static session_t* get_session_by_session_token(uint8_t session_token)
     return NULL;
 }*/
 
-error_t d7ap_stack_send(uint8_t client_id, d7ap_session_config_t* config, uint8_t* payload,
-                        uint8_t len, uint8_t expected_response_length, uint16_t *trans_id)
+error_t d7ap_stack_send(uint8_t client_id, d7ap_session_config_t* config, shared_buffer_t* buffer,
+                        uint8_t expected_response_length, uint16_t *trans_id)
 {
+    uint8_t* payload = shared_buffer_get_data(buffer);
+    uint8_t len = shared_buffer_get_length(buffer);
 
     // When an application response is expected, forward the payload directly to the current D7A session
     // TODO how to filter by client Id since we don't know to which client the request is addressed?
@@ -267,9 +271,7 @@ error_t d7ap_stack_send(uint8_t client_id, d7ap_session_config_t* config, uint8_
 
     //TODO handle here the fragmentation if needed?
 
-    uint8_t request_id = d7asp_queue_request(session->token,
-                                             payload, len,
-                                             expected_response_length);
+    uint8_t request_id = d7asp_queue_request(session->token, buffer, expected_response_length);
 
     session->trans_id[session->request_nb] = ((uint16_t)session->token << 8) | (request_id & 0x00FF);
 
@@ -360,9 +362,9 @@ void d7ap_stack_session_completed(uint8_t session_token, uint8_t* progress_bitma
         registered_client[session->client_id].transmitted_cb(session->trans_id[i], error);
     }
 
-    switch_state(D7AP_STACK_STATE_IDLE);
-
 free_session:
+    // the next pending master session (if any) is signalled active when its flush starts
+    switch_state(D7AP_STACK_STATE_IDLE);
     free_session(session);
 }
 
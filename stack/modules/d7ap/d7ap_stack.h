@@ -41,8 +41,8 @@ void d7ap_stack_init(void);
  */
 void d7ap_stack_stop();
 
-error_t d7ap_stack_send(uint8_t client_id, d7ap_session_config_t* config, uint8_t* payload,
-                        uint8_t len, uint8_t expected_response_length, uint16_t *trans_id);
+error_t d7ap_stack_send(uint8_t client_id, d7ap_session_config_t* config, shared_buffer_t* buffer,
+                        uint8_t expected_response_length, uint16_t *trans_id);
 
 bool d7ap_stack_process_unsolicited_request(uint8_t* payload, uint8_t length, d7ap_session_result_t result, bool response_expected);
 
@@ -26,6 +26,7 @@
 #include "log.h"
 #include "bitmap.h"
 #include "d7ap_fs.h"
+#include "alp.h"
 #include "random.h"
 #include "errors.h"
 #include "compress.h"
@@ -49,6 +50,9 @@
 #define DPRINT_DATA(...)
 #endif
 
+_Static_assert(D7AP_SEND_BUFFER_HEADROOM >= ALP_OP_SIZE_REQUEST_TAG,
+    "the headroom of a request buffer should hold the request tag prepended to it");
+
 typedef enum {
   D7ASP_MASTER_SESSION_IDLE,
   D7ASP_MASTER_SESSION_DORMANT,
@@ -65,20 +69,37 @@ struct d7asp_master_session {
     uint8_t progress_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
     uint8_t success_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
     uint8_t next_request_id;
-    uint8_t request_buffer_tail_idx;
-    uint8_t requests_indices[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the index in command_buffer the index where the request begins */
-    uint8_t requests_lengths[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the index in command_buffer the length of the ALP payload in that request */
-    uint8_t response_lengths[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the index in command_buffer the expected length of the ALP response for the specific request */
-    uint8_t request_buffer[MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE];
-    d7ap_addressee_t preferred_addressee;
+    shared_buffer_t* requests[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the buffer of the request, a tagged request starts with its tag request */
+    uint8_t requests_lengths[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the length of the ALP payload in that request */
+    uint8_t response_lengths[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the expected length of the ALP response for the specific request */
+    timer_tick_t dormant_deadline; /**< The time at which a dormant session becomes pending */
 };
 
-static d7asp_master_session_t NGDEF(_current_master_session); // TODO we only use 1 fifo for now, should be multiple later (1 per on unique addressee and QoS combination)
+typedef struct {
+    uint8_t token;
+    uint8_t last_request_id;
+    uint8_t progress_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
+    uint8_t success_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
+} session_result_t;
+
+static d7asp_master_session_t NGDEF(_master_sessions)[MODULE_D7AP_MAX_SESSION_COUNT]; // 1 FIFO per unique addressee and QoS combination
+#define master_sessions NG(_master_sessions)
+
+static d7asp_master_session_t* NGDEF(_current_master_session); // the session being flushed, NULL when no master session is active
 #define current_master_session NG(_current_master_session)
 
+static uint8_t NGDEF(_last_flushed_session_idx); // pending sessions are flushed round-robin, starting after this one
+#define last_flushed_session_idx NG(_last_flushed_session_idx)
+
+static d7ap_addressee_t NGDEF(_preferred_addressee); // shared by all sessions, see init_master_session()
+#define preferred_addressee NG(_preferred_addressee)
+
 static uint8_t NGDEF(_current_request_id); // TODO move ?
 #define current_request_id NG(_current_request_id)
 
+static uint8_t NGDEF(_current_request_count); // the number of requests, starting from current_request_id, sent in the current transaction
+#define current_request_count NG(_current_request_count)
+
 static uint8_t NGDEF(_current_request_retry_count);
 #define current_request_retry_count NG(_current_request_retry_count)
 
@@ -91,8 +112,10 @@ static uint8_t NGDEF(_single_request_retry_limit);
 static packet_t* NGDEF(_current_response_packet);
 #define current_response_packet NG(_current_response_packet)
 
-static timer_event current_session_timer;
-static timer_event dormant_session_timer;
+static timer_event NGDEF(_current_session_timer);
+#define current_session_timer NG(_current_session_timer)
+static timer_event NGDEF(_dormant_session_timer);
+#define dormant_session_timer NG(_dormant_session_timer)
 
 typedef enum {
     D7ASP_STATE_STOPPED,
@@ -109,64 +132,371 @@ typedef struct {
   uint8_t id[8];
 } lowest_lb_responder_t;
 
-static lowest_lb_responder_t current_responder_lowest_lb;
+static lowest_lb_responder_t NGDEF(_current_responder_lowest_lb);
+#define current_responder_lowest_lb NG(_current_responder_lowest_lb)
 
 #define LB_MAX 140
 
-static state_t NGDEF(_state) = D7ASP_STATE_STOPPED;
+static state_t NGDEF(_state);
 #define d7asp_state NG(_state)
 
 static void switch_state(state_t new_state);
+static void schedule_pending_sessions();
 
 static void mark_current_request_done()
 {
-    bitmap_set(current_master_session.progress_bitmap, current_request_id);
+    for(uint8_t i = 0; i < current_request_count; i++)
+        bitmap_set(current_master_session->progress_bitmap, current_request_id + i);
+
     // current_request_packet will be free-ed in the packet_queue when the transaction is completed
 }
 
 static void mark_current_request_successful()
 {
-    bitmap_set(current_master_session.success_bitmap, current_request_id);
+    for(uint8_t i = 0; i < current_request_count; i++)
+        bitmap_set(current_master_session->success_bitmap, current_request_id + i);
+}
+
+static inline uint8_t get_last_current_request_id()
+{
+    return current_request_id + current_request_count - 1;
+}
+
+static inline bool is_last_request_of_session(uint8_t request_id)
+{
+    return request_id == current_master_session->next_request_id - 1;
+}
+
+/*
+ * A request expecting a response payload is queued after an ALP tag request, with its request ID as tag. The
+ * responder ends the response of every tagged request with a tag response, which allows to demultiplex the response
+ * of a transaction with several requests, see process_aggregated_response(). A request sent on its own is sent without
+ * its tag request.
+ */
+static inline bool is_request_tagged(d7asp_master_session_t* session, uint8_t request_id)
+{
+#if defined(MODULE_D7AP_AGGREGATE_REQUESTS)
+    return session->response_lengths[request_id] > 0;
+#else
+    return false;
+#endif
+}
+
+static inline uint8_t get_tagged_length(d7asp_master_session_t* session, uint8_t request_id, uint8_t length)
+{
+    return is_request_tagged(session, request_id) ? length + ALP_OP_SIZE_REQUEST_TAG : length;
+}
+
+/*
+ * Returns the number of queued requests, starting from first_request_id, which are sent together in one
+ * transaction and sets the payload of the transaction, which starts at the first request in its buffer.
+ * Requests are packed as long as they, and the responses they expect, fit in the payload of a frame for the NLS
+ * method of the session. The requests behind the first one are copied in the tailroom of its buffer, which leaves the
+ * data of that buffer unchanged.
+ */
+static uint8_t get_request_batch(d7asp_master_session_t* session, uint8_t first_request_id, uint8_t** payload, uint8_t* payload_length)
+{
+    shared_buffer_t* first_request = session->requests[first_request_id];
+    uint8_t request_id = first_request_id;
+    uint16_t length = shared_buffer_get_length(first_request);
+
+#if defined(MODULE_D7AP_AGGREGATE_REQUESTS)
+    uint16_t response_length = get_tagged_length(session, request_id, session->response_lengths[request_id]);
+    uint16_t buffer_space = length + shared_buffer_get_tailroom(first_request);
+    uint8_t payload_max_size = d7ap_get_payload_max_size(session->config.addressee.ctrl.nls_method);
+    if (payload_max_size > PACKET_MAX_PAYLOAD_SIZE)
+        payload_max_size = PACKET_MAX_PAYLOAD_SIZE;
+
+    while ((request_id + 1 < session->next_request_id)
+           && (length + shared_buffer_get_length(session->requests[request_id + 1]) <= payload_max_size)
+           && (length + shared_buffer_get_length(session->requests[request_id + 1]) <= buffer_space)
+           && (response_length + get_tagged_length(session, request_id + 1, session->response_lengths[request_id + 1]) <= payload_max_size))
+    {
+        request_id++;
+        memcpy(shared_buffer_get_data(first_request) + length, shared_buffer_get_data(session->requests[request_id]),
+               shared_buffer_get_length(session->requests[request_id]));
+        length += shared_buffer_get_length(session->requests[request_id]);
+        response_length += get_tagged_length(session, request_id, session->response_lengths[request_id]);
+    }
+#endif
+
+    *payload = shared_buffer_get_data(first_request);
+    if (request_id == first_request_id)
+    {
+        // a request sent on its own is sent without its tag request
+        *payload += length - session->requests_lengths[first_request_id];
+        length = session->requests_lengths[first_request_id];
+    }
+
+    *payload_length = length;
+    return request_id - first_request_id + 1;
+}
+
+static uint8_t get_current_response_length()
+{
+    if (current_request_count == 1)
+        return current_master_session->response_lengths[current_request_id];
+
+    uint8_t response_length = 0; // fits in a frame, see get_request_batch()
+    for (uint8_t request_id = current_request_id; request_id <= get_last_current_request_id(); request_id++)
+        response_length += get_tagged_length(current_master_session, request_id, current_master_session->response_lengths[request_id]);
+
+    return response_length;
+}
+
+// returns the length of the ALP length operand at pos, or 0 when it does not fit in the payload
+static uint8_t read_alp_length_operand(const uint8_t* payload, uint16_t payload_length, uint16_t pos, uint32_t* value)
+{
+    if (pos >= payload_length)
+        return 0;
+
+    uint8_t field_length = (payload[pos] >> 6) + 1;
+    if (pos + field_length > payload_length)
+        return 0;
+
+    *value = payload[pos] & 0x3F;
+    for (uint8_t i = 1; i < field_length; i++)
+        *value = (*value << 8) | payload[pos + i];
+
+    return field_length;
+}
+
+// returns the length of the ALP response action at pos, or 0 when it is malformed or not a response action
+static uint16_t get_alp_response_action_length(const uint8_t* payload, uint16_t payload_length, uint16_t pos)
+{
+    alp_control_t ctrl = { .raw = payload[pos] };
+    uint32_t length = 1;
+    uint32_t data_length = 0;
+    uint8_t field_length;
+    switch (ctrl.operation)
+    {
+        case ALP_OP_RESPONSE_TAG:
+            length += 1; // the tag ID
+            break;
+        case ALP_OP_RETURN_FILE_DATA:
+            length += 1; // the file ID
+            field_length = read_alp_length_operand(payload, payload_length, pos + length, &data_length); // the offset
+            if (field_length == 0)
+                return 0;
+
+            length += field_length;
+            field_length = read_alp_length_operand(payload, payload_length, pos + length, &data_length);
+            if (field_length == 0)
+                return 0;
+
+            length += field_length + data_length;
+            break;
+        case ALP_OP_RETURN_FILE_PROPERTIES:
+            length += 1 + sizeof(d7ap_fs_file_header_t);
+            break;
+        case ALP_OP_STATUS:
+            if (!ctrl.b6 && !ctrl.b7)
+            {
+                length += 1; // the action status code
+            }
+            else if (ctrl.b6 && !ctrl.b7)
+            {
+                length += 1; // the interface ID
+                field_length = read_alp_length_operand(payload, payload_length, pos + length, &data_length);
+                if (field_length == 0)
+                    return 0;
+
+                length += field_length + data_length;
+            }
+            else
+                return 0;
+
+            break;
+        default:
+            return 0;
+    }
+
+    return (pos + length <= payload_length) ? length : 0;
+}
+
+/*
+ * Reports the response of a transaction with several requests per request: the response of a tagged request ends with
+ * a tag response holding its request ID and is reported with that seqnr. A tagged request without tag response, or with
+ * the error flag set in its tag response, is not successful. What cannot be attributed to a request, for example
+ * when the response contains an action D7ASP does not know, is reported with the seqnr of the last request.
+ */
+static void process_aggregated_response(uint8_t* payload, uint8_t payload_length, d7ap_session_result_t* result)
+{
+    uint8_t responded_bitmap[REQUESTS_BITMAP_BYTE_COUNT] = { 0 };
+    uint16_t response_start = 0;
+    uint16_t pos = 0;
+    while (pos < payload_length)
+    {
+        uint16_t action_length = get_alp_response_action_length(payload, payload_length, pos);
+        if (action_length == 0)
+        {
+            DPRINT("Unknown ALP action %02X in response, not demultiplexing the remainder", payload[pos]);
+            break;
+        }
+
+        alp_control_tag_response_t ctrl = { .raw = payload[pos] };
+        uint8_t request_id = payload[pos + 1];
+        if (ctrl.operation == ALP_OP_RESPONSE_TAG && request_id >= current_request_id
+            && request_id <= get_last_current_request_id() && is_request_tagged(current_master_session, request_id))
+        {
+            DPRINT("Response of request ID %d, length %d, error %d", request_id, pos - response_start, ctrl.error);
+            result->seqnr = request_id;
+            d7ap_stack_process_received_response(payload + response_start, pos - response_start, *result);
+            if (!ctrl.error)
+                bitmap_set(responded_bitmap, request_id);
+
+            response_start = pos + action_length;
+        }
+
+        pos += action_length;
+    }
+
+    if (response_start < payload_length)
+    {
+        result->seqnr = get_last_current_request_id();
+        d7ap_stack_process_received_response(payload + response_start, payload_length - response_start, *result);
+    }
+
+    for (uint8_t request_id = current_request_id; request_id <= get_last_current_request_id(); request_id++)
+    {
+        if (is_request_tagged(current_master_session, request_id) && !bitmap_get(responded_bitmap, request_id))
+            bitmap_clear(current_master_session->success_bitmap, request_id);
+    }
+}
+
+static bool is_session_pending(d7asp_master_session_t* session)
+{
+    return session->state == D7ASP_MASTER_SESSION_PENDING ||
+           session->state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TIMEOUT ||
+           session->state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED;
+}
+
+static bool has_pending_session()
+{
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++)
+    {
+        if(is_session_pending(&master_sessions[i]))
+            return true;
+    }
+
+    return false;
+}
+
+static d7asp_master_session_t* get_session_in_state(d7asp_master_session_state_t state)
+{
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++)
+    {
+        if(master_sessions[i].state == state)
+            return &master_sessions[i];
+    }
+
+    return NULL;
+}
+
+static bool is_token_used(uint8_t token)
+{
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++)
+    {
+        if(master_sessions[i].token == token)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Selects the next session to flush. A dormant session triggered by a request of its addressee goes first,
+ * since the addressee listens for it after the response. The other pending sessions take turns, so
+ * requests for one addressee don't have to wait until all sessions queued before are flushed.
+ */
+static d7asp_master_session_t* select_next_session()
+{
+    d7asp_master_session_t* session = get_session_in_state(D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED);
+    if(session != NULL)
+        return session;
+
+    for(uint8_t i = 1; i <= MODULE_D7AP_MAX_SESSION_COUNT; i++)
+    {
+        uint8_t session_idx = (last_flushed_session_idx + i) % MODULE_D7AP_MAX_SESSION_COUNT;
+        if(is_session_pending(&master_sessions[session_idx]))
+        {
+            last_flushed_session_idx = session_idx;
+            return &master_sessions[session_idx];
+        }
+    }
+
+    return NULL;
 }
 
 static void init_master_session(d7asp_master_session_t* session) {
+    uint8_t previous_token = session->token;
+    uint8_t token;
     session->state = D7ASP_MASTER_SESSION_IDLE;
+    session->token = 0;
+    // the token identifies the session (and is used as dialog ID) so it has to be unique, also compared
+    // to the previous one of this session, of which the result can still be reported
     do {
-        session->token = get_rnd() % 0xFF;
-    } while(session->token == 0);
+        token = get_rnd() % 0xFF;
+    } while(token == 0 || token == previous_token || is_token_used(token));
+    session->token = token;
     memset(session->progress_bitmap, 0x00, REQUESTS_BITMAP_BYTE_COUNT);
     memset(session->success_bitmap, 0x00, REQUESTS_BITMAP_BYTE_COUNT);
+    for (uint8_t i = 0; i < MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT; i++)
+    {
+        if (session->requests[i] != NULL)
+            shared_buffer_release(session->requests[i]);
+
+        session->requests[i] = NULL;
+    }
+
     session->next_request_id = 0;
-    session->request_buffer_tail_idx = 0;
-    memset(session->requests_indices, 0x00, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
     memset(session->requests_lengths, 0x00, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
     memset(session->response_lengths, 255, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
-    memset(session->request_buffer, 0x00, MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE);
 
-    // TODO we don't reset preferred_addressee field for now
+    // the preferred_addressee is not part of the session and is not reset here
     // for now one ALP command execution mostly results one new session, which
     // would break the preferred addressee mechanism. For now this is cached regardless
-    // over the session, until we decide on session lifetime etc
+    // over the sessions, until we decide on session lifetime etc
+}
+
+/*
+ * Frees the current session and keeps its result, which is reported afterwards by report_session_result().
+ * This way the client can queue new requests from the completion callback without those ending up in the
+ * completed session.
+ */
+static void release_current_session(session_result_t* result)
+{
+    result->token = current_master_session->token;
+    result->last_request_id = current_master_session->next_request_id - 1;
+    memcpy(result->progress_bitmap, current_master_session->progress_bitmap, REQUESTS_BITMAP_BYTE_COUNT);
+    memcpy(result->success_bitmap, current_master_session->success_bitmap, REQUESTS_BITMAP_BYTE_COUNT);
+    init_master_session(current_master_session);
+    current_master_session = NULL;
+}
+
+static void report_session_result(session_result_t* result)
+{
+    d7ap_stack_session_completed(result->token, result->progress_bitmap, result->success_bitmap, result->last_request_id);
 }
 
 static void flush_completed() {
+    session_result_t result;
     DPRINT("FIFO flush completed");
 
     // TODO When a Session does not terminate on success, the Session is automatically re-activated using
     // the RETRY_MODE pattern defined in the Configuration file
 
     // single flush of the FIFO without retry
-    d7ap_stack_session_completed(current_master_session.token, current_master_session.progress_bitmap,
-                                   current_master_session.success_bitmap, current_master_session.next_request_id - 1);
-    init_master_session(&current_master_session);
-    current_master_session.state = D7ASP_MASTER_SESSION_IDLE;
+    release_current_session(&result);
     d7atp_signal_dialog_termination();
     switch_state(D7ASP_STATE_IDLE);
+    report_session_result(&result);
+    schedule_pending_sessions(); // continue with the other sessions
 }
 
 static void schedule_current_session() {
     assert(d7asp_state == D7ASP_STATE_MASTER || d7asp_state == D7ASP_STATE_PENDING_MASTER || d7asp_state == D7ASP_STATE_SLAVE);
-    assert(current_master_session.state >= D7ASP_MASTER_SESSION_PENDING);
+    assert(current_master_session != NULL ? current_master_session->state >= D7ASP_MASTER_SESSION_PENDING : has_pending_session());
 
     DPRINT("Re-schedule immediately the current session");
     current_session_timer.next_event = 0;
@@ -174,6 +504,21 @@ static void schedule_current_session() {
     assert(rtc == SUCCESS);
 }
 
+static void schedule_pending_sessions()
+{
+    if(!has_pending_session())
+        return;
+
+    // when a master session is active the next one is selected after its flush is completed
+    if(d7asp_state == D7ASP_STATE_IDLE)
+    {
+        switch_state(D7ASP_STATE_PENDING_MASTER);
+        schedule_current_session();
+    }
+    else if(d7asp_state == D7ASP_STATE_SLAVE)
+        switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
+}
+
 static void flush_fifos()
 {
     error_t ret;
@@ -184,20 +529,21 @@ static void flush_fifos()
         return;
     }
 
-    if(current_master_session.state != D7ASP_MASTER_SESSION_PENDING &&
-       current_master_session.state != D7ASP_MASTER_SESSION_ACTIVE &&
-       current_master_session.state != D7ASP_MASTER_SESSION_PENDING_DORMANT_TIMEOUT &&
-       current_master_session.state != D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED) {
+    if (current_master_session == NULL)
+        current_master_session = select_next_session();
+
+    if(current_master_session == NULL) {
       DPRINT("No sessions in pending or active state, skipping");
       return;
     }
 
-    bool is_triggered_dormant_session = (current_master_session.state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED);
-    current_master_session.state = D7ASP_MASTER_SESSION_ACTIVE;
+    assert(is_session_pending(current_master_session) || current_master_session->state == D7ASP_MASTER_SESSION_ACTIVE);
+    bool is_triggered_dormant_session = (current_master_session->state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED);
+    current_master_session->state = D7ASP_MASTER_SESSION_ACTIVE;
     if (d7asp_state == D7ASP_STATE_PENDING_MASTER)
     {
         switch_state(D7ASP_STATE_MASTER);
-        d7ap_stack_signal_active_master_session(current_master_session.token);
+        d7ap_stack_signal_active_master_session(current_master_session->token);
     }
 
     current_responder_lowest_lb.lb = LB_MAX;
@@ -207,8 +553,8 @@ static void flush_fifos()
     if (current_request_id == NO_ACTIVE_REQUEST_ID)
     {
         // find first request which is not acked or dropped
-        int8_t found_next_req_index = bitmap_search(current_master_session.progress_bitmap, false, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
-        if (found_next_req_index == -1 || found_next_req_index == current_master_session.next_request_id)
+        int8_t found_next_req_index = bitmap_search(current_master_session->progress_bitmap, false, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
+        if (found_next_req_index == -1 || found_next_req_index == current_master_session->next_request_id)
         {
             // we handled all requests ...
             flush_completed();
@@ -222,20 +568,22 @@ static void flush_fifos()
         current_request_packet = packet_queue_alloc_packet();
         assert(current_request_packet);
         packet_queue_mark_processing(current_request_packet);
-        current_request_packet->d7anp_addressee = &(current_master_session.config.addressee); // TODO explicitly pass addressee down the stack layers?
+        current_request_packet->d7anp_addressee = &(current_master_session->config.addressee); // TODO explicitly pass addressee down the stack layers?
 
-        if(current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
-           && memcmp(current_master_session.preferred_addressee.id,(uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8) != 0)
+        if(current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
+           && memcmp(preferred_addressee.id,(uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8) != 0)
         {
             DPRINT("overriding addressee with preferred one");
-            current_master_session.preferred_addressee.access_class = current_master_session.config.addressee.access_class;
-            current_master_session.preferred_addressee.ctrl.nls_method = current_master_session.config.addressee.ctrl.nls_method;
-            current_master_session.config.addressee.ctrl.id_type = ID_TYPE_UID; // TODO no VID for now
-            current_request_packet->d7anp_addressee = &current_master_session.preferred_addressee;
+            preferred_addressee.access_class = current_master_session->config.addressee.access_class;
+            preferred_addressee.ctrl.nls_method = current_master_session->config.addressee.ctrl.nls_method;
+            current_master_session->config.addressee.ctrl.id_type = ID_TYPE_UID; // TODO no VID for now
+            current_request_packet->d7anp_addressee = &preferred_addressee;
         }
 
-        memcpy(current_request_packet->payload, current_master_session.request_buffer + current_master_session.requests_indices[current_request_id], current_master_session.requests_lengths[current_request_id]);
-        current_request_packet->payload_length = current_master_session.requests_lengths[current_request_id];
+        // the batch is sent from the buffer of its first request, which the session only releases when it is
+        // released itself, after the last retry of the request.
+        current_request_count = get_request_batch(current_master_session, current_request_id, &current_request_packet->payload, &current_request_packet->payload_length);
+        DPRINT("Sending %i request(s) in this transaction", current_request_count);
 
         if(is_triggered_dormant_session)
         {
@@ -273,8 +621,11 @@ static void flush_fifos()
     }
 
     uint8_t listen_timeout = 0; // TODO calculate timeout (and update during transaction lifetime) (based on Tc, channel, cs, payload size, # msgs, # retries)
-    ret = d7atp_send_request(current_master_session.token, current_request_id, (current_request_id == current_master_session.next_request_id - 1),
-                       current_request_packet, &current_master_session.config.qos, listen_timeout, current_master_session.response_lengths[current_request_id]);
+    // the session config is packed, so the QoS settings are passed as a copy instead of a possibly unaligned pointer
+    d7ap_session_qos_t qos = current_master_session->config.qos;
+    // the transaction ID is the ID of the first request in the transaction
+    ret = d7atp_send_request(current_master_session->token, current_request_id, is_last_request_of_session(get_last_current_request_id()),
+                       current_request_packet, &qos, listen_timeout, get_current_response_length());
     if (ret == EPERM)
     {
         // this is probably because no further encryption is possible (frame counter reaches the maximum value)
@@ -350,25 +701,52 @@ static void switch_state(state_t new_state)
     }
 }
 
+// the dormant timer is shared by all dormant sessions and fires at the first deadline
+static void schedule_dormant_timer() {
+  timer_tick_t now = timer_get_counter_value();
+  bool dormant_session_found = false;
+  int32_t next_timeout = INT32_MAX;
+  for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++) {
+    if(master_sessions[i].state != D7ASP_MASTER_SESSION_DORMANT)
+      continue;
+
+    int32_t timeout = (int32_t)(master_sessions[i].dormant_deadline - now);
+    if(timeout < next_timeout)
+      next_timeout = timeout;
+
+    dormant_session_found = true;
+  }
+
+  if(!dormant_session_found) {
+    timer_cancel_event(&dormant_session_timer);
+    return;
+  }
+
+  dormant_session_timer.next_event = next_timeout > 0 ? next_timeout : 0;
+  error_t rtc = timer_add_event(&dormant_session_timer);
+  assert(rtc == SUCCESS);
+}
+
 static void dormant_session_timeout() {
-  // TODO pass session so we can have multiple
   DPRINT("dormant session timeout");
-  if(current_master_session.state == D7ASP_MASTER_SESSION_DORMANT) {
-    current_master_session.state = D7ASP_MASTER_SESSION_PENDING_DORMANT_TIMEOUT;
-    if(d7asp_state == D7ASP_STATE_IDLE)
-      d7asp_state = D7ASP_STATE_PENDING_MASTER;
-
-    schedule_current_session();
+  timer_tick_t now = timer_get_counter_value();
+  for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++) {
+    if(master_sessions[i].state == D7ASP_MASTER_SESSION_DORMANT && (int32_t)(master_sessions[i].dormant_deadline - now) <= 0) {
+      DPRINT("dormant session %d is now pending", master_sessions[i].token);
+      master_sessions[i].state = D7ASP_MASTER_SESSION_PENDING_DORMANT_TIMEOUT;
+    }
   }
+
+  schedule_dormant_timer();
+  schedule_pending_sessions();
 }
 
 static void schedule_dormant_session(d7asp_master_session_t* dormant_session) {
   assert(dormant_session->state == D7ASP_MASTER_SESSION_DORMANT);
   timer_tick_t timeout = CT_DECOMPRESS(dormant_session->config.dormant_timeout);
   DPRINT("Sched dormant timeout in %i s", timeout);
-  dormant_session_timer.next_event = timeout * 1024;
-  error_t rtc = timer_add_event(&dormant_session_timer);
-  assert(rtc == SUCCESS);
+  dormant_session->dormant_deadline = timer_get_counter_value() + timeout * 1024;
+  schedule_dormant_timer();
 }
 
 void d7asp_init()
@@ -378,9 +756,15 @@ void d7asp_init()
     d7asp_state = D7ASP_STATE_IDLE;
     current_request_id = NO_ACTIVE_REQUEST_ID;
 
-    current_master_session.state = D7ASP_MASTER_SESSION_IDLE;
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++) {
+        master_sessions[i].state = D7ASP_MASTER_SESSION_IDLE;
+        master_sessions[i].token = 0;
+    }
+
+    current_master_session = NULL;
+    last_flushed_session_idx = MODULE_D7AP_MAX_SESSION_COUNT - 1;
     memcpy(current_responder_lowest_lb.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
-    memcpy(current_master_session.preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
+    memcpy(preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
     DPRINT("REQUESTS_BITMAP_BYTE_COUNT %d", REQUESTS_BITMAP_BYTE_COUNT);
     DPRINT("FIFO_MAX_REQUESTS_COUNT %d", MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
 
@@ -395,61 +779,77 @@ void d7asp_stop()
     timer_cancel_event(&dormant_session_timer);
 }
 
+static bool is_matching_session(d7asp_master_session_t* session, d7ap_session_config_t* config)
+{
+    return (session->config.addressee.access_class == config->addressee.access_class) &&
+           (session->config.addressee.ctrl.nls_method == config->addressee.ctrl.nls_method) &&
+           ((config->qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED && session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) ||
+           (session->config.addressee.ctrl.id_type == config->addressee.ctrl.id_type &&
+           memcmp(session->config.addressee.id, config->addressee.id, d7ap_addressee_id_length(config->addressee.ctrl.id_type)) == 0));
+}
+
 uint8_t d7asp_master_session_create(d7ap_session_config_t* d7asp_master_session_config) {
-    // TODO for now we assume only one concurrent session, in the future we should dynamically allocate (or return from pool) a session
+    d7asp_master_session_t* session = NULL;
 
-    if (current_master_session.state != D7ASP_MASTER_SESSION_IDLE)
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++)
     {
-        // Requests can be pushed in the FIFO by upper layer anytime
-        if ((current_master_session.config.addressee.access_class == d7asp_master_session_config->addressee.access_class) &&
-                (current_master_session.config.addressee.ctrl.nls_method == d7asp_master_session_config->addressee.ctrl.nls_method) &&
-                ((d7asp_master_session_config->qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED && current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) ||
-                (current_master_session.config.addressee.ctrl.id_type == d7asp_master_session_config->addressee.ctrl.id_type && 
-                memcmp(current_master_session.config.addressee.id, d7asp_master_session_config->addressee.id, d7ap_addressee_id_length(d7asp_master_session_config->addressee.ctrl.id_type)) == 0)))
-            return current_master_session.token;
-        else
-            return 0;
-        // TODO create a pending session or a dormant session if TO (DORM_TIMER) !=0
-    }
+        if (master_sessions[i].state == D7ASP_MASTER_SESSION_IDLE)
+        {
+            if (session == NULL)
+                session = &master_sessions[i];
+
+            continue;
+        }
 
-    DPRINT("current master session state %d", current_master_session.state);
+        // Requests can be pushed in the FIFO of an existing session by upper layer anytime
+        if (is_matching_session(&master_sessions[i], d7asp_master_session_config))
+            return master_sessions[i].token;
+    }
 
+    if (session == NULL)
+    {
+        DPRINT("All %d master sessions are in use", MODULE_D7AP_MAX_SESSION_COUNT);
+        return 0;
+    }
 
-    init_master_session(&current_master_session);
+    init_master_session(session);
 
-    DPRINT("Create master session %d", current_master_session.token);
+    DPRINT("Create master session %d", session->token);
 
-    current_master_session.config.qos = d7asp_master_session_config->qos;
-    current_master_session.config.dormant_timeout = d7asp_master_session_config->dormant_timeout;
-    current_master_session.config.addressee.ctrl = d7asp_master_session_config->addressee.ctrl;
-    current_master_session.config.addressee.access_class = d7asp_master_session_config->addressee.access_class;
+    session->config.qos = d7asp_master_session_config->qos;
+    session->config.dormant_timeout = d7asp_master_session_config->dormant_timeout;
+    session->config.addressee.ctrl = d7asp_master_session_config->addressee.ctrl;
+    session->config.addressee.access_class = d7asp_master_session_config->addressee.access_class;
 
-    if(current_master_session.config.qos.qos_resp_mode != SESSION_RESP_MODE_PREFERRED) {
-      memcpy(current_master_session.config.addressee.id, d7asp_master_session_config->addressee.id, sizeof(current_master_session.config.addressee.id));
+    if(session->config.qos.qos_resp_mode != SESSION_RESP_MODE_PREFERRED) {
+      memcpy(session->config.addressee.id, d7asp_master_session_config->addressee.id, sizeof(session->config.addressee.id));
     } else {
       // in this case we don't reset the preferred addressee.
       // for now one ALP command execution mostly results one new session, which
       // would break the preferred addressee mechanism. For now this is cached regardless
       // over the session, until we decide on session lifetime etc.
-      current_master_session.config.addressee.id[0] = d7asp_master_session_config->addressee.id[0];
+      session->config.addressee.id[0] = d7asp_master_session_config->addressee.id[0];
       assert(d7asp_master_session_config->addressee.ctrl.id_type == ID_TYPE_NBID
              || d7asp_master_session_config->addressee.ctrl.id_type == ID_TYPE_NOID);
     }
 
-    if(current_master_session.config.dormant_timeout) {
-      current_master_session.state = D7ASP_MASTER_SESSION_DORMANT;
-      schedule_dormant_session(&current_master_session);
+    if(session->config.dormant_timeout) {
+      session->state = D7ASP_MASTER_SESSION_DORMANT;
+      schedule_dormant_session(session);
     }
 
-    return current_master_session.token;
+    return session->token;
 }
 
 static d7asp_master_session_t* get_master_session_from_token(uint8_t session_token)
 {
-    //TODO handle a list of sessions
-    //for now, return systematically the current master session
-    assert(current_master_session.token == session_token);
-    return(&current_master_session);
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT; i++)
+    {
+        if (master_sessions[i].token == session_token)
+            return &master_sessions[i];
+    }
+
+    return NULL;
 }
 
 error_t d7asp_send_response(uint8_t* payload, uint8_t length)
@@ -464,11 +864,14 @@ error_t d7asp_send_response(uint8_t* payload, uint8_t length)
         return EINVAL;
     }
 
+    // the payload of the request packet points into the received frame, which is overwritten when assembling
+    current_response_packet->payload = packet_queue_get_payload_buffer(current_response_packet);
+    assert(current_response_packet->payload != NULL);
     current_response_packet->payload_length = length;
     memcpy(current_response_packet->payload, payload, length);
 
-    // check if there is a pending session
-    if (current_master_session.state == D7ASP_MASTER_SESSION_ACTIVE)
+    // check if there is an active master session
+    if (current_master_session != NULL && current_master_session->state == D7ASP_MASTER_SESSION_ACTIVE)
         switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
     else
         switch_state(D7ASP_STATE_SLAVE);
@@ -490,44 +893,44 @@ error_t d7asp_send_response(uint8_t* payload, uint8_t length)
     return(d7atp_send_response(current_response_packet));
 }
 
-uint8_t d7asp_queue_request(uint8_t session_token, uint8_t* alp_payload_buffer, uint8_t alp_payload_length, uint8_t expected_alp_response_length)
+uint8_t d7asp_queue_request(uint8_t session_token, shared_buffer_t* buffer, uint8_t expected_alp_response_length)
 {
     DPRINT("Queuing request in the session queue");
     d7asp_master_session_t *session = get_master_session_from_token(session_token);
 
     // TODO can be called in all session states?
     assert(session != NULL);
-    assert(session->request_buffer_tail_idx + alp_payload_length < MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE);
     assert(session->next_request_id < MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT); // TODO do not assert but let upper layer handle this
     assert(!(expected_alp_response_length > 0 &&
              (session->config.qos.qos_resp_mode == SESSION_RESP_MODE_NO || session->config.qos.qos_resp_mode == SESSION_RESP_MODE_NO_RPT))); // TODO return error
     single_request_retry_limit = 1; // TODO read from SEL config file
 
-    // add request to buffer
-    // TODO request can contain 1 or more ALP commands, find a way to group commands in requests instead of dumping all requests in one buffer
+    // the session keeps a reference to the buffer of the request instead of copying it.
+    // Requests which fit together in a frame are grouped in one transaction when flushing, see get_request_batch()
     uint8_t request_id = session->next_request_id;
-    session->requests_indices[request_id] = session->request_buffer_tail_idx;
-    session->requests_lengths[request_id] = alp_payload_length;
     session->response_lengths[request_id] = expected_alp_response_length;
-    memcpy(session->request_buffer + session->request_buffer_tail_idx, alp_payload_buffer, alp_payload_length);
-    session->request_buffer_tail_idx += alp_payload_length + 1;
+    session->requests_lengths[request_id] = shared_buffer_get_length(buffer);
+    if (is_request_tagged(session, request_id))
+    {
+        uint8_t* tag_request = shared_buffer_prepend(buffer, ALP_OP_SIZE_REQUEST_TAG);
+        assert(tag_request != NULL); // the headroom is checked by d7ap_send_buffer()
+        tag_request[0] = ALP_OP_REQUEST_TAG | (1 << 7); // respond when completed
+        tag_request[1] = request_id;
+    }
+
+    shared_buffer_retain(buffer);
+    session->requests[request_id] = buffer;
     session->next_request_id++;
 
-    if(current_master_session.state == D7ASP_MASTER_SESSION_IDLE) {
-      current_master_session.state = D7ASP_MASTER_SESSION_PENDING;
+    if(session->state == D7ASP_MASTER_SESSION_IDLE) {
+      session->state = D7ASP_MASTER_SESSION_PENDING;
       DPRINT("converting IDLE session to PENDING");
-    } else if(current_master_session.state == D7ASP_MASTER_SESSION_DORMANT) {
+    } else if(session->state == D7ASP_MASTER_SESSION_DORMANT) {
       DPRINT("session is dormant, not activating");
     }
 
     // TODO for master only set to pending when asked by upper layer (ie new function call)
-    if ((d7asp_state == D7ASP_STATE_IDLE) && (current_master_session.state != D7ASP_MASTER_SESSION_DORMANT))
-    {
-        switch_state(D7ASP_STATE_PENDING_MASTER);
-        schedule_current_session();
-    }
-    else if (d7asp_state == D7ASP_STATE_SLAVE)
-        switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
+    schedule_pending_sessions();
 
     return request_id;
 }
@@ -555,34 +958,34 @@ void d7asp_process_received_response(packet_t* packet, bool extension)
     };
 
     assert(d7asp_state == D7ASP_STATE_MASTER);
-    assert(packet->d7atp_dialog_id == current_master_session.token);
+    assert(packet->d7atp_dialog_id == current_master_session->token);
     assert(packet->d7atp_transaction_id == current_request_id);
 
     // received ack
-    DPRINT("Received ACK for request ID %d", current_request_id);
-    if (current_master_session.config.qos.qos_resp_mode != SESSION_RESP_MODE_NO
-       && current_master_session.config.qos.qos_resp_mode != SESSION_RESP_MODE_NO_RPT)
+    DPRINT("Received ACK for request ID %d (%d request(s))", current_request_id, current_request_count);
+    if (current_master_session->config.qos.qos_resp_mode != SESSION_RESP_MODE_NO
+       && current_master_session->config.qos.qos_resp_mode != SESSION_RESP_MODE_NO_RPT)
     {
         // for SESSION_RESP_MODE_NO and SESSION_RESP_MODE_NO_RPT the request was already marked as done
         // upon successfull CSMA insertion. We don't care about response in these cases.
 
-        if((current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) 
-            && (current_master_session.config.addressee.ctrl.id_type == ID_TYPE_UID) 
+        if((current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) 
+            && (current_master_session->config.addressee.ctrl.id_type == ID_TYPE_UID) 
             && (packet->d7atp_ctrl.ctrl_xoff)) {
             DPRINT("preferred gateway answered that it should not be preferred, this should not count as an ACK");
-            memcpy(current_master_session.preferred_addressee.id,
+            memcpy(preferred_addressee.id,
                 (uint8_t[8]) { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
             memcpy(current_responder_lowest_lb.id, (uint8_t[8]) { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
             packet_queue_free_packet(packet);
             return;
         }
 
-        result.fifo_token = current_master_session.token;
-        result.seqnr = current_request_id;
+        result.fifo_token = current_master_session->token;
+        result.seqnr = get_last_current_request_id(); // see process_aggregated_response() for transactions with several requests
         mark_current_request_successful();
         mark_current_request_done();
-        if(current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
-           && ID_TYPE_IS_BROADCAST(current_master_session.config.addressee.ctrl.id_type))
+        if(current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
+           && ID_TYPE_IS_BROADCAST(current_master_session->config.addressee.ctrl.id_type))
         {
             if(result.link_budget < current_responder_lowest_lb.lb && (!packet->d7atp_ctrl.ctrl_xoff))
             {
@@ -595,12 +998,15 @@ void d7asp_process_received_response(packet_t* packet, bool extension)
         assert(packet != current_request_packet);
     }
 
-    d7ap_stack_process_received_response(packet->payload, packet->payload_length, result);
+    if (current_request_count > 1 && packet->payload_length > 0)
+        process_aggregated_response(packet->payload, packet->payload_length, &result);
+    else
+        d7ap_stack_process_received_response(packet->payload, packet->payload_length, result);
 
     packet_queue_free_packet(packet); // ACK can be cleaned
 
     /* In case of unicast session, it is acceptable to switch to the next request before the expiration of Tc */
-    if (!ID_TYPE_IS_BROADCAST(current_master_session.config.addressee.ctrl.id_type))
+    if (!ID_TYPE_IS_BROADCAST(current_master_session->config.addressee.ctrl.id_type))
     {
         DPRINT("Request completed, don't wait end of transaction");
         packet_queue_free_packet(current_request_packet);
@@ -608,7 +1014,7 @@ void d7asp_process_received_response(packet_t* packet, bool extension)
         // terminate the dialog if all request handled
         // we need to switch to the state idle otherwise we may receive a new packet before the task flush_fifos is handled
         // in this case, we may assert since the state remains MASTER
-        if (current_request_id == current_master_session.next_request_id - 1)
+        if (is_last_request_of_session(get_last_current_request_id()))
         {
             flush_completed();
             return;
@@ -619,13 +1025,13 @@ void d7asp_process_received_response(packet_t* packet, bool extension)
         // d7atp_stop_transaction(); //TO BE CHECKED THAT COMMENTING THIS OUT HAS NO NEGATIVE EFFECT
     }
     // switch to the state slave when the D7ATP Dialog Extension Procedure is initiated and all request are handled
-    else if ((extension) && (current_request_id == current_master_session.next_request_id - 1))
+    else if ((extension) && is_last_request_of_session(get_last_current_request_id()))
     {
         DPRINT("Dialog Extension Procedure is initiated, mark the FIFO flush "
                "completed before switching to a responder state");
-        d7ap_stack_session_completed(current_master_session.token, current_master_session.progress_bitmap,
-                                     current_master_session.success_bitmap, current_master_session.next_request_id - 1);
-        current_master_session.state = D7ASP_MASTER_SESSION_IDLE;
+        session_result_t session_result;
+        release_current_session(&session_result);
+        report_session_result(&session_result);
         switch_state(D7ASP_STATE_SLAVE);
     }
 }
@@ -670,11 +1076,18 @@ bool d7asp_process_received_packet(packet_t* packet)
         expect_upper_layer_resp_payload = d7ap_stack_process_unsolicited_request(packet->payload, packet->payload_length, result, packet->d7atp_ctrl.ctrl_is_ack_requested);
     }
 
-    if (current_master_session.state == D7ASP_MASTER_SESSION_DORMANT &&
-        (!ID_TYPE_IS_BROADCAST(packet->dll_header.control_target_id_type)) &&
-        memcmp(current_master_session.config.addressee.id, packet->d7anp_addressee->id, d7ap_addressee_id_length(packet->d7anp_addressee->ctrl.id_type)) == 0) {
-        DPRINT("pending dormant session for requester");
-        current_master_session.state = D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED;
+    // only one dormant session can be appended to the dialog
+    d7asp_master_session_t* triggered_session = get_session_in_state(D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED);
+    for(uint8_t i = 0; i < MODULE_D7AP_MAX_SESSION_COUNT && triggered_session == NULL; i++)
+    {
+        if (master_sessions[i].state == D7ASP_MASTER_SESSION_DORMANT &&
+            (!ID_TYPE_IS_BROADCAST(packet->dll_header.control_target_id_type)) &&
+            memcmp(master_sessions[i].config.addressee.id, packet->d7anp_addressee->id, d7ap_addressee_id_length(packet->d7anp_addressee->ctrl.id_type)) == 0) {
+            DPRINT("pending dormant session for requester");
+            triggered_session = &master_sessions[i];
+            triggered_session->state = D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED;
+            schedule_dormant_timer();
+        }
     }
 
     /*
@@ -682,7 +1095,7 @@ bool d7asp_process_received_packet(packet_t* packet)
      * and a master session is pending
      */
     if ((!ID_TYPE_IS_BROADCAST(packet->dll_header.control_target_id_type)) &&
-        (d7asp_state == D7ASP_STATE_SLAVE) && (current_master_session.state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED))
+        (d7asp_state == D7ASP_STATE_SLAVE) && (triggered_session != NULL))
     {
         packet->d7atp_ctrl.ctrl_is_start = true;
         packet->d7atp_ctrl.ctrl_tl = true;
@@ -700,9 +1113,12 @@ bool d7asp_process_received_packet(packet_t* packet)
 
         estimated_tl += t_g; // Tt < silent time < Tg ~ in practice 4.26 ms
         // TX duration for dormant session
+        uint8_t* first_transaction_payload;
+        uint8_t first_transaction_length;
+        get_request_batch(triggered_session, 0, &first_transaction_payload, &first_transaction_length);
         estimated_tl += phy_calculate_tx_duration(packet->phy_config.rx.channel_id.channel_header.ch_class,
                                                   packet->phy_config.rx.channel_id.channel_header.ch_coding,
-                                                  current_master_session.requests_lengths[0], false); // TODO assuming 1 queued request for now
+                                                  first_transaction_length, false); // TODO only the first transaction of the session is taken into account
         DPRINT("Dormant session estimated Tl=%i", estimated_tl);
         packet->d7atp_tl = compress_data(estimated_tl, true);
     }
@@ -736,22 +1152,22 @@ static void on_request_completed()
     assert(d7asp_state == D7ASP_STATE_MASTER);
     DPRINT("request completed");
 
-    if(current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) {
-      memcpy(current_master_session.preferred_addressee.id, current_responder_lowest_lb.id, 8); // TODO assume UID for now
-      current_master_session.preferred_addressee.ctrl.id_type = ID_TYPE_UID;
+    if(current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED) {
+      memcpy(preferred_addressee.id, current_responder_lowest_lb.id, 8); // TODO assume UID for now
+      preferred_addressee.ctrl.id_type = ID_TYPE_UID;
 
       DPRINT("preferred addressee with LB %i is now:", current_responder_lowest_lb.lb);
-      DPRINT_DATA(current_master_session.preferred_addressee.id, 8);
+      DPRINT_DATA(preferred_addressee.id, 8);
     }
 
-    if (!bitmap_get(current_master_session.progress_bitmap, current_request_id))
+    if (!bitmap_get(current_master_session->progress_bitmap, current_request_id))
     {
-        if(current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
-          && memcmp(current_master_session.preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8) != 0)
+        if(current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_PREFERRED
+          && memcmp(preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8) != 0)
         {
             DPRINT("No ack from preferred addressee, switching to bcast");
             current_responder_lowest_lb.lb = LB_MAX;
-            memcpy(current_master_session.preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
+            memcpy(preferred_addressee.id, (uint8_t[8]){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8);
         }
         current_request_retry_count++;
         // the request may be retransmitted, don't free yet (this will be done in flush_fifo() when failed)
@@ -764,7 +1180,7 @@ static void on_request_completed()
         // terminate the dialog if all request handled
         // we need to switch to the state idle otherwise we may receive a new packet before the task flush_fifos is handled
         // in this case, we may assert since the state remains MASTER
-        if (current_request_id == current_master_session.next_request_id - 1)
+        if (is_last_request_of_session(get_last_current_request_id()))
         {
             flush_completed();
             return;
@@ -781,8 +1197,8 @@ void d7asp_signal_packet_transmitted(packet_t *packet)
     if (d7asp_state == D7ASP_STATE_MASTER)
     {
         // for the lowest QoS level the packet is ack-ed when CSMA/CA process succeeded
-        if (current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_NO ||
-           current_master_session.config.qos.qos_resp_mode == SESSION_RESP_MODE_NO_RPT)
+        if (current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_NO ||
+           current_master_session->config.qos.qos_resp_mode == SESSION_RESP_MODE_NO_RPT)
         {
             mark_current_request_done();
             mark_current_request_successful();
@@ -816,7 +1232,7 @@ void d7asp_signal_transaction_terminated()
     if (d7asp_state == D7ASP_STATE_SLAVE_WAITING_RESPONSE)
     {
         // the time window to respond is expired, so it is not possible to send a response anymore
-        if (current_master_session.state == D7ASP_MASTER_SESSION_ACTIVE)
+        if (current_master_session != NULL && current_master_session->state == D7ASP_MASTER_SESSION_ACTIVE)
             switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
         else
             switch_state(D7ASP_STATE_SLAVE);
@@ -839,12 +1255,9 @@ void d7asp_signal_dialog_terminated()
         current_response_packet = NULL;
     }
 
-    if (current_master_session.state == D7ASP_MASTER_SESSION_PENDING_DORMANT_TRIGGERED) {
-      switch_state(D7ASP_STATE_PENDING_MASTER);
-      schedule_current_session();
-    } else {
-      switch_state(D7ASP_STATE_IDLE);
-    }
+    // a dormant session triggered during this dialog is flushed first, see select_next_session()
+    switch_state(D7ASP_STATE_IDLE);
+    schedule_pending_sessions();
 
     d7ap_stack_signal_slave_session_terminated();
 }
@@ -55,7 +55,11 @@ void d7asp_init();
 void d7asp_stop();
 uint8_t d7asp_master_session_create(d7ap_session_config_t* d7asp_master_session_config);
 
-uint8_t d7asp_queue_request(uint8_t session_token, uint8_t* alp_payload_buffer, uint8_t alp_payload_length, uint8_t expected_alp_response_length);
+/**
+ * @brief Queues the data of the buffer as a request in the session, which keeps a reference to the buffer until the
+ * session is completed. The buffer needs D7AP_SEND_BUFFER_HEADROOM bytes of headroom for the request tag.
+ */
+uint8_t d7asp_queue_request(uint8_t session_token, shared_buffer_t* buffer, uint8_t expected_alp_response_length);
 
 error_t d7asp_send_response(uint8_t* payload, uint8_t length);
 
@@ -76,7 +76,7 @@ static dae_access_profile_t NGDEF(_remote_access_profile);
 static uint8_t NGDEF(_active_access_class);
 #define active_access_class NG(_active_access_class)
 
-static dll_state_t NGDEF(_dll_state) = DLL_STATE_STOPPED;
+static dll_state_t NGDEF(_dll_state);
 #define dll_state NG(_dll_state)
 
 static packet_t* NGDEF(_current_packet);
@@ -125,13 +125,19 @@ static uint16_t NGDEF(_tsched);
 static bool NGDEF(_guarded_channel);
 #define guarded_channel NG(_guarded_channel)
 
-static timer_tick_t guarded_channel_time_stop;
+static timer_tick_t NGDEF(_guarded_channel_time_stop);
+#define guarded_channel_time_stop NG(_guarded_channel_time_stop)
 
-static uint8_t noisefl_last_measurements[PHY_STATUS_MAX_CHANNELS][NOISEFL_NUMBER_MEASUREMENTS]; //3 measurement per channel
-static channel_status_t channels[PHY_STATUS_MAX_CHANNELS];
-static uint8_t phy_status_channel_counter = 0;
-static bool reset_noisefl_last_measurements = false;
-static bool phy_status_file_inited = false;
+static uint8_t NGDEF(_noisefl_last_measurements)[PHY_STATUS_MAX_CHANNELS][NOISEFL_NUMBER_MEASUREMENTS]; //3 measurement per channel
+#define noisefl_last_measurements NG(_noisefl_last_measurements)
+static channel_status_t NGDEF(_channels)[PHY_STATUS_MAX_CHANNELS];
+#define channels NG(_channels)
+static uint8_t NGDEF(_phy_status_channel_counter);
+#define phy_status_channel_counter NG(_phy_status_channel_counter)
+static bool NGDEF(_reset_noisefl_last_measurements);
+#define reset_noisefl_last_measurements NG(_reset_noisefl_last_measurements)
+static bool NGDEF(_phy_status_file_inited);
+#define phy_status_file_inited NG(_phy_status_file_inited)
 
 static void execute_cca(void *arg);
 static void execute_csma_ca(void *arg);
@@ -142,27 +148,32 @@ static uint8_t get_position_channel();
 /*!
  * D7A timer used to perform a CCA
  */
-static timer_event dll_cca_timer;
+static timer_event NGDEF(_dll_cca_timer);
+#define dll_cca_timer NG(_dll_cca_timer)
 
 /*!
  * D7A timer used to perform a CSMA-CA
  */
-static timer_event dll_csma_timer;
+static timer_event NGDEF(_dll_csma_timer);
+#define dll_csma_timer NG(_dll_csma_timer)
 
 /*!
  * D7A timer used to start the automation scan (foreground)
  */
-static timer_event dll_scan_automation_timer;
+static timer_event NGDEF(_dll_scan_automation_timer);
+#define dll_scan_automation_timer NG(_dll_scan_automation_timer)
 
 /*!
  * D7A timer used to start a background scan
  */
-static timer_event dll_background_scan_timer;
+static timer_event NGDEF(_dll_background_scan_timer);
+#define dll_background_scan_timer NG(_dll_background_scan_timer)
 
 /*!
  * D7A timer used to delay the processing of a received packet
  */
-static timer_event dll_process_received_packet_timer;
+static timer_event NGDEF(_dll_process_received_packet_timer);
+#define dll_process_received_packet_timer NG(_dll_process_received_packet_timer)
 
 static void switch_state(dll_state_t next_state)
 {
@@ -535,7 +546,7 @@ static void execute_csma_ca(void *arg)
             if (current_packet->type == RESPONSE_TO_UNICAST || current_packet->type == RESPONSE_TO_BROADCAST)
                 dll_tc = CT_DECOMPRESS(current_packet->d7atp_tc);
             else
-                dll_tc = ceil((SFc + 1) * current_packet->tx_duration + t_g);
+                dll_tc = (SFc + 1) * current_packet->tx_duration + t_g;
 
             /*
              * Tca = Tc - Ttx - Tg
@@ -1101,15 +1112,25 @@ void dll_tx_frame(packet_t* packet)
         }
     }
 
-    packet_assemble(packet);
+    current_packet = packet;
+
+    if (packet_assemble(packet) != SUCCESS)
+    {
+        // the frame could not be secured, it fails like a frame for which the channel never became clear
+        DPRINT("Packet assembly failed");
+        switch_state(DLL_STATE_CSMA_CA_STARTED);
+        switch_state(DLL_STATE_CCA_FAIL);
+        dll_csma_timer.next_event = 0;
+        error_t rtc = timer_add_event(&dll_csma_timer);
+        assert(rtc == SUCCESS);
+        return;
+    }
 
     packet->tx_duration = phy_calculate_tx_duration(current_channel_id.channel_header.ch_class,
                                                     current_channel_id.channel_header.ch_coding,
                                                     packet->hw_radio_packet.length + 1, false);
     DPRINT("Packet LENGTH %d, TX DURATION %d", packet->hw_radio_packet.length, packet->tx_duration);
 
-    current_packet = packet;
-
     switch_state(DLL_STATE_CSMA_CA_STARTED);
 
     if ((packet->type == RESPONSE_TO_UNICAST) || (packet->type == RESPONSE_TO_BROADCAST))
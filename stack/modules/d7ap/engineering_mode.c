@@ -23,6 +23,7 @@
 #include "d7ap.h"
 #include "log.h"
 #include "d7ap_fs.h"
+#include "ng.h"
 #include "phy.h"
 #include "packet.h"
 #include "crc.h"
@@ -50,26 +51,39 @@
 
 typedef struct packet packet_t;
 
-static uint8_t timeout_em = 0;
-static phy_tx_config_t tx_cfg;
-static phy_rx_config_t rx_cfg;
-static bool stop = false;
-
-static uint16_t per_missed_packets_counter = 0;
-static uint16_t per_received_packets_counter = 0;
-static uint16_t per_packet_counter = 0; 
-static uint16_t per_start_index = 65535; //Impossible value to show this is not yet set
-static uint16_t per_packet_limit = 0;
-static uint8_t per_data[PACKET_SIZE] = { [0 ... PACKET_SIZE-1]  = 0 };
-static uint8_t per_fill_data[FILL_DATA_SIZE + 1];
+static uint8_t NGDEF(_timeout_em);
+#define timeout_em NG(_timeout_em)
+static phy_tx_config_t NGDEF(_tx_cfg);
+#define tx_cfg NG(_tx_cfg)
+static phy_rx_config_t NGDEF(_rx_cfg);
+#define rx_cfg NG(_rx_cfg)
+static bool NGDEF(_stop);
+#define stop NG(_stop)
+
+static uint16_t NGDEF(_per_missed_packets_counter);
+#define per_missed_packets_counter NG(_per_missed_packets_counter)
+static uint16_t NGDEF(_per_received_packets_counter);
+#define per_received_packets_counter NG(_per_received_packets_counter)
+static uint16_t NGDEF(_per_packet_counter); 
+#define per_packet_counter NG(_per_packet_counter)
+static uint16_t NGDEF(_per_start_index); //65535 is an impossible value to show this is not yet set
+#define per_start_index NG(_per_start_index)
+static uint16_t NGDEF(_per_packet_limit);
+#define per_packet_limit NG(_per_packet_limit)
+static uint8_t NGDEF(_per_data)[PACKET_SIZE];
+#define per_data NG(_per_data)
+static uint8_t NGDEF(_per_fill_data)[FILL_DATA_SIZE + 1];
+#define per_fill_data NG(_per_fill_data)
 typedef struct {
   union {
     uint8_t per_packet_buffer[sizeof(hw_radio_packet_t) + 255];
     hw_radio_packet_t hw_radio_packet;
   };
 } per_packet_t;
-static per_packet_t per_packet;
-static engineering_mode_t active_mode = EM_OFF;
+static per_packet_t NGDEF(_per_packet);
+#define per_packet NG(_per_packet)
+static engineering_mode_t NGDEF(_active_mode);
+#define active_mode NG(_active_mode)
 
 static void start_mode();
 static void stop_mode();
@@ -89,8 +103,11 @@ static void packet_transmitted_callback(packet_t* packet) {
 }
 
 static void packet_received_em(packet_t* packet) {
-  uint16_t crc = __builtin_bswap16(crc_calculate(packet->hw_radio_packet.data, packet->hw_radio_packet.length - 2));
-  if(memcmp(&crc, packet->hw_radio_packet.data + packet->hw_radio_packet.length - 2, 2) != 0)
+  uint16_t crc = 0;
+  if(packet->hw_radio_packet.length >= 2)
+    crc = __builtin_bswap16(crc_calculate(packet->hw_radio_packet.data, packet->hw_radio_packet.length - 2));
+
+  if(packet->hw_radio_packet.length < 2 || memcmp(&crc, packet->hw_radio_packet.data + packet->hw_radio_packet.length - 2, 2) != 0)
   {
       per_missed_packets_counter++;
       DPRINT("##fault##");
@@ -283,6 +300,7 @@ error_t engineering_mode_init()
   uint8_t init_data[D7A_FILE_ENGINEERING_MODE_SIZE] = {0};
   d7ap_fs_write_file(D7A_FILE_ENGINEERING_MODE_FILE_ID, 0, init_data, D7A_FILE_ENGINEERING_MODE_SIZE, ROOT_AUTH);
 
+  per_start_index = 65535;
   d7ap_fs_register_file_modified_callback(D7A_FILE_ENGINEERING_MODE_FILE_ID, &em_file_change_callback);
 
   sched_register_task(&start_mode);
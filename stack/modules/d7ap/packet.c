@@ -53,7 +53,7 @@ void packet_init(packet_t* packet)
     memset(packet, 0x00, sizeof(packet_t));
 }
 
-void packet_assemble(packet_t* packet)
+error_t packet_assemble(packet_t* packet)
 {
     uint8_t* data_ptr = packet->hw_radio_packet.data + 1; // skip length field for now, we fill this later
 
@@ -73,7 +73,14 @@ void packet_assemble(packet_t* packet)
 #if defined(MODULE_D7AP_NLS_ENABLED)
     /* Encrypt/authenticate nwl_payload if needed */
     if (packet->d7anp_ctrl.nls_method)
-        data_ptr += d7anp_secure_payload(packet, nwl_payload, data_ptr - nwl_payload);
+    {
+        uint8_t auth_len;
+        error_t rtc = d7anp_secure_payload(packet, nwl_payload, data_ptr - nwl_payload, &auth_len);
+        if (rtc != SUCCESS)
+            return rtc;
+
+        data_ptr += auth_len;
+    }
 #endif
 
     packet->hw_radio_packet.length = data_ptr - packet->hw_radio_packet.data + 2; // exclude the CRC bytes
@@ -89,6 +96,7 @@ void packet_assemble(packet_t* packet)
         memcpy(data_ptr, &crc, 2);
     }
 
+    return SUCCESS;
 }
 
 void packet_disassemble(packet_t* packet)
@@ -96,7 +104,14 @@ void packet_disassemble(packet_t* packet)
 
     if (packet->hw_radio_packet.rx_meta.crc_status == HW_CRC_UNAVAILABLE)
     {
+        // normally the PHY already verified the CRC while the frame was received, see phy.c
         uint16_t crc;
+        if (packet->hw_radio_packet.length < 2)
+        {
+            DPRINT_DLL("Packet too short for a CRC: len %d", packet->hw_radio_packet.length);
+            goto cleanup;
+        }
+
         crc = __builtin_bswap16(crc_calculate(packet->hw_radio_packet.data, packet->hw_radio_packet.length - 2));
 
         if(memcmp(&crc, packet->hw_radio_packet.data + packet->hw_radio_packet.length - 2, 2) != 0)
@@ -130,9 +145,9 @@ void packet_disassemble(packet_t* packet)
         if(!d7atp_disassemble_packet_header(packet, &data_idx))
             goto cleanup;
 
-        // extract payload
+        // the payload is not copied, it remains valid as long as the packet
         packet->payload_length = packet->hw_radio_packet.length - data_idx - 2; // exclude the headers CRC bytes // TODO exclude footers
-        memcpy(packet->payload, packet->hw_radio_packet.data + data_idx, packet->payload_length);
+        packet->payload = packet->hw_radio_packet.data + data_idx;
     }
     else
     {
@@ -35,6 +35,9 @@
 #include "phy.h"
 #include "hwradio.h"
 
+#define PACKET_MAX_PAYLOAD_SIZE 239 // TODO make max size configurable using cmake
+#define PACKET_MAX_FRAME_SIZE 255
+
 typedef enum {
     INITIAL_REQUEST,
     SUBSEQUENT_REQUEST,
@@ -69,18 +72,18 @@ struct packet
     uint16_t tx_duration;
     // TODO d7atp ack template
     uint8_t payload_length;
-    uint8_t payload[239]; // TODO make max size configurable using cmake
+    uint8_t* payload;       // not owned by the packet: points into the received frame, into the shared buffer of the
+                            // D7ASP request for requests, or to the payload buffer of the packet queue slot for responses
                             // TODO store payload here or only pointer to file where we need to fetch it? can we assume data will not be changed in between
     phy_config_t phy_config;
     hw_radio_packet_t hw_radio_packet; // TODO we might not need all metadata included in hw_radio_packet_t. If not copy needed data fields
-    uint8_t __data[255];    // reserves space for hw_radio_packet_t.data flexible array member,
-                            // do not use this directly but use hw_radio_packet_t.data instead, which contains the length byte
-                            // TODO configure max length from cmake
+                            // the packet queue slot reserves the space for the hw_radio_packet_t.data flexible array member
+                            // right behind the packet, which contains the length byte
 };
 
 
 void packet_init(packet_t*);
-void packet_assemble(packet_t*);
+error_t packet_assemble(packet_t*);
 void packet_disassemble(packet_t*);
 
 #endif //OSS_7_PACKET_H
@@ -24,12 +24,30 @@
 #include "ng.h"
 #include "log.h"
 
+#include <stddef.h>
+#include <string.h>
+
 #if defined(FRAMEWORK_LOG_ENABLED) && defined(MODULE_D7AP_PACKET_LOG_ENABLED)
 #define DPRINT(...) log_print_stack_string(LOG_STACK_FWK, __VA_ARGS__)
 #else
 #define DPRINT(...)
 #endif
 
+#ifndef MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE
+#define MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE 0
+#endif
+
+#ifndef MODULE_D7AP_PACKET_SMALL_FRAME_SIZE
+#define MODULE_D7AP_PACKET_SMALL_FRAME_SIZE 64
+#endif
+
+#if MODULE_D7AP_PACKET_SMALL_FRAME_SIZE > PACKET_MAX_FRAME_SIZE
+#error "MODULE_D7AP_PACKET_SMALL_FRAME_SIZE cannot exceed PACKET_MAX_FRAME_SIZE"
+#endif
+
+#define SLOT_COUNT (MODULE_D7AP_PACKET_QUEUE_SIZE + MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE)
+#define SLOT_NONE 0xFF
+
 typedef enum
 {
     PACKET_QUEUE_ELEMENT_STATUS_FREE,       /*! The element is free */
@@ -39,79 +57,221 @@ typedef enum
     PACKET_QUEUE_ELEMENT_STATUS_PROCESSING  /*! Indicates the supplied packet is being processed */
 } packet_queue_element_status_t;
 
-static packet_t NGDEF(_packet_queue)[MODULE_D7AP_PACKET_QUEUE_SIZE];
-#define packet_queue NG(_packet_queue)
-static packet_queue_element_status_t NGDEF(_packet_queue_element_status)[MODULE_D7AP_PACKET_QUEUE_SIZE];
+typedef enum
+{
+    PACKET_SIZE_CLASS_MAX,
+    PACKET_SIZE_CLASS_SMALL,
+    PACKET_SIZE_CLASS_COUNT
+} packet_size_class_t;
+
+// The frame buffer directly follows the packet_t, so it provides the storage for the hw_radio_packet_t.data
+// flexible array member, which is the last member of packet_t.
+// The payload of a received frame is not copied but points into the frame, the payload buffer is only used to
+// assemble a response, so small slots (which are only used for received frames) don't have one.
+typedef struct
+{
+    packet_t packet;
+    uint8_t frame[PACKET_MAX_FRAME_SIZE];
+    uint8_t payload[PACKET_MAX_PAYLOAD_SIZE];
+} max_packet_slot_t;
+
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+typedef struct
+{
+    packet_t packet;
+    uint8_t frame[MODULE_D7AP_PACKET_SMALL_FRAME_SIZE];
+} small_packet_slot_t;
+
+static small_packet_slot_t NGDEF(_small_slots)[MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE];
+#define small_slots NG(_small_slots)
+#endif
+
+static max_packet_slot_t NGDEF(_max_slots)[MODULE_D7AP_PACKET_QUEUE_SIZE];
+#define max_slots NG(_max_slots)
+
+// slots are identified by a single index: 0 .. PACKET_QUEUE_SIZE-1 are of the maximum size class, the remaining
+// ones of the small size class. Free slots of each class are chained in a free list.
+static packet_queue_element_status_t NGDEF(_packet_queue_element_status)[SLOT_COUNT];
 #define packet_queue_element_status NG(_packet_queue_element_status)
+static uint8_t NGDEF(_next_free)[SLOT_COUNT];
+#define next_free NG(_next_free)
+static uint8_t NGDEF(_free_head)[PACKET_SIZE_CLASS_COUNT];
+#define free_head NG(_free_head)
+
+static inline packet_t* get_packet(uint8_t slot)
+{
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+    if(slot >= MODULE_D7AP_PACKET_QUEUE_SIZE)
+        return &(small_slots[slot - MODULE_D7AP_PACKET_QUEUE_SIZE].packet);
+#endif
+
+    return &(max_slots[slot].packet);
+}
+
+static inline uint8_t* get_payload(uint8_t slot)
+{
+    if(slot >= MODULE_D7AP_PACKET_QUEUE_SIZE)
+        return NULL;
+
+    return max_slots[slot].payload;
+}
+
+// returns the slot index of the packet or SLOT_NONE when the packet is not part of the queue
+static uint8_t get_slot(packet_t* packet)
+{
+    uintptr_t ptr = (uintptr_t)packet;
+    uintptr_t start = (uintptr_t)max_slots;
+    if(ptr >= start && ptr < (uintptr_t)&max_slots[MODULE_D7AP_PACKET_QUEUE_SIZE])
+    {
+        if((ptr - start) % sizeof(max_packet_slot_t) != 0)
+            return SLOT_NONE;
+
+        return (ptr - start) / sizeof(max_packet_slot_t);
+    }
+
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+    start = (uintptr_t)small_slots;
+    if(ptr >= start && ptr < (uintptr_t)&small_slots[MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE])
+    {
+        if((ptr - start) % sizeof(small_packet_slot_t) != 0)
+            return SLOT_NONE;
+
+        return MODULE_D7AP_PACKET_QUEUE_SIZE + (ptr - start) / sizeof(small_packet_slot_t);
+    }
+#endif
+
+    return SLOT_NONE;
+}
+
+static inline packet_size_class_t get_size_class(uint8_t slot)
+{
+    return slot < MODULE_D7AP_PACKET_QUEUE_SIZE ? PACKET_SIZE_CLASS_MAX : PACKET_SIZE_CLASS_SMALL;
+}
+
+static packet_t* alloc_slot(packet_size_class_t size_class)
+{
+    uint8_t slot = free_head[size_class];
+    if(slot == SLOT_NONE)
+        return NULL;
+
+    free_head[size_class] = next_free[slot];
+    packet_queue_element_status[slot] = PACKET_QUEUE_ELEMENT_STATUS_ALLOCATED;
+
+    packet_t* packet = get_packet(slot);
+    packet_init(packet);
+    packet->payload = get_payload(slot);
+    DPRINT("Packet queue alloc %p slot %i", packet, slot);
+    return packet;
+}
 
 void packet_queue_init()
 {
-    for(uint8_t i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
+    for(uint8_t i = 0; i < PACKET_SIZE_CLASS_COUNT; i++)
+        free_head[i] = SLOT_NONE;
+
+    // build the free lists back to front so the slots are handed out in order
+    for(int16_t i = SLOT_COUNT - 1; i >= 0; i--)
     {
-        packet_init(&(packet_queue[i]));
+        packet_size_class_t size_class = get_size_class(i);
         packet_queue_element_status[i] = PACKET_QUEUE_ELEMENT_STATUS_FREE;
+        next_free[i] = free_head[size_class];
+        free_head[size_class] = i;
     }
 }
 
 packet_t* packet_queue_alloc_packet()
 {
-    for(uint8_t i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
+    packet_t* packet = alloc_slot(PACKET_SIZE_CLASS_MAX);
+
+    // should not happen, possible to small PACKET_QUEUE_SIZE or not always free()-ed correctly?
+    if(packet == NULL)
+        DPRINT("Packet queue full, could not alloc new packet!");
+
+    return packet;
+}
+
+packet_t* packet_queue_alloc_packet_for_frame(uint16_t frame_length)
+{
+    packet_t* packet = NULL;
+    if(MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0 && frame_length <= MODULE_D7AP_PACKET_SMALL_FRAME_SIZE)
+        packet = alloc_slot(PACKET_SIZE_CLASS_SMALL);
+
+    if(packet == NULL)
+        packet = packet_queue_alloc_packet();
+
+    return packet;
+}
+
+packet_t* packet_queue_ensure_max_size(packet_t* packet)
+{
+    uint8_t slot = get_slot(packet);
+    assert(slot != SLOT_NONE);
+    if(get_size_class(slot) == PACKET_SIZE_CLASS_MAX)
+        return packet;
+
+    packet_t* max_packet = alloc_slot(PACKET_SIZE_CLASS_MAX);
+    if(max_packet == NULL)
     {
-        if(packet_queue_element_status[i] == PACKET_QUEUE_ELEMENT_STATUS_FREE)
-        {
-            packet_queue_element_status[i] = PACKET_QUEUE_ELEMENT_STATUS_ALLOCATED;
-            DPRINT("Packet queue alloc %p slot %i", &(packet_queue[i]), i);
-            return &(packet_queue[i]);
-        }
+        DPRINT("No packet of the maximum size available to move slot %i to", slot);
+        return NULL;
     }
 
-    // should not happen, possible to small PACKET_QUEUE_SIZE or not always free()-ed correctly?
-    DPRINT("Packet queue full, could not alloc new packet!");
-    return NULL;
+    uint8_t* payload = max_packet->payload;
+    memcpy(max_packet, packet, sizeof(packet_t));
+    memcpy(max_packet->hw_radio_packet.data, packet->hw_radio_packet.data, packet->hw_radio_packet.length + 1);
+
+    // a small slot has no payload buffer, so the payload (if any) refers to the frame which moved along
+    if(packet->payload != NULL)
+        max_packet->payload = max_packet->hw_radio_packet.data + (packet->payload - packet->hw_radio_packet.data);
+    else
+        max_packet->payload = payload;
+
+    packet_queue_element_status[get_slot(max_packet)] = packet_queue_element_status[slot];
+    DPRINT("Packet queue moved slot %i to %p", slot, max_packet);
+
+    packet_queue_free_packet(packet);
+    return max_packet;
+}
+
+uint8_t* packet_queue_get_payload_buffer(packet_t* packet)
+{
+    uint8_t slot = get_slot(packet);
+    assert(slot != SLOT_NONE);
+    return get_payload(slot);
 }
 
 void packet_queue_free_packet(packet_t* packet)
 {
     DPRINT("Packet queue mark free %p", packet);
-    for(uint8_t i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
-    {
-        if(packet == &(packet_queue[i]))
-        {
-            DPRINT("packet slot %i", i);
-            assert(packet_queue_element_status[i] >= PACKET_QUEUE_ELEMENT_STATUS_ALLOCATED);
-            packet_queue_element_status[i] = PACKET_QUEUE_ELEMENT_STATUS_FREE;
-            packet_init(&(packet_queue[i]));
-            return;
-        }
-    }
+    uint8_t slot = get_slot(packet);
+    assert(slot != SLOT_NONE); // should never happen
+    DPRINT("packet slot %i", slot);
+    assert(packet_queue_element_status[slot] >= PACKET_QUEUE_ELEMENT_STATUS_ALLOCATED);
+    packet_queue_element_status[slot] = PACKET_QUEUE_ELEMENT_STATUS_FREE;
 
-    assert(false); // should never happen
+    // the packet is cleared on the next alloc, not here
+    packet_size_class_t size_class = get_size_class(slot);
+    next_free[slot] = free_head[size_class];
+    free_head[size_class] = slot;
 }
 
 packet_t* packet_queue_find_packet(hw_radio_packet_t* hw_radio_packet)
 {
-    for(uint8_t i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
-    {
-        if(&(packet_queue[i].hw_radio_packet) == hw_radio_packet)
-            return &(packet_queue[i]);
-    }
+    // the hw_radio_packet_t is embedded in the packet_t, so the owner can be derived directly. Packets which are
+    // not allocated from the queue (like the ones of the engineering mode) are not found.
+    packet_t* packet = (packet_t*)((uint8_t*)hw_radio_packet - offsetof(packet_t, hw_radio_packet));
+    if(get_slot(packet) == SLOT_NONE)
+        return NULL;
 
-    return NULL;
+    return packet;
 }
 
 void packet_queue_mark_processing(packet_t* packet)
 {
     DPRINT("Packet queue mark processing %p", packet);
-    for(uint8_t i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
-    {
-        if(packet == &(packet_queue[i]))
-        {
-            assert(packet_queue_element_status[i] != PACKET_QUEUE_ELEMENT_STATUS_FREE);
-            DPRINT("Packet slot %i", i);
-            packet_queue_element_status[i] = PACKET_QUEUE_ELEMENT_STATUS_PROCESSING;
-            return;
-        }
-    }
-
-    assert(false);
+    uint8_t slot = get_slot(packet);
+    assert(slot != SLOT_NONE);
+    assert(packet_queue_element_status[slot] != PACKET_QUEUE_ELEMENT_STATUS_FREE);
+    DPRINT("Packet slot %i", slot);
+    packet_queue_element_status[slot] = PACKET_QUEUE_ELEMENT_STATUS_PROCESSING;
 }
@@ -33,13 +33,26 @@
 /*! Initializes the packet queue */
 void packet_queue_init();
 
-/*! Returns the first free packet buffer in the queue and marks this as used until this is free()-ed again */
+/*! Returns a free packet buffer of the maximum frame size and marks this as used until this is free()-ed again */
 packet_t* packet_queue_alloc_packet();
 
+/*! Returns a free packet buffer which can hold a received frame of the given length. Short frames use the small size class
+ * (if configured) so more packets can be in flight, the maximum size class is used when no small packet is available */
+packet_t* packet_queue_alloc_packet_for_frame(uint16_t frame_length);
+
+/*! Makes sure the packet can hold a frame and payload of the maximum size, for example before a received request
+ * is turned into a response. A packet of the small size class is moved to the maximum size class and freed. Returns the
+ * packet to continue with, or NULL when no packet of the maximum size is available (the supplied packet is kept then) */
+packet_t* packet_queue_ensure_max_size(packet_t*);
+
+/*! Returns the payload buffer of the slot of a packet of the maximum size class, which can hold PACKET_MAX_PAYLOAD_SIZE bytes.
+ * Packets of the small size class don't have a payload buffer, NULL is returned for those */
+uint8_t* packet_queue_get_payload_buffer(packet_t*);
+
 /*! Marks the packet buffer as free again */
 void packet_queue_free_packet(packet_t*);
 
-/*! Finds the packet_t corresponding to the supplied hw_radio_packet_t */
+/*! Returns the packet_t which owns the supplied hw_radio_packet_t */
 packet_t* packet_queue_find_packet(hw_radio_packet_t*);
 
 /*! Indicates the supplied packet has been successfully received and is ready for further processing */
@@ -25,12 +25,12 @@
 #include "stdbool.h"
 #include "string.h"
 #include "types.h"
-#include "math.h"
 
 #include "debug.h"
 #include "log.h"
 #include "scheduler.h"
 #include "timer.h"
+#include "ng.h"
 
 #include "hwradio.h"
 #include "hwdebug.h"
@@ -129,17 +129,26 @@ typedef enum {
   STATE_CONT_RX
 } state_t;
 
-static hwradio_init_args_t init_args;
-
-static phy_tx_packet_callback_t transmitted_callback;
-static phy_rx_packet_callback_t received_callback;
-
-static state_t state = STATE_IDLE;
-static hw_radio_packet_t *current_packet;
-static bool should_rx_after_tx_completed = false;
-static syncword_class_t current_syncword_class = PHY_SYNCWORD_CLASS0;
-static uint16_t current_syncword = 0;
-static phy_rx_config_t pending_rx_cfg;
+static hwradio_init_args_t NGDEF(_init_args);
+#define init_args NG(_init_args)
+
+static phy_tx_packet_callback_t NGDEF(_transmitted_callback);
+#define transmitted_callback NG(_transmitted_callback)
+static phy_rx_packet_callback_t NGDEF(_received_callback);
+#define received_callback NG(_received_callback)
+
+static state_t NGDEF(_state);
+#define state NG(_state)
+static hw_radio_packet_t *NGDEF(_current_packet);
+#define current_packet NG(_current_packet)
+static bool NGDEF(_should_rx_after_tx_completed);
+#define should_rx_after_tx_completed NG(_should_rx_after_tx_completed)
+static syncword_class_t NGDEF(_current_syncword_class);
+#define current_syncword_class NG(_current_syncword_class)
+static uint16_t NGDEF(_current_syncword);
+#define current_syncword NG(_current_syncword)
+static phy_rx_config_t NGDEF(_pending_rx_cfg);
+#define pending_rx_cfg NG(_pending_rx_cfg)
 
 const channel_id_t default_channel_id = {
   .channel_header.ch_coding = PHY_CODING_PN9,
@@ -150,43 +159,87 @@ const channel_id_t default_channel_id = {
 
 #define EMPTY_CHANNEL_ID { .channel_header_raw = 0xFF, .center_freq_index = 0xFF }
 
-static channel_id_t current_channel_id = EMPTY_CHANNEL_ID;
-
-static uint32_t rx_bw_lo_rate;
-static uint32_t rx_bw_normal_rate;
-static uint32_t rx_bw_hi_rate;
-static bool fact_settings_changed = false;
-
-static uint32_t bitrate_lo_rate;
-static uint32_t fdev_lo_rate;
-static uint32_t bitrate_normal_rate;
-static uint32_t fdev_normal_rate;
-static uint32_t bitrate_hi_rate;
-static uint32_t fdev_hi_rate;
-
-static uint32_t lora_bw;
-static uint8_t lora_SF;
-
-static uint8_t preamble_size_lo_rate;
-static uint8_t preamble_size_normal_rate;
-static uint8_t preamble_size_hi_rate;
-static uint8_t preamble_detector_size_lo_rate;
-static uint8_t preamble_detector_size_normal_rate;
-static uint8_t preamble_detector_size_hi_rate;
-static uint8_t preamble_tol_lo_rate;
-static uint8_t preamble_tol_normal_rate;
-static uint8_t preamble_tol_hi_rate;
-
-static uint8_t rssi_smoothing;
-static uint8_t rssi_offset;
-
-static uint16_t total_bg = 0;
-static uint16_t total_rssi_triggers = 0;
-static uint16_t total_fg = 0;
-static uint16_t total_succeeded_fg = 0;
-static uint8_t write_file_counter = 0;
-
-static uint8_t gain_offset = 0;
+static channel_id_t NGDEF(_current_channel_id);
+#define current_channel_id NG(_current_channel_id)
+
+static uint32_t NGDEF(_rx_bw_lo_rate);
+#define rx_bw_lo_rate NG(_rx_bw_lo_rate)
+static uint32_t NGDEF(_rx_bw_normal_rate);
+#define rx_bw_normal_rate NG(_rx_bw_normal_rate)
+static uint32_t NGDEF(_rx_bw_hi_rate);
+#define rx_bw_hi_rate NG(_rx_bw_hi_rate)
+static bool NGDEF(_fact_settings_changed);
+#define fact_settings_changed NG(_fact_settings_changed)
+
+static uint32_t NGDEF(_bitrate_lo_rate);
+#define bitrate_lo_rate NG(_bitrate_lo_rate)
+static uint32_t NGDEF(_fdev_lo_rate);
+#define fdev_lo_rate NG(_fdev_lo_rate)
+static uint32_t NGDEF(_bitrate_normal_rate);
+#define bitrate_normal_rate NG(_bitrate_normal_rate)
+static uint32_t NGDEF(_fdev_normal_rate);
+#define fdev_normal_rate NG(_fdev_normal_rate)
+static uint32_t NGDEF(_bitrate_hi_rate);
+#define bitrate_hi_rate NG(_bitrate_hi_rate)
+static uint32_t NGDEF(_fdev_hi_rate);
+#define fdev_hi_rate NG(_fdev_hi_rate)
+
+static uint32_t NGDEF(_lora_bw);
+#define lora_bw NG(_lora_bw)
+static uint8_t NGDEF(_lora_SF);
+#define lora_SF NG(_lora_SF)
+
+static uint8_t NGDEF(_preamble_size_lo_rate);
+#define preamble_size_lo_rate NG(_preamble_size_lo_rate)
+static uint8_t NGDEF(_preamble_size_normal_rate);
+#define preamble_size_normal_rate NG(_preamble_size_normal_rate)
+static uint8_t NGDEF(_preamble_size_hi_rate);
+#define preamble_size_hi_rate NG(_preamble_size_hi_rate)
+static uint8_t NGDEF(_preamble_detector_size_lo_rate);
+#define preamble_detector_size_lo_rate NG(_preamble_detector_size_lo_rate)
+static uint8_t NGDEF(_preamble_detector_size_normal_rate);
+#define preamble_detector_size_normal_rate NG(_preamble_detector_size_normal_rate)
+static uint8_t NGDEF(_preamble_detector_size_hi_rate);
+#define preamble_detector_size_hi_rate NG(_preamble_detector_size_hi_rate)
+static uint8_t NGDEF(_preamble_tol_lo_rate);
+#define preamble_tol_lo_rate NG(_preamble_tol_lo_rate)
+static uint8_t NGDEF(_preamble_tol_normal_rate);
+#define preamble_tol_normal_rate NG(_preamble_tol_normal_rate)
+static uint8_t NGDEF(_preamble_tol_hi_rate);
+#define preamble_tol_hi_rate NG(_preamble_tol_hi_rate)
+
+static uint8_t NGDEF(_rssi_smoothing);
+#define rssi_smoothing NG(_rssi_smoothing)
+static uint8_t NGDEF(_rssi_offset);
+#define rssi_offset NG(_rssi_offset)
+
+static uint16_t NGDEF(_total_bg);
+#define total_bg NG(_total_bg)
+static uint16_t NGDEF(_total_rssi_triggers);
+#define total_rssi_triggers NG(_total_rssi_triggers)
+static uint16_t NGDEF(_total_fg);
+#define total_fg NG(_total_fg)
+static uint16_t NGDEF(_total_succeeded_fg);
+#define total_succeeded_fg NG(_total_succeeded_fg)
+static uint8_t NGDEF(_write_file_counter);
+#define write_file_counter NG(_write_file_counter)
+
+static uint8_t NGDEF(_gain_offset);
+#define gain_offset NG(_gain_offset)
+
+// state of the packet which is being decoded while it is received
+static hw_radio_packet_t*NGDEF(_rx_stream_packet);
+#define rx_stream_packet NG(_rx_stream_packet)
+static uint16_t NGDEF(_rx_stream_length); // number of received bytes which are already de-whitened and FEC decoded
+#define rx_stream_length NG(_rx_stream_length)
+static crc_ctx_t NGDEF(_rx_crc); // CRC of the decoded bytes, calculated while the frame is received
+#define rx_crc NG(_rx_crc)
+static uint16_t NGDEF(_rx_crc_length); // number of decoded bytes which are fed to rx_crc
+#define rx_crc_length NG(_rx_crc_length)
+#ifndef HAL_RADIO_USE_HW_FEC
+static fec_decoder_t NGDEF(_rx_fec_decoder);
+#define rx_fec_decoder NG(_rx_fec_decoder)
+#endif
 
 /*
  * FSK packet handler structure
@@ -198,7 +251,8 @@ typedef struct
     uint8_t FifoThresh;
 }FskPacketHandler_t;
 
-FskPacketHandler_t FskPacketHandler;
+static FskPacketHandler_t NGDEF(_FskPacketHandler);
+#define FskPacketHandler NG(_FskPacketHandler)
 
 /*
  * Background advertising packet handler structure
@@ -214,17 +268,19 @@ typedef struct
     timer_tick_t stop_time;
 }bg_adv_t;
 
-bg_adv_t bg_adv;
+static bg_adv_t NGDEF(_bg_adv);
+#define bg_adv NG(_bg_adv)
 
 typedef struct
 {
     uint16_t encoded_length;
     uint8_t encoded_packet[PREAMBLE_HI_RATE_CLASS + 2 + (PACKET_MAX_SIZE + 1)*2]; // include space for preamble and syncword
     uint16_t transmitted_index;
-    bool bg_adv;
+    bool has_bg_adv;
 }fg_frame_t;
 
-fg_frame_t fg_frame;
+static fg_frame_t NGDEF(_fg_frame);
+#define fg_frame NG(_fg_frame)
 
 const uint16_t sync_word_value[2][4] = {
     { 0xE6D0, 0x0000, 0xF498, 0xE6D0 },
@@ -247,19 +303,19 @@ const uint8_t bg_timeout[4] = {
     To_CLASS_HI_RATE
 };
 
-uint16_t end_time;
+static uint16_t NGDEF(_end_time);
+#define end_time NG(_end_time)
 /*!
  * D7A timer used to expire the continuous TX
  */
-static timer_event continuous_tx_expiration_timer;
+static timer_event NGDEF(_continuous_tx_expiration_timer);
+#define continuous_tx_expiration_timer NG(_continuous_tx_expiration_timer)
 
 static void fill_in_fifo(uint16_t remaining_bytes_len);
 
 static hw_radio_packet_t* alloc_new_packet(uint16_t length)
 {
-    // note we don't use length because in the current implementation the packets in the queue are of
-    // fixed (maximum) size
-    packet_t* allocated_packet = packet_queue_alloc_packet();
+    packet_t* allocated_packet = packet_queue_alloc_packet_for_frame(length);
     return allocated_packet == NULL ? NULL : &allocated_packet->hw_radio_packet;
 }
 
@@ -292,6 +348,85 @@ static void packet_transmitted(timer_tick_t timestamp)
     transmitted_callback(packet_queue_find_packet(current_packet));
 }
 
+static uint16_t rx_decoded_length()
+{
+#ifndef HAL_RADIO_USE_HW_FEC
+    if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
+        return rx_fec_decoder.output_length;
+#endif
+    return rx_stream_length;
+}
+
+static uint16_t rx_frame_length(hw_radio_packet_t* hw_radio_packet)
+{
+    if (current_syncword_class == PHY_SYNCWORD_CLASS0)
+        return BACKGROUND_FRAME_LENGTH;
+
+    return hw_radio_packet->data[0] + 1;
+}
+
+static void update_rx_crc(hw_radio_packet_t* hw_radio_packet)
+{
+    // the CRC covers the frame without the CRC itself, the frame length is known once the length byte is decoded
+    uint16_t decoded = rx_decoded_length();
+    if (decoded == 0)
+        return;
+
+    uint16_t frame_length = rx_frame_length(hw_radio_packet);
+    uint16_t crc_length = frame_length < 2 ? 0 : frame_length - 2;
+    if (decoded > crc_length)
+        decoded = crc_length;
+
+    if (decoded > rx_crc_length)
+    {
+        crc_update(&rx_crc, hw_radio_packet->data + rx_crc_length, decoded - rx_crc_length);
+        rx_crc_length = decoded;
+    }
+}
+
+static hw_crc_t rx_crc_status(hw_radio_packet_t* hw_radio_packet)
+{
+    uint16_t frame_length = rx_frame_length(hw_radio_packet);
+    if (frame_length < 2 || rx_decoded_length() < frame_length || rx_crc_length != frame_length - 2)
+        return HW_CRC_INVALID;
+
+    uint16_t crc = __builtin_bswap16(crc_final(&rx_crc));
+    if (memcmp(&crc, hw_radio_packet->data + frame_length - 2, 2) != 0)
+        return HW_CRC_INVALID;
+
+    return HW_CRC_VALID;
+}
+
+static void packet_chunk_received(hw_radio_packet_t* hw_radio_packet, uint16_t offset, uint16_t len)
+{
+    if (offset == 0)
+    {
+        rx_stream_packet = hw_radio_packet;
+        rx_stream_length = 0;
+        crc_init(&rx_crc);
+        rx_crc_length = 0;
+#ifndef HAL_RADIO_USE_HW_FEC
+        // the decoded data is written to the start of the packet buffer, behind the received data
+        if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
+            fec_decoder_init(&rx_fec_decoder, hw_radio_packet->data, hw_radio_packet->length);
+#endif
+    }
+
+    // the chunks are processed in place, so they have to arrive in order
+    assert(hw_radio_packet == rx_stream_packet && offset == rx_stream_length);
+
+#ifndef HAL_RADIO_USE_HW_DC_FREE
+    pn9_encode_offset(hw_radio_packet->data + offset, len, offset);
+#endif
+#ifndef HAL_RADIO_USE_HW_FEC
+    if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
+        fec_decoder_update(&rx_fec_decoder, hw_radio_packet->data + offset, len);
+#endif
+
+    rx_stream_length += len;
+    update_rx_crc(hw_radio_packet);
+}
+
 static void packet_received(hw_radio_packet_t* hw_radio_packet)
 {
     assert(state == STATE_RX || state == STATE_BG_SCAN);
@@ -301,20 +436,28 @@ static void packet_received(hw_radio_packet_t* hw_radio_packet)
 
     packet_t* packet = packet_queue_find_packet(hw_radio_packet);
 
-    DPRINT("Rx packet before decoding <len = %d>", hw_radio_packet->length);
-    DPRINT_DATA(hw_radio_packet->data, hw_radio_packet->length);
+    // normally the radio driver already delivered the packet in chunks which are decoded by now,
+    // only the remainder (or the complete packet if the driver does not support this) is decoded here
+    if (hw_radio_packet != rx_stream_packet)
+        packet_chunk_received(hw_radio_packet, 0, 0);
 
-#ifndef HAL_RADIO_USE_HW_DC_FREE
-    pn9_encode(hw_radio_packet->data, hw_radio_packet->length);
+    if (rx_stream_length < hw_radio_packet->length)
+        packet_chunk_received(hw_radio_packet, rx_stream_length, hw_radio_packet->length - rx_stream_length);
+
+    rx_stream_packet = NULL;
 
-    DPRINT("Rx packet after pn9 encoding <len = %d>", hw_radio_packet->length);
-    DPRINT_DATA(hw_radio_packet->data, hw_radio_packet->length);
-#endif
 #ifndef HAL_RADIO_USE_HW_FEC
     if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
-        fec_decode_packet(hw_radio_packet->data, hw_radio_packet->length, hw_radio_packet->length);
+        fec_decoder_final(&rx_fec_decoder);
 #endif
 
+    // without a hardware CRC, the CRC calculated during the reception is checked here instead of in packet.c
+    if (hw_radio_packet->rx_meta.crc_status == HW_CRC_UNAVAILABLE)
+    {
+        update_rx_crc(hw_radio_packet);
+        hw_radio_packet->rx_meta.crc_status = rx_crc_status(hw_radio_packet);
+    }
+
     if (current_syncword_class == PHY_SYNCWORD_CLASS0)
     {
         packet->type = BACKGROUND_ADV;
@@ -382,50 +525,38 @@ bool phy_radio_channel_ids_equal(const channel_id_t* a, const channel_id_t* b)
 
 uint16_t phy_calculate_tx_duration(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length, bool payload_only)
 {
-    double data_rate = 6.0; // Normal rate: 6.9 bytes/tick
-
-    if (ch_coding == PHY_CODING_FEC_PN9)
-        packet_length = fec_calculated_decoded_length(packet_length);
-
-    if(!payload_only)
-      packet_length += sizeof(uint16_t); // Sync word
-
 #ifdef USE_SX127X
     if(channel_class == PHY_CLASS_LORA) {
+        if (ch_coding == PHY_CODING_FEC_PN9)
+            packet_length = fec_calculated_decoded_length(packet_length);
+
+        if(!payload_only)
+            packet_length += sizeof(uint16_t); // Sync word
+
         // based on http://www.semtech.com/images/datasheet/LoraDesignGuide_STD.pdf
         // only valid for explicit header, CR4/5, SF9 for now
-        uint16_t payload_symbols = 8 + ceil(2*(packet_length+1)/9)*5;
+        uint16_t payload_symbols = 8 + (2*(packet_length+1)/9)*5;
         uint16_t lora_duration = ((1 << lora_SF) * 1000) / lora_bw;
         uint16_t packet_duration = lora_duration * (LORA_T_PREAMBLE_LENGTH + payload_symbols); 
         return packet_duration;
     }
 #endif
 
-    switch (channel_class)
+    uint16_t overhead_length = 0;
+    if(!payload_only)
     {
-    case PHY_CLASS_LO_RATE:
-        if(!payload_only)
-          packet_length += preamble_size_lo_rate;
-
-        data_rate = 1.2; // Lo Rate 9.6 kbps: 1.2 bytes/tick
-        break;
-    case PHY_CLASS_NORMAL_RATE:
-        if(!payload_only)
-          packet_length += preamble_size_normal_rate;
-
-        data_rate = 6.9; // Normal Rate 55.555 kbps: 6.94 bytes/tick
-        break;
-    case PHY_CLASS_HI_RATE:
-        if(!payload_only)
-          packet_length += preamble_tol_hi_rate;
-
-        data_rate = 20.8; // High rate 166.667 kbps: 20.83 byte/tick
-        break;
+        overhead_length = sizeof(uint16_t); // Sync word
+        if(channel_class == PHY_CLASS_LO_RATE)
+            overhead_length += preamble_size_lo_rate;
+        else if(channel_class == PHY_CLASS_NORMAL_RATE)
+            overhead_length += preamble_size_normal_rate;
+        else if(channel_class == PHY_CLASS_HI_RATE)
+            overhead_length += preamble_tol_hi_rate;
     }
 
     // TODO Add the power ramp-up/ramp-down symbols in the packet length?
 
-    return ceil(packet_length / data_rate) + 1;
+    return phy_calculate_airtime(channel_class, ch_coding, packet_length, overhead_length);
 }
 
 static void configure_eirp(eirp_t eirp)
@@ -589,12 +720,14 @@ error_t phy_init(void) {
     error_t ret = SUCCESS;
 
     state = STATE_IDLE;
+    current_channel_id = (channel_id_t)EMPTY_CHANNEL_ID;
 
     init_args.alloc_packet_cb = alloc_new_packet;
     init_args.release_packet_cb = release_packet;
     init_args.rx_packet_cb = packet_received;
     init_args.tx_packet_cb = packet_transmitted;
     init_args.rx_packet_header_cb = packet_header_received;
+    init_args.rx_packet_chunk_cb = packet_chunk_received;
     init_args.tx_refill_cb = fill_in_fifo;
 
     hw_radio_init(&init_args);
@@ -647,8 +780,9 @@ void status_write() {
     write_file_counter++;
     if(write_file_counter == 100) {
         write_file_counter = 0;
-        uint16_t bg_trigger_ratio = 1024 * total_rssi_triggers / total_bg;
-        uint16_t scan_timeout_ratio = 1024 * (total_fg - total_succeeded_fg) / total_fg;
+        // a node which only does foreground scans (or only background scans) has nothing to divide by
+        uint16_t bg_trigger_ratio = total_bg ? 1024 * total_rssi_triggers / total_bg : 0;
+        uint16_t scan_timeout_ratio = total_fg ? 1024 * (total_fg - total_succeeded_fg) / total_fg : 0;
         uint8_t buffer[4] = {(uint8_t)(bg_trigger_ratio >> 8), (uint8_t)(bg_trigger_ratio & 0xFF), (uint8_t)(scan_timeout_ratio >> 8), (uint8_t)(scan_timeout_ratio & 0xFF)};
         d7ap_fs_write_file(D7A_FILE_DLL_STATUS_FILE_ID, 8, buffer, 4, ROOT_AUTH);
         DPRINT("wrote to file 0x%02X the bg trigger ratio %d and scan timeout ratio %d", D7A_FILE_DLL_STATUS_FILE_ID, bg_trigger_ratio, scan_timeout_ratio);
@@ -721,22 +855,30 @@ error_t phy_stop_rx(){
 
 static uint16_t encode_packet(hw_radio_packet_t* packet, uint8_t* encoded_packet)
 {
-    uint16_t encoded_len = packet->length;
-    memcpy(encoded_packet, packet->data, packet->length);
-
+    // the packet is kept intact for retransmissions, the first encoding step reads it directly so the frame
+    // is not copied to the encode buffer separately
 #ifndef HAL_RADIO_USE_HW_FEC
     if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
-        encoded_len = fec_encode(encoded_packet, packet->length);
-#endif
+    {
+        uint16_t encoded_len = fec_encode_copy(encoded_packet, packet->data, packet->length);
 
-    DPRINT("AFTER FEC ENCODING TX len=%d", encoded_len);
-    DPRINT_DATA(encoded_packet, encoded_len);
+        DPRINT("AFTER FEC ENCODING TX len=%d", encoded_len);
+        DPRINT_DATA(encoded_packet, encoded_len);
+
+#ifndef HAL_RADIO_USE_HW_DC_FREE
+        pn9_encode(encoded_packet, encoded_len);
+#endif
+        return encoded_len;
+    }
+#endif
 
 #ifndef HAL_RADIO_USE_HW_DC_FREE
-    pn9_encode(encoded_packet, encoded_len);
+    pn9_encode_copy(encoded_packet, packet->data, packet->length);
+#else
+    memcpy(encoded_packet, packet->data, packet->length);
 #endif
 
-    return encoded_len;
+    return packet->length;
 }
 
 error_t phy_send_packet(hw_radio_packet_t* packet, phy_tx_config_t* config, phy_tx_packet_callback_t tx_callback)
@@ -879,7 +1021,7 @@ error_t phy_send_packet_with_advertising(hw_radio_packet_t* packet, phy_tx_confi
     DPRINT_DATA(packet->data, packet->length);
 
     DPRINT("tx_duration_bg_frame %i", bg_adv.tx_duration);
-    fg_frame.bg_adv = true;
+    fg_frame.has_bg_adv = true;
     memset(fg_frame.encoded_packet, 0xAA, preamble_len);
     sync_word = __builtin_bswap16(sync_word_value[PHY_SYNCWORD_CLASS1][current_channel_id.channel_header.ch_coding]);
     memcpy(&fg_frame.encoded_packet[preamble_len], &sync_word, 2);
@@ -923,7 +1065,7 @@ static void fill_in_fifo(uint16_t remaining_bytes_len)
     // TODO adapt how we calculate ETA. There is no reason to use current time for each ETA update, we can just use the BG frame duration
     // and a frame counter to determine this.
 
-    if (fg_frame.bg_adv)
+    if (fg_frame.has_bg_adv)
     {
         DEBUG_BG_END();
         timer_tick_t current = timer_get_counter_value();
@@ -975,7 +1117,7 @@ static void fill_in_fifo(uint16_t remaining_bytes_len)
             DEBUG_BG_END();
 
             bg_adv.eta = 0;
-            fg_frame.bg_adv = false;
+            fg_frame.has_bg_adv = false;
         }
     }
     else
@@ -1069,7 +1211,7 @@ void phy_continuous_tx(phy_tx_config_t const* tx_cfg, uint8_t time_period, phy_t
         timer_add_event(&continuous_tx_expiration_timer);
     }
 
-    fg_frame.bg_adv = false;
+    fg_frame.has_bg_adv = false;
     if (current_channel_id.channel_header.ch_coding == PHY_CODING_FEC_PN9)
     {
         uint8_t payload_len = 32;
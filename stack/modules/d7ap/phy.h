@@ -258,8 +258,20 @@ error_t phy_start_background_scan(phy_rx_config_t* config, phy_rx_packet_callbac
  */
 bool phy_radio_channel_ids_equal(const channel_id_t* a, const channel_id_t* b);
 
+/** \brief Calculate the airtime of a frame, including the preamble and sync word unless payload_only is set.
+ *
+ * \return uint16_t The airtime in timer ticks.
+ */
 uint16_t phy_calculate_tx_duration(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length, bool payload_only);
 
+/** \brief Calculate the airtime of packet_length bytes, encoded with ch_coding, followed or preceded by
+ *         overhead_length bytes which are not encoded (preamble, sync word). Only integer arithmetic is used, so this
+ *         is cheap enough to be used from interrupt context. LoRa timing is not covered, see phy_calculate_tx_duration().
+ *
+ * \return uint16_t The airtime in timer ticks.
+ */
+uint16_t phy_calculate_airtime(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length, uint16_t overhead_length);
+
 void phy_continuous_tx(phy_tx_config_t const* tx_cfg, uint8_t time_period, phy_tx_packet_callback_t tx_cb);
 
 error_t phy_init();
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Airtime of a frame in timer ticks, without floating point or division.
+ *
+ * Each channel class transmits a fixed, fractional number of bytes per tick (e.g. 6.9 bytes per tick at normal rate).
+ * The airtime is the number of ticks needed for the frame, rounded up, plus one tick margin:
+ *     ticks = ceil(bytes * ticks_per_rate / bytes_per_rate) + 1
+ * The division by bytes_per_rate is replaced by a multiplication with its reciprocal in fixed point. With
+ * PHY_AIRTIME_SHIFT bits of precision this gives exactly the same result for frames up to PHY_AIRTIME_MAX_BYTES,
+ * which is checked exhaustively by tests/phy_airtime. Longer frames do not exist, but are still calculated correctly
+ * using a division.
+ */
+
+#include "phy.h"
+#include "fec.h"
+
+#define PHY_AIRTIME_SHIFT 20
+#define PHY_AIRTIME_MAX_BYTES 2047
+
+typedef struct
+{
+    uint8_t bytes;       // bytes_per_rate
+    uint8_t ticks;       // ticks_per_rate
+    uint32_t reciprocal; // ceil(2^PHY_AIRTIME_SHIFT / bytes)
+} phy_airtime_rate_t;
+
+#define PHY_AIRTIME_RATE(bytes_, ticks_) \
+    { .bytes = bytes_, .ticks = ticks_, .reciprocal = ((1UL << PHY_AIRTIME_SHIFT) + bytes_ - 1) / bytes_ }
+
+static const phy_airtime_rate_t rates[] = {
+    [PHY_CLASS_LO_RATE] = PHY_AIRTIME_RATE(6, 5),       // 9.6 kbps: 1.2 bytes/tick
+    [0x01] = PHY_AIRTIME_RATE(6, 1),                    // LoRa is timed by the PHY itself, the default is 6 bytes/tick
+    [PHY_CLASS_NORMAL_RATE] = PHY_AIRTIME_RATE(69, 10), // 55.555 kbps: 6.9 bytes/tick
+    [PHY_CLASS_HI_RATE] = PHY_AIRTIME_RATE(104, 5),     // 166.667 kbps: 20.8 bytes/tick
+};
+
+uint16_t phy_calculate_airtime(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length,
+                               uint16_t overhead_length)
+{
+    if (ch_coding == PHY_CODING_FEC_PN9)
+        packet_length = fec_calculated_decoded_length(packet_length);
+
+    uint32_t bytes = (uint16_t)(packet_length + overhead_length);
+    const phy_airtime_rate_t* rate = &rates[channel_class & 0x03];
+    uint32_t scaled = bytes * rate->ticks + rate->bytes - 1;
+    if (bytes > PHY_AIRTIME_MAX_BYTES)
+        return scaled / rate->bytes + 1;
+
+    return ((scaled * rate->reciprocal) >> PHY_AIRTIME_SHIFT) + 1;
+}
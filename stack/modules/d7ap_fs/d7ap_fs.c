@@ -26,6 +26,7 @@
 #include "framework_defs.h"
 #include "string.h"
 #include "debug.h"
+#include "ng.h"
 #include "fs.h"
 #include "d7ap.h"
 #include "d7ap_fs.h"
@@ -64,15 +65,93 @@
 #define IS_SYSTEM_FILE(file_id) (file_id <= 0x3F)
 
 #define FILE_SIZE_MAX (MODULE_D7AP_FS_FILE_SIZE_MAX + sizeof(d7ap_fs_file_header_t))
-static uint8_t file_buffer[FILE_SIZE_MAX]; // statically allocated buffer used during file operations, to prevent stack overflow at runtime
+// statically allocated buffer used during file operations, to prevent stack overflow at runtime.
+// It does not hold state between calls, so it is not kept per node (see ng.h)
+static uint8_t file_buffer[FILE_SIZE_MAX];
 
-static d7ap_fs_modified_file_callback_t file_modified_callbacks[FRAMEWORK_FS_FILE_COUNT] = { NULL }; // TODO limit to lower number so save RAM?
-static d7ap_fs_modifying_file_callback_t file_modifying_callbacks[FRAMEWORK_FS_FILE_COUNT] = { NULL };
+static d7ap_fs_modified_file_callback_t NGDEF(_file_modified_callbacks)[FRAMEWORK_FS_FILE_COUNT]; // TODO limit to lower number so save RAM?
+#define file_modified_callbacks NG(_file_modified_callbacks)
+static d7ap_fs_modifying_file_callback_t NGDEF(_file_modifying_callbacks)[FRAMEWORK_FS_FILE_COUNT];
+#define file_modifying_callbacks NG(_file_modifying_callbacks)
+
+#define HEADER_CACHE_NO_FILE 0xFF
+
+#if MODULE_D7AP_FS_HEADER_CACHE_SIZE > 0
+// the decoded (native endian) headers of the most recently accessed files, kept coherent with the stored headers
+typedef struct
+{
+  d7ap_fs_file_header_t header;
+  uint32_t last_used;
+  uint8_t file_id;
+} header_cache_entry_t;
+
+static header_cache_entry_t NGDEF(_header_cache)[MODULE_D7AP_FS_HEADER_CACHE_SIZE];
+#define header_cache NG(_header_cache)
+static uint32_t NGDEF(_header_cache_clock);
+#define header_cache_clock NG(_header_cache_clock)
+#endif
+
+static d7ap_fs_header_cache_stats_t NGDEF(_header_cache_stats);
+#define header_cache_stats NG(_header_cache_stats)
+
+static void header_cache_invalidate()
+{
+#if MODULE_D7AP_FS_HEADER_CACHE_SIZE > 0
+  for(uint8_t i = 0; i < MODULE_D7AP_FS_HEADER_CACHE_SIZE; i++)
+  {
+    header_cache[i].file_id = HEADER_CACHE_NO_FILE;
+    header_cache[i].last_used = 0;
+  }
+
+  header_cache_clock = 0;
+#endif
+}
+
+static bool header_cache_lookup(uint8_t file_id, d7ap_fs_file_header_t* file_header)
+{
+#if MODULE_D7AP_FS_HEADER_CACHE_SIZE > 0
+  for(uint8_t i = 0; i < MODULE_D7AP_FS_HEADER_CACHE_SIZE; i++)
+  {
+    if(header_cache[i].file_id == file_id)
+    {
+      header_cache[i].last_used = ++header_cache_clock;
+      *file_header = header_cache[i].header;
+      header_cache_stats.hits++;
+      return true;
+    }
+  }
+#endif
+
+  header_cache_stats.misses++;
+  return false;
+}
+
+static void header_cache_store(uint8_t file_id, const d7ap_fs_file_header_t* file_header)
+{
+#if MODULE_D7AP_FS_HEADER_CACHE_SIZE > 0
+  header_cache_entry_t* entry = &header_cache[0];
+  for(uint8_t i = 0; i < MODULE_D7AP_FS_HEADER_CACHE_SIZE; i++)
+  {
+    if(header_cache[i].file_id == file_id)
+    {
+      entry = &header_cache[i];
+      break;
+    }
+
+    // evict the least recently used entry, unused entries have the lowest timestamp
+    if(header_cache[i].last_used < entry->last_used)
+      entry = &header_cache[i];
+  }
+
+  entry->file_id = file_id;
+  entry->header = *file_header;
+  entry->last_used = ++header_cache_clock;
+#endif
+}
 
 static inline bool is_file_defined(uint8_t file_id)
 {
-    fs_file_stat_t *stat = fs_file_stat(file_id);
-    return (stat != NULL);
+    return fs_file_stat(file_id, NULL) == 0;
 }
 
 #if defined(MODULE_ALP) && defined(MODULE_D7AP)
@@ -104,6 +183,13 @@ void d7ap_fs_init()
 {
   //init fs with the D7A specific system files
   fs_init();
+  header_cache_invalidate();
+
+  // the security state must survive an unexpected reset
+  fs_set_write_through(D7A_FILE_NWL_SECURITY_KEY, true);
+  fs_set_write_through(D7A_FILE_NWL_SECURITY, true);
+  fs_set_write_through(D7A_FILE_NWL_SECURITY_STATE_REG, true);
+  fs_set_write_through(D7A_FILE_NWL_SSR_EVICTED_NODES, true);
 
   // TODO platform specific
   // TODO set FW version
@@ -160,7 +246,11 @@ int d7ap_fs_init_file_on_blockdevice(
         memcpy(file_buffer + sizeof(d7ap_fs_file_header_t), initial_data, file_header->length);
     }
        
-    return fs_init_file(file_id, blockdevice_index, (const uint8_t *)file_buffer, length, sizeof(d7ap_fs_file_header_t) + file_header->allocated_length);
+    int rtc = fs_init_file(file_id, blockdevice_index, (const uint8_t *)file_buffer, length, sizeof(d7ap_fs_file_header_t) + file_header->allocated_length);
+    if(rtc == 0)
+      header_cache_store(file_id, file_header);
+
+    return rtc;
 }
 
 int d7ap_fs_read_file(uint8_t file_id, uint32_t offset, uint8_t* buffer, uint32_t* length, authentication_t auth)
@@ -211,6 +301,9 @@ int d7ap_fs_read_file_header(uint8_t file_id, d7ap_fs_file_header_t* file_header
   int rtc;
   if(!is_file_defined(file_id)) return -ENOENT;
 
+  if(header_cache_lookup(file_id, file_header))
+    return 0;
+
   rtc = fs_read_file(file_id, 0, (uint8_t *)file_header, sizeof(d7ap_fs_file_header_t));
   if (rtc != 0)
     return rtc;
@@ -221,6 +314,7 @@ int d7ap_fs_read_file_header(uint8_t file_id, d7ap_fs_file_header_t* file_header
   file_header->allocated_length = __builtin_bswap32(file_header->allocated_length);
 #endif
 
+  header_cache_store(file_id, file_header);
   return 0;
 }
 
@@ -238,12 +332,17 @@ int d7ap_fs_write_file_header(uint8_t file_id, d7ap_fs_file_header_t* file_heade
 #endif
 
   // Input of data shall be in big-endian ordering
+  header = *file_header;
 #if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
-  file_header->length = __builtin_bswap32(file_header->length);
-  file_header->allocated_length = __builtin_bswap32(file_header->allocated_length);
+  header.length = __builtin_bswap32(header.length);
+  header.allocated_length = __builtin_bswap32(header.allocated_length);
 #endif
 
-  return (fs_write_file(file_id, 0, (const uint8_t*)file_header, sizeof(d7ap_fs_file_header_t)));
+  int rtc = fs_write_file(file_id, 0, (const uint8_t*)&header, sizeof(d7ap_fs_file_header_t));
+  if(rtc == 0)
+    header_cache_store(file_id, file_header);
+
+  return rtc;
 }
 
 int d7ap_fs_write_file(uint8_t file_id, uint32_t offset, const uint8_t* buffer, uint32_t length, authentication_t auth)
@@ -350,22 +449,37 @@ int d7ap_fs_write_nwl_security(dae_nwl_security_t *nwl_security)
   return (d7ap_fs_write_file(D7A_FILE_NWL_SECURITY, 0, (uint8_t*)&sec, D7A_FILE_NWL_SECURITY_SIZE, ROOT_AUTH));
 }
 
+// a register entry is stored as key counter, frame counter (big endian) and UID, without the padding of the struct
+#define SSR_ENTRY_SIZE (D7A_FILE_NWL_SECURITY_SIZE + D7A_FILE_UID_SIZE)
+
 int d7ap_fs_read_nwl_security_state_register(dae_nwl_ssr_t *node_security_state)
 {
   int rtc;
-  uint32_t length = sizeof(dae_nwl_ssr_t);
+  uint8_t entry[SSR_ENTRY_SIZE];
+  uint32_t length = 2;
 
   if(!is_file_defined(D7A_FILE_NWL_SECURITY_STATE_REG)) return -ENOENT;
 
-  rtc = (d7ap_fs_read_file(D7A_FILE_NWL_SECURITY_STATE_REG, 0,
-                           (uint8_t*)node_security_state, &length, ROOT_AUTH));
+  rtc = d7ap_fs_read_file(D7A_FILE_NWL_SECURITY_STATE_REG, 0, entry, &length, ROOT_AUTH);
   if (rtc != 0)
     return rtc;
 
-   // correct endiannes
+  node_security_state->filter_mode = entry[0];
+  node_security_state->trusted_node_nb = entry[1];
+  if (node_security_state->trusted_node_nb > FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE)
+    node_security_state->trusted_node_nb = FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE;
+
   for(uint8_t i = 0; i < node_security_state->trusted_node_nb; i++)
   {
-    node_security_state->trusted_node_table[i].frame_counter = (uint32_t)__builtin_bswap32(node_security_state->trusted_node_table[i].frame_counter);
+    dae_nwl_trusted_node_t* node = &node_security_state->trusted_node_table[i];
+    length = SSR_ENTRY_SIZE;
+    rtc = d7ap_fs_read_file(D7A_FILE_NWL_SECURITY_STATE_REG, 2 + i * SSR_ENTRY_SIZE, entry, &length, ROOT_AUTH);
+    if (rtc != 0)
+      return rtc;
+
+    node->key_counter = entry[0];
+    node->frame_counter = (uint32_t)entry[1] << 24 | (uint32_t)entry[2] << 16 | (uint32_t)entry[3] << 8 | entry[4];
+    memcpy(node->addr, &entry[5], D7A_FILE_UID_SIZE);
   }
 
   return rtc;
@@ -375,25 +489,27 @@ static int write_security_state_register_entry(dae_nwl_trusted_node_t *trusted_n
 {
   assert(trusted_node_nb <= FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE);
 
-  uint16_t entry_offset = (D7A_FILE_NWL_SECURITY_SIZE + D7A_FILE_UID_SIZE)*(trusted_node_nb - 1) + 2;
-  // correct endiannes before writing
-  dae_nwl_trusted_node_t node;
-  memcpy(&node, trusted_node, sizeof(dae_nwl_trusted_node_t));
-  node.frame_counter = __builtin_bswap32(node.frame_counter);
-  return (d7ap_fs_write_file(D7A_FILE_NWL_SECURITY, entry_offset, (uint8_t*)&node, sizeof(dae_nwl_trusted_node_t), ROOT_AUTH));
+  uint16_t entry_offset = SSR_ENTRY_SIZE * (trusted_node_nb - 1) + 2;
+  uint8_t entry[SSR_ENTRY_SIZE];
+  entry[0] = trusted_node->key_counter;
+  entry[1] = trusted_node->frame_counter >> 24;
+  entry[2] = trusted_node->frame_counter >> 16;
+  entry[3] = trusted_node->frame_counter >> 8;
+  entry[4] = trusted_node->frame_counter;
+  memcpy(&entry[5], trusted_node->addr, D7A_FILE_UID_SIZE);
+  return (d7ap_fs_write_file(D7A_FILE_NWL_SECURITY_STATE_REG, entry_offset, entry, SSR_ENTRY_SIZE, ROOT_AUTH));
 }
 
 int d7ap_fs_add_nwl_security_state_register_entry(dae_nwl_trusted_node_t *trusted_node,
                                                   uint8_t trusted_node_nb)
 {
-  // TODO test
   assert(trusted_node_nb <= FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE);
   if(!is_file_defined(D7A_FILE_NWL_SECURITY_STATE_REG)) return -ENOENT;
 
   // first add the new entry ...
   write_security_state_register_entry(trusted_node, trusted_node_nb);
   // ... and finally update the node count
-  return (d7ap_fs_write_file(D7A_FILE_NWL_SECURITY, 1, &trusted_node_nb, 1, ROOT_AUTH));
+  return (d7ap_fs_write_file(D7A_FILE_NWL_SECURITY_STATE_REG, 1, &trusted_node_nb, 1, ROOT_AUTH));
 }
 
 int d7ap_fs_update_nwl_security_state_register(dae_nwl_trusted_node_t *trusted_node,
@@ -404,6 +520,44 @@ int d7ap_fs_update_nwl_security_state_register(dae_nwl_trusted_node_t *trusted_n
   return (write_security_state_register_entry(trusted_node, trusted_node_index));
 }
 
+// the evicted nodes file holds the evicted nodes, each stored as UID and frame counter. The frame counters are big
+// endian, an entry with frame counter 0 is free.
+int d7ap_fs_get_nwl_ssr_evicted_node_count(void)
+{
+  if(!is_file_defined(D7A_FILE_NWL_SSR_EVICTED_NODES)) return -ENOENT;
+
+  uint32_t count = d7ap_fs_get_file_length(D7A_FILE_NWL_SSR_EVICTED_NODES) / D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE;
+  return count > UINT16_MAX ? UINT16_MAX : count;
+}
+
+int d7ap_fs_read_nwl_ssr_evicted_node(dae_nwl_evicted_node_t *evicted_node, uint16_t index)
+{
+  uint8_t entry[D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE];
+  uint32_t length = D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE;
+
+  int rtc = d7ap_fs_read_file(D7A_FILE_NWL_SSR_EVICTED_NODES, index * D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE, entry, &length,
+                              ROOT_AUTH);
+  if (rtc != 0)
+    return rtc;
+
+  memcpy(evicted_node->addr, entry, D7A_FILE_UID_SIZE);
+  evicted_node->next_frame_counter = (uint32_t)entry[D7A_FILE_UID_SIZE] << 24 | (uint32_t)entry[D7A_FILE_UID_SIZE + 1] << 16
+                                     | (uint32_t)entry[D7A_FILE_UID_SIZE + 2] << 8 | entry[D7A_FILE_UID_SIZE + 3];
+  return 0;
+}
+
+int d7ap_fs_write_nwl_ssr_evicted_node(const dae_nwl_evicted_node_t *evicted_node, uint16_t index)
+{
+  uint8_t entry[D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE];
+  memcpy(entry, evicted_node->addr, D7A_FILE_UID_SIZE);
+  entry[D7A_FILE_UID_SIZE] = evicted_node->next_frame_counter >> 24;
+  entry[D7A_FILE_UID_SIZE + 1] = evicted_node->next_frame_counter >> 16;
+  entry[D7A_FILE_UID_SIZE + 2] = evicted_node->next_frame_counter >> 8;
+  entry[D7A_FILE_UID_SIZE + 3] = evicted_node->next_frame_counter;
+  return (d7ap_fs_write_file(D7A_FILE_NWL_SSR_EVICTED_NODES, index * D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE, entry,
+                             D7A_FILE_NWL_SSR_EVICTED_NODE_SIZE, ROOT_AUTH));
+}
+
 int d7ap_fs_read_access_class(uint8_t access_class_index, dae_access_profile_t *access_class)
 {
   uint32_t length = D7A_FILE_ACCESS_PROFILE_SIZE;
@@ -448,6 +602,11 @@ int d7ap_fs_write_dll_conf_active_access_class(uint8_t access_class)
   return (d7ap_fs_write_file(D7A_FILE_DLL_CONF_FILE_ID, 0, &access_class, 1, ROOT_AUTH));
 }
 
+const d7ap_fs_header_cache_stats_t* d7ap_fs_get_header_cache_stats()
+{
+  return &header_cache_stats;
+}
+
 uint32_t d7ap_fs_get_file_length(uint8_t file_id)
 {
   d7ap_fs_file_header_t header;
@@ -480,7 +639,7 @@ bool d7ap_fs_unregister_file_modified_callback(uint8_t file_id) {
 
 bool d7ap_fs_register_file_modified_callback(uint8_t file_id, d7ap_fs_modified_file_callback_t callback)
 {
-    if(!fs_file_stat(file_id))
+    if(fs_file_stat(file_id, NULL) != 0)
         return false;
 
     if(file_modified_callbacks[file_id])
@@ -500,7 +659,7 @@ bool d7ap_fs_unregister_file_modifying_callback(uint8_t file_id) {
 
 bool d7ap_fs_register_file_modifying_callback(uint8_t file_id, d7ap_fs_modifying_file_callback_t callback)
 {
-    if(!fs_file_stat(file_id))
+    if(fs_file_stat(file_id, NULL) != 0)
         return false;
 
     if(file_modifying_callbacks[file_id])
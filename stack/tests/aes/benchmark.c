@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aes.h"
+#include "errors.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_BYTES (4 * 1024 * 1024)
+#define FRAME_SIZE 160 // a typical secured D7A payload
+
+static const uint8_t nwl_key[AES_BLOCK_SIZE] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static aes128_ctx_t nwl_ctx;
+static uint8_t frame[FRAME_SIZE + AES_BLOCK_SIZE];
+static uint8_t iv[AES_BLOCK_SIZE];
+static uint8_t ctr_blk[AES_BLOCK_SIZE];
+static uint8_t add[8];
+
+static inline uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void test_ecb()
+{
+    // FIPS-197 appendix C.1
+    static const uint8_t key[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+    static const uint8_t pt[] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+    static const uint8_t ct[] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+    aes128_ctx_t ctx;
+    uint8_t block[AES_BLOCK_SIZE];
+
+    AES128_init_ctx(&ctx, key);
+    AES128_ECB_encrypt_ctx(&ctx, pt, block);
+    assert(memcmp(block, ct, AES_BLOCK_SIZE) == 0);
+
+    // in place
+    AES128_ECB_decrypt_ctx(&ctx, block, block);
+    assert(memcmp(block, pt, AES_BLOCK_SIZE) == 0);
+    AES128_ECB_encrypt_ctx(&ctx, block, block);
+    assert(memcmp(block, ct, AES_BLOCK_SIZE) == 0);
+    printf("AES ECB OK\n");
+}
+
+static void test_ccm()
+{
+    const aes128_ctx_t *key = &nwl_ctx;
+    uint8_t plain[FRAME_SIZE];
+    for (uint8_t i = 0; i < FRAME_SIZE; i++)
+        plain[i] = i;
+
+    for (uint8_t length = 0; length <= FRAME_SIZE; length += 7) {
+        memcpy(frame, plain, length);
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_encrypt_ctx(key, frame, length, iv, add, sizeof(add), ctr_blk, 8) == SUCCESS);
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_decrypt_ctx(key, frame, length, iv, add, sizeof(add), ctr_blk, frame + length, 8) == SUCCESS);
+        assert(memcmp(frame, plain, length) == 0);
+
+        // a modified frame is rejected
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_encrypt_ctx(key, frame, length, iv, add, sizeof(add), ctr_blk, 8) == SUCCESS);
+        frame[length / 2] ^= 0x01;
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_decrypt_ctx(key, frame, length, iv, add, sizeof(add), ctr_blk, frame + length, 8) != SUCCESS);
+    }
+
+    printf("AES CCM OK\n");
+}
+
+// feeding the additional data and the payload in arbitrary segments gives the same result as the one shot API
+static void test_ccm_streaming()
+{
+    const aes128_ctx_t *key = &nwl_ctx;
+    uint8_t expected[FRAME_SIZE + AES_BLOCK_SIZE];
+    uint8_t auth[AES_BLOCK_SIZE];
+    aes128_ccm_ctx_t ccm;
+
+    for (uint8_t i = 0; i < sizeof(add); i++)
+        add[i] = 0xA0 + i;
+
+    for (uint8_t step = 1; step <= 37; step += 3) {
+        for (uint8_t i = 0; i < FRAME_SIZE; i++)
+            frame[i] = expected[i] = i * step;
+
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_encrypt_ctx(key, expected, FRAME_SIZE, iv, add, sizeof(add), ctr_blk, 16) == SUCCESS);
+
+        memset(ctr_blk, 0x5A, AES_BLOCK_SIZE);
+        assert(AES128_CCM_init(&ccm, key, iv, sizeof(add), ctr_blk, 16) == SUCCESS);
+        AES128_CCM_update_aad(&ccm, add, 3);
+        AES128_CCM_update_aad(&ccm, add + 3, sizeof(add) - 3);
+        for (uint16_t offset = 0; offset < FRAME_SIZE; offset += step)
+            AES128_CCM_encrypt_update(&ccm, frame + offset, offset + step > FRAME_SIZE ? FRAME_SIZE - offset : step);
+        AES128_CCM_finish(&ccm, auth);
+        assert(memcmp(frame, expected, FRAME_SIZE) == 0);
+        assert(memcmp(auth, expected + FRAME_SIZE, 16) == 0);
+
+        assert(AES128_CCM_init(&ccm, key, iv, sizeof(add), ctr_blk, 16) == SUCCESS);
+        AES128_CCM_update_aad(&ccm, add, sizeof(add));
+        for (uint16_t offset = 0; offset < FRAME_SIZE; offset += step)
+            AES128_CCM_decrypt_update(&ccm, frame + offset, offset + step > FRAME_SIZE ? FRAME_SIZE - offset : step);
+        assert(AES128_CCM_verify(&ccm, auth) == SUCCESS);
+        for (uint8_t i = 0; i < FRAME_SIZE; i++)
+            assert(frame[i] == (uint8_t)(i * step));
+
+        // the CBC-MAC only mode matches the one shot API as well
+        assert(AES128_CBC_MAC_ctx(key, expected, frame, FRAME_SIZE, iv, add, sizeof(add), 8) == SUCCESS);
+        assert(AES128_CCM_init(&ccm, key, iv, sizeof(add), NULL, 8) == SUCCESS);
+        AES128_CCM_update_aad(&ccm, add, sizeof(add));
+        for (uint16_t offset = 0; offset < FRAME_SIZE; offset += step)
+            AES128_CCM_authenticate(&ccm, frame + offset, offset + step > FRAME_SIZE ? FRAME_SIZE - offset : step);
+        AES128_CCM_finish(&ccm, auth);
+        assert(memcmp(auth, expected, 8) == 0);
+    }
+
+    assert(AES128_CCM_init(&ccm, key, iv, sizeof(add), ctr_blk, 6) == EINVAL);
+    assert(AES128_CCM_init(&ccm, key, iv, 32, ctr_blk, 8) == EINVAL);
+
+    printf("AES CCM streaming OK\n");
+}
+
+static void report(const char *name, struct timespec *start, struct timespec *stop, uint64_t cycles, double bytes)
+{
+    double ns = (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+    printf("%-8s %6.2f ns/byte, %6.2f cycles/byte\n", name, ns / bytes, cycles / bytes);
+}
+
+#define BENCHMARK(name, operation) do { \
+    struct timespec start, stop; \
+    uint32_t rounds = BENCHMARK_BYTES / FRAME_SIZE; \
+    clock_gettime(CLOCK_MONOTONIC, &start); \
+    uint64_t cycles = read_cycles(); \
+    for (uint32_t i = 0; i < rounds; i++) \
+        operation; \
+    cycles = read_cycles() - cycles; \
+    clock_gettime(CLOCK_MONOTONIC, &stop); \
+    report(name, &start, &stop, cycles, (double) rounds * FRAME_SIZE); \
+} while (0)
+
+int main()
+{
+    AES128_init_ctx(&nwl_ctx, nwl_key);
+    test_ecb();
+    test_ccm();
+    test_ccm_streaming();
+
+    const aes128_ctx_t *key = &nwl_ctx;
+    uint8_t auth[AES_BLOCK_SIZE];
+
+    BENCHMARK("CTR", AES128_CTR_encrypt_ctx(key, frame, frame, FRAME_SIZE, ctr_blk));
+    BENCHMARK("CBC-MAC", AES128_CBC_MAC_ctx(key, auth, frame, FRAME_SIZE, iv, add, sizeof(add), 8));
+    BENCHMARK("CCM", AES128_CCM_encrypt_ctx(key, frame, FRAME_SIZE, iv, add, sizeof(add), ctr_blk, 8));
+
+    // the key expanded for every frame, as when it is not kept expanded
+    aes128_ctx_t ctx;
+    BENCHMARK("CCM+key", (AES128_init_ctx(&ctx, nwl_key), AES128_CCM_encrypt_ctx(&ctx, frame, FRAME_SIZE, iv, add, sizeof(add), ctr_blk, 8)));
+
+    printf("AES benchmark done!\n");
+    return 0;
+}
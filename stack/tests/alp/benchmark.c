@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Measures the number of ALP actions parsed per second, by alp_parse_action() (which pops every operand from the
+ * command fifo) and by alp_index_command() (one pass over the command).
+ * A recorded corpus can be supplied as argument: a file of commands, each preceded by a length byte. Otherwise
+ * a corpus is generated.
+ */
+
+#include "corpus.h"
+
+#include "alp.h"
+#include "fifo.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_COMMAND_COUNT 4096
+#define GENERATED_COMMAND_COUNT 4096
+#define BENCHMARK_ROUNDS 50
+#define MAX_ACTIONS 64
+
+typedef struct {
+    uint16_t length;
+    uint8_t data[ALP_PAYLOAD_MAX_SIZE];
+} recorded_command_t;
+
+static recorded_command_t corpus[MAX_COMMAND_COUNT];
+static uint16_t command_count = 0;
+static uint8_t command_storage[ALP_PAYLOAD_MAX_SIZE];
+static alp_command_t command = { .alp_command = command_storage };
+static alp_action_index_t actions[MAX_ACTIONS];
+
+static void load_corpus(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if(file == NULL) {
+        printf("Could not open %s\n", path);
+        exit(1);
+    }
+
+    int length;
+    while(command_count < MAX_COMMAND_COUNT && (length = fgetc(file)) != EOF) {
+        if(fread(corpus[command_count].data, 1, length, file) != (size_t)length)
+            break;
+
+        corpus[command_count++].length = length;
+    }
+
+    fclose(file);
+    printf("Loaded %u commands from %s\n", command_count, path);
+}
+
+static void generate_corpus()
+{
+    uint8_t action_count, expected_response_length;
+    for(command_count = 0; command_count < GENERATED_COMMAND_COUNT; command_count++)
+        corpus[command_count].length = corpus_generate_command(corpus[command_count].data, &action_count, &expected_response_length);
+
+    printf("Generated %u commands\n", command_count);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t parse_corpus()
+{
+    uint64_t parsed = 0;
+    alp_action_t action;
+    for(uint16_t i = 0; i < command_count; i++) {
+        // like alp_layer_process() and process_async(): determine the response length, then parse action by action
+        memcpy(command.alp_command, corpus[i].data, corpus[i].length);
+        fifo_init_filled(&command.alp_command_fifo, command.alp_command, corpus[i].length, ALP_PAYLOAD_MAX_SIZE);
+        if(alp_get_expected_response_length(&command) < 0)
+            continue;
+
+        while(fifo_get_size(&command.alp_command_fifo) > 0 && alp_parse_action(&command, &action))
+            parsed++;
+    }
+
+    return parsed;
+}
+
+static uint64_t index_corpus()
+{
+    uint64_t indexed = 0;
+    uint8_t expected_response_length;
+    for(uint16_t i = 0; i < command_count; i++) {
+        memcpy(command.alp_command, corpus[i].data, corpus[i].length);
+        int count = alp_index_command(command.alp_command, corpus[i].length, actions, MAX_ACTIONS, &expected_response_length);
+        if(count > 0)
+            indexed += count;
+    }
+
+    return indexed;
+}
+
+static void benchmark(const char* name, uint64_t (*run)())
+{
+    uint64_t actions_total = 0;
+    double start = now();
+    for(uint32_t round = 0; round < BENCHMARK_ROUNDS; round++)
+        actions_total += run();
+
+    double elapsed = now() - start;
+    printf("%-20s %10.0f actions/s, %7.1f ns/action\n", name, actions_total / elapsed, elapsed * 1e9 / actions_total);
+}
+
+int main(int argc, char *argv[])
+{
+    corpus_init(0x87654321);
+    if(argc > 1)
+        load_corpus(argv[1]);
+    else
+        generate_corpus();
+
+    benchmark("alp_parse_action", parse_corpus);
+    benchmark("alp_index_command", index_corpus);
+
+    printf("ALP benchmark done!\n");
+    return 0;
+}
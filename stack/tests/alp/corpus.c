@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "corpus.h"
+
+#include "alp.h"
+#include "d7ap.h"
+#include "d7ap_fs.h"
+#include "lorawan_stack.h"
+#include "fifo.h"
+#include "assert.h"
+#include <string.h>
+
+// leave enough room in the command for the largest action generated below
+#define MAX_ACTION_SIZE 48
+
+static uint32_t rng_state;
+
+static alp_interface_t d7ap_interface = {
+    .itf_id = ALP_ITF_ID_D7ASP,
+    .itf_cfg_len = sizeof(d7ap_session_config_t),
+    .itf_status_len = 0,
+    .unique = false
+};
+
+static alp_interface_t lorawan_interface = {
+    .itf_id = ALP_ITF_ID_LORAWAN_OTAA,
+    .itf_cfg_len = 3, // the control byte, application port and data rate appended by alp_append_forward_action()
+    .itf_status_len = 0,
+    .unique = false
+};
+
+void corpus_init(uint32_t seed)
+{
+    rng_state = seed;
+    alp_register_interface(&d7ap_interface);
+    alp_register_interface(&lorawan_interface);
+}
+
+uint32_t corpus_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void random_bytes(uint8_t* data, uint8_t length)
+{
+    for(uint8_t i = 0; i < length; i++)
+        data[i] = corpus_random();
+}
+
+// offsets and lengths use all length operand sizes
+static uint32_t random_offset()
+{
+    static const uint32_t max_offsets[] = { 0x3F, 0x3FFF, 0x3FFFFF, 0x3FFFFFFF };
+    return corpus_random() % (max_offsets[corpus_random() % 4] + 1);
+}
+
+static bool append_action(alp_command_t* command, uint8_t* expected_response_length)
+{
+    fifo_t* fifo = &command->alp_command_fifo;
+    uint8_t data[32];
+    uint8_t length = corpus_random() % sizeof(data);
+    random_bytes(data, length);
+
+    switch(corpus_random() % 12) {
+    case 0: {
+        uint32_t offset = random_offset();
+        uint32_t requested_length = corpus_random() % 200;
+        *expected_response_length += 1 + alp_length_operand_coded_length(offset) + 1 + alp_length_operand_coded_length(requested_length);
+        return alp_append_read_file_data_action(command, corpus_random(), offset, requested_length, true, false);
+    }
+    case 1:
+        return alp_append_write_file_data_action(command, corpus_random(), random_offset(), length, data, false, false);
+    case 2:
+        return alp_append_return_file_data_action(command, corpus_random(), random_offset(), length, data);
+    case 3:
+        *expected_response_length += 2;
+        return alp_append_tag_request_action(command, corpus_random(), true);
+    case 4:
+        return alp_append_tag_response_action(command, corpus_random(), true, false);
+    case 5: {
+#ifdef MODULE_D7AP
+        // the D7ASP interface configuration is only parsed when the D7AP module is part of the build
+        if(corpus_random() % 2) {
+            // the configuration is parsed as a d7ap_session_config_t without the unused part of the addressee ID,
+            // which only equals the format of alp_append_forward_action() when enums take one byte
+            d7ap_session_config_t session_config;
+            random_bytes((uint8_t*)&session_config, sizeof(session_config));
+            uint8_t config_length = sizeof(session_config) - 8 + d7ap_addressee_id_length(session_config.addressee.ctrl.id_type);
+            return (fifo_put_byte(fifo, ALP_OP_FORWARD) == SUCCESS) && (fifo_put_byte(fifo, ALP_ITF_ID_D7ASP) == SUCCESS)
+                && (fifo_put(fifo, (uint8_t*)&session_config, config_length) == SUCCESS);
+        }
+#endif
+
+        lorawan_session_config_otaa_t session_config = { .request_ack = corpus_random() % 2, .application_port = corpus_random() };
+        alp_interface_config_t config = { .itf_id = ALP_ITF_ID_LORAWAN_OTAA };
+        memcpy(config.itf_config, &session_config, sizeof(session_config));
+        return alp_append_forward_action(command, &config, sizeof(session_config));
+    }
+    case 6:
+        return alp_append_indirect_forward_action(command, corpus_random(), false, NULL, 0);
+    case 7: {
+        // the query types which take one file offset operand
+        static const alp_query_code_type_t types[] = { QUERY_CODE_TYPE_NON_VOID_CHECK,
+            QUERY_CODE_TYPE_ARITHM_COMP_WITH_ZERO, QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY,
+            QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP, QUERY_CODE_TYPE_STRING_TOKEN_SEARCH };
+        alp_operand_query_t query = { .code.type = types[corpus_random() % 5], .code.mask = corpus_random() % 2,
+                                      .code.param = corpus_random() % 2, .compare_operand_length = 1 + corpus_random() % 8 };
+        random_bytes(query.compare_body, 2 * query.compare_operand_length);
+        if(query.code.type == QUERY_CODE_TYPE_NON_VOID_CHECK)
+            query.code.mask = false;
+
+        if(query.code.type == QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP && query.code.mask) {
+            // a range of one byte values with a bitmap of at most 2 bytes
+            query.compare_operand_length = 1;
+            query.compare_body[0] = corpus_random() % 200;
+            query.compare_body[1] = query.compare_body[0] + corpus_random() % 16;
+        }
+
+        return alp_append_break_query_action(command, corpus_random(), random_offset(), &query);
+    }
+    case 8:
+        return alp_append_create_new_file_data_action(command, corpus_random(), corpus_random() % 1000, FS_STORAGE_PERMANENT, false, false);
+    case 9: {
+        alp_interface_status_t status = { .itf_id = ALP_ITF_ID_D7ASP, .len = length % ALP_ITF_STATUS_MAX_SIZE };
+        memcpy(status.itf_status, data, status.len);
+        return alp_append_interface_status(command, &status);
+    }
+    case 10:
+        return (fifo_put_byte(fifo, ALP_OP_READ_FILE_PROPERTIES) == SUCCESS) && (fifo_put_byte(fifo, corpus_random()) == SUCCESS);
+    default:
+        return corpus_random() % 2 ? alp_append_start_itf_action(command) : alp_append_stop_itf_action(command);
+    }
+}
+
+uint16_t corpus_generate_command(uint8_t* buffer, uint8_t* action_count, uint8_t* expected_response_length)
+{
+    static uint8_t command_storage[ALP_PAYLOAD_MAX_SIZE];
+    static alp_command_t command = { .alp_command = command_storage };
+    fifo_init(&command.alp_command_fifo, command.alp_command, ALP_PAYLOAD_MAX_SIZE);
+
+    uint8_t count = 1 + corpus_random() % 12;
+    *action_count = 0;
+    *expected_response_length = 0;
+    while(*action_count < count && fifo_get_size(&command.alp_command_fifo) + MAX_ACTION_SIZE <= ALP_PAYLOAD_MAX_SIZE) {
+        bool appended = append_action(&command, expected_response_length);
+        assert(appended);
+        (*action_count)++;
+    }
+
+    uint16_t length = fifo_get_size(&command.alp_command_fifo);
+    fifo_pop(&command.alp_command_fifo, buffer, length);
+    return length;
+}
+
+// alp.c reads the interface file of an overloaded indirect forward action, which the corpus does not contain
+int d7ap_fs_read_file(uint8_t file_id, uint32_t offset, uint8_t* buffer, uint32_t* length, authentication_t auth)
+{
+    assert(false);
+    return -EINVAL;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Generates random but valid ALP commands for the ALP parser tests and benchmark, using the alp_append_*()
+ * functions. The functions of the rest of the stack needed by alp.c are stubbed in corpus.c as well.
+ */
+#ifndef ALP_TEST_CORPUS_H
+#define ALP_TEST_CORPUS_H
+
+#include "stdint.h"
+
+/*! Registers the D7ASP interface, so forward actions can be parsed */
+void corpus_init(uint32_t seed);
+
+uint32_t corpus_random();
+
+/*! Writes a random valid command to buffer (which holds ALP_PAYLOAD_MAX_SIZE bytes) and returns its length.
+ * action_count and expected_response_length are set to the number of actions and the length of the response */
+uint16_t corpus_generate_command(uint8_t* buffer, uint8_t* action_count, uint8_t* expected_response_length);
+
+#endif // ALP_TEST_CORPUS_H
@@ -24,8 +24,11 @@
 #include <string.h>
 
 #include "debug.h"
+#include "errors.h"
 
 #include "alp.h"
+#include "fifo.h"
+#include "corpus.h"
 
 // TODO define here now, since we are not using APP_BUILD() macro for tests
 const char _APP_NAME[] = "alp_test";
@@ -64,7 +67,207 @@ void test_alp_parse_length_operand()
     assert(length == 4263936);
 }
 
-void bootstrap()
+/*
+ * Tests alp_index_command(): the action descriptors are compared to the result of alp_parse_action() for a corpus of
+ * generated commands, and mutated commands are fuzzed to check that the indexer never describes bytes outside the
+ * command.
+ */
+
+#define COMMAND_COUNT 20000
+#define FUZZ_ROUNDS 200000
+#define MAX_ACTIONS 64
+
+static uint8_t buffer[ALP_PAYLOAD_MAX_SIZE];
+static alp_action_index_t actions[MAX_ACTIONS];
+static uint8_t command_storage[ALP_PAYLOAD_MAX_SIZE];
+static alp_command_t command = { .alp_command = command_storage };
+
+static void load_command(alp_command_t* cmd, uint8_t* data, uint16_t length)
+{
+    memcpy(cmd->alp_command, data, length);
+    fifo_init_filled(&cmd->alp_command_fifo, cmd->alp_command, length, ALP_PAYLOAD_MAX_SIZE);
+}
+
+// compares the descriptor with the action parsed from the fifo, which must have consumed the same bytes
+static void check_action(const uint8_t* data, const alp_action_index_t* index, const alp_action_t* action)
+{
+    assert(index->ctrl.raw == action->ctrl.raw);
+    switch(index->ctrl.operation) {
+    case ALP_OP_READ_FILE_DATA:
+        assert(index->file_id == action->file_data_request_operand.file_offset.file_id);
+        assert(index->file_offset == action->file_data_request_operand.file_offset.offset);
+        assert(index->data_length == action->file_data_request_operand.requested_data_length);
+        break;
+    case ALP_OP_WRITE_FILE_DATA:
+    case ALP_OP_RETURN_FILE_DATA:
+        assert(index->file_id == action->file_data_operand.file_offset.file_id);
+        assert(index->file_offset == action->file_data_operand.file_offset.offset);
+        assert(index->data_length == action->file_data_operand.provided_data_length);
+        assert(memcmp(data + index->data_offset, action->file_data_operand.data, index->data_length) == 0);
+        break;
+    case ALP_OP_READ_FILE_PROPERTIES:
+        assert(index->file_id == action->file_id_operand.file_id);
+        break;
+    case ALP_OP_CREATE_FILE:
+        assert(index->file_id == action->file_header_operand.file_id);
+        assert(index->data_length == sizeof(d7ap_fs_file_header_t));
+        break;
+    case ALP_OP_REQUEST_TAG:
+    case ALP_OP_RESPONSE_TAG:
+        assert(index->file_id == action->tag_id_operand.tag_id);
+        break;
+    case ALP_OP_FORWARD:
+        assert(index->file_id == action->interface_config.itf_id);
+        assert(memcmp(data + index->data_offset, action->interface_config.itf_config, index->data_length) == 0);
+        break;
+    case ALP_OP_INDIRECT_FORWARD:
+        assert(index->file_id == action->indirect_interface_operand.interface_file_id);
+        break;
+    case ALP_OP_BREAK_QUERY:
+        // the compare body of the parsed action ends with the file offset operand
+        assert(index->data_length < action->query_operand.body_length);
+        assert(memcmp(data + index->data_offset, action->query_operand.compare_body, index->data_length) == 0);
+        break;
+    case ALP_OP_STATUS:
+        assert(index->file_id == action->interface_status.itf_id);
+        assert(index->data_length == action->interface_status.len);
+        assert(memcmp(data + index->data_offset, action->interface_status.itf_status, index->data_length) == 0);
+        break;
+    case ALP_OP_START_ITF:
+    case ALP_OP_STOP_ITF:
+        break;
+    default:
+        assert(false);
+    }
+}
+
+static void test_corpus()
+{
+    for(uint32_t i = 0; i < COMMAND_COUNT; i++) {
+        uint8_t action_count, expected_response_length, response_length;
+        uint16_t length = corpus_generate_command(buffer, &action_count, &expected_response_length);
+
+        int count = alp_index_command(buffer, length, actions, MAX_ACTIONS, &response_length);
+        assert(count == action_count);
+        assert(response_length == expected_response_length);
+
+        load_command(&command, buffer, length);
+        assert(alp_get_expected_response_length(&command) == expected_response_length);
+
+        for(uint8_t a = 0; a < count; a++) {
+            alp_action_t action;
+            assert(command.alp_command_fifo.head_idx == actions[a].offset);
+            assert(alp_parse_action(&command, &action));
+            assert(command.alp_command_fifo.head_idx == actions[a].offset + actions[a].length);
+            check_action(buffer, &actions[a], &action);
+        }
+
+        assert(fifo_get_size(&command.alp_command_fifo) == 0);
+    }
+
+    printf("ALP corpus OK\n");
+}
+
+static void test_errors()
+{
+    uint8_t action_count, expected_response_length, response_length;
+    uint16_t length = corpus_generate_command(buffer, &action_count, &expected_response_length);
+    int count = alp_index_command(buffer, length, actions, MAX_ACTIONS, &response_length);
+    assert(count == action_count);
+
+    // a truncated command is only valid up to the end of an action
+    for(uint16_t truncated = 0; truncated < length; truncated++) {
+        bool at_boundary = false;
+        for(uint8_t a = 0; a < count; a++)
+            at_boundary |= (actions[a].offset == truncated);
+
+        int rc = alp_index_command(buffer, truncated, NULL, 0, &response_length);
+        assert(at_boundary ? rc >= 0 : rc == -EFAULT);
+    }
+
+    // too many actions for the descriptor array
+    if(count > 1)
+        assert(alp_index_command(buffer, length, actions, count - 1, &response_length) == -ENOMEM);
+
+    // unknown operation and undefined status extension
+    uint8_t unknown[] = { 0x3F };
+    assert(alp_index_command(unknown, sizeof(unknown), NULL, 0, &response_length) == -ENOEXEC);
+    uint8_t status_ext[] = { ALP_OP_STATUS | (1 << 7), 0 };
+    assert(alp_index_command(status_ext, sizeof(status_ext), NULL, 0, &response_length) == -ENOEXEC);
+
+    // the length of an overloaded indirect forward depends on the interface file
+    uint8_t indirect[] = { ALP_OP_INDIRECT_FORWARD | (1 << 7), 0x40 };
+    assert(alp_index_command(indirect, sizeof(indirect), NULL, 0, &response_length) == -EPERM);
+
+    // a forward over an interface which is not registered
+    uint8_t forward[] = { ALP_OP_FORWARD, ALP_ITF_ID_NFC, 0, 0, 0 };
+    assert(alp_index_command(forward, sizeof(forward), NULL, 0, &response_length) == -EFAULT);
+
+    printf("ALP errors OK\n");
+}
+
+static void test_wrapped_fifo()
+{
+    uint8_t action_count, expected_response_length;
+    uint16_t length = corpus_generate_command(buffer, &action_count, &expected_response_length);
+
+    // move the head of the fifo so the command wraps around the end of the buffer
+    uint8_t filler[ALP_PAYLOAD_MAX_SIZE - 10] = { 0 };
+    fifo_init(&command.alp_command_fifo, command.alp_command, ALP_PAYLOAD_MAX_SIZE);
+    fifo_put(&command.alp_command_fifo, filler, sizeof(filler));
+    fifo_skip(&command.alp_command_fifo, sizeof(filler));
+    fifo_put(&command.alp_command_fifo, buffer, length);
+    assert(alp_get_expected_response_length(&command) == expected_response_length);
+    printf("ALP wrapped fifo OK\n");
+}
+
+static void test_fuzz()
+{
+    uint32_t valid = 0;
+    for(uint32_t round = 0; round < FUZZ_ROUNDS; round++) {
+        uint8_t action_count, expected_response_length, response_length;
+        uint16_t length = corpus_generate_command(buffer, &action_count, &expected_response_length);
+
+        // flip some bytes, truncate or overwrite the command with random bytes
+        switch(corpus_random() % 3) {
+        case 0:
+            for(uint8_t i = 0; i < 1 + corpus_random() % 4; i++)
+                buffer[corpus_random() % length] ^= 1 << (corpus_random() % 8);
+            break;
+        case 1:
+            length = corpus_random() % length;
+            break;
+        default:
+            length = 1 + corpus_random() % ALP_PAYLOAD_MAX_SIZE;
+            for(uint16_t i = 0; i < length; i++)
+                buffer[i] = corpus_random();
+        }
+
+        int count = alp_index_command(buffer, length, actions, MAX_ACTIONS, &response_length);
+        if(count < 0) {
+            assert(count == -EFAULT || count == -ENOEXEC || count == -EPERM || count == -ENOMEM);
+            continue;
+        }
+
+        // the actions describe the complete command without gaps
+        uint16_t end = 0;
+        for(uint8_t a = 0; a < count; a++) {
+            assert(actions[a].offset == end && actions[a].length > 0);
+            end += actions[a].length;
+            if(actions[a].data_offset != 0)
+                assert(actions[a].data_offset + actions[a].data_length <= end);
+        }
+
+        assert(end == length);
+        load_command(&command, buffer, length);
+        assert(alp_get_expected_response_length(&command) == response_length);
+        valid++;
+    }
+
+    printf("ALP fuzz OK (%u of %u mutated commands valid)\n", (unsigned)valid, FUZZ_ROUNDS);
+}
+
+int main()
 {
     printf("Unit-tests for ALP\n");
 
@@ -72,7 +275,12 @@ void bootstrap()
     test_alp_parse_length_operand();
     printf("Success!\n");
 
-    printf("Unit-tests for ALP completed\n");
+    corpus_init(0x12345678);
+    test_corpus();
+    test_errors();
+    test_wrapped_fifo();
+    test_fuzz();
 
-    exit(0);
+    printf("All ALP tests passed!\n");
+    return 0;
 }
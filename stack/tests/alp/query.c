@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tests alp_query_compile() and alp_query_evaluate() on query operands parsed by alp_parse_action(), against files
+ * stubbed below. Arithmetic comparisons are also checked against a reference which converts the values to integers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "errors.h"
+
+#include "alp.h"
+#include "d7ap_fs.h"
+#include "fifo.h"
+
+// TODO define here now, since we are not using APP_BUILD() macro for tests
+const char _APP_NAME[] = "alp_query_test";
+const char _GIT_SHA1[] = "";
+
+#define FILE_A 0x40
+#define FILE_B 0x41
+#define FILE_TEXT 0x42
+#define RANDOM_ROUNDS 20000
+
+static uint8_t file_a[8];
+static uint8_t file_b[8];
+static uint8_t file_text[] = "the quick brown fox";
+
+int d7ap_fs_read_file(uint8_t file_id, uint32_t offset, uint8_t* buffer, uint32_t* length, authentication_t auth)
+{
+    uint8_t* data;
+    uint32_t file_length;
+    switch(file_id) {
+    case FILE_A:
+        data = file_a;
+        file_length = sizeof(file_a);
+        break;
+    case FILE_B:
+        data = file_b;
+        file_length = sizeof(file_b);
+        break;
+    case FILE_TEXT:
+        data = file_text;
+        file_length = sizeof(file_text) - 1;
+        break;
+    default:
+        return -ENOENT;
+    }
+
+    if(offset > file_length)
+        return -EINVAL;
+
+    if(offset + *length > file_length)
+        *length = file_length - offset;
+
+    memcpy(buffer, data + offset, *length);
+    return SUCCESS;
+}
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t random_value()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// builds a BREAK_QUERY action with the given compare body and file offset operand(s), parses and compiles it
+static bool compile(uint8_t code, uint8_t compare_length, const uint8_t* body, uint8_t body_length, alp_query_t* query)
+{
+    uint8_t command_storage[ALP_PAYLOAD_MAX_SIZE];
+    alp_command_t command = { .alp_command = command_storage };
+    fifo_init(&command.alp_command_fifo, command.alp_command, ALP_PAYLOAD_MAX_SIZE);
+    fifo_put_byte(&command.alp_command_fifo, ALP_OP_BREAK_QUERY);
+    fifo_put_byte(&command.alp_command_fifo, code);
+    alp_append_length_operand(&command, compare_length);
+    fifo_put(&command.alp_command_fifo, (uint8_t*)body, body_length);
+
+    alp_action_t action;
+    if(!alp_parse_action(&command, &action))
+        return false;
+
+    assert(fifo_get_size(&command.alp_command_fifo) == 0);
+    return alp_query_compile(&action.query_operand, query);
+}
+
+static bool evaluate(uint8_t code, uint8_t compare_length, const uint8_t* body, uint8_t body_length)
+{
+    alp_query_t query;
+    bool result;
+    assert(compile(code, compare_length, body, body_length, &query));
+    assert(alp_query_evaluate(&query, ROOT_AUTH, &result) == SUCCESS);
+    return result;
+}
+
+static uint8_t query_code(alp_query_code_type_t type, bool mask, uint8_t param)
+{
+    return (type << 5) | (mask << 4) | param;
+}
+
+static int64_t to_integer(const uint8_t* bytes, uint8_t length, bool is_signed)
+{
+    uint64_t value = 0;
+    for(uint8_t i = 0; i < length; i++)
+        value = (value << 8) | bytes[i];
+
+    if(is_signed && length < 8 && (bytes[0] & 0x80))
+        value |= ~0ULL << (8 * length);
+
+    return (int64_t)value;
+}
+
+static bool reference_comparison(alp_query_arithmetic_comparison_type_t comp_type, const uint8_t* a, const uint8_t* b,
+    uint8_t length, bool is_signed)
+{
+    int64_t x = to_integer(a, length, is_signed);
+    int64_t y = to_integer(b, length, is_signed);
+    if(!is_signed && length == 8) {
+        // compare the full 64 bit values unsigned
+        x ^= INT64_MIN;
+        y ^= INT64_MIN;
+    }
+
+    switch(comp_type) {
+    case ARITH_COMP_TYPE_INEQUALITY: return x != y;
+    case ARITH_COMP_TYPE_EQUALITY: return x == y;
+    case ARITH_COMP_TYPE_LESS_THAN: return x < y;
+    case ARITH_COMP_TYPE_LESS_THAN_OR_EQUAL_TO: return x <= y;
+    case ARITH_COMP_TYPE_GREATER_THAN: return x > y;
+    default: return x >= y;
+    }
+}
+
+static void test_arithmetic()
+{
+    // 0x0102 < 0x0201, also when signed
+    uint8_t body[32] = { 0x02, 0x01, FILE_A, 0 };
+    memcpy(file_a, (uint8_t[]){ 0x01, 0x02 }, 2);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, false, ARITH_COMP_TYPE_LESS_THAN), 2, body, 4));
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, false, ARITH_COMP_TYPE_EQUALITY), 2, body, 4));
+
+    // 0xFF is -1 when signed
+    memcpy(body, (uint8_t[]){ 0x01, FILE_A, 0 }, 3);
+    file_a[0] = 0xFF;
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, false, ARITH_COMP_TYPE_GREATER_THAN), 1, body, 3));
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, false, 0x08 | ARITH_COMP_TYPE_LESS_THAN), 1, body, 3));
+
+    // the mask selects the high nibble of the first byte
+    memcpy(body, (uint8_t[]){ 0xF0, 0x00, 0x1F, 0xAA, FILE_A, 0 }, 6);
+    memcpy(file_a, (uint8_t[]){ 0x12, 0x34 }, 2);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, true, ARITH_COMP_TYPE_EQUALITY), 2, body, 6));
+
+    // comparison with zero
+    memcpy(body, (uint8_t[]){ FILE_A, 1 }, 2);
+    file_a[1] = 0;
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_ZERO, false, ARITH_COMP_TYPE_EQUALITY), 1, body, 2));
+    memcpy(body, (uint8_t[]){ 0x0F, FILE_A, 0 }, 3);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_ZERO, true, ARITH_COMP_TYPE_INEQUALITY), 1, body, 3));
+
+    // comparison between two files
+    memcpy(file_a, (uint8_t[]){ 0x00, 0x10, 0x20 }, 3);
+    memcpy(file_b, (uint8_t[]){ 0x00, 0x10, 0x21 }, 3);
+    memcpy(body, (uint8_t[]){ FILE_A, 0, FILE_B, 0 }, 4);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES, false, ARITH_COMP_TYPE_LESS_THAN), 3, body, 4));
+    memcpy(body, (uint8_t[]){ 0xFF, 0xFF, 0xF0, FILE_A, 0, FILE_B, 0 }, 7);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_FILES, true, ARITH_COMP_TYPE_EQUALITY), 3, body, 7));
+
+    // the file data is too short for the comparison
+    memcpy(body, (uint8_t[]){ 0x00, 0x00, FILE_A, 7 }, 4);
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, false, ARITH_COMP_TYPE_INEQUALITY), 2, body, 4));
+
+    // random values of all lengths up to 8 bytes, with and without mask, signed and unsigned
+    for(uint32_t round = 0; round < RANDOM_ROUNDS; round++) {
+        uint8_t length = 1 + random_value() % 8;
+        bool mask = random_value() % 2;
+        bool is_signed = random_value() % 2;
+        alp_query_arithmetic_comparison_type_t comp_type = random_value() % 6;
+        uint8_t mask_bytes[8], value[8];
+        for(uint8_t i = 0; i < length; i++) {
+            mask_bytes[i] = mask ? random_value() : 0xFF;
+            value[i] = random_value();
+            file_a[i] = random_value() % 4 ? value[i] : random_value(); // make equal values likely
+        }
+
+        uint8_t offset = 0;
+        if(mask) {
+            memcpy(body, mask_bytes, length);
+            offset = length;
+        }
+
+        memcpy(body + offset, value, length);
+        body[offset + length] = FILE_A;
+        body[offset + length + 1] = 0;
+        uint8_t code = query_code(QUERY_CODE_TYPE_ARITHM_COMP_WITH_VALUE_IN_QUERY, mask, (is_signed << 3) | comp_type);
+        bool result = evaluate(code, length, body, offset + length + 2);
+
+        uint8_t masked_file[8], masked_value[8];
+        for(uint8_t i = 0; i < length; i++) {
+            masked_file[i] = file_a[i] & mask_bytes[i];
+            masked_value[i] = value[i] & mask_bytes[i];
+        }
+
+        assert(result == reference_comparison(comp_type, masked_file, masked_value, length, is_signed));
+    }
+
+    printf("ALP query arithmetic comparisons OK\n");
+}
+
+static void test_range()
+{
+    // 10 to 20 with a bitmap which only allows 15
+    uint8_t body[] = { 10, 20, 0x20, 0x00, FILE_A, 0 };
+    uint8_t in_range = query_code(QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP, true, 1);
+    file_a[0] = 15;
+    assert(evaluate(in_range, 1, body, sizeof(body)));
+    file_a[0] = 16;
+    assert(!evaluate(in_range, 1, body, sizeof(body)));
+    assert(evaluate(query_code(QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP, true, 0), 1, body, sizeof(body)));
+
+    // without bitmap, the boundaries are inclusive
+    uint8_t range[] = { 0x00, 0x10, 0x01, 0x00, FILE_A, 0 };
+    in_range = query_code(QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP, false, 1);
+    memcpy(file_a, (uint8_t[]){ 0x01, 0x00 }, 2);
+    assert(evaluate(in_range, 2, range, sizeof(range)));
+    memcpy(file_a, (uint8_t[]){ 0x01, 0x01 }, 2);
+    assert(!evaluate(in_range, 2, range, sizeof(range)));
+
+    // signed, from -2 to 1
+    uint8_t signed_range[] = { 0xFE, 0x01, FILE_A, 0 };
+    file_a[0] = 0xFF;
+    assert(evaluate(query_code(QUERY_CODE_TYPE_RANGE_COMP_WITH_BITMAP, false, 0x08 | 1), 1, signed_range, sizeof(signed_range)));
+
+    // the maximum is below the minimum
+    alp_query_t query;
+    uint8_t invalid[] = { 20, 10, 0x00, FILE_A, 0 };
+    assert(!compile(in_range | 0x10, 1, invalid, sizeof(invalid), &query));
+
+    printf("ALP query range comparisons OK\n");
+}
+
+static void test_string_token()
+{
+    uint8_t body[16] = { 'b', 'r', 'o', 'w', 'n', FILE_TEXT, 0 };
+    assert(evaluate(query_code(QUERY_CODE_TYPE_STRING_TOKEN_SEARCH, false, 0), 5, body, 7));
+
+    // one byte may differ
+    memcpy(body, (uint8_t[]){ 'b', 'r', 'a', 'w', 'n', FILE_TEXT, 0 }, 7);
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_STRING_TOKEN_SEARCH, false, 0), 5, body, 7));
+    assert(evaluate(query_code(QUERY_CODE_TYPE_STRING_TOKEN_SEARCH, false, 1), 5, body, 7));
+
+    // the token is searched from the file offset onwards
+    memcpy(body, (uint8_t[]){ 'q', 'u', FILE_TEXT, 6 }, 4);
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_STRING_TOKEN_SEARCH, false, 0), 2, body, 4));
+
+    // the mask ignores the case of the letters
+    memcpy(body, (uint8_t[]){ 0xDF, 0xDF, 0xDF, 'F', 'O', 'X', FILE_TEXT, 0 }, 8);
+    assert(evaluate(query_code(QUERY_CODE_TYPE_STRING_TOKEN_SEARCH, true, 0), 3, body, 8));
+
+    printf("ALP query string token search OK\n");
+}
+
+static void test_non_void()
+{
+    uint8_t body[] = { FILE_A, 0 };
+    assert(evaluate(query_code(QUERY_CODE_TYPE_NON_VOID_CHECK, false, 0), 8, body, sizeof(body)));
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_NON_VOID_CHECK, false, 0), 9, body, sizeof(body)));
+    uint8_t missing[] = { 0x7F, 0 };
+    assert(!evaluate(query_code(QUERY_CODE_TYPE_NON_VOID_CHECK, false, 0), 1, missing, sizeof(missing)));
+
+    // the RFU query codes are rejected by the parser
+    alp_query_t query;
+    assert(!compile(query_code(5, false, 0), 1, body, sizeof(body), &query));
+
+    printf("ALP query non-void check OK\n");
+}
+
+int main()
+{
+    printf("Unit-tests for ALP queries\n");
+    test_arithmetic();
+    test_range();
+    test_string_token();
+    test_non_void();
+    printf("All ALP query tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the READ_FILE_DATA handling of the ALP layer on the NATIVE platform. Consecutive reads of adjacent data in
+ * a file are served by one file read, but the response has to stay the same as when every action is read by itself:
+ * one return file data action per read, truncated at the end of the file, an error for a read starting beyond the end
+ * of the file which aborts the rest of the command, and files with an action protocol on read are read once per action.
+ * A command received over an interface with several tagged requests gets a tag response after the response of each.
+ */
+#include "MODULE_ALP_defs.h"
+#include "alp_layer.h"
+#include "alp.h"
+#include "d7ap_fs.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "errors.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FILE_A_ID 0x40
+#define FILE_A_LENGTH 64
+#define FILE_C_ID 0x41
+#define FILE_C_LENGTH 8
+#define ACT_FILE_ID 0x42      // triggers the action protocol when it is read
+#define ACT_FILE_LENGTH 8
+#define ACTION_FILE_ID 0x43
+#define INTERFACE_FILE_ID 0x44
+#define TEST_ITF_ID ALP_ITF_ID_BLE // not registered by the stack on the NATIVE platform
+
+#define MAX_ACTIONS 64
+#define CHECK_DELAY 100 // ticks, enough to process the command and the commands it results in
+
+typedef struct {
+    uint8_t file_id;
+    uint32_t offset;
+    uint32_t length;
+} read_t;
+
+// normally generated for applications from cmake/version.c.in
+const char _GIT_SHA1[] = "0000000";
+const char _APP_NAME[] = "alp_layer";
+
+static uint8_t file_a[FILE_A_LENGTH];
+static uint8_t file_c[FILE_C_LENGTH];
+static uint8_t act_file[ACT_FILE_LENGTH];
+
+static uint8_t response[ALP_PAYLOAD_MAX_SIZE];
+static int16_t response_length;
+static uint32_t header_lookups;
+static uint8_t forward_count;
+static uint8_t itf_payload[ALP_PAYLOAD_MAX_SIZE];
+static uint8_t itf_payload_length;
+static void (*current_check)();
+
+static void command_result(alp_command_t* command, alp_interface_status_t* origin_itf_status)
+{
+    assert(response_length == -1); // one response per command
+    response_length = fifo_get_size(&command->alp_command_fifo);
+    memcpy(response, command->alp_command, response_length);
+}
+
+static alp_init_args_t init_args = { .alp_command_result_cb = &command_result };
+
+static error_t test_itf_send_command(shared_buffer_t* command, uint8_t expected_response_length,
+                                     uint16_t* trans_id, alp_interface_config_t* itf_cfg)
+{
+    forward_count++;
+    memcpy(itf_payload, shared_buffer_get_data(command), shared_buffer_get_length(command));
+    itf_payload_length = shared_buffer_get_length(command);
+    return SUCCESS;
+}
+
+static alp_interface_t test_itf = {
+    .itf_id = TEST_ITF_ID,
+    .itf_cfg_len = 0,
+    .itf_status_len = 0,
+    .send_command = &test_itf_send_command,
+    .unique = false
+};
+
+static uint32_t get_header_lookups()
+{
+    const d7ap_fs_header_cache_stats_t* stats = d7ap_fs_get_header_cache_stats();
+    return stats->hits + stats->misses;
+}
+
+static const uint8_t* get_file_data(uint8_t file_id)
+{
+    switch(file_id) {
+    case FILE_A_ID:
+        return file_a;
+    case FILE_C_ID:
+        return file_c;
+    case ACT_FILE_ID:
+        return act_file;
+    default:
+        assert(false);
+    }
+}
+
+static void init_file(uint8_t file_id, d7ap_fs_file_header_t* header, uint8_t* data, uint32_t length)
+{
+    header->file_permissions = (file_permission_t) { .guest_read = true, .user_read = true, .user_write = true };
+    header->file_properties.storage_class = FS_STORAGE_PERMANENT;
+    header->length = length;
+    header->allocated_length = length;
+    assert(d7ap_fs_init_file(file_id, header, data) == SUCCESS);
+}
+
+static void init_files()
+{
+    d7ap_fs_file_header_t header = { 0 };
+    for(uint8_t i = 0; i < FILE_A_LENGTH; i++)
+        file_a[i] = 3 * i + 1;
+    init_file(FILE_A_ID, &header, file_a, FILE_A_LENGTH);
+
+    memset(file_c, 0xC0, FILE_C_LENGTH);
+    init_file(FILE_C_ID, &header, file_c, FILE_C_LENGTH);
+
+#ifdef MODULE_D7AP
+    // the action of ACT_FILE_ID reads one byte of FILE_A_ID, the response is forwarded over the test interface
+    alp_command_t* action = alp_layer_command_alloc(false, false);
+    assert(alp_append_read_file_data_action(action, FILE_A_ID, 0, 1, true, false));
+    init_file(ACTION_FILE_ID, &header, action->alp_command, fifo_get_size(&action->alp_command_fifo));
+    alp_layer_command_free(action);
+
+    alp_interface_config_t interface_config = { .itf_id = TEST_ITF_ID };
+    init_file(INTERFACE_FILE_ID, &header, (uint8_t*)&interface_config, sizeof(interface_config));
+
+    header.file_properties.action_protocol_enabled = true;
+    header.file_properties.action_condition = D7A_ACT_COND_READ;
+    header.action_file_id = ACTION_FILE_ID;
+    header.interface_file_id = INTERFACE_FILE_ID;
+#endif
+    memset(act_file, 0xAC, ACT_FILE_LENGTH);
+    init_file(ACT_FILE_ID, &header, act_file, ACT_FILE_LENGTH);
+}
+
+static void check_task(void* arg)
+{
+    current_check();
+}
+
+static void run_command(const read_t* reads, uint8_t count, void (*check)())
+{
+    alp_command_t* command = alp_layer_command_alloc(true, true);
+    assert(command != NULL);
+    for(uint8_t i = 0; i < count; i++)
+        assert(alp_append_read_file_data_action(command, reads[i].file_id, reads[i].offset, reads[i].length, true, false));
+
+    response_length = -1;
+    header_lookups = get_header_lookups();
+    forward_count = 0;
+    current_check = check;
+    alp_layer_process(command);
+    timer_post_task_delay(&check_task, CHECK_DELAY);
+}
+
+// checks the response consists of a return file data action per expected read, with the data of the file
+static void check_response(const read_t* expected, uint8_t count)
+{
+    alp_action_index_t actions[MAX_ACTIONS];
+    uint8_t expected_response_length;
+
+    assert(response_length >= 0);
+    assert(alp_index_command(response, response_length, actions, MAX_ACTIONS, &expected_response_length) == count);
+    for(uint8_t i = 0; i < count; i++) {
+        assert(actions[i].ctrl.operation == ALP_OP_RETURN_FILE_DATA);
+        assert(actions[i].file_id == expected[i].file_id);
+        assert(actions[i].file_offset == expected[i].offset);
+        assert(actions[i].data_length == expected[i].length);
+        assert(memcmp(response + actions[i].data_offset, get_file_data(expected[i].file_id) + expected[i].offset,
+                      expected[i].length) == 0);
+    }
+}
+
+static void test_action_protocol();
+
+static void check_errors_first_read()
+{
+    // the command is aborted by the first read, so the response is empty
+    check_response(NULL, 0);
+    printf("Coalesced read errors OK\n");
+    test_action_protocol();
+}
+
+static void check_errors()
+{
+    // the read starting beyond the end of the file fails and aborts the command, the read of the other file is not done
+    const read_t expected[] = { { FILE_A_ID, 60, 4 } };
+    check_response(expected, 1);
+
+    const read_t reads[] = { { FILE_A_ID, FILE_A_LENGTH + 2, 2 }, { FILE_A_ID, FILE_A_LENGTH + 4, 2 }, { FILE_C_ID, 0, 2 } };
+    run_command(reads, 3, &check_errors_first_read);
+}
+
+static void test_errors()
+{
+    const read_t reads[] = { { FILE_A_ID, 60, 8 }, { FILE_A_ID, 68, 2 }, { FILE_C_ID, 0, 2 } };
+    run_command(reads, 3, &check_errors);
+}
+
+static void check_truncation()
+{
+    // like a single read, a read crossing the end of the file is truncated, one starting at the end returns no data
+    const read_t expected[] = { { FILE_A_ID, 56, 4 }, { FILE_A_ID, 60, 4 }, { FILE_A_ID, 64, 0 } };
+    check_response(expected, 3);
+    printf("Coalesced read truncation OK\n");
+    test_errors();
+}
+
+static void test_truncation()
+{
+    const read_t reads[] = { { FILE_A_ID, 56, 4 }, { FILE_A_ID, 60, 4 }, { FILE_A_ID, 64, 2 } };
+    run_command(reads, 3, &check_truncation);
+}
+
+static void check_run_length()
+{
+    // runs are split after MODULE_ALP_MAX_COALESCED_READS actions, which does not change the response
+    read_t expected[2 * MODULE_ALP_MAX_COALESCED_READS + 1];
+    for(uint8_t i = 0; i < 2 * MODULE_ALP_MAX_COALESCED_READS + 1; i++)
+        expected[i] = (read_t) { FILE_A_ID, i, 1 };
+
+    check_response(expected, 2 * MODULE_ALP_MAX_COALESCED_READS + 1);
+    printf("Coalesced read run length OK\n");
+    test_truncation();
+}
+
+static void test_run_length()
+{
+    read_t reads[2 * MODULE_ALP_MAX_COALESCED_READS + 1];
+    for(uint8_t i = 0; i < 2 * MODULE_ALP_MAX_COALESCED_READS + 1; i++)
+        reads[i] = (read_t) { FILE_A_ID, i, 1 };
+
+    run_command(reads, 2 * MODULE_ALP_MAX_COALESCED_READS + 1, &check_run_length);
+}
+
+static const read_t adjacent_reads[] = {
+    { FILE_A_ID, 0, 4 }, { FILE_A_ID, 4, 4 }, { FILE_A_ID, 8, 4 }, // one range
+    { FILE_C_ID, 0, 2 },                                           // another file
+    { FILE_A_ID, 16, 4 }, { FILE_A_ID, 12, 4 }                     // not continuing the previous read
+};
+
+static void check_adjacent_reads()
+{
+    check_response(adjacent_reads, sizeof(adjacent_reads) / sizeof(adjacent_reads[0]));
+
+#if MODULE_ALP_MAX_COALESCED_READS >= 3
+    // every range needs one header lookup to check for an action protocol and one to read it
+    assert(get_header_lookups() - header_lookups == 4 * 2);
+#endif
+    printf("Coalesced adjacent reads OK\n");
+    test_run_length();
+}
+
+static void test_adjacent_reads()
+{
+    run_command(adjacent_reads, sizeof(adjacent_reads) / sizeof(adjacent_reads[0]), &check_adjacent_reads);
+}
+
+static void done()
+{
+    // every command returned its shared buffer to the pool
+    assert(shared_buffer_get_free_count() == FRAMEWORK_SHARED_BUFFER_COUNT);
+    printf("All alp_layer tests passed!\n");
+    exit(0);
+}
+
+static void check_tagged_requests()
+{
+    // the response of every tagged request ends with its tag response
+    alp_action_index_t actions[MAX_ACTIONS];
+    uint8_t expected_response_length;
+    assert(forward_count == 1);
+    assert(alp_index_command(itf_payload, itf_payload_length, actions, MAX_ACTIONS, &expected_response_length) == 4);
+    assert(actions[0].ctrl.operation == ALP_OP_RETURN_FILE_DATA && actions[0].file_id == FILE_A_ID);
+    assert(actions[1].ctrl.operation == ALP_OP_RESPONSE_TAG && actions[1].file_id == 1 && actions[1].ctrl.b7 && !actions[1].ctrl.b6);
+    assert(actions[2].ctrl.operation == ALP_OP_RETURN_FILE_DATA && actions[2].file_id == FILE_C_ID);
+    assert(actions[3].ctrl.operation == ALP_OP_RESPONSE_TAG && actions[3].file_id == 2 && actions[3].ctrl.b7 && !actions[3].ctrl.b6);
+    printf("Tagged requests OK\n");
+    done();
+}
+
+// like the requests D7ASP sends together in one transaction
+static void test_tagged_requests()
+{
+    alp_command_t* command = alp_layer_command_alloc(false, false);
+    assert(command != NULL);
+    command->origin_itf_id = TEST_ITF_ID;
+    command->respond_when_completed = true;
+    assert(alp_append_tag_request_action(command, 1, true));
+    assert(alp_append_read_file_data_action(command, FILE_A_ID, 0, 2, true, false));
+    assert(alp_append_tag_request_action(command, 2, true));
+    assert(alp_append_read_file_data_action(command, FILE_C_ID, 0, 2, true, false));
+
+    forward_count = 0;
+    current_check = &check_tagged_requests;
+    alp_layer_process(command);
+    timer_post_task_delay(&check_task, CHECK_DELAY);
+}
+
+#ifdef MODULE_D7AP
+static void check_action_protocol()
+{
+    // the file is read once per action, so the action protocol runs and forwards its response for each of them
+    const read_t expected[] = { { ACT_FILE_ID, 0, 2 }, { ACT_FILE_ID, 2, 2 } };
+    check_response(expected, 2);
+    assert(forward_count == 2);
+    // the forwarded commands wait for a response of the interface, but their buffers are released already
+    assert(shared_buffer_get_free_count() == FRAMEWORK_SHARED_BUFFER_COUNT);
+    alp_layer_free_itf_commands(TEST_ITF_ID);
+    printf("Action protocol reads OK\n");
+    test_tagged_requests();
+}
+#endif
+
+static void test_action_protocol()
+{
+#ifdef MODULE_D7AP
+    const read_t reads[] = { { ACT_FILE_ID, 0, 2 }, { ACT_FILE_ID, 2, 2 } };
+    run_command(reads, 2, &check_action_protocol);
+#else
+    test_tagged_requests();
+#endif
+}
+
+void bootstrap()
+{
+    alp_layer_init(&init_args, false);
+    alp_layer_register_interface(&test_itf);
+    init_files();
+    sched_register_task(&check_task);
+
+    test_adjacent_reads();
+}
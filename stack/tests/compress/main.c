@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Exhaustive test of the compressed time format: every compressed value is decompressed, every 16 bit value is
+ * compressed in both rounding modes and compared against the best representable value and, when rounding up, against
+ * the floating point implementation the shift based one replaced. Afterwards both implementations are timed.
+ */
+#include "compress.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCHMARK_ROUNDS 50
+
+static uint32_t decompressed[256];
+
+// the original implementations, using pow()
+#define REFERENCE_CT_DECOMPRESS(ct) (pow(4, ct >> 5) * (ct & 0b11111))
+
+static uint8_t reference_compress_data(uint16_t value, bool ceil)
+{
+    uint8_t mantissa;
+    uint16_t remainder;
+
+    for ( int i = 0; i < 8; i++)
+    {
+        if (value <= (pow(4, i) * 31))
+        {
+            mantissa = value / pow(4, i);
+            remainder = value % (uint16_t)(pow(4, i));
+
+            if (ceil && remainder)
+                mantissa++;
+
+            return (uint8_t)( i<<5 | mantissa);
+        }
+    }
+
+    return 0;
+}
+
+static void test_decompress()
+{
+    for(uint16_t ct = 0; ct <= 0xFF; ct++)
+    {
+        decompressed[ct] = CT_DECOMPRESS(ct);
+        assert(decompressed[ct] == (uint32_t)REFERENCE_CT_DECOMPRESS(ct));
+    }
+
+    assert(CT_DECOMPRESS(0xFF) == 507904);
+    printf("Decompression of all 256 values OK\n");
+}
+
+static void test_compress()
+{
+    for(uint32_t value = 0; value <= UINT16_MAX; value++)
+    {
+        uint8_t floor_ct = compress_data(value, false);
+        uint8_t ceil_ct = compress_data(value, true);
+        assert(ceil_ct == reference_compress_data(value, true));
+
+        // the closest representable values below and above
+        uint32_t below = 0, above = UINT32_MAX;
+        for(uint16_t ct = 0; ct <= 0xFF; ct++)
+        {
+            if(decompressed[ct] <= value && decompressed[ct] > below)
+                below = decompressed[ct];
+            if(decompressed[ct] >= value && decompressed[ct] < above)
+                above = decompressed[ct];
+        }
+
+        assert(decompressed[floor_ct] == below);
+        assert(decompressed[ceil_ct] == above);
+
+        // representable values are kept in both rounding modes
+        assert(CT_DECOMPRESS(compress_data(below, true)) == below);
+        if(above <= UINT16_MAX)
+            assert(CT_DECOMPRESS(compress_data(above, false)) == above);
+    }
+
+    printf("Compression of all 16 bit values OK\n");
+}
+
+static double elapsed_ns(struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+static void benchmark()
+{
+    volatile uint32_t sink = 0;
+    struct timespec start;
+    uint32_t calls = BENCHMARK_ROUNDS * (UINT16_MAX + 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t round = 0; round < BENCHMARK_ROUNDS; round++)
+        for(uint32_t value = 0; value <= UINT16_MAX; value++)
+            sink += compress_data(value, value & 1);
+
+    double compress_ns = elapsed_ns(&start) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t round = 0; round < BENCHMARK_ROUNDS; round++)
+        for(uint32_t value = 0; value <= UINT16_MAX; value++)
+            sink += reference_compress_data(value, value & 1);
+
+    double reference_compress_ns = elapsed_ns(&start) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t round = 0; round < BENCHMARK_ROUNDS; round++)
+        for(uint32_t value = 0; value <= UINT16_MAX; value++)
+            sink += CT_DECOMPRESS((uint8_t)(value ^ sink));
+
+    double decompress_ns = elapsed_ns(&start) / calls;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t round = 0; round < BENCHMARK_ROUNDS; round++)
+        for(uint32_t value = 0; value <= UINT16_MAX; value++)
+            sink += REFERENCE_CT_DECOMPRESS((uint8_t)(value ^ sink));
+
+    double reference_decompress_ns = elapsed_ns(&start) / calls;
+
+    printf("compress_data: %.1f ns (pow: %.1f ns), CT_DECOMPRESS: %.1f ns (pow: %.1f ns)\n",
+           compress_ns, reference_compress_ns, decompress_ns, reference_decompress_ns);
+}
+
+void bootstrap()
+{
+    test_decompress();
+    test_compress();
+    benchmark();
+    printf("All compress tests passed!\n");
+    exit(0);
+}
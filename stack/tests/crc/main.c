@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "crc.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BUFFER_SIZE 65536
+#define BENCHMARK_ROUNDS 200
+
+static uint8_t buffer[BUFFER_SIZE];
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// straightforward bit by bit CRC16 CCITT (poly 0x1021, init 0xFFFF) to compare against
+static uint16_t reference_crc(const uint8_t* data, uint32_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for(uint32_t i = 0; i < length; i++)
+    {
+        crc ^= data[i] << 8;
+        for(uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+
+    return crc;
+}
+
+static void test_vectors()
+{
+    assert(crc_calculate((const uint8_t*) "123456789", 9) == 0x29B1);
+    assert(crc_calculate(buffer, 0) == 0xFFFF);
+
+    // all lengths up to a few slices and a full 64 KiB buffer, from unaligned start addresses
+    for(uint32_t length = 0; length < 100; length++)
+        for(uint32_t offset = 0; offset < 8; offset++)
+            assert(crc_calculate(buffer + offset, length) == reference_crc(buffer + offset, length));
+
+    assert(crc_calculate(buffer, BUFFER_SIZE) == reference_crc(buffer, BUFFER_SIZE));
+    printf("CRC vectors OK\n");
+}
+
+static void test_incremental()
+{
+    // feeding the data in random pieces, with several contexts interleaved, gives the same result
+    crc_ctx_t ctx[2];
+    uint32_t pos[2] = { 0, 0 };
+    uint32_t length = 4000;
+    uint16_t expected = reference_crc(buffer, length);
+
+    crc_init(&ctx[0]);
+    crc_init(&ctx[1]);
+    while(pos[0] < length || pos[1] < length)
+    {
+        uint8_t i = next_random() % 2;
+        uint32_t chunk = next_random() % 20;
+        if(chunk > length - pos[i])
+            chunk = length - pos[i];
+
+        crc_update(&ctx[i], buffer + pos[i], chunk);
+        pos[i] += chunk;
+    }
+
+    assert(crc_final(&ctx[0]) == expected);
+    assert(crc_final(&ctx[1]) == expected);
+    printf("CRC incremental OK\n");
+}
+
+static void benchmark(uint32_t length)
+{
+    struct timespec start, stop;
+    uint32_t rounds = BENCHMARK_ROUNDS * (BUFFER_SIZE / length);
+    volatile uint16_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < rounds; i++)
+        sink ^= crc_calculate(buffer, length);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+    printf("%-10s %5u bytes: %6.2f ns/byte, %7.1f MB/s\n", FRAMEWORK_CRC_IMPLEMENTATION_NAME, length,
+        ns / ((double) rounds * length), ((double) rounds * length) / (ns / 1e9) / 1e6);
+}
+
+int main()
+{
+    for(uint32_t i = 0; i < BUFFER_SIZE; i++)
+        buffer[i] = next_random();
+
+    test_vectors();
+    test_incremental();
+
+    benchmark(16);
+    benchmark(256);
+    benchmark(BUFFER_SIZE);
+
+    printf("All CRC tests passed!\n");
+    return 0;
+}
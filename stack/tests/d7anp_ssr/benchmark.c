@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native benchmark of the security state register. First the lookup of a node in a full register is timed, through
+ * the hash index and with the linear scan it replaced. Then frames of 1k and 10k simulated nodes are received by a
+ * register which is much smaller: every node sends with its own frame counter. The sender of each frame is either
+ * picked at random from all nodes, or most of the frames come from a slowly drifting set of active nodes which fits in
+ * the register. The evicted nodes file has room for all nodes, so no honest frame may be refused: neither of a new
+ * node nor of a node which comes back. This reports how often a node has to be evicted, and how many writes of the
+ * register are done when the changes are persisted every PERSIST_PERIOD_FRAMES frames, compared to writing every
+ * change, next to the writes of the evicted nodes. After every frame an earlier frame of a random node is replayed, the
+ * share of replays which would be accepted is reported as well and has to be 0. Finally the 10k nodes are received with
+ * the default evicted nodes file of DEFAULT_EVICTED_NODES entries, where new nodes are refused once it is full.
+ */
+#include "MODULE_D7AP_defs.h"
+#include "d7anp_ssr.h"
+#include "stubs.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define SSR_SIZE FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE
+#define LOOKUP_COUNT 1000000
+#define FRAME_COUNT 200000
+#define PERSIST_PERIOD_FRAMES 100
+#define ACTIVE_NODES (SSR_SIZE / 2)
+#define ACTIVE_PERCENT 90
+#define ACTIVE_DRIFT_FRAMES 1000
+#define DEFAULT_EVICTED_NODES 32
+
+static uint8_t addresses[SSR_SIZE * 2][8];
+static dae_nwl_trusted_node_t linear_table[SSR_SIZE];
+
+// the lookup as it was done before the hash index
+static dae_nwl_trusted_node_t* linear_get_node(uint8_t* address)
+{
+    for(uint8_t i = 0; i < SSR_SIZE; i++)
+    {
+        if(memcmp(linear_table[i].addr, address, 8) == 0)
+            return &linear_table[i];
+    }
+
+    return NULL;
+}
+
+static double elapsed_ns(struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+static void benchmark_lookup()
+{
+    stubs_reset_evicted_file(DEFAULT_EVICTED_NODES);
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    d7anp_ssr_init();
+    for(uint16_t i = 0; i < SSR_SIZE * 2; i++)
+        stubs_node_address(i, addresses[i]);
+
+    for(uint16_t i = 0; i < SSR_SIZE; i++)
+    {
+        d7anp_ssr_add_node(addresses[i], 0, 0);
+        memcpy(linear_table[i].addr, addresses[i], 8);
+    }
+
+    // half of the lookups are for nodes which are not in the register
+    uint32_t found = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < LOOKUP_COUNT; i++)
+        found += d7anp_ssr_get_node(addresses[(i * 7919) % (SSR_SIZE * 2)]) != NULL;
+
+    double hash_ns = elapsed_ns(&start) / LOOKUP_COUNT;
+
+    uint32_t linear_found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < LOOKUP_COUNT; i++)
+        linear_found += linear_get_node(addresses[(i * 7919) % (SSR_SIZE * 2)]) != NULL;
+
+    double linear_ns = elapsed_ns(&start) / LOOKUP_COUNT;
+
+    assert(found == linear_found);
+    printf("lookup in a register of %u nodes: %.1f ns (linear scan %.1f ns)\n", SSR_SIZE, hash_ns, linear_ns);
+}
+
+static void benchmark_nodes(uint32_t node_count, bool active_set, uint16_t evicted_nodes)
+{
+    uint32_t* frame_counters = calloc(node_count, sizeof(uint32_t));
+    uint32_t* accepted_counters = calloc(node_count, sizeof(uint32_t));
+    uint32_t hits = 0, added = 0, refused = 0, replays = 0, replays_accepted = 0;
+
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(evicted_nodes);
+    d7anp_ssr_init();
+    stubs_entry_writes = 0;
+    stubs_evicted_writes = 0;
+    srand(node_count);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t frame = 1; frame <= FRAME_COUNT; frame++)
+    {
+        uint32_t id = rand() % node_count;
+        if(active_set && rand() % 100 < ACTIVE_PERCENT)
+            id = (frame / ACTIVE_DRIFT_FRAMES + rand() % ACTIVE_NODES) % node_count;
+
+        uint32_t frame_counter = ++frame_counters[id];
+        uint8_t address[8];
+        stubs_node_address(id, address);
+
+        // the checks done by d7anp_disassemble_packet_header()
+        dae_nwl_trusted_node_t* node = d7anp_ssr_get_node(address);
+        if(node)
+        {
+            assert(node->frame_counter < frame_counter);
+            d7anp_ssr_update_frame_counter(node, frame_counter);
+            accepted_counters[id] = frame_counter;
+            hits++;
+        }
+        else if(d7anp_ssr_may_add_node(address, frame_counter))
+        {
+            d7anp_ssr_add_node(address, frame_counter, 0);
+            accepted_counters[id] = frame_counter;
+            added++;
+        }
+        else
+            refused++;
+
+        // the replay of an accepted frame, or of one before it
+        uint32_t replay_id = rand() % node_count;
+        if(accepted_counters[replay_id] > 0)
+        {
+            uint32_t replay_counter = accepted_counters[replay_id] - rand() % accepted_counters[replay_id];
+            stubs_node_address(replay_id, address);
+            node = d7anp_ssr_get_node(address);
+            replays++;
+            if(node ? node->frame_counter < replay_counter : d7anp_ssr_may_add_node(address, replay_counter))
+                replays_accepted++;
+        }
+
+        if(frame % PERSIST_PERIOD_FRAMES == 0)
+            d7anp_ssr_persist();
+    }
+
+    // the replays are included, they only do lookups
+    double frame_ns = elapsed_ns(&start) / FRAME_COUNT;
+    uint32_t accepted = hits + added;
+    printf("%5u nodes, %s, %5u evicted node entries: %4.1f%% found, %4.1f%% added (%u evictions), %4.1f%% refused,"
+           " %.1f ns/frame, %u writes/1000 frames (%u when writing every change) and %u of evicted nodes,"
+           " %u of %u replays accepted\n",
+           node_count, active_set ? "active set" : "random", evicted_nodes, 100.0 * hits / FRAME_COUNT,
+           100.0 * added / FRAME_COUNT,
+           added > SSR_SIZE ? added - SSR_SIZE : 0, 100.0 * refused / FRAME_COUNT, frame_ns,
+           (uint32_t)(1000ULL * stubs_entry_writes / FRAME_COUNT), (uint32_t)(1000ULL * accepted / FRAME_COUNT),
+           (uint32_t)(1000ULL * stubs_evicted_writes / FRAME_COUNT), replays_accepted, replays);
+    assert(replays_accepted == 0);
+    assert(evicted_nodes < node_count || refused == 0);
+    free(frame_counters);
+    free(accepted_counters);
+}
+
+void bootstrap()
+{
+    benchmark_lookup();
+    benchmark_nodes(1000, false, 1500);
+    benchmark_nodes(10000, false, STUBS_EVICTED_FILE_SIZE);
+    benchmark_nodes(1000, true, 1500);
+    benchmark_nodes(10000, true, STUBS_EVICTED_FILE_SIZE);
+    benchmark_nodes(10000, false, DEFAULT_EVICTED_NODES);
+    benchmark_nodes(10000, true, DEFAULT_EVICTED_NODES);
+    printf("Security state register benchmark done!\n");
+    exit(0);
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the security state register on the NATIVE platform: nodes are loaded from the (stubbed) file system, found
+ * through the hash index and evicted in least recently used order when the register is full. A random sequence of
+ * frames is checked against a simple model of the register, which also exercises the removal from the index: no
+ * honest frame may be refused and no node may ever be added again with a frame counter it already used. The evicted
+ * nodes have to be remembered after a reboot, also a node which was evicted before its slot was written, and when
+ * they can not be stored the register may not evict. Finally the changes have to reach the file system in one batch,
+ * after MODULE_D7AP_SSR_PERSIST_DELAY.
+ */
+#include "MODULE_D7AP_defs.h"
+#include "d7anp_ssr.h"
+#include "stubs.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SSR_SIZE FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE
+#define EVICTED_NODES (2 * SSR_SIZE)
+#define CHURN_NODES (4 * SSR_SIZE)
+#define CHURN_FRAMES 20000
+
+#if SSR_SIZE < 4
+#error "this test needs a register of at least 4 nodes"
+#endif
+
+static dae_nwl_trusted_node_t* get_node(uint32_t id)
+{
+    uint8_t address[8];
+    stubs_node_address(id, address);
+    return d7anp_ssr_get_node(address);
+}
+
+static dae_nwl_trusted_node_t* add_node(uint32_t id, uint32_t frame_counter)
+{
+    uint8_t address[8];
+    stubs_node_address(id, address);
+    return d7anp_ssr_add_node(address, frame_counter, 0);
+}
+
+static bool may_add_node(uint32_t id, uint32_t frame_counter)
+{
+    uint8_t address[8];
+    stubs_node_address(id, address);
+    return d7anp_ssr_may_add_node(address, frame_counter);
+}
+
+static void test_load()
+{
+    stubs_reset_evicted_file(EVICTED_NODES);
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_ssr_file.filter_mode = 0x01;
+    stubs_ssr_file.trusted_node_nb = 3;
+    for(uint8_t i = 0; i < 3; i++)
+    {
+        stubs_node_address(i + 1, stubs_ssr_file.trusted_node_table[i].addr);
+        stubs_ssr_file.trusted_node_table[i].frame_counter = (i + 1) * 10;
+    }
+
+    d7anp_ssr_init();
+    assert(d7anp_ssr_get_filter_mode() == 0x01);
+    for(uint8_t i = 0; i < 3; i++)
+        assert(get_node(i + 1)->frame_counter == (i + 1) * 10u);
+
+    assert(get_node(4) == NULL);
+    printf("Load OK\n");
+}
+
+static void test_eviction()
+{
+    // fill the register behind the 3 loaded nodes
+    for(uint32_t id = 100; id < 100 + SSR_SIZE - 3; id++)
+        assert(add_node(id, id)->frame_counter == id);
+
+    // node 1 was loaded first so it is the least recently used one, unless it receives a frame
+    d7anp_ssr_update_frame_counter(get_node(1), 11);
+    assert(add_node(500, 5) != NULL);
+    assert(get_node(2) == NULL);
+    for(uint32_t id = 100; id < 100 + SSR_SIZE - 3; id++)
+        assert(get_node(id) != NULL);
+    assert(get_node(1) && get_node(3) && get_node(500));
+
+    // the evicted node may not go back in time, not even after it is evicted
+    assert(!may_add_node(2, 19));
+    assert(!may_add_node(2, 20));
+    assert(may_add_node(2, 21));
+    assert(add_node(2, 21) != NULL);
+    assert(get_node(3) == NULL);
+    assert(!may_add_node(3, 30));
+    assert(may_add_node(3, 31));
+    printf("Eviction OK\n");
+}
+
+static void test_churn()
+{
+    // the model keeps the nodes in the register, from the most to the least recently used
+    uint32_t model[SSR_SIZE];
+    uint8_t model_nb = 0;
+    uint32_t frame_counters[CHURN_NODES] = { 0 };
+    uint32_t accepted_counters[CHURN_NODES] = { 0 };
+
+    // every node which is not in the register fits in the evicted nodes
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(CHURN_NODES);
+    d7anp_ssr_init();
+    srand(42);
+    for(uint32_t frame = 0; frame < CHURN_FRAMES; frame++)
+    {
+        uint32_t id = rand() % CHURN_NODES;
+        uint32_t frame_counter = ++frame_counters[id];
+        dae_nwl_trusted_node_t* node = get_node(id);
+
+        uint8_t position = 0;
+        while(position < model_nb && model[position] != id)
+            position++;
+
+        if(position < model_nb)
+        {
+            assert(node != NULL && node->frame_counter < frame_counter);
+            d7anp_ssr_update_frame_counter(node, frame_counter);
+        }
+        else
+        {
+            assert(node == NULL);
+            // an evicted node can not be added with a frame counter it already used
+            if(accepted_counters[id] > 0)
+                assert(!may_add_node(id, accepted_counters[id]));
+
+            assert(may_add_node(id, frame_counter));
+            assert(add_node(id, frame_counter) != NULL);
+            if(model_nb < SSR_SIZE)
+                model_nb++;
+
+            position = model_nb - 1;
+        }
+
+        accepted_counters[id] = frame_counter;
+        memmove(&model[1], &model[0], position * sizeof(model[0]));
+        model[0] = id;
+
+        if(frame % 97 == 0)
+        {
+            for(uint8_t i = 0; i < model_nb; i++)
+                assert(get_node(model[i]) != NULL);
+
+            for(uint32_t other = CHURN_NODES; other < CHURN_NODES + 64; other++)
+                assert(get_node(other) == NULL);
+        }
+    }
+
+    printf("Churn of %u frames from %u nodes OK\n", CHURN_FRAMES, CHURN_NODES);
+}
+
+static void test_reboot()
+{
+    // one entry of the evicted nodes file is kept free
+    const uint32_t evicted_nb = EVICTED_NODES - 1;
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(EVICTED_NODES);
+    d7anp_ssr_init();
+    for(uint32_t id = 0; id < SSR_SIZE + evicted_nb; id++)
+    {
+        assert(may_add_node(id, 100 + id));
+        assert(add_node(id, 100 + id) != NULL);
+    }
+
+    // a new node could not be remembered when it is evicted
+    assert(!may_add_node(SSR_SIZE + evicted_nb, 1));
+    assert(add_node(SSR_SIZE + evicted_nb, 1) == NULL);
+
+    d7anp_ssr_persist();
+    d7anp_ssr_init();
+    for(uint32_t id = 0; id < evicted_nb; id++)
+    {
+        assert(get_node(id) == NULL);
+        assert(!may_add_node(id, 100 + id));
+        assert(may_add_node(id, 101 + id));
+    }
+
+    for(uint32_t id = evicted_nb; id < SSR_SIZE + evicted_nb; id++)
+        assert(get_node(id)->frame_counter == 100 + id);
+
+    // a node which comes back takes the place of the least recently used node, also when the file is full
+    assert(!may_add_node(SSR_SIZE + evicted_nb, 1));
+    assert(add_node(0, 101) != NULL);
+    uint32_t swapped = 0;
+    for(uint32_t id = evicted_nb; id < SSR_SIZE + evicted_nb; id++)
+    {
+        if(get_node(id) == NULL)
+        {
+            assert(!may_add_node(id, 100 + id));
+            swapped++;
+        }
+    }
+
+    assert(swapped == 1);
+    assert(get_node(0)->frame_counter == 101);
+    assert(!may_add_node(SSR_SIZE + evicted_nb, 1));
+    printf("Evicted nodes refused after a reboot OK\n");
+}
+
+static void test_unclean_reset()
+{
+#if MODULE_D7AP_SSR_PERSIST_DELAY > 0
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(EVICTED_NODES);
+    d7anp_ssr_init();
+    for(uint32_t id = 0; id < SSR_SIZE; id++)
+        add_node(id, 10);
+
+    d7anp_ssr_persist();
+
+    // node 0 sends a frame and is evicted as the least recently used node before the register is written
+    d7anp_ssr_update_frame_counter(get_node(0), 20);
+    for(uint32_t id = 1; id < SSR_SIZE; id++)
+        d7anp_ssr_update_frame_counter(get_node(id), 11);
+
+    assert(add_node(SSR_SIZE, 10) != NULL);
+    assert(get_node(0) == NULL);
+
+    // after the reset node 0 is back in the register, with the counter it was evicted with and only once
+    d7anp_ssr_init();
+    assert(get_node(0)->frame_counter == 20);
+    assert(get_node(SSR_SIZE) == NULL);
+    uint8_t address[8];
+    stubs_node_address(0, address);
+    for(uint16_t index = 0; index < EVICTED_NODES; index++)
+        assert(stubs_evicted_file[index].next_frame_counter == 0);
+
+    for(uint8_t slot = 0; slot < SSR_SIZE; slot++)
+    {
+        if(memcmp(stubs_ssr_file.trusted_node_table[slot].addr, address, sizeof(address)) == 0)
+            assert(stubs_ssr_file.trusted_node_table[slot].frame_counter == 20);
+    }
+
+    printf("Evicted node in the register after an unclean reset OK\n");
+#endif
+}
+
+static void test_eviction_not_allowed()
+{
+    // without a place to store the evicted nodes, nodes can only be added as long as the register is not full
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(0);
+    d7anp_ssr_init();
+    for(uint32_t id = 0; id < SSR_SIZE; id++)
+    {
+        assert(may_add_node(id, 1));
+        assert(add_node(id, 1) != NULL);
+    }
+
+    assert(!may_add_node(SSR_SIZE, 1));
+    assert(add_node(SSR_SIZE, 1) == NULL);
+    d7anp_ssr_update_frame_counter(get_node(0), 2);
+    for(uint32_t id = 0; id < SSR_SIZE; id++)
+        assert(get_node(id) != NULL);
+
+    // when the evicted nodes can not be read, any unknown node may have been evicted
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_reset_evicted_file(EVICTED_NODES);
+    d7anp_ssr_init();
+    stubs_evicted_file_error = true;
+    assert(!may_add_node(1, 1));
+    assert(add_node(1, 1) == NULL);
+
+    stubs_evicted_file_error = false;
+    printf("No eviction without evicted node storage OK\n");
+}
+
+static void check_persisted(void *arg)
+{
+#if MODULE_D7AP_SSR_PERSIST_DELAY > 0
+    // one write per changed node, the count is written once for the two new nodes
+    assert(stubs_entry_writes == 4);
+    assert(stubs_count_writes == 1);
+#endif
+    assert(stubs_ssr_file.trusted_node_nb == 4);
+    assert(stubs_ssr_file.trusted_node_table[0].frame_counter == 100);
+    assert(stubs_ssr_file.trusted_node_table[1].frame_counter == 200);
+    assert(stubs_ssr_file.trusted_node_table[3].frame_counter == 41);
+    printf("Batched persistence OK\n");
+    printf("All security state register tests passed!\n");
+    exit(0);
+}
+
+static void test_persistence()
+{
+    stubs_reset_evicted_file(EVICTED_NODES);
+    memset(&stubs_ssr_file, 0, sizeof(stubs_ssr_file));
+    stubs_ssr_file.trusted_node_nb = 2;
+    stubs_node_address(1, stubs_ssr_file.trusted_node_table[0].addr);
+    stubs_node_address(2, stubs_ssr_file.trusted_node_table[1].addr);
+    d7anp_ssr_init();
+
+    stubs_entry_writes = 0;
+    stubs_count_writes = 0;
+    for(uint32_t frame_counter = 1; frame_counter <= 100; frame_counter++)
+    {
+        d7anp_ssr_update_frame_counter(get_node(1), frame_counter);
+        d7anp_ssr_update_frame_counter(get_node(2), 2 * frame_counter);
+    }
+
+    add_node(3, 30);
+    add_node(4, 40);
+    d7anp_ssr_update_frame_counter(get_node(4), 41);
+#if MODULE_D7AP_SSR_PERSIST_DELAY > 0
+    assert(stubs_entry_writes == 0);
+#endif
+
+    sched_register_task(&check_persisted);
+    timer_post_task_delay(&check_persisted, (MODULE_D7AP_SSR_PERSIST_DELAY + 1) * TIMER_TICKS_PER_SEC);
+}
+
+void bootstrap()
+{
+    test_load();
+    test_eviction();
+    test_churn();
+    test_reboot();
+    test_unclean_reset();
+    test_eviction_not_allowed();
+    test_persistence();
+}
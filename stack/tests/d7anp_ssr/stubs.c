@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stubs.h"
+#include "d7ap_fs.h"
+#include "errors.h"
+#include "assert.h"
+#include <string.h>
+
+dae_nwl_ssr_t stubs_ssr_file;
+uint32_t stubs_entry_writes = 0;
+uint32_t stubs_count_writes = 0;
+
+dae_nwl_evicted_node_t stubs_evicted_file[STUBS_EVICTED_FILE_SIZE];
+uint16_t stubs_evicted_node_count = 0;
+bool stubs_evicted_file_error = false;
+uint32_t stubs_evicted_writes = 0;
+
+void stubs_reset_evicted_file(uint16_t count)
+{
+    assert(count <= STUBS_EVICTED_FILE_SIZE);
+    memset(stubs_evicted_file, 0, count * sizeof(dae_nwl_evicted_node_t));
+    stubs_evicted_node_count = count;
+    stubs_evicted_file_error = false;
+}
+
+void stubs_node_address(uint32_t node, uint8_t* address)
+{
+    // UIDs of one vendor, which only differ in the last bytes
+    uint8_t uid[8] = { 0xBE, 0x45, 0x00, 0x00, node >> 24, node >> 16, node >> 8, node };
+    memcpy(address, uid, sizeof(uid));
+}
+
+int d7ap_fs_read_nwl_security_state_register(dae_nwl_ssr_t *node_security_state)
+{
+    memcpy(node_security_state, &stubs_ssr_file, sizeof(dae_nwl_ssr_t));
+    return 0;
+}
+
+int d7ap_fs_add_nwl_security_state_register_entry(dae_nwl_trusted_node_t *trusted_node, uint8_t trusted_node_nb)
+{
+    d7ap_fs_update_nwl_security_state_register(trusted_node, trusted_node_nb);
+    stubs_ssr_file.trusted_node_nb = trusted_node_nb;
+    stubs_count_writes++;
+    return 0;
+}
+
+int d7ap_fs_update_nwl_security_state_register(dae_nwl_trusted_node_t *trusted_node, uint8_t trusted_node_index)
+{
+    assert(trusted_node_index >= 1 && trusted_node_index <= FRAMEWORK_FS_TRUSTED_NODE_TABLE_SIZE);
+    memcpy(&stubs_ssr_file.trusted_node_table[trusted_node_index - 1], trusted_node, sizeof(dae_nwl_trusted_node_t));
+    stubs_entry_writes++;
+    return 0;
+}
+
+int d7ap_fs_get_nwl_ssr_evicted_node_count(void)
+{
+    return stubs_evicted_node_count > 0 ? stubs_evicted_node_count : -ENOENT;
+}
+
+int d7ap_fs_read_nwl_ssr_evicted_node(dae_nwl_evicted_node_t *evicted_node, uint16_t index)
+{
+    if(stubs_evicted_file_error)
+        return -EIO;
+
+    assert(index < stubs_evicted_node_count);
+    memcpy(evicted_node, &stubs_evicted_file[index], sizeof(dae_nwl_evicted_node_t));
+    return 0;
+}
+
+int d7ap_fs_write_nwl_ssr_evicted_node(const dae_nwl_evicted_node_t *evicted_node, uint16_t index)
+{
+    if(stubs_evicted_file_error)
+        return -EIO;
+
+    assert(index < stubs_evicted_node_count);
+    memcpy(&stubs_evicted_file[index], evicted_node, sizeof(dae_nwl_evicted_node_t));
+    stubs_evicted_writes++;
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stubs of the security state register file and the evicted nodes file, so the register can be tested without the
+ * file system. The entries are kept in RAM and every write is counted.
+ */
+#ifndef D7ANP_SSR_TEST_STUBS_H
+#define D7ANP_SSR_TEST_STUBS_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "dae.h"
+
+extern dae_nwl_ssr_t stubs_ssr_file;
+extern uint32_t stubs_entry_writes;
+extern uint32_t stubs_count_writes;
+
+// the evicted nodes file, with room for the largest simulated network. It is not defined while its count is 0.
+#define STUBS_EVICTED_FILE_SIZE 16384
+extern dae_nwl_evicted_node_t stubs_evicted_file[STUBS_EVICTED_FILE_SIZE];
+extern uint16_t stubs_evicted_node_count;
+extern bool stubs_evicted_file_error; // the file can not be read or written, as when the storage fails
+extern uint32_t stubs_evicted_writes;
+
+/*! Defines an empty evicted nodes file of count entries */
+void stubs_reset_evicted_file(uint16_t count);
+
+/*! Fills the address of a simulated node */
+void stubs_node_address(uint32_t node, uint8_t* address);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Test of the decoded file header cache of d7ap_fs on the NATIVE platform: the cached headers must stay
+ * coherent with the headers stored in the filesystem while files are accessed, resized and their
+ * permissions changed, also when more files are accessed than the cache can hold.
+ */
+#include "MODULE_D7AP_FS_defs.h"
+#include "d7ap_fs.h"
+#include "fs.h"
+#include "alp_layer.h"
+#include "errors.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FILE_COUNT 12
+#define FILE_ALLOCATED_LENGTH 16 // two volatile files fit in FRAMEWORK_FS_VOLATILE_STORAGE_SIZE
+#define FILE_ID(i) (0x30 + (i))
+
+// normally generated for applications from cmake/version.c.in
+const char _GIT_SHA1[] = "0000000";
+const char _APP_NAME[] = "d7apfs";
+
+#if defined(MODULE_ALP) && defined(MODULE_D7AP)
+// d7ap_fs hands D7AActP actions to the ALP layer, which is not linked in since the test files have no action protocol
+void alp_layer_process_d7aactp(alp_interface_config_t* interface_config, uint8_t* alp_command, uint32_t alp_command_length)
+{
+    assert(false);
+}
+#endif
+
+static void check_stored_header(uint8_t file_id, const d7ap_fs_file_header_t* expected)
+{
+    d7ap_fs_file_header_t stored;
+    assert(fs_read_file(file_id, 0, (uint8_t*)&stored, sizeof(stored)) == SUCCESS);
+    stored.length = __builtin_bswap32(stored.length);
+    stored.allocated_length = __builtin_bswap32(stored.allocated_length);
+    assert(memcmp(&stored, expected, sizeof(stored)) == 0);
+}
+
+static void init_files()
+{
+    uint8_t data[FILE_ALLOCATED_LENGTH];
+
+    for(int i = 0; i < FILE_COUNT; i++)
+    {
+        d7ap_fs_file_header_t header = {
+            .file_permissions = { .guest_read = true, .user_read = true, .user_write = true },
+            .file_properties.storage_class = (i % 6 == 0) ? FS_STORAGE_VOLATILE : FS_STORAGE_PERMANENT,
+            .length = FILE_ALLOCATED_LENGTH / 2,
+            .allocated_length = FILE_ALLOCATED_LENGTH
+        };
+
+        memset(data, i, sizeof(data));
+        assert(d7ap_fs_init_file(FILE_ID(i), &header, data) == SUCCESS);
+        check_stored_header(FILE_ID(i), &header);
+    }
+}
+
+static void check_file(int i, uint32_t length)
+{
+    uint8_t buffer[FILE_ALLOCATED_LENGTH];
+    uint32_t read_length = sizeof(buffer);
+
+    assert(d7ap_fs_read_file(FILE_ID(i), 0, buffer, &read_length, ROOT_AUTH) == SUCCESS);
+    assert(read_length == length);
+    for(int j = 0; j < length; j++)
+        assert(buffer[j] == (uint8_t)i);
+}
+
+static void test_hits()
+{
+    const d7ap_fs_header_cache_stats_t* stats = d7ap_fs_get_header_cache_stats();
+
+    check_file(FILE_COUNT - 1, FILE_ALLOCATED_LENGTH / 2);
+    uint32_t hits = stats->hits;
+    uint32_t misses = stats->misses;
+
+    // repeated accesses to the same file do not read its header again
+    for(int n = 0; n < 10; n++)
+        check_file(FILE_COUNT - 1, FILE_ALLOCATED_LENGTH / 2);
+
+#if MODULE_D7AP_FS_HEADER_CACHE_SIZE > 0
+    assert(stats->hits == hits + 10 && stats->misses == misses);
+#else
+    assert(stats->hits == hits && stats->misses == misses + 10);
+#endif
+    printf("Header cache hits OK\n");
+}
+
+static void test_coherency()
+{
+    d7ap_fs_file_header_t header;
+    uint8_t data[FILE_ALLOCATED_LENGTH];
+    uint32_t length = 1;
+
+    for(int i = 0; i < FILE_COUNT; i++)
+    {
+        // grow the file and fill the new part
+        assert(d7ap_fs_change_file_length(FILE_ID(i), FILE_ALLOCATED_LENGTH) == SUCCESS);
+        assert(d7ap_fs_get_file_length(FILE_ID(i)) == FILE_ALLOCATED_LENGTH);
+        memset(data, i, sizeof(data));
+        assert(d7ap_fs_write_file(FILE_ID(i), 0, data, FILE_ALLOCATED_LENGTH, ROOT_AUTH) == SUCCESS);
+
+        assert(d7ap_fs_update_permissions(FILE_ID(i), false, false, i % 2, false) == SUCCESS);
+    }
+
+    // access the files round robin, so a small cache keeps evicting headers
+    for(int round = 0; round < 3; round++)
+    {
+        for(int i = 0; i < FILE_COUNT; i++)
+        {
+            check_file(i, FILE_ALLOCATED_LENGTH);
+            assert(d7ap_fs_read_file(FILE_ID(i), 0, data, &length, GUEST_AUTH) == -EACCES);
+            assert((d7ap_fs_read_file(FILE_ID(i), 0, data, &length, USER_AUTH) == -EACCES) == !(i % 2));
+            assert(d7ap_fs_write_file(FILE_ID(i), 0, data, 1, USER_AUTH) == -EACCES);
+
+            assert(d7ap_fs_read_file_header(FILE_ID(i), &header) == SUCCESS);
+            check_stored_header(FILE_ID(i), &header);
+            assert(header.length == FILE_ALLOCATED_LENGTH && header.file_permissions.user_read == i % 2);
+        }
+    }
+
+    // the header passed to d7ap_fs_write_file_header() is left untouched
+    header.length = 3;
+    d7ap_fs_file_header_t written = header;
+    assert(d7ap_fs_write_file_header(FILE_ID(0), &written, ROOT_AUTH) == SUCCESS);
+    assert(memcmp(&written, &header, sizeof(header)) == 0);
+    check_stored_header(FILE_ID(0), &header);
+    check_file(0, 3);
+    printf("Header cache coherency OK\n");
+}
+
+void bootstrap()
+{
+    d7ap_fs_init();
+    init_files();
+
+    test_hits();
+    test_coherency();
+
+    const d7ap_fs_header_cache_stats_t* stats = d7ap_fs_get_header_cache_stats();
+    printf("%u header lookups, hit rate %u%%\n", (unsigned)(stats->hits + stats->misses),
+           (unsigned)(100 * stats->hits / (stats->hits + stats->misses)));
+    printf("All d7ap_fs tests passed!\n");
+    exit(0);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native benchmark of the D7ASP request aggregation: a number of small requests for one addressee is
+ * flushed, once as writes without response payload and once as reads expecting a response payload. When
+ * MODULE_D7AP_AGGREGATE_REQUESTS is enabled the requests which fit in a frame are sent together in one
+ * transaction and the responses are reported per request. Nothing is simulated: the lower layers are the stubs
+ * which ack every request right away, and the air time is only an estimate calculated from the frames handed to
+ * the stubbed transport layer and their acks, using a fixed overhead per frame and a normal rate channel.
+ */
+#include "MODULE_D7AP_defs.h"
+#include "d7asp.h"
+#include "stubs.h"
+#include "alp.h"
+#include "scheduler.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#if FRAMEWORK_SHARED_BUFFER_COUNT < MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT
+#error "every queued request holds a shared buffer, this benchmark needs FRAMEWORK_SHARED_BUFFER_COUNT >= MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT"
+#endif
+
+#define REQUEST_COUNT 48
+#define DATA_LENGTH 4           // written or read per request
+#define FRAME_OVERHEAD 20       // preamble, sync word, lower layer headers and CRC, see d7asp_process_received_packet()
+#define ACK_FRAME_LENGTH 20
+#define GUARD_TIME_MS 5         // t_g, including the CSMA-CA for the next transaction
+#define BYTES_PER_S (55555 / 8) // normal rate channel
+
+static bool read_requests;
+static uint16_t queued_count;
+static uint16_t completed_sessions;
+
+static void queue_requests()
+{
+    d7ap_session_config_t config = {
+        .qos.qos_resp_mode = SESSION_RESP_MODE_ANY,
+        .addressee = {
+            .ctrl.id_type = ID_TYPE_UID,
+            .access_class = 0x01,
+            .id = { 0, 0, 0, 0, 0, 0, 0, 1 }
+        }
+    };
+
+    uint8_t write[4 + DATA_LENGTH] = { ALP_OP_WRITE_FILE_DATA, 0x40, 0x00, DATA_LENGTH };
+    uint8_t read[4] = { ALP_OP_READ_FILE_DATA, 0x40, 0x00, DATA_LENGTH };
+    uint8_t token = d7asp_master_session_create(&config);
+    assert(token != 0);
+    for(uint8_t i = 0; i < MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT && queued_count < REQUEST_COUNT; i++)
+    {
+        if(read_requests)
+            stubs_queue_request(token, read, sizeof(read), 4 + DATA_LENGTH);
+        else
+            stubs_queue_request(token, write, sizeof(write), 0);
+
+        queued_count++;
+    }
+}
+
+static void next();
+
+static void session_completed(uint8_t session_token, uint8_t* success_bitmap)
+{
+    completed_sessions++;
+    if(queued_count < REQUEST_COUNT)
+        queue_requests();
+    else
+        sched_post_task(&next); // all requests are flushed
+}
+
+static void report(const char* name)
+{
+    uint32_t air_bytes = 0;
+    for(uint16_t i = 0; i < stubs_sent_count; i++)
+        air_bytes += FRAME_OVERHEAD + stubs_sent[i].payload_length + ACK_FRAME_LENGTH + stubs_sent[i].response_length;
+
+    uint32_t air_time_ms = (air_bytes * 1000) / BYTES_PER_S + stubs_sent_count * GUARD_TIME_MS;
+    uint16_t responses = 0;
+    for(uint16_t i = 0; i < stubs_response_count; i++)
+        responses += (stubs_responses[i].length > 0);
+
+    printf("%-18s %3u requests in %3u transactions (%u sessions), %3u responses, ~%5u bytes on air, ~%4u ms, ~%3u requests/s\n",
+           name, REQUEST_COUNT, stubs_sent_count, completed_sessions, responses, air_bytes, air_time_ms,
+           (REQUEST_COUNT * 1000) / air_time_ms);
+}
+
+static void run(bool reads)
+{
+    read_requests = reads;
+    queued_count = 0;
+    completed_sessions = 0;
+    stubs_sent_count = 0;
+    stubs_response_count = 0;
+    queue_requests();
+}
+
+static void next()
+{
+    if(!read_requests)
+    {
+        report("writes:");
+        run(true);
+        return;
+    }
+
+    report("reads:");
+    printf("D7ASP aggregation benchmark done!\n");
+    exit(0);
+}
+
+void bootstrap()
+{
+    sched_register_task(&next);
+    stubs_init();
+    stubs_session_completed_cb = &session_completed;
+
+    printf("%u data bytes per request, %u requests per session FIFO, air time estimated from stubbed lower layers\n",
+           DATA_LENGTH, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
+    run(false);
+}
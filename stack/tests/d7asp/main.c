@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the D7ASP master session table on the NATIVE platform: requests for different addressees are
+ * queued in separate sessions, which are flushed one after the other in round-robin order, and a dormant
+ * session is only flushed after its timeout. The queued requests of a session are sent in one transaction and
+ * the response of such a transaction is reported per request.
+ */
+#include "MODULE_D7AP_defs.h"
+#include "d7asp.h"
+#include "stubs.h"
+#include "alp.h"
+#include "bitmap.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if MODULE_D7AP_MAX_SESSION_COUNT < 2
+#error "this test needs at least 2 sessions"
+#endif
+
+#if MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT < 2
+#error "this test needs at least 2 requests per session"
+#endif
+
+#define WRITE_REQUEST_LENGTH 5
+#define READ_REQUEST_LENGTH 4
+#define READ_LENGTH 3
+#define READ_RESPONSE_LENGTH (4 + READ_LENGTH)
+
+static uint8_t completed[16];
+static uint8_t completed_count = 0;
+static uint8_t success_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
+
+static uint8_t token_a, token_b, token_a2, token_c, token_d, token_e, token_f;
+static timer_tick_t dormant_created_time;
+
+static uint8_t create_session(uint8_t id, uint8_t dormant_timeout)
+{
+    d7ap_session_config_t config = {
+        .qos.qos_resp_mode = SESSION_RESP_MODE_ANY,
+        .dormant_timeout = dormant_timeout,
+        .addressee = {
+            .ctrl.id_type = ID_TYPE_UID,
+            .access_class = 0x01,
+            .id = { 0, 0, 0, 0, 0, 0, 0, id }
+        }
+    };
+
+    return d7asp_master_session_create(&config);
+}
+
+static void queue_write(uint8_t token)
+{
+    uint8_t payload[WRITE_REQUEST_LENGTH] = { ALP_OP_WRITE_FILE_DATA, 0x40, 0x00, 0x01, 0xAA };
+    stubs_queue_request(token, payload, sizeof(payload), 0);
+}
+
+static void queue_read(uint8_t token, uint8_t file_id)
+{
+    uint8_t payload[READ_REQUEST_LENGTH] = { ALP_OP_READ_FILE_DATA, file_id, 0x00, READ_LENGTH };
+    stubs_queue_request(token, payload, sizeof(payload), READ_RESPONSE_LENGTH);
+}
+
+static void session_completed(uint8_t session_token, uint8_t* session_success_bitmap)
+{
+    assert(completed_count < sizeof(completed));
+    completed[completed_count++] = session_token;
+    memcpy(success_bitmap, session_success_bitmap, sizeof(success_bitmap));
+    assert(bitmap_get(success_bitmap, 0));
+
+    if(session_token == token_a && token_a2 == 0)
+    {
+        // a client queuing a new request from the completion callback gets a new session, which has to wait
+        // until the pending session for the other addressee is flushed
+        token_a2 = create_session(1, 0);
+        assert(token_a2 != 0 && token_a2 != token_a && token_a2 != token_b);
+        queue_write(token_a2);
+    }
+}
+
+static void check_sent(const sent_request_t* expected, uint8_t count)
+{
+    assert(stubs_sent_count == count);
+    for(uint8_t i = 0; i < count; i++)
+    {
+        assert(stubs_sent[i].token == expected[i].token);
+        assert(stubs_sent[i].request_id == expected[i].request_id);
+        assert(stubs_sent[i].payload_length == expected[i].payload_length);
+    }
+}
+
+static void check_responses(const received_response_t* expected, uint8_t count)
+{
+    assert(stubs_response_count == count);
+    for(uint8_t i = 0; i < count; i++)
+    {
+        assert(stubs_responses[i].seqnr == expected[i].seqnr);
+        assert(stubs_responses[i].length == expected[i].length);
+        assert(stubs_responses[i].file_id == expected[i].file_id);
+    }
+}
+
+static void check_failing_request()
+{
+    assert(completed_count == 7 && completed[6] == token_f);
+#if defined(MODULE_D7AP_AGGREGATE_REQUESTS)
+    // the tag response of the second request has the error flag set, only that request failed
+    assert(!bitmap_get(success_bitmap, 1));
+#endif
+    printf("Failing request OK\n");
+    // the completed sessions released the buffers of their requests
+    assert(shared_buffer_get_free_count() == FRAMEWORK_SHARED_BUFFER_COUNT);
+    printf("All d7asp tests passed!\n");
+    exit(0);
+}
+
+static void check_response_requests()
+{
+    assert(completed_count == 6 && completed[5] == token_e);
+    // the reads are sent together, and the response is reported per request
+    received_response_t expected_responses[] = { { 0, READ_RESPONSE_LENGTH, 1 }, { 1, READ_RESPONSE_LENGTH, 2 } };
+#if defined(MODULE_D7AP_AGGREGATE_REQUESTS)
+    sent_request_t expected[] = { { token_e, 0, 2 * (READ_REQUEST_LENGTH + ALP_OP_SIZE_REQUEST_TAG) } };
+#else
+    sent_request_t expected[] = { { token_e, 0, READ_REQUEST_LENGTH }, { token_e, 1, READ_REQUEST_LENGTH } };
+#endif
+    check_sent(expected, sizeof(expected) / sizeof(expected[0]));
+    check_responses(expected_responses, sizeof(expected_responses) / sizeof(expected_responses[0]));
+    printf("Requests expecting a response OK\n");
+
+    stubs_failing_request_id = 1;
+    token_f = create_session(6, 0);
+    queue_read(token_f, 1);
+    queue_read(token_f, 2);
+
+    timer_post_task_delay(&check_failing_request, 100);
+}
+
+static void check_dormant_session()
+{
+    // the dormant session is flushed after its timeout, after the session created later
+    assert(completed_count == 5 && completed[3] == token_c && completed[4] == token_d);
+    assert(stubs_sent_count >= 2 && stubs_sent[stubs_sent_count - 2].token == token_c && stubs_sent[stubs_sent_count - 1].token == token_d);
+    assert(timer_get_counter_value() - dormant_created_time >= 1024);
+    printf("Dormant session OK\n");
+
+    stubs_sent_count = 0;
+    stubs_response_count = 0;
+    token_e = create_session(5, 0);
+    queue_read(token_e, 1);
+    queue_read(token_e, 2);
+
+    timer_post_task_delay(&check_response_requests, 100);
+}
+
+static void test_dormant_session()
+{
+    // the sessions of the first test are all completed by now
+    assert(completed_count == 3 && completed[0] == token_a && completed[1] == token_b && completed[2] == token_a2);
+#if defined(MODULE_D7AP_AGGREGATE_REQUESTS)
+    // both requests for A are sent in one transaction
+    sent_request_t expected[] = { { token_a, 0, 2 * WRITE_REQUEST_LENGTH }, { token_b, 0, WRITE_REQUEST_LENGTH }, { token_a2, 0, WRITE_REQUEST_LENGTH } };
+#else
+    sent_request_t expected[] = { { token_a, 0, WRITE_REQUEST_LENGTH }, { token_a, 1, WRITE_REQUEST_LENGTH }, { token_b, 0, WRITE_REQUEST_LENGTH }, { token_a2, 0, WRITE_REQUEST_LENGTH } };
+#endif
+    check_sent(expected, sizeof(expected) / sizeof(expected[0]));
+    printf("Round-robin sessions OK\n");
+
+    dormant_created_time = timer_get_counter_value();
+    token_d = create_session(4, 1); // 1 s
+    queue_write(token_d);
+    token_c = create_session(3, 0);
+    queue_write(token_c);
+    assert(token_c != 0 && token_c != token_d);
+
+    timer_post_task_delay(&check_dormant_session, 2 * 1024);
+}
+
+void bootstrap()
+{
+    sched_register_task(&test_dormant_session);
+    sched_register_task(&check_dormant_session);
+    sched_register_task(&check_response_requests);
+    sched_register_task(&check_failing_request);
+    stubs_init();
+    stubs_session_completed_cb = &session_completed;
+
+    // requests for different addressees no longer have to wait until the previous session is completed
+    token_a = create_session(1, 0);
+    queue_write(token_a);
+    token_b = create_session(2, 0);
+    assert(token_b != 0 && token_b != token_a);
+    queue_write(token_b);
+    assert(create_session(1, 0) == token_a);
+    queue_write(token_a);
+
+#if MODULE_D7AP_MAX_SESSION_COUNT == 2
+    assert(create_session(3, 0) == 0); // all sessions in use
+#endif
+
+    timer_post_task_delay(&test_dormant_session, 100);
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stubs.h"
+
+#include "alp.h"
+#include "bitmap.h"
+#include "d7ap_stack.h"
+#include "d7asp.h"
+#include "d7atp.h"
+#include "packet_queue.h"
+#include "packet.h"
+#include "phy.h"
+#include "scheduler.h"
+#include "assert.h"
+#include <string.h>
+
+sent_request_t stubs_sent[STUBS_MAX_SENT_REQUESTS];
+uint16_t stubs_sent_count = 0;
+received_response_t stubs_responses[STUBS_MAX_RESPONSES];
+uint16_t stubs_response_count = 0;
+uint8_t stubs_failing_request_id = 0xFF;
+void (*stubs_session_completed_cb)(uint8_t session_token, uint8_t* success_bitmap) = NULL;
+
+static packet_t* request_packet;
+static d7ap_addressee_t responder;
+static uint8_t response_payload[PACKET_MAX_PAYLOAD_SIZE];
+
+void packet_init(packet_t* packet)
+{
+    memset(packet, 0x00, sizeof(packet_t));
+}
+
+uint16_t phy_calculate_tx_duration(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length, bool payload_only)
+{
+    return 0;
+}
+
+uint8_t d7ap_get_payload_max_size(nls_method_t nls_method)
+{
+    assert(nls_method == AES_NONE);
+    return D7A_PAYLOAD_MAX_SIZE;
+}
+
+static uint8_t append_tag_response(uint8_t length, uint8_t tag_id)
+{
+    response_payload[length++] = ALP_OP_RESPONSE_TAG | (1 << 7) | ((tag_id == stubs_failing_request_id) << 6);
+    response_payload[length++] = tag_id;
+    return length;
+}
+
+// the offsets and lengths of the requests fit in a one byte length operand
+static uint8_t build_response(const uint8_t* request, uint8_t request_length)
+{
+    uint8_t length = 0;
+    bool tagged = false;
+    uint8_t tag_id = 0;
+    uint8_t pos = 0;
+    while(pos < request_length)
+    {
+        switch(request[pos] & 0x3F)
+        {
+            case ALP_OP_REQUEST_TAG:
+                if(tagged)
+                    length = append_tag_response(length, tag_id);
+
+                tagged = true;
+                tag_id = request[pos + 1];
+                pos += 2;
+                break;
+            case ALP_OP_READ_FILE_DATA:
+                assert(length + 4 + request[pos + 3] <= sizeof(response_payload));
+                response_payload[length++] = ALP_OP_RETURN_FILE_DATA;
+                response_payload[length++] = request[pos + 1];
+                response_payload[length++] = request[pos + 2];
+                response_payload[length++] = request[pos + 3];
+                memset(response_payload + length, request[pos + 1], request[pos + 3]);
+                length += request[pos + 3];
+                pos += 4;
+                break;
+            case ALP_OP_WRITE_FILE_DATA:
+                pos += 4 + request[pos + 3];
+                break;
+            default:
+                assert(false);
+        }
+    }
+
+    if(tagged)
+        length = append_tag_response(length, tag_id);
+
+    return length;
+}
+
+static void respond()
+{
+    packet_t* response = packet_queue_alloc_packet();
+    assert(response != NULL);
+    response->d7atp_dialog_id = stubs_sent[stubs_sent_count - 1].token;
+    response->d7atp_transaction_id = stubs_sent[stubs_sent_count - 1].request_id;
+    memcpy(&responder, request_packet->d7anp_addressee, sizeof(d7ap_addressee_t));
+    response->d7anp_addressee = &responder;
+    response->payload = response_payload;
+    response->payload_length = build_response(request_packet->payload, request_packet->payload_length);
+    stubs_sent[stubs_sent_count - 1].response_length = response->payload_length;
+    d7asp_process_received_response(response, false);
+}
+
+error_t d7atp_send_request(uint8_t dialog_id, uint8_t transaction_id, bool is_last_transaction,
+                           packet_t* packet, d7ap_session_qos_t* qos_settings, uint8_t listen_timeout, uint8_t expected_response_length)
+{
+    assert(stubs_sent_count < STUBS_MAX_SENT_REQUESTS);
+    stubs_sent[stubs_sent_count].token = dialog_id;
+    stubs_sent[stubs_sent_count].request_id = transaction_id;
+    stubs_sent[stubs_sent_count].payload_length = packet->payload_length;
+    stubs_sent_count++;
+    request_packet = packet;
+    sched_post_task(&respond);
+    return SUCCESS;
+}
+
+error_t d7atp_send_response(packet_t* packet)
+{
+    assert(false);
+    return FAIL;
+}
+
+void d7atp_signal_dialog_termination() {}
+
+void d7ap_stack_session_completed(uint8_t session_token, uint8_t* progress_bitmap, uint8_t* success_bitmap, uint8_t bitmap_byte_count)
+{
+    if(stubs_session_completed_cb)
+        stubs_session_completed_cb(session_token, success_bitmap);
+}
+
+void d7ap_stack_process_received_response(uint8_t* payload, uint8_t length, d7ap_session_result_t result)
+{
+    assert(stubs_response_count < STUBS_MAX_RESPONSES);
+    stubs_responses[stubs_response_count++] = (received_response_t) {
+        .seqnr = result.seqnr,
+        .length = length,
+        .file_id = (length > 0) ? payload[1] : 0
+    };
+}
+
+bool d7ap_stack_process_unsolicited_request(uint8_t* payload, uint8_t length, d7ap_session_result_t result, bool response_expected) { return false; }
+void d7ap_stack_signal_active_master_session(uint8_t session_token) {}
+void d7ap_stack_signal_slave_session_terminated(void) {}
+void d7ap_stack_signal_transaction_terminated(void) {}
+
+void stubs_init()
+{
+    sched_register_task(&respond);
+    packet_queue_init();
+    d7asp_init();
+}
+
+uint8_t stubs_queue_request(uint8_t session_token, const uint8_t* payload, uint8_t length, uint8_t expected_response_length)
+{
+    shared_buffer_t* buffer = shared_buffer_alloc(D7AP_SEND_BUFFER_HEADROOM);
+    assert(buffer != NULL);
+    memcpy(shared_buffer_append(buffer, length), payload, length);
+    uint8_t request_id = d7asp_queue_request(session_token, buffer, expected_response_length);
+    shared_buffer_release(buffer);
+    return request_id;
+}
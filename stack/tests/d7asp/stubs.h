@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stubs for the layers around D7ASP, so the session layer can be tested on its own. Every request sent by
+ * D7ASP is recorded and acked by a unicast response. The requests are ALP read and write file data actions, the
+ * stubbed responder returns the data of each read, filled with its file ID, and ends the response of each tagged
+ * request with a tag response, like the ALP layer does.
+ */
+#ifndef D7ASP_TEST_STUBS_H
+#define D7ASP_TEST_STUBS_H
+
+#include "stdint.h"
+
+#define STUBS_MAX_SENT_REQUESTS 64
+#define STUBS_MAX_RESPONSES 64
+
+typedef struct {
+    uint8_t token;
+    uint8_t request_id;
+    uint8_t payload_length;
+    uint8_t response_length; /**< The length of the response payload of the ack */
+} sent_request_t;
+
+typedef struct {
+    uint8_t seqnr;
+    uint8_t length;
+    uint8_t file_id; /**< The file ID of the first read returned in the response, 0 when empty */
+} received_response_t;
+
+extern sent_request_t stubs_sent[STUBS_MAX_SENT_REQUESTS];
+extern uint16_t stubs_sent_count;
+
+/*! The responses D7ASP reports to the upper layer */
+extern received_response_t stubs_responses[STUBS_MAX_RESPONSES];
+extern uint16_t stubs_response_count;
+
+/*! The responder sets the error flag in the tag response of the request with this ID, 0xFF for none */
+extern uint8_t stubs_failing_request_id;
+
+/*! Called when D7ASP reports a completed session, with the success bitmap of its requests */
+extern void (*stubs_session_completed_cb)(uint8_t session_token, uint8_t* success_bitmap);
+
+/*! Initializes the packet queue and D7ASP */
+void stubs_init();
+
+/*! Queues a copy of the payload in a shared buffer as a request in the session, like d7ap_send() */
+uint8_t stubs_queue_request(uint8_t session_token, const uint8_t* payload, uint8_t length, uint8_t expected_response_length);
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Filesystem test on the NATIVE platform: a filesystem image is prepared on the RAM blockdevices
+ * before fs_init() loads it, after which more files are created and accessed in an order which
+ * exercises the eviction of the file header cache when FRAMEWORK_FS_HEADER_CACHE_SIZE is smaller
+ * than FRAMEWORK_FS_FILE_COUNT. The write-back cache is disabled by default, to test it as well use for example:
+ *   cmake -DPLATFORM=NATIVE -DTEST_FS=ON -DFRAMEWORK_FS_WRITEBACK_SLOTS=2 ..
+ */
+#include "fs.h"
+#include "blockdevice_ram.h"
+#include "platform.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "errors.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STORED_FILE_COUNT 3
+#define STORED_FILE_LENGTH 16
+#define CREATED_FILE_COUNT 20
+#define CREATED_FILE_LENGTH 20
+#define VOLATILE_FILE_COUNT 2
+#define VOLATILE_FILE_LENGTH 8
+
+#define WRITEBACK_FILE_COUNT 3
+#define WRITEBACK_FILE_LENGTH 40
+#define NOISE_FLOOR_UPDATES 100
+
+#define STORED_FILE_ID(i) (0x20 + (i))
+#define CREATED_FILE_ID(i) (0x28 + (i))
+#define VOLATILE_FILE_ID(i) (0x10 + (i))
+#define WRITEBACK_FILE_ID(i) (0x3C + (i))
+
+// the RAM buffers behind the blockdevices of the NATIVE platform
+#define d7ap_fs_metadata (((blockdevice_ram_t*) PLATFORM_METADATA_BLOCKDEVICE)->buffer)
+#define d7ap_files_data (((blockdevice_ram_t*) PLATFORM_PERMANENT_BLOCKDEVICE)->buffer)
+
+// count the physical program operations by wrapping the RAM blockdevice driver
+static error_t (*ram_program)(blockdevice_t* bd, const uint8_t* data, uint32_t addr, uint32_t size);
+static uint32_t program_count = 0;
+
+static error_t counting_program(blockdevice_t* bd, const uint8_t* data, uint32_t addr, uint32_t size)
+{
+    program_count++;
+    return ram_program(bd, data, addr, size);
+}
+
+static void store_header(uint8_t file_id, uint8_t bd_index, uint32_t length, uint32_t addr)
+{
+    uint8_t* header = d7ap_fs_metadata + FS_FILE_HEADERS_ADDRESS + file_id * FS_FILE_HEADER_SIZE;
+    header[0] = bd_index;
+    for(int i = 0; i < 4; i++)
+    {
+        header[1 + i] = length >> (24 - 8 * i);
+        header[5 + i] = addr >> (24 - 8 * i);
+    }
+}
+
+static void prepare_image()
+{
+    uint8_t magic[FS_MAGIC_NUMBER_SIZE] = FS_MAGIC_NUMBER;
+    memcpy(d7ap_fs_metadata + FS_MAGIC_NUMBER_ADDRESS, magic, FS_MAGIC_NUMBER_SIZE);
+    d7ap_fs_metadata[FS_NUMBER_OF_FILES_ADDRESS + 3] = STORED_FILE_COUNT;
+
+    for(int i = 0; i < STORED_FILE_COUNT; i++)
+    {
+        store_header(STORED_FILE_ID(i), FS_BLOCKDEVICE_TYPE_PERMANENT, STORED_FILE_LENGTH, i * STORED_FILE_LENGTH);
+        memset(d7ap_files_data + i * STORED_FILE_LENGTH, 0xA0 + i, STORED_FILE_LENGTH);
+    }
+}
+
+static void check_file(uint8_t file_id, uint32_t length, uint8_t content)
+{
+    uint8_t buffer[CREATED_FILE_LENGTH];
+
+    fs_file_stat_t stat;
+    assert(fs_file_stat(file_id, &stat) == 0 && stat.length == length);
+    assert(fs_read_file(file_id, 0, buffer, length) == SUCCESS);
+    for(int i = 0; i < length; i++)
+        assert(buffer[i] == content);
+}
+
+static void test_load()
+{
+    for(int i = 0; i < STORED_FILE_COUNT; i++)
+    {
+        check_file(STORED_FILE_ID(i), STORED_FILE_LENGTH, 0xA0 + i);
+        assert(fs_get_address(STORED_FILE_ID(i)) == i * STORED_FILE_LENGTH);
+    }
+
+    assert(fs_file_stat(STORED_FILE_ID(STORED_FILE_COUNT), NULL) == -ENOENT);
+    assert(fs_file_stat(FRAMEWORK_FS_FILE_COUNT, NULL) == -ENOENT);
+    assert(fs_read_file(FRAMEWORK_FS_FILE_COUNT, 0, NULL, 0) == -ENOENT);
+
+    // new files are allocated after the loaded ones
+    assert(fs_init_file(STORED_FILE_ID(0), FS_BLOCKDEVICE_TYPE_PERMANENT, NULL, 0, 1) == -EEXIST);
+    printf("Loading the filesystem OK\n");
+}
+
+static void test_create()
+{
+    uint8_t data[CREATED_FILE_LENGTH];
+
+    for(int i = 0; i < VOLATILE_FILE_COUNT; i++)
+    {
+        memset(data, 0x50 + i, VOLATILE_FILE_LENGTH);
+        assert(fs_init_file(VOLATILE_FILE_ID(i), FS_BLOCKDEVICE_TYPE_VOLATILE, data, VOLATILE_FILE_LENGTH, VOLATILE_FILE_LENGTH) == SUCCESS);
+    }
+
+    for(int i = 0; i < CREATED_FILE_COUNT; i++)
+    {
+        memset(data, i, CREATED_FILE_LENGTH);
+        assert(fs_init_file(CREATED_FILE_ID(i), FS_BLOCKDEVICE_TYPE_PERMANENT, data, CREATED_FILE_LENGTH, CREATED_FILE_LENGTH) == SUCCESS);
+        assert(fs_get_address(CREATED_FILE_ID(i)) == STORED_FILE_COUNT * STORED_FILE_LENGTH + i * CREATED_FILE_LENGTH);
+    }
+
+    // access all files round robin and in reverse, so a small header cache keeps evicting entries
+    for(int round = 0; round < 3; round++)
+    {
+        for(int i = 0; i < CREATED_FILE_COUNT; i++)
+        {
+            int index = (round & 1) ? CREATED_FILE_COUNT - 1 - i : i;
+            check_file(CREATED_FILE_ID(index), CREATED_FILE_LENGTH, index + round);
+
+            memset(data, index + round + 1, CREATED_FILE_LENGTH);
+            assert(fs_write_file(CREATED_FILE_ID(index), 0, data, CREATED_FILE_LENGTH) == SUCCESS);
+            assert(fs_write_file(CREATED_FILE_ID(index), 1, data, CREATED_FILE_LENGTH) == -ENOBUFS);
+
+            check_file(VOLATILE_FILE_ID(i % VOLATILE_FILE_COUNT), VOLATILE_FILE_LENGTH, 0x50 + i % VOLATILE_FILE_COUNT);
+            check_file(STORED_FILE_ID(i % STORED_FILE_COUNT), STORED_FILE_LENGTH, 0xA0 + i % STORED_FILE_COUNT);
+        }
+    }
+
+    // the results of consecutive lookups are independent of each other, also when the header cache is cycled
+    fs_file_stat_t volatile_stat, created_stat;
+    for(int i = 0; i < VOLATILE_FILE_COUNT; i++)
+    {
+        assert(fs_file_stat(VOLATILE_FILE_ID(i), &volatile_stat) == 0);
+        assert(fs_file_stat(CREATED_FILE_ID(0), &created_stat) == 0);
+        assert(volatile_stat.storage == FS_STORAGE_VOLATILE && volatile_stat.length == VOLATILE_FILE_LENGTH);
+        assert(created_stat.storage == FS_STORAGE_PERMANENT && created_stat.length == CREATED_FILE_LENGTH);
+    }
+    printf("Creating and accessing files OK\n");
+}
+
+static uint8_t expected[WRITEBACK_FILE_COUNT][WRITEBACK_FILE_LENGTH];
+
+static void check_writeback_file(int i)
+{
+    uint8_t buffer[WRITEBACK_FILE_LENGTH];
+    assert(fs_read_file(WRITEBACK_FILE_ID(i), 0, buffer, WRITEBACK_FILE_LENGTH) == SUCCESS);
+    assert(memcmp(buffer, expected[i], WRITEBACK_FILE_LENGTH) == 0);
+}
+
+static bool is_stored(int i)
+{
+    return memcmp(d7ap_files_data + fs_get_address(WRITEBACK_FILE_ID(i)), expected[i], WRITEBACK_FILE_LENGTH) == 0;
+}
+
+// returns the number of program operations caused by the write
+static uint32_t write_fragment(int i, uint32_t offset, uint32_t length, uint8_t content)
+{
+    memset(expected[i] + offset, content, length);
+    uint32_t count = program_count;
+    assert(fs_write_file(WRITEBACK_FILE_ID(i), offset, expected[i] + offset, length) == SUCCESS);
+    return program_count - count;
+}
+
+// write two adjacent fragments, as the DLL does for every noise floor measurement
+static uint32_t update_noise_floor(int i, uint8_t content)
+{
+    return write_fragment(i, 7, 1, content) + write_fragment(i, 8, 8, content + 1);
+}
+
+static void check_deadline()
+{
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    // the pending write was programmed when the deadline expired
+    assert(is_stored(0));
+    printf("Write-back deadline OK\n");
+#endif
+    printf("All fs tests passed!\n");
+    exit(0);
+}
+
+static void test_writeback()
+{
+    fs_sync(); // the writes of the previous tests
+    ram_program = blockdevice_driver_ram.program;
+    blockdevice_driver_ram.program = &counting_program;
+
+    for(int i = 0; i < WRITEBACK_FILE_COUNT; i++)
+    {
+        memset(expected[i], 0x10 * i, WRITEBACK_FILE_LENGTH);
+        assert(fs_init_file(WRITEBACK_FILE_ID(i), FS_BLOCKDEVICE_TYPE_PERMANENT, expected[i], WRITEBACK_FILE_LENGTH, WRITEBACK_FILE_LENGTH) == SUCCESS);
+    }
+
+    // baseline: every fragment is programmed
+    fs_set_write_through(WRITEBACK_FILE_ID(0), true);
+    uint32_t write_through_programs = 0;
+    for(int n = 0; n < NOISE_FLOOR_UPDATES; n++)
+        write_through_programs += update_noise_floor(0, n);
+
+    assert(write_through_programs == 2 * NOISE_FLOOR_UPDATES);
+    assert(is_stored(0));
+
+    fs_set_write_through(WRITEBACK_FILE_ID(0), false);
+    uint32_t count = program_count;
+    for(int n = 0; n < NOISE_FLOOR_UPDATES; n++)
+    {
+        update_noise_floor(0, 0x80 + n);
+        check_writeback_file(0); // pending writes are read back, the rest of the file comes from the blockdevice
+    }
+
+    fs_sync();
+    uint32_t writeback_programs = program_count - count;
+    assert(is_stored(0));
+    printf("%u noise floor updates: %u programs write-through, %u programs write-back\n", NOISE_FLOOR_UPDATES,
+           (unsigned)write_through_programs, (unsigned)writeback_programs);
+#if FRAMEWORK_FS_WRITEBACK_SLOTS > 0
+    assert(writeback_programs == 1);
+
+    // fragments with a gap in between are merged, the gap is filled with the stored content
+    assert(write_fragment(1, 20, 4, 0x61) == 0);
+    assert(write_fragment(1, 2, 2, 0x62) == 0);
+    assert(write_fragment(1, 10, 2, 0x63) == 0);
+    check_writeback_file(1);
+    assert(!is_stored(1));
+    // the merged range would exceed the buffer, so the pending range is programmed first
+    assert(write_fragment(1, 2, WRITEBACK_FILE_LENGTH - 2, 0x64) == 2);
+    assert(is_stored(1));
+
+    // when all slots are in use, the oldest one is flushed
+    for(int i = 0; i < WRITEBACK_FILE_COUNT; i++)
+        assert(update_noise_floor(i, 0x70) == (i >= FRAMEWORK_FS_WRITEBACK_SLOTS ? 1 : 0));
+
+    assert(is_stored(0) == (FRAMEWORK_FS_WRITEBACK_SLOTS < WRITEBACK_FILE_COUNT));
+    for(int i = 0; i < WRITEBACK_FILE_COUNT; i++)
+        check_writeback_file(i);
+
+    fs_sync();
+    for(int i = 0; i < WRITEBACK_FILE_COUNT; i++)
+        assert(is_stored(i));
+
+    // leave a pending write for the deadline
+    assert(update_noise_floor(0, 0x90) == 0);
+    assert(!is_stored(0));
+    printf("Write-back OK\n");
+#endif
+}
+
+void bootstrap()
+{
+    prepare_image();
+    fs_init();
+
+    test_load();
+    test_create();
+    test_writeback();
+
+    sched_register_task(&check_deadline);
+    timer_post_task_delay(&check_deadline, (FRAMEWORK_FS_WRITEBACK_DEADLINE + 1) * TIMER_TICKS_PER_SEC);
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the binary log backend: a number of log calls are done with stdout redirected to a pipe, the records which
+ * are flushed by the log task are read back and decoded. Afterwards the cost of a binary log call is compared to
+ * formatting the same message with vsnprintf(), which is what the text backend does.
+ */
+#include "log.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define BENCHMARK_ITERATIONS 200000
+
+extern const char log_format_anchor[];
+
+static const char* format_ints = "ints %d %u %x";
+static const char* format_stack = "%s=%lld";
+static const char* format_error = "%.*f %c%%";
+static const char* format_words = "%ld %p %zu";
+static const char* format_strings = "%s %s %s";
+static const char* long_string = "a string which is longer than the inline limit";
+
+static int pipe_fds[2];
+static FILE* report;
+
+typedef struct
+{
+    uint8_t kind;
+    uint8_t layer;
+    uint16_t counter;
+    int32_t format_id;
+    const uint8_t* args;
+    uint8_t args_length;
+} record_t;
+
+static uint8_t output[1024];
+static uint16_t output_length;
+static uint16_t output_offset;
+
+static void next_record(record_t* record, bool has_format_id)
+{
+    assert(output_offset + 2 <= output_length);
+    const uint8_t* p = output + output_offset;
+    assert(p[0] == 0xA5);
+    uint8_t length = p[1];
+    assert(output_offset + 2 + length <= output_length);
+    record->kind = p[2];
+    record->layer = p[3];
+    memcpy(&record->counter, p + 4, sizeof(record->counter));
+    record->format_id = 0;
+    uint8_t header_length = 6;
+    if(has_format_id)
+    {
+        memcpy(&record->format_id, p + 6, sizeof(record->format_id));
+        header_length += 4;
+    }
+
+    record->args = p + header_length;
+    record->args_length = length + 2 - header_length;
+    output_offset += length + 2;
+}
+
+static int32_t arg_int32(const uint8_t* p)
+{
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static double elapsed_ns(struct timespec* start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+static char text[128];
+
+static void format_text(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+}
+
+static void benchmark()
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+        log_print_string(format_ints, -(int32_t)i, i, i);
+
+    // once the ring is full records are dropped, this is the cost a call site sees either way
+    double binary_ns = elapsed_ns(&start) / BENCHMARK_ITERATIONS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+        format_text(format_ints, -(int32_t)i, i, i);
+
+    double text_ns = elapsed_ns(&start) / BENCHMARK_ITERATIONS;
+
+    fprintf(report, "binary log call: %.1f ns, vsnprintf of the same message: %.1f ns\n", binary_ns, text_ns);
+    assert(binary_ns < text_ns);
+}
+
+static void check_output(void *arg)
+{
+    fflush(stdout);
+    int read_length = read(pipe_fds[0], output, sizeof(output));
+    assert(read_length > 0);
+    output_length = read_length;
+    output_offset = 0;
+
+    record_t record;
+    next_record(&record, true);
+    assert(record.kind == 0x01);
+    assert(record.counter == 0);
+    assert(record.format_id == format_ints - log_format_anchor);
+    assert(record.args_length == 12);
+    assert(arg_int32(record.args) == -5);
+    assert(arg_int32(record.args + 4) == 7);
+    assert(arg_int32(record.args + 8) == 0xbeef);
+
+    next_record(&record, true);
+    assert(record.kind == 0x02);
+    assert(record.layer == LOG_STACK_DLL);
+    assert(record.counter == 1);
+    assert(record.format_id == format_stack - log_format_anchor);
+    assert(record.args_length == 1 + 4 + 8);
+    assert(record.args[0] == 4 && memcmp(record.args + 1, "name", 4) == 0);
+    int64_t big;
+    memcpy(&big, record.args + 5, sizeof(big));
+    assert(big == -(1LL << 40));
+
+    next_record(&record, true);
+    assert(record.kind == 0x03);
+    assert(record.counter == 2);
+    assert(record.format_id == format_error - log_format_anchor);
+    assert(record.args_length == 4 + 8 + 4);
+    assert(arg_int32(record.args) == 2);
+    double real;
+    memcpy(&real, record.args + 4, sizeof(real));
+    assert(real == 3.5);
+    assert(arg_int32(record.args + 12) == 'x');
+
+    // long, pointers and size_t take 4 bytes, as on the MCU
+    next_record(&record, true);
+    assert(record.kind == 0x01);
+    assert(record.counter == 3);
+    assert(record.format_id == format_words - log_format_anchor);
+    assert(record.args_length == 12);
+    assert(arg_int32(record.args) == -3);
+    assert(arg_int32(record.args + 4) == (int32_t)(uintptr_t)output);
+    assert(arg_int32(record.args + 8) == sizeof(output));
+
+    // the strings are cut to 24 characters and the last one does not fit the record anymore
+    next_record(&record, true);
+    assert(record.kind == (0x01 | 0x80));
+    assert(record.counter == 4);
+    assert(record.format_id == format_strings - log_format_anchor);
+    assert(record.args_length == 2 * 25);
+    assert(record.args[0] == 24 && memcmp(record.args + 1, long_string, 24) == 0);
+
+    // the data is split over two records, the layer field marks that more data follows
+    uint8_t data_offset = 0;
+    for(uint16_t counter = 5; counter < 7; counter++)
+    {
+        next_record(&record, false);
+        assert(record.kind == 0x04);
+        assert(record.counter == counter);
+        assert(record.layer == (counter == 5));
+        for(uint8_t i = 0; i < record.args_length; i++)
+            assert(record.args[i] == data_offset++);
+    }
+
+    assert(data_offset == 100);
+    assert(output_offset == output_length);
+    fprintf(report, "decoded %d bytes of log records\n", output_length);
+
+    benchmark();
+    fprintf(report, "log test passed\n");
+    exit(0);
+}
+
+void bootstrap()
+{
+    // the log macros derive the storage of every argument from its type
+    uint8_t bytes[4];
+    assert(LOG_ARG_TYPES("", 'c', (uint8_t)1, "s", bytes, 1.0f, 1LL) ==
+           (LOG_ARG_INT32 | LOG_ARG_INT32 << 3 | LOG_ARG_STRING << 6 | (sizeof(void*) > 4 ? LOG_ARG_WORD64 : LOG_ARG_INT32) << 9
+            | LOG_ARG_DOUBLE << 12 | LOG_ARG_INT64 << 15));
+    assert(LOG_ARG_TYPES("") == 0);
+
+    // the framework only resets the log when FRAMEWORK_LOG_ENABLED is set for the whole build
+    log_counter_reset();
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, NULL, _IONBF, 0);
+    assert(pipe(pipe_fds) == 0);
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    dup2(pipe_fds[1], STDOUT_FILENO);
+
+    uint8_t data[100];
+    for(uint8_t i = 0; i < sizeof(data); i++)
+        data[i] = i;
+
+    log_print_string(format_ints, -5, 7u, 0xbeef);
+    log_print_stack_string(LOG_STACK_DLL, format_stack, "name", -(1LL << 40));
+    log_print_error_string(format_error, 2, 3.5, 'x');
+    log_print_string(format_words, -3L, (void*)output, sizeof(output));
+    log_print_string(format_strings, long_string, long_string, long_string);
+    log_print_data(data, sizeof(data));
+
+    sched_register_task(&check_output);
+    timer_post_task_delay(&check_output, TIMER_TICKS_PER_SEC / 10);
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput benchmark of the modem interface on the NATIVE loopback UART: frames of random length are queued as
+ * fast as the TX queue accepts them and are received again by the same node. Every frame is checked, and the link
+ * utilisation (payload bytes against the line rate) and the wall-clock time are reported.
+ *
+ * The benchmark runs in phases: protocol version 0 with small frames, then protocol version 1 (negotiated with a ping
+ * to ourselves) with frames up to 255 bytes, first on a clean line and then with bit errors injected by the
+ * simulator. Version 1 has to deliver every frame exactly once and in order, also when bytes get corrupted. When the
+ * framework is built without FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1 the negotiation has to end at version 0. With
+ * FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES the test is skipped, test_modem_interface_link runs between two nodes.
+ */
+#include "framework_defs.h"
+#include "modem_interface.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BAUDRATE 115200
+#define FRAME_COUNT 2000
+#define PAYLOAD_LENGTH_MAX_V0 64
+#define PAYLOAD_LENGTH_MAX_V1 255
+#define ERRORS_PER_MILLION 100
+
+typedef enum
+{
+    PHASE_V0,
+    PHASE_V1,
+    PHASE_V1_ERRORS,
+    PHASE_COUNT
+} phase_t;
+
+static const char* phase_names[PHASE_COUNT] = { "version 0", "version 1", "version 1 with bit errors" };
+
+static phase_t phase = PHASE_V0;
+static uint16_t payload_length_max = PAYLOAD_LENGTH_MAX_V0;
+static uint32_t frames_queued = 0;
+static uint32_t frames_received = 0;
+static uint64_t payload_bytes = 0;
+static uint32_t queue_full = 0;
+static sim_time_t phase_start_time;
+static uint64_t phase_start_line_bytes;
+static modem_interface_stats_t phase_start_stats;
+static struct timespec wall_start;
+static double payload_throughput[PHASE_COUNT];
+
+// the payload of frame n is derived from n, so the receiver can check it
+static uint16_t payload_length(uint32_t frame)
+{
+    return 1 + (frame * 2654435761u >> 16) % payload_length_max;
+}
+
+static uint8_t payload_byte(uint32_t frame, uint16_t index)
+{
+    return (uint8_t)(frame * 31 + index * 7);
+}
+
+static void queue_frames(void *arg);
+
+static void start_phase()
+{
+    frames_queued = 0;
+    frames_received = 0;
+    payload_bytes = 0;
+    queue_full = 0;
+    phase_start_time = sim_get_time();
+    phase_start_line_bytes = sim_get_stats()->uart_bytes_transmitted;
+    phase_start_stats = *modem_interface_get_stats();
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    sched_post_task(&queue_frames);
+}
+
+static void ping_response_received(fifo_t* fifo)
+{
+#ifndef FRAMEWORK_MODEM_INTERFACE_PROTOCOL_V1
+    assert(modem_interface_get_protocol_version() == 0);
+    assert(modem_interface_get_max_frame_size() == 255);
+    printf("Modem interface test done!\n");
+    exit(0);
+#endif
+    assert(modem_interface_get_protocol_version() == 1);
+    assert(modem_interface_get_max_frame_size() >= PAYLOAD_LENGTH_MAX_V1);
+    payload_length_max = PAYLOAD_LENGTH_MAX_V1;
+    start_phase();
+}
+
+static void finish_phase()
+{
+    struct timespec wall_stop;
+    clock_gettime(CLOCK_MONOTONIC, &wall_stop);
+    double wall_ms = (wall_stop.tv_sec - wall_start.tv_sec) * 1e3 + (wall_stop.tv_nsec - wall_start.tv_nsec) / 1e6;
+    double seconds = (double)(sim_get_time() - phase_start_time) / SIM_TICKS_PER_SECOND;
+    double line_bytes_per_second = BAUDRATE / 10.0;
+    uint64_t line_bytes = sim_get_stats()->uart_bytes_transmitted - phase_start_line_bytes;
+    const modem_interface_stats_t* stats = modem_interface_get_stats();
+
+    payload_throughput[phase] = payload_bytes / seconds;
+    printf("%s: %u frames, %lu payload bytes in %.3f s simulated (%.1f ms wall clock)\n", phase_names[phase],
+        FRAME_COUNT, (unsigned long) payload_bytes, seconds, wall_ms);
+    printf("  payload throughput %.0f B/s, line utilisation %.1f %%, TX queue full %u times\n",
+        payload_throughput[phase], 100.0 * line_bytes / seconds / line_bytes_per_second, queue_full);
+    printf("  %u retransmissions, %u duplicates, %u CRC errors, %u bytes skipped\n",
+        stats->frames_retransmitted - phase_start_stats.frames_retransmitted,
+        stats->frames_duplicate - phase_start_stats.frames_duplicate,
+        stats->crc_errors - phase_start_stats.crc_errors,
+        stats->bytes_skipped - phase_start_stats.bytes_skipped);
+
+    assert(stats->frames_dropped == 0);
+    switch(phase)
+    {
+        case PHASE_V0:
+            // the line only idles while the TX queue is empty
+            assert(line_bytes / seconds > 0.9 * line_bytes_per_second);
+            phase = PHASE_V1;
+            assert(modem_interface_negotiate_protocol() == SUCCESS);
+            break;
+        case PHASE_V1:
+            // the window keeps the line busy, larger frames carry more payload per byte on the line
+            assert(line_bytes / seconds > 0.9 * line_bytes_per_second);
+            assert(stats->frames_retransmitted == phase_start_stats.frames_retransmitted);
+            assert(payload_throughput[PHASE_V1] > payload_throughput[PHASE_V0]);
+            phase = PHASE_V1_ERRORS;
+            sim_uart_set_error_rate(ERRORS_PER_MILLION);
+            start_phase();
+            break;
+        case PHASE_V1_ERRORS:
+            assert(sim_get_stats()->uart_bytes_corrupted > 0);
+            assert(stats->frames_retransmitted > phase_start_stats.frames_retransmitted);
+            assert(modem_interface_get_protocol_version() == 1);
+            printf("Modem interface test done!\n");
+            exit(0);
+        default:
+            assert(false);
+    }
+}
+
+static void alp_received(fifo_t* fifo)
+{
+    uint8_t payload[PAYLOAD_LENGTH_MAX_V1];
+    uint16_t length = fifo_get_size(fifo);
+    assert(length == payload_length(frames_received));
+    fifo_pop(fifo, payload, length);
+    for(uint16_t i = 0; i < length; i++)
+        assert(payload[i] == payload_byte(frames_received, i));
+
+    frames_received++;
+    payload_bytes += length;
+    if(frames_received == FRAME_COUNT)
+        finish_phase();
+}
+
+static void queue_frames(void *arg)
+{
+    uint8_t payload[PAYLOAD_LENGTH_MAX_V1];
+    while(frames_queued < FRAME_COUNT)
+    {
+        uint16_t length = payload_length(frames_queued);
+        for(uint16_t i = 0; i < length; i++)
+            payload[i] = payload_byte(frames_queued, i);
+
+        if(modem_interface_transfer_bytes(payload, length, SERIAL_MESSAGE_TYPE_ALP_DATA) != SUCCESS)
+        {
+            // retry once some frames have left the queue
+            queue_full++;
+            timer_post_task_delay(&queue_frames, 1);
+            return;
+        }
+
+        frames_queued++;
+    }
+}
+
+void bootstrap()
+{
+#ifdef FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES
+    // the handshake over the interrupt lines needs a peer, test_modem_interface_link covers it
+    printf("Modem interface test skipped, the loopback UART does not work with interrupt lines\n");
+    exit(0);
+#endif
+    modem_interface_init(0, BAUDRATE, 0, 0);
+    modem_interface_register_handler(&alp_received, SERIAL_MESSAGE_TYPE_ALP_DATA);
+    modem_interface_register_handler(&ping_response_received, SERIAL_MESSAGE_TYPE_PING_RESPONSE);
+
+    sched_register_task(&queue_frames);
+    start_phase();
+}
+
+// the modem interface frees the ALP commands on a ping request, there are none here
+void alp_layer_free_commands()
+{
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the modem interface between two nodes of the NATIVE simulator: node 0 is the host and node 1 the modem, their
+ * UARTs and state pins are cross-wired, so the interrupt line handshake and the DMA transfers are exercised when the
+ * framework is built with FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES and FRAMEWORK_MODEM_INTERFACE_USE_DMA.
+ *
+ * Both ends send at the same time, a different number of frames in each direction, so the sequence numbers of the host
+ * and the modem run apart and wrap at different moments. Every frame has to arrive once and in order:
+ * - version 0
+ * - version 1, negotiated by the host
+ * - version 1 with bit errors injected by the simulator, both ends have to retransmit
+ * - version 1 renegotiated by the modem, which restarts the sequence numbers on both ends while they differ
+ * At the end of each phase the modem reports its statistics to the host.
+ */
+#include "framework_defs.h"
+#include "modem_interface.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim.h"
+#include "ng.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HOST 0
+#define MODEM 1
+#define UART_PORT 0
+#define STATE_PIN 0         // output, tells the peer we want to transmit or are ready to receive
+#define TARGET_STATE_PIN 1  // input, driven by the state pin of the peer
+#define BAUDRATE 115200
+#define ERRORS_PER_MILLION 500
+#define SETTLE_DELAY TIMER_TICKS_PER_SEC // lets the last acknowledgements arrive before the next phase starts
+#define TEST_TIMEOUT (10 * TIMER_TICKS_PER_MINUTE)
+#define PAYLOAD_HEADER_SIZE 3 // the phase and the index of the frame
+
+// control messages, sent as logging frames
+#define MESSAGE_REPORT 0         // modem to host: all frames of the phase are received, followed by the statistics
+#define MESSAGE_RENEGOTIATE 1    // host to modem: negotiate the protocol version again
+#define MESSAGE_RENEGOTIATED 2   // modem to host: the ping response to the version request arrived
+
+typedef enum
+{
+    PHASE_V0,
+    PHASE_V1,
+    PHASE_V1_ERRORS,
+    PHASE_RENEGOTIATED,
+    PHASE_COUNT
+} phase_t;
+
+typedef struct
+{
+    const char* name;
+    uint16_t frames[2];     // sent by the host and by the modem
+    uint16_t length_max;
+} phase_config_t;
+
+static const phase_config_t phases[PHASE_COUNT] = {
+    { "version 0", { 300, 120 }, 64 },
+    { "version 1", { 600, 250 }, 255 },
+    { "version 1 with bit errors", { 600, 250 }, 255 },
+    { "version 1 renegotiated by the modem", { 100, 300 }, 255 },
+};
+
+static uint8_t NGDEF(_phase);
+#define phase NG(_phase)
+static uint16_t NGDEF(_frames_queued);
+#define frames_queued NG(_frames_queued)
+static uint16_t NGDEF(_frames_received);
+#define frames_received NG(_frames_received)
+static bool NGDEF(_report_sent);
+#define report_sent NG(_report_sent)
+
+// host only
+static bool modem_reported;
+static modem_interface_stats_t modem_stats;
+static modem_interface_stats_t modem_stats_phase_start;
+static modem_interface_stats_t host_stats_phase_start;
+static sim_time_t phase_start_time;
+
+static inline size_t peer()
+{
+    return sim_get_node_id() == HOST ? MODEM : HOST;
+}
+
+// the payload of a frame is derived from the sender, the phase and the index, so the receiver can check it
+static uint16_t payload_length(size_t sender, uint8_t frame_phase, uint16_t index)
+{
+    uint32_t hash = (index * 2654435761u + sender * 40503u + frame_phase * 9973u) >> 16;
+    return PAYLOAD_HEADER_SIZE + hash % (phases[frame_phase].length_max - PAYLOAD_HEADER_SIZE + 1);
+}
+
+static uint8_t payload_byte(size_t sender, uint8_t frame_phase, uint16_t index, uint16_t offset)
+{
+    return (uint8_t)(index * 31 + offset * 7 + sender * 101 + frame_phase * 57);
+}
+
+static void send_message(uint8_t message)
+{
+    uint8_t payload[2 + sizeof(modem_interface_stats_t)] = { message, phase };
+    memcpy(payload + 2, modem_interface_get_stats(), sizeof(modem_interface_stats_t));
+    uint16_t length = message == MESSAGE_REPORT ? sizeof(payload) : 2;
+    assert(modem_interface_transfer_bytes(payload, length, SERIAL_MESSAGE_TYPE_LOGGING) == SUCCESS);
+}
+
+static void queue_frames(void *arg)
+{
+    uint8_t payload[255];
+    uint16_t frame_count = phases[phase].frames[sim_get_node_id()];
+    while(frames_queued < frame_count)
+    {
+        uint16_t length = payload_length(sim_get_node_id(), phase, frames_queued);
+        payload[0] = phase;
+        payload[1] = frames_queued & 0xFF;
+        payload[2] = frames_queued >> 8;
+        for(uint16_t i = PAYLOAD_HEADER_SIZE; i < length; i++)
+            payload[i] = payload_byte(sim_get_node_id(), phase, frames_queued, i);
+
+        if(modem_interface_transfer_bytes(payload, length, SERIAL_MESSAGE_TYPE_ALP_DATA) != SUCCESS)
+        {
+            // retry once some frames have left the queue
+            timer_post_task_delay(&queue_frames, 1);
+            return;
+        }
+
+        frames_queued++;
+    }
+
+    // the report follows the data frames of the modem, so the host has everything once it arrives
+    if(sim_get_node_id() == MODEM && !report_sent && frames_received == phases[phase].frames[HOST])
+    {
+        report_sent = true;
+        send_message(MESSAGE_REPORT);
+    }
+}
+
+static void start_phase(uint8_t new_phase)
+{
+    phase = new_phase;
+    frames_queued = 0;
+    frames_received = 0;
+    report_sent = false;
+    sched_post_task(&queue_frames);
+}
+
+static void start_next_phase()
+{
+    modem_reported = false;
+    host_stats_phase_start = *modem_interface_get_stats();
+    modem_stats_phase_start = modem_stats;
+    phase_start_time = sim_get_time();
+    start_phase(phase + 1);
+}
+
+// the modem negotiates and tells when it is done, the next phase starts then
+static void request_renegotiation(void *arg)
+{
+    send_message(MESSAGE_RENEGOTIATE);
+}
+
+static void finish_phase()
+{
+    const modem_interface_stats_t* host_stats = modem_interface_get_stats();
+    double seconds = (double)(sim_get_time() - phase_start_time) / SIM_TICKS_PER_SECOND;
+    uint32_t host_retransmissions = host_stats->frames_retransmitted - host_stats_phase_start.frames_retransmitted;
+    uint32_t modem_retransmissions = modem_stats.frames_retransmitted - modem_stats_phase_start.frames_retransmitted;
+
+    printf("%s: %u frames to the modem, %u frames to the host in %.3f s simulated\n", phases[phase].name,
+        phases[phase].frames[HOST], phases[phase].frames[MODEM], seconds);
+    printf("  retransmissions: %u by the host, %u by the modem\n", host_retransmissions, modem_retransmissions);
+    printf("  CRC errors: %u at the host, %u at the modem\n",
+        host_stats->crc_errors - host_stats_phase_start.crc_errors,
+        modem_stats.crc_errors - modem_stats_phase_start.crc_errors);
+
+    assert(host_stats->frames_dropped == 0 && modem_stats.frames_dropped == 0);
+    assert(modem_interface_get_protocol_version() == (phase == PHASE_V0 ? 0 : 1));
+    switch(phase)
+    {
+        case PHASE_V0:
+            assert(modem_interface_negotiate_protocol() == SUCCESS);
+            break;
+        case PHASE_V1:
+            assert(host_retransmissions == 0 && modem_retransmissions == 0);
+            sim_uart_set_error_rate(ERRORS_PER_MILLION);
+            start_next_phase();
+            break;
+        case PHASE_V1_ERRORS:
+            assert(sim_get_stats()->uart_bytes_corrupted > 0);
+            assert(host_retransmissions > 0 && modem_retransmissions > 0);
+            sim_uart_set_error_rate(0);
+            timer_post_task_delay(&request_renegotiation, SETTLE_DELAY);
+            break;
+        case PHASE_RENEGOTIATED:
+            printf("Modem interface link test done!\n");
+            exit(0);
+        default:
+            assert(false);
+    }
+}
+
+static void alp_received(fifo_t* fifo)
+{
+    uint8_t payload[255];
+    uint16_t length = fifo_get_size(fifo);
+    fifo_pop(fifo, payload, length);
+
+    // the modem follows the host into the next phase
+    if(sim_get_node_id() == MODEM && payload[0] != phase)
+        start_phase(payload[0]);
+
+    uint16_t index = payload[1] | (payload[2] << 8);
+    assert(payload[0] == phase);
+    assert(index == frames_received);
+    assert(length == payload_length(peer(), phase, index));
+    for(uint16_t i = PAYLOAD_HEADER_SIZE; i < length; i++)
+        assert(payload[i] == payload_byte(peer(), phase, index, i));
+
+    frames_received++;
+    if(sim_get_node_id() == MODEM)
+        queue_frames(NULL);
+    else if(frames_received == phases[phase].frames[MODEM] && modem_reported)
+        finish_phase();
+}
+
+static void message_received(fifo_t* fifo)
+{
+    uint8_t payload[2 + sizeof(modem_interface_stats_t)];
+    uint16_t length = fifo_get_size(fifo);
+    fifo_pop(fifo, payload, length);
+    switch(payload[0])
+    {
+        case MESSAGE_REPORT:
+            assert(sim_get_node_id() == HOST && payload[1] == phase && length == sizeof(payload));
+            memcpy(&modem_stats, payload + 2, sizeof(modem_stats));
+            modem_reported = true;
+            if(frames_received == phases[phase].frames[MODEM])
+                finish_phase();
+            break;
+        case MESSAGE_RENEGOTIATE:
+            assert(sim_get_node_id() == MODEM);
+            assert(modem_interface_negotiate_protocol() == SUCCESS);
+            break;
+        case MESSAGE_RENEGOTIATED:
+            assert(sim_get_node_id() == HOST && phase == PHASE_V1_ERRORS);
+            start_next_phase();
+            break;
+        default:
+            assert(false);
+    }
+}
+
+static void ping_response_received(fifo_t* fifo)
+{
+    assert(modem_interface_get_protocol_version() == 1);
+    if(sim_get_node_id() == MODEM)
+        send_message(MESSAGE_RENEGOTIATED);
+    else
+        start_next_phase();
+}
+
+static void target_rebooted(system_reboot_reason_t reboot_reason)
+{
+    // both ends are up, start with version 0
+    if(sim_get_node_id() == HOST)
+    {
+        host_stats_phase_start = *modem_interface_get_stats();
+        phase_start_time = sim_get_time();
+        start_phase(PHASE_V0);
+    }
+}
+
+static void test_timeout(void *arg)
+{
+    printf("Timeout in phase %u: %u of %u frames received by the host\n", phase, frames_received,
+        phases[phase].frames[MODEM]);
+    assert(false);
+}
+
+void bootstrap()
+{
+    assert(sim_get_node_count() > MODEM);
+    if(sim_get_node_id() > MODEM)
+        return;
+
+    if(sim_get_node_id() == HOST)
+    {
+        sim_uart_connect(HOST, UART_PORT, MODEM, UART_PORT);
+        sim_gpio_connect(HOST, STATE_PIN, MODEM, TARGET_STATE_PIN);
+        sim_gpio_connect(MODEM, STATE_PIN, HOST, TARGET_STATE_PIN);
+#if defined(FRAMEWORK_MODEM_INTERFACE_USE_DMA)
+        printf("Using interrupt lines and DMA\n");
+#elif defined(FRAMEWORK_MODEM_INTERFACE_USE_INTERRUPT_LINES)
+        printf("Using interrupt lines\n");
+#endif
+        sched_register_task(&request_renegotiation);
+        sched_register_task(&test_timeout);
+        timer_post_task_delay(&test_timeout, TEST_TIMEOUT);
+    }
+
+    modem_interface_init(UART_PORT, BAUDRATE, STATE_PIN, TARGET_STATE_PIN);
+    modem_interface_register_handler(&alp_received, SERIAL_MESSAGE_TYPE_ALP_DATA);
+    modem_interface_register_handler(&message_received, SERIAL_MESSAGE_TYPE_LOGGING);
+    modem_interface_register_handler(&ping_response_received, SERIAL_MESSAGE_TYPE_PING_RESPONSE);
+    modem_interface_set_target_rebooted_callback(&target_rebooted);
+    sched_register_task(&queue_frames);
+    phase = PHASE_V0;
+}
+
+// the modem interface frees the ALP commands on a ping request, there are none here
+void alp_layer_free_commands()
+{
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/*
+ * Test of the D7AP packet queue on the NATIVE platform: packets of both size classes are handed out and recycled,
+ * short frames use the small size class while it has free packets, and a small packet can be moved to the
+ * maximum size class without losing its contents.
+ */
+#include "MODULE_D7AP_defs.h"
+#include "packet_queue.h"
+#include "packet.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SMALL_FRAME_SIZE MODULE_D7AP_PACKET_SMALL_FRAME_SIZE
+
+// same as in packet.c, which is not linked
+void packet_init(packet_t* packet)
+{
+    memset(packet, 0x00, sizeof(packet_t));
+}
+
+static void fill_packet(packet_t* packet, uint8_t frame_length, uint8_t payload_length, uint8_t seed)
+{
+    packet->hw_radio_packet.length = frame_length - 1;
+    for(int i = 0; i < frame_length; i++)
+        packet->hw_radio_packet.data[i] = seed + i;
+
+    packet->payload_length = payload_length;
+    for(int i = 0; i < payload_length; i++)
+        packet->payload[i] = seed ^ i;
+}
+
+static void check_packet(packet_t* packet, uint8_t frame_length, uint8_t payload_length, uint8_t seed)
+{
+    assert(packet->hw_radio_packet.length == frame_length - 1);
+    for(int i = 0; i < frame_length; i++)
+        assert(packet->hw_radio_packet.data[i] == (uint8_t)(seed + i));
+
+    assert(packet->payload_length == payload_length);
+    for(int i = 0; i < payload_length; i++)
+        assert(packet->payload[i] == (uint8_t)(seed ^ i));
+}
+
+// the payload of a received frame is not copied, it points to the end of the frame
+static void fill_received_packet(packet_t* packet, uint8_t frame_length, uint8_t payload_length, uint8_t seed)
+{
+    packet->hw_radio_packet.length = frame_length - 1;
+    for(int i = 0; i < frame_length; i++)
+        packet->hw_radio_packet.data[i] = seed + i;
+
+    packet->payload = packet->hw_radio_packet.data + frame_length - payload_length;
+    packet->payload_length = payload_length;
+}
+
+static void check_received_packet(packet_t* packet, uint8_t frame_length, uint8_t payload_length, uint8_t seed)
+{
+    assert(packet->hw_radio_packet.length == frame_length - 1);
+    for(int i = 0; i < frame_length; i++)
+        assert(packet->hw_radio_packet.data[i] == (uint8_t)(seed + i));
+
+    assert(packet->payload == packet->hw_radio_packet.data + frame_length - payload_length);
+    assert(packet->payload_length == payload_length);
+}
+
+static void test_max_size()
+{
+    packet_t* packets[MODULE_D7AP_PACKET_QUEUE_SIZE];
+
+    // all packets can hold a maximum size frame and payload without overlapping each other
+    for(int i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
+    {
+        packets[i] = packet_queue_alloc_packet();
+        assert(packets[i] != NULL);
+        assert(packet_queue_find_packet(&packets[i]->hw_radio_packet) == packets[i]);
+        fill_packet(packets[i], PACKET_MAX_FRAME_SIZE, PACKET_MAX_PAYLOAD_SIZE, i);
+    }
+
+    assert(packet_queue_alloc_packet() == NULL);
+
+    for(int i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
+        check_packet(packets[i], PACKET_MAX_FRAME_SIZE, PACKET_MAX_PAYLOAD_SIZE, i);
+
+    // a freed packet is handed out again, cleared
+    packet_queue_free_packet(packets[1]);
+    packet_t* packet = packet_queue_alloc_packet();
+    assert(packet == packets[1]);
+    assert(packet->payload_length == 0 && packet->hw_radio_packet.length == 0);
+
+    for(int i = 0; i < MODULE_D7AP_PACKET_QUEUE_SIZE; i++)
+        packet_queue_free_packet(packets[i]);
+
+    // packets which are not part of the queue are not found
+    static uint8_t other[sizeof(packet_t) + PACKET_MAX_FRAME_SIZE];
+    assert(packet_queue_find_packet(&((packet_t*)other)->hw_radio_packet) == NULL);
+    printf("Max size class OK\n");
+}
+
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+static void test_size_classes()
+{
+    packet_t* small[MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE + 1];
+
+    // short frames use the small packets first, then fall back to the maximum size class
+    for(int i = 0; i <= MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE; i++)
+    {
+        small[i] = packet_queue_alloc_packet_for_frame(SMALL_FRAME_SIZE);
+        assert(small[i] != NULL);
+        fill_received_packet(small[i], SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4, 0x40 + i);
+    }
+
+    // a long frame always uses the maximum size class
+    packet_t* large = packet_queue_alloc_packet_for_frame(SMALL_FRAME_SIZE + 1);
+    assert(large != NULL);
+    fill_packet(large, PACKET_MAX_FRAME_SIZE, PACKET_MAX_PAYLOAD_SIZE, 0x80);
+
+    // the small packets can be moved to the maximum size class while max packets are available
+    int moved = 0;
+    for(int i = 0; i < MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE; i++)
+    {
+        packet_queue_mark_processing(small[i]);
+        packet_t* packet = packet_queue_ensure_max_size(small[i]);
+        if(packet == NULL)
+        {
+            // the supplied packet is kept when no packet of the maximum size is available
+            check_received_packet(small[i], SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4, 0x40 + i);
+            continue;
+        }
+
+        // the payload refers to the moved frame
+        moved++;
+        check_received_packet(packet, SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4, 0x40 + i);
+        assert(packet_queue_find_packet(&packet->hw_radio_packet) == packet);
+
+        // the packet can now grow to the maximum size without affecting the others, using the payload buffer of its slot
+        packet->payload = packet_queue_get_payload_buffer(packet);
+        fill_packet(packet, PACKET_MAX_FRAME_SIZE, PACKET_MAX_PAYLOAD_SIZE, 0x40 + i);
+        assert(packet_queue_ensure_max_size(packet) == packet);
+        small[i] = packet;
+    }
+
+    // one max packet is used by the fallback and one by the long frame
+    int max_free = MODULE_D7AP_PACKET_QUEUE_SIZE - 2;
+    assert(moved == (max_free < MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE ? max_free : MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE));
+    check_packet(large, PACKET_MAX_FRAME_SIZE, PACKET_MAX_PAYLOAD_SIZE, 0x80);
+    check_received_packet(small[MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE], SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4,
+                          0x40 + MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE);
+
+    for(int i = 0; i <= MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE; i++)
+        packet_queue_free_packet(small[i]);
+
+    packet_queue_free_packet(large);
+    printf("Size classes OK (%i small packets moved)\n", moved);
+}
+#endif
+
+static void test_payload_buffers()
+{
+    // a packet of the maximum size class starts out with the payload buffer of its slot
+    packet_t* packet = packet_queue_alloc_packet();
+    assert(packet != NULL);
+    assert(packet->payload != NULL && packet->payload == packet_queue_get_payload_buffer(packet));
+    packet_queue_free_packet(packet);
+
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+    // a small packet only holds a received frame and has no payload buffer, until it is moved to the maximum size class
+    packet = packet_queue_alloc_packet_for_frame(SMALL_FRAME_SIZE);
+    assert(packet != NULL);
+    assert(packet->payload == NULL && packet_queue_get_payload_buffer(packet) == NULL);
+    fill_received_packet(packet, SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4, 0x20);
+
+    packet_queue_mark_processing(packet);
+    packet_t* max_packet = packet_queue_ensure_max_size(packet);
+    assert(max_packet != NULL && max_packet != packet);
+    check_received_packet(max_packet, SMALL_FRAME_SIZE, SMALL_FRAME_SIZE - 4, 0x20);
+    assert(packet_queue_get_payload_buffer(max_packet) != NULL);
+    packet_queue_free_packet(max_packet);
+#endif
+    printf("Payload buffers OK\n");
+}
+
+void bootstrap()
+{
+    packet_queue_init();
+
+    test_max_size();
+    test_max_size(); // again, to check the packets are all recycled
+#if MODULE_D7AP_PACKET_QUEUE_SMALL_SIZE > 0
+    test_size_classes();
+    test_size_classes();
+#endif
+    test_payload_buffers();
+
+    printf("packet slot sizes: %u bytes (max), %u bytes (frame <= %u bytes)\n",
+           (unsigned)(sizeof(packet_t) + PACKET_MAX_FRAME_SIZE + PACKET_MAX_PAYLOAD_SIZE),
+           (unsigned)(sizeof(packet_t) + SMALL_FRAME_SIZE), SMALL_FRAME_SIZE);
+    printf("All packet_queue tests passed!\n");
+    exit(0);
+}
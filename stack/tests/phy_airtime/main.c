@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the integer airtime calculation against the floating point formula it replaces, for every channel class,
+ * coding and frame length, with every possible preamble length of the factory settings.
+ */
+#include "phy.h"
+#include "fec.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// the original phy_calculate_tx_duration(), with the preamble length as a parameter instead of a factory setting
+static uint16_t reference_tx_duration(phy_channel_class_t channel_class, phy_coding_t ch_coding, uint16_t packet_length,
+                                      bool payload_only, uint8_t preamble_length)
+{
+    double data_rate = 6.0;
+
+    if (ch_coding == PHY_CODING_FEC_PN9)
+        packet_length = fec_calculated_decoded_length(packet_length);
+
+    if(!payload_only)
+      packet_length += sizeof(uint16_t); // Sync word
+
+    switch (channel_class)
+    {
+    case PHY_CLASS_LO_RATE:
+        if(!payload_only)
+          packet_length += preamble_length;
+
+        data_rate = 1.2;
+        break;
+    case PHY_CLASS_NORMAL_RATE:
+        if(!payload_only)
+          packet_length += preamble_length;
+
+        data_rate = 6.9;
+        break;
+    case PHY_CLASS_HI_RATE:
+        if(!payload_only)
+          packet_length += preamble_length;
+
+        data_rate = 20.8;
+        break;
+    default:
+        break;
+    }
+
+    return ceil(packet_length / data_rate) + 1;
+}
+
+static void test_frames()
+{
+    uint32_t checked = 0;
+    for(uint8_t channel_class = PHY_CLASS_LO_RATE; channel_class <= PHY_CLASS_HI_RATE; channel_class++)
+    {
+        for(uint8_t coding = PHY_CODING_PN9; coding <= PHY_CODING_CW; coding++)
+        {
+            for(uint16_t length = 0; length <= 255; length++)
+            {
+                assert(phy_calculate_airtime(channel_class, coding, length, 0)
+                       == reference_tx_duration(channel_class, coding, length, true, 0));
+
+                for(uint16_t preamble_length = 0; preamble_length <= 255; preamble_length++)
+                {
+                    uint16_t overhead_length = sizeof(uint16_t);
+                    if(channel_class != 0x01) // no preamble for LoRa
+                        overhead_length += preamble_length;
+
+                    assert(phy_calculate_airtime(channel_class, coding, length, overhead_length)
+                           == reference_tx_duration(channel_class, coding, length, false, preamble_length));
+                    checked++;
+                }
+            }
+        }
+    }
+
+    printf("%u frame configurations OK\n", checked);
+}
+
+// longer than any frame, to cover the whole fixed point range and the fallback beyond it
+static void test_long_lengths()
+{
+    for(uint8_t channel_class = PHY_CLASS_LO_RATE; channel_class <= PHY_CLASS_HI_RATE; channel_class++)
+        for(uint16_t length = 0; length < 8192; length++)
+            assert(phy_calculate_airtime(channel_class, PHY_CODING_PN9, length, 0)
+                   == reference_tx_duration(channel_class, PHY_CODING_PN9, length, true, 0));
+
+    printf("Lengths up to 8191 bytes OK\n");
+}
+
+void bootstrap()
+{
+    test_frames();
+    test_long_lengths();
+    printf("All phy airtime tests passed!\n");
+    exit(0);
+}
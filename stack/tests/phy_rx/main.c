@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the streaming RX path of the PHY on the NATIVE simulator. Node 0 transmits foreground frames of several
+ * lengths, both FEC encoded and PN9 only, node 1 receives them. The simulated radio hands a received packet to the
+ * PHY in 64 byte FIFO chunks, which are de-whitened and FEC decoded as they arrive, so the longer frames span
+ * several chunks and decoder states. Every frame has to arrive intact, with a valid CRC calculated during the
+ * reception. The other simulated nodes stay idle.
+ */
+#include "phy.h"
+#include "packet_queue.h"
+#include "d7ap_fs.h"
+#include "hwblockdevice.h"
+#include "platform.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim.h"
+#include "crc.h"
+#include "ng.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SENDER 0
+#define RECEIVER 1
+#define FRAME_INTERVAL (TIMER_TICKS_PER_SEC / 4)
+
+// from a single chunk up to the longest frame packet_header_received() accepts with FEC, which spans 8 chunks
+static const uint8_t frame_lengths[] = { 8, 31, 64, 65, 100, 200, 253 };
+#define FRAME_LENGTH_COUNT (sizeof(frame_lengths) / sizeof(frame_lengths[0]))
+
+static const phy_coding_t codings[] = { PHY_CODING_FEC_PN9, PHY_CODING_PN9 };
+#define FRAME_COUNT (FRAME_LENGTH_COUNT * (sizeof(codings) / sizeof(codings[0])))
+
+const char _GIT_SHA1[] = "0000000";
+const char _APP_NAME[] = "phy_rx";
+
+// the default system files (fs/d7ap_fs_data.c)
+extern uint8_t d7ap_fs_metadata[];
+extern uint8_t d7ap_files_data[];
+
+static uint8_t NGDEF(_frame_index);
+#define frame_index NG(_frame_index)
+
+static channel_id_t frame_channel(uint8_t index)
+{
+    channel_id_t channel = {
+        .channel_header.ch_coding = codings[index / FRAME_LENGTH_COUNT],
+        .channel_header.ch_class = PHY_CLASS_NORMAL_RATE,
+        .channel_header.ch_freq_band = PHY_BAND_868,
+        .center_freq_index = 0
+    };
+
+    return channel;
+}
+
+static void build_frame(uint8_t index, uint8_t* data)
+{
+    // the length byte, a payload which differs for every frame and the CRC as appended by the DLL
+    uint8_t length = frame_lengths[index % FRAME_LENGTH_COUNT];
+    data[0] = length - 1;
+    for(uint16_t i = 1; i < length - 2; i++)
+        data[i] = (uint8_t)(i * 7 + index);
+
+    uint16_t crc = __builtin_bswap16(crc_calculate(data, length - 2));
+    memcpy(data + length - 2, &crc, 2);
+}
+
+static void send_frame(void *arg);
+
+static void frame_transmitted(packet_t* packet)
+{
+    packet_queue_free_packet(packet);
+
+    frame_index++;
+    if(frame_index < FRAME_COUNT)
+        timer_post_task_delay(&send_frame, FRAME_INTERVAL);
+}
+
+static void send_frame(void *arg)
+{
+    packet_t* packet = packet_queue_alloc_packet();
+    assert(packet != NULL);
+
+    build_frame(frame_index, packet->hw_radio_packet.data);
+    packet->hw_radio_packet.length = frame_lengths[frame_index % FRAME_LENGTH_COUNT];
+
+    phy_tx_config_t config = {
+        .channel_id = frame_channel(frame_index),
+        .syncword_class = PHY_SYNCWORD_CLASS1,
+        .eirp = 10
+    };
+
+    error_t rtc = phy_send_packet(&packet->hw_radio_packet, &config, &frame_transmitted);
+    assert(rtc == SUCCESS);
+}
+
+static void start_rx();
+
+static void frame_received(packet_t* packet)
+{
+    hw_radio_packet_t* received = &packet->hw_radio_packet;
+    uint8_t expected[PACKET_MAX_SIZE];
+    build_frame(frame_index, expected);
+
+    assert(received->rx_meta.crc_status == HW_CRC_VALID);
+    assert(received->length == frame_lengths[frame_index % FRAME_LENGTH_COUNT]);
+    assert(memcmp(received->data, expected, received->length) == 0);
+    printf("frame of %3u bytes received (%s)\n", received->length,
+        codings[frame_index / FRAME_LENGTH_COUNT] == PHY_CODING_FEC_PN9 ? "FEC and PN9" : "PN9");
+
+    packet_queue_free_packet(packet);
+
+    frame_index++;
+    if(frame_index == FRAME_COUNT)
+    {
+        assert(sim_get_stats()->frames_received == FRAME_COUNT);
+        printf("All phy RX tests passed!\n");
+        exit(0);
+    }
+
+    // the coding is part of the channel, so the receiver follows the sender
+    if(frame_index % FRAME_LENGTH_COUNT == 0)
+        start_rx();
+}
+
+static void start_rx()
+{
+    channel_id_t channel = frame_channel(frame_index);
+    error_t rtc = phy_start_rx(&channel, PHY_SYNCWORD_CLASS1, &frame_received);
+    assert(rtc == SUCCESS);
+}
+
+void bootstrap()
+{
+    assert(sim_get_node_count() > RECEIVER);
+
+    if(sim_get_node_id() != SENDER && sim_get_node_id() != RECEIVER)
+        return;
+
+    // the PHY reads its settings from the factory settings file of the default system files
+    blockdevice_program(PLATFORM_METADATA_BLOCKDEVICE, d7ap_fs_metadata, 0, PLATFORM_METADATA_BLOCKDEVICE->size);
+    blockdevice_program(PLATFORM_PERMANENT_BLOCKDEVICE, d7ap_files_data, 0, PLATFORM_PERMANENT_BLOCKDEVICE->size);
+    d7ap_fs_init();
+    packet_queue_init();
+    phy_init();
+
+    if(sim_get_node_id() == RECEIVER)
+        start_rx();
+    else
+    {
+        sched_register_task(&send_frame);
+        timer_post_task_delay(&send_frame, FRAME_INTERVAL);
+    }
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pn9.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BUFFER_SIZE 2048
+#define BENCHMARK_BYTES (64 * 1024 * 1024)
+
+static uint8_t original[BUFFER_SIZE];
+static uint8_t buffer[BUFFER_SIZE];
+static uint8_t expected[BUFFER_SIZE];
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// the previous implementation, which clocks the LFSR 8 times per byte
+static void reference_pn9_encode(uint8_t *data, uint16_t length)
+{
+    uint16_t pn9 = PN9_INITIALIZER;
+    for (uint16_t i = 0; i < length; i++) {
+        data[i] ^= pn9;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            pn9 = (((((pn9 & 0x20) >> 5) ^ pn9) << 8) | ((pn9 >> 1) & 0xff)) & 0x1ff;
+    }
+}
+
+static inline uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void test_encode()
+{
+    memcpy(expected, original, BUFFER_SIZE);
+    reference_pn9_encode(expected, BUFFER_SIZE);
+
+    // all lengths around the word size and the keystream period, from unaligned addresses
+    for (uint16_t length = 0; length < 1100; length++) {
+        uint8_t shift = length % 8;
+        memcpy(buffer + shift, original, length);
+        pn9_encode(buffer + shift, length);
+        assert(memcmp(buffer + shift, expected, length) == 0);
+    }
+
+    // whitening twice restores the data
+    memcpy(buffer, original, BUFFER_SIZE);
+    pn9_encode(buffer, BUFFER_SIZE);
+    pn9_encode(buffer, BUFFER_SIZE);
+    assert(memcmp(buffer, original, BUFFER_SIZE) == 0);
+    printf("PN9 encode OK\n");
+}
+
+static void test_encode_copy()
+{
+    memcpy(expected, original, BUFFER_SIZE);
+    reference_pn9_encode(expected, BUFFER_SIZE);
+
+    // whitening into a separate buffer, with differently aligned input and output
+    for (uint16_t length = 0; length < 1100; length++) {
+        uint8_t shift = length % 8;
+        uint8_t input_shift = (8 - shift) % 8;
+        memset(buffer, 0, BUFFER_SIZE);
+        pn9_encode_copy(buffer + shift, original + input_shift, length);
+        for (uint16_t i = 0; i < length; i++)
+            assert((buffer[shift + i] ^ original[input_shift + i]) == (expected[i] ^ original[i]));
+    }
+
+    printf("PN9 encode copy OK\n");
+}
+
+static void test_offset()
+{
+    memcpy(expected, original, BUFFER_SIZE);
+    reference_pn9_encode(expected, BUFFER_SIZE);
+
+    // header and body in separate calls
+    memcpy(buffer, original, BUFFER_SIZE);
+    pn9_encode_offset(buffer, 4, 0);
+    pn9_encode_offset(buffer + 4, 251, 4);
+    assert(memcmp(buffer, expected, 255) == 0);
+
+    // random split points
+    for (uint16_t round = 0; round < 1000; round++) {
+        memcpy(buffer, original, BUFFER_SIZE);
+        uint16_t pos = 0;
+        while (pos < BUFFER_SIZE) {
+            uint16_t chunk = next_random() % 40;
+            if (chunk > BUFFER_SIZE - pos)
+                chunk = BUFFER_SIZE - pos;
+
+            pn9_encode_offset(buffer + pos, chunk, pos);
+            pos += chunk;
+        }
+
+        assert(memcmp(buffer, expected, BUFFER_SIZE) == 0);
+    }
+
+    printf("PN9 offset OK\n");
+}
+
+static void benchmark(const char* name, void (*encode)(uint8_t*, uint16_t), uint16_t length)
+{
+    struct timespec start, stop;
+    uint32_t rounds = BENCHMARK_BYTES / length;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t cycles = read_cycles();
+    for (uint32_t i = 0; i < rounds; i++)
+        encode(buffer, length);
+    cycles = read_cycles() - cycles;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double bytes = (double) rounds * length;
+    double ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+    printf("%-9s %4u bytes: %6.2f ns/byte, %6.2f cycles/byte\n", name, length, ns / bytes, cycles / bytes);
+}
+
+int main()
+{
+    for (uint16_t i = 0; i < BUFFER_SIZE; i++)
+        original[i] = next_random();
+
+    test_encode();
+    test_encode_copy();
+    test_offset();
+
+    const uint16_t lengths[] = { 4, 64, 255 };
+    for (uint8_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        benchmark("reference", reference_pn9_encode, lengths[i]);
+        benchmark("pn9", pn9_encode, lengths[i]);
+    }
+
+    printf("All PN9 tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmark of the scheduler ready queue: the cost of posting and cancelling tasks
+ * and the latency between posting a task and the scheduler dispatching it. Tasks are posted
+ * both as a task_t, which the scheduler looks up, and by the handle they got at registration.
+ */
+#include "scheduler.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define POST_TASK_COUNT 32
+#define POST_ROUNDS 20000
+#define DISPATCH_ROUNDS 200000
+
+static task_t post_tasks[POST_TASK_COUNT];
+static sched_task_handle_t post_handles[POST_TASK_COUNT];
+static sched_task_handle_t dispatch_handle;
+static bool dispatch_by_handle = false;
+static struct timespec post_time;
+static double dispatch_ns = 0;
+static uint32_t dispatch_count = 0;
+static uint32_t rng_state = 0x12345678;
+
+void dummy_task(void *arg)
+{
+    // never executed, only used to derive distinct task pointers
+    assert(false);
+}
+
+static uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double elapsed_ns(struct timespec* start, struct timespec* stop)
+{
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+static void benchmark_post_cancel(bool by_handle)
+{
+    struct timespec start, stop;
+    uint8_t priorities[POST_TASK_COUNT];
+    double post_ns = 0, cancel_ns = 0;
+
+    for(uint32_t round = 0; round < POST_ROUNDS; round++)
+    {
+        for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+            priorities[i] = next_random() % (MIN_PRIORITY + 1);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if(by_handle)
+            for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+                sched_post_task_handle_prio(post_handles[i], priorities[i], NULL);
+        else
+            for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+                sched_post_task_prio(post_tasks[i], priorities[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        post_ns += elapsed_ns(&start, &stop);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if(by_handle)
+            for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+                sched_cancel_task_handle(post_handles[i]);
+        else
+            for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+                sched_cancel_task(post_tasks[i]);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        cancel_ns += elapsed_ns(&start, &stop);
+    }
+
+    assert(!sched_is_scheduled(post_tasks[0]));
+    const char* by = by_handle ? "handle" : "task";
+    printf("post by %-6s: %.1f ns (%.2f Mposts/s)\n", by, post_ns / (POST_ROUNDS * POST_TASK_COUNT), (POST_ROUNDS * POST_TASK_COUNT) / post_ns * 1e3);
+    printf("cancel by %-6s: %.1f ns\n", by, cancel_ns / (POST_ROUNDS * POST_TASK_COUNT));
+}
+
+void dispatch_task(void *arg)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dispatch_ns += elapsed_ns(&post_time, &now);
+
+    if(++dispatch_count == DISPATCH_ROUNDS)
+    {
+        printf("dispatch latency posted by %s: %.1f ns\n", dispatch_by_handle ? "handle" : "task", dispatch_ns / DISPATCH_ROUNDS);
+        if(dispatch_by_handle)
+        {
+            printf("Scheduler benchmark done!\n");
+            exit(0);
+        }
+
+        dispatch_by_handle = true;
+        dispatch_count = 0;
+        dispatch_ns = 0;
+    }
+
+    error_t rtc;
+    clock_gettime(CLOCK_MONOTONIC, &post_time);
+    if(dispatch_by_handle)
+        rtc = sched_post_task_handle_prio(dispatch_handle, next_random() % (MIN_PRIORITY + 1), NULL);
+    else
+        rtc = sched_post_task_prio(&dispatch_task, next_random() % (MIN_PRIORITY + 1), NULL);
+    assert(rtc == SUCCESS);
+}
+
+void bootstrap()
+{
+    for(uint32_t i = 0; i < POST_TASK_COUNT; i++)
+    {
+        post_tasks[i] = (task_t)((uintptr_t)&dummy_task + i + 1);
+        error_t rtc = sched_register_task_handle(post_tasks[i], &post_handles[i]);
+        assert(rtc == SUCCESS);
+    }
+
+    benchmark_post_cancel(false);
+    benchmark_post_cancel(true);
+
+    error_t rtc = sched_register_task_handle(&dispatch_task, &dispatch_handle);
+    assert(rtc == SUCCESS);
+    clock_gettime(CLOCK_MONOTONIC, &post_time);
+    rtc = sched_post_task_prio(&dispatch_task, MIN_PRIORITY, NULL);
+    assert(rtc == SUCCESS);
+}
@@ -31,6 +31,10 @@ bool task4a_called = false;
 bool task5_called[] = {false, false};
 bool task6_called[] = {false, false, false, false};
 bool task7_called[] = {false, false};
+bool task8_called = false;
+bool task9_called = false;
+sched_task_handle_t task8_handle;
+sched_task_handle_t task9_handle;
 
 
 void task1(void* arg)
@@ -97,6 +101,18 @@ void task7(void* arg)
     }
 }
 
+void task8(void* arg)
+{
+    task8_called = true;
+    assert(arg == (void*)8);
+    assert(!sched_is_scheduled(&task8));
+}
+
+void task9(void* arg)
+{
+    task9_called = true;
+}
+
 
 void end_task(void*arg)
 {
@@ -114,6 +130,8 @@ void end_task(void*arg)
     assert(task6_called[3]);
     assert(task7_called[0]);
     assert(!task7_called[1]);
+    assert(task8_called);
+    assert(!task9_called);
     printf("All scheduler tests passed!\n");
     exit(0);
 }
@@ -135,6 +153,24 @@ void bootstrap()
     assert(sched_register_task(&task5) == SUCCESS);
     assert(sched_register_task(&end_task) == SUCCESS);
 
+    sched_task_handle_t handle;
+    assert(sched_post_task_handle(SCHED_NO_TASK_HANDLE) == -EINVAL);
+    assert(sched_cancel_task_handle(SCHED_NO_TASK_HANDLE) == -EINVAL);
+    assert(sched_register_task_handle(&task8, &task8_handle) == SUCCESS);
+    assert(task8_handle != SCHED_NO_TASK_HANDLE);
+    assert(sched_register_task_handle(&task8, &handle) == -EALREADY);
+    assert(handle == task8_handle);
+    assert(sched_register_task_handle(&task9, &task9_handle) == SUCCESS);
+    assert(sched_cancel_task_handle(task9_handle) == -EALREADY);
+    assert(sched_post_task_handle_prio(task9_handle, MIN_PRIORITY + 1, NULL) == -ESIZE);
+    assert(sched_post_task_handle(task9_handle) == SUCCESS);
+    assert(sched_post_task(&task9) == -EALREADY);
+    assert(sched_is_scheduled(&task9));
+    assert(sched_cancel_task_handle(task9_handle) == SUCCESS);
+    assert(!sched_is_scheduled(&task9));
+    assert(sched_post_task(&task9) == SUCCESS);
+    assert(sched_cancel_task_handle(task9_handle) == SUCCESS);
+
     assert(sched_post_task_prio(&task1, 6, NULL) == SUCCESS);
     assert(sched_post_task_prio(&task1, 6, NULL) == -EALREADY);
 
@@ -166,7 +202,14 @@ void bootstrap()
     assert(sched_post_task_prio(&task7, 6, (void*)0) == SUCCESS);
     assert(sched_register_task_allow_multiple(&task7, true) == SUCCESS);
     assert(sched_post_task_prio(&task7, 6, (void*)1) == SUCCESS);
-    
+
+    // a task registered multiple times has no handle, the handles of the other tasks stay valid
+    assert(sched_register_task_handle(&task6, &handle) == -EALREADY);
+    assert(handle == SCHED_NO_TASK_HANDLE);
+    assert(sched_post_task_handle_prio(task8_handle, 6, (void*)8) == SUCCESS);
+    assert(sched_post_task_handle_prio(task8_handle, 6, (void*)8) == -EALREADY);
+    assert(sched_is_scheduled(&task8));
+
     assert(sched_post_task_prio(&end_task, MIN_PRIORITY, NULL) == SUCCESS);
 
 }
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shared_buffer.h"
+#include "ng.h"
+#include "assert.h"
+#include "stdio.h"
+#include <string.h>
+
+#define HEADROOM 2
+
+void test_alloc()
+{
+    shared_buffer_t* buffers[FRAMEWORK_SHARED_BUFFER_COUNT];
+    for(int i = 0; i < FRAMEWORK_SHARED_BUFFER_COUNT; i++)
+    {
+        buffers[i] = shared_buffer_alloc(HEADROOM);
+        assert(buffers[i] != NULL);
+        assert(shared_buffer_get_length(buffers[i]) == 0);
+        assert(shared_buffer_get_headroom(buffers[i]) == HEADROOM);
+        assert(shared_buffer_get_tailroom(buffers[i]) == FRAMEWORK_SHARED_BUFFER_SIZE - HEADROOM);
+    }
+
+    assert(shared_buffer_get_free_count() == 0);
+    assert(shared_buffer_alloc(HEADROOM) == NULL);
+
+    // a buffer with an additional reference is only returned to the pool when both are released
+    shared_buffer_retain(buffers[0]);
+    shared_buffer_release(buffers[0]);
+    assert(shared_buffer_alloc(HEADROOM) == NULL);
+    shared_buffer_release(buffers[0]);
+    assert(shared_buffer_get_free_count() == 1);
+    assert(shared_buffer_alloc(HEADROOM) == buffers[0]);
+
+    for(int i = 0; i < FRAMEWORK_SHARED_BUFFER_COUNT; i++)
+        shared_buffer_release(buffers[i]);
+
+    assert(shared_buffer_get_free_count() == FRAMEWORK_SHARED_BUFFER_COUNT);
+    assert(shared_buffer_alloc(FRAMEWORK_SHARED_BUFFER_SIZE + 1) == NULL);
+}
+
+void test_prepend_append()
+{
+    uint8_t data[] = { 3, 4, 5 };
+    shared_buffer_t* buffer = shared_buffer_alloc(HEADROOM);
+    memcpy(shared_buffer_append(buffer, sizeof(data)), data, sizeof(data));
+    assert(shared_buffer_get_length(buffer) == sizeof(data));
+
+    // the header is prepended in place, the data is not moved
+    uint8_t* header = shared_buffer_prepend(buffer, HEADROOM);
+    assert(header == shared_buffer_get_data(buffer));
+    header[0] = 1;
+    header[1] = 2;
+    assert(shared_buffer_get_length(buffer) == HEADROOM + sizeof(data));
+    assert(memcmp(shared_buffer_get_data(buffer), (uint8_t[]){ 1, 2, 3, 4, 5 }, 5) == 0);
+    assert(shared_buffer_prepend(buffer, 1) == NULL);
+
+    uint16_t tailroom = shared_buffer_get_tailroom(buffer);
+    assert(shared_buffer_append(buffer, tailroom + 1) == NULL);
+    assert(shared_buffer_append(buffer, tailroom) != NULL);
+    assert(shared_buffer_get_tailroom(buffer) == 0);
+
+    // data written through a pointer to the storage
+    shared_buffer_set_data(buffer, buffer->storage + 10, 4);
+    assert(shared_buffer_get_headroom(buffer) == 10);
+    assert(shared_buffer_get_length(buffer) == 4);
+    assert(shared_buffer_get_tailroom(buffer) == FRAMEWORK_SHARED_BUFFER_SIZE - 14);
+
+    shared_buffer_release(buffer);
+}
+
+int main()
+{
+#ifdef NODE_GLOBALS
+    // the pool is node global in simulation builds, and there is no simulator selecting a node
+    set_node_global_id(0);
+#endif
+    test_alloc();
+    test_prepend_append();
+    printf("All shared buffer tests passed!\n");
+    return 0;
+}
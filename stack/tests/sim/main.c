@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Network capacity test on the NATIVE simulator: every simulated node periodically transmits a frame
+ * using a simple listen-before-talk scheme with random back-off, while listening to all other nodes
+ * in between. After SIM_DURATION_SECONDS of virtual time the medium statistics are reported.
+ *
+ * Configure the number of nodes with -DPLATFORM_NATIVE_SIM_NODES=<n>, with n at least 2.
+ */
+#include "hwradio.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim.h"
+#include "ng.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_DURATION_SECONDS 60
+#define TX_INTERVAL_MAX (10 * TIMER_TICKS_PER_SEC)
+#define BACKOFF_MAX 20
+#define PAYLOAD_LENGTH 16
+#define CENTER_FREQ 868000000
+#define BITRATE 55555
+#define PREAMBLE_SIZE 5
+#define CCA_THRESHOLD -86
+
+static uint8_t sync_word[2] = { 0xD0, 0xE6 };
+
+static uint32_t NGDEF(_rng_state);
+static uint32_t NGDEF(_rx_buffer)[(HW_PACKET_BUF_SIZE(PAYLOAD_LENGTH) + 3) / 4];
+
+// aggregated over all nodes
+static uint32_t tx_attempts = 0;
+static uint32_t backoffs = 0;
+static struct timespec wall_start;
+
+static uint32_t next_random()
+{
+    uint32_t x = NG(_rng_state);
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    NG(_rng_state) = x;
+    return x;
+}
+
+static hw_radio_packet_t* alloc_packet(uint16_t length)
+{
+    assert(length <= PAYLOAD_LENGTH);
+    return (hw_radio_packet_t*) NG(_rx_buffer);
+}
+
+static void release_packet(hw_radio_packet_t* packet)
+{
+}
+
+static void packet_received(hw_radio_packet_t* packet)
+{
+    // the payload carries the index of the sender, which can never be the receiver itself
+    assert(packet->length == PAYLOAD_LENGTH);
+    uint16_t sender = packet->data[0] | (packet->data[1] << 8);
+    assert(sender < sim_get_node_count() && sender != sim_get_node_id());
+}
+
+static void start_tx(void *arg)
+{
+    tx_attempts++;
+    if(hw_radio_get_rssi() > CCA_THRESHOLD)
+    {
+        backoffs++;
+        timer_post_task_delay(&start_tx, 1 + next_random() % BACKOFF_MAX);
+        return;
+    }
+
+    uint8_t payload[PAYLOAD_LENGTH];
+    memset(payload, 0, sizeof(payload));
+    payload[0] = sim_get_node_id() & 0xFF;
+    payload[1] = sim_get_node_id() >> 8;
+    error_t rtc = hw_radio_send_payload(payload, sizeof(payload));
+    assert(rtc == SUCCESS);
+}
+
+static void packet_transmitted(timer_tick_t timestamp)
+{
+    hw_radio_set_opmode(HW_STATE_RX);
+    timer_post_task_delay(&start_tx, 1 + next_random() % TX_INTERVAL_MAX);
+}
+
+static void finish(void *arg)
+{
+    struct timespec wall_stop;
+    clock_gettime(CLOCK_MONOTONIC, &wall_stop);
+    double wall_ms = (wall_stop.tv_sec - wall_start.tv_sec) * 1e3 + (wall_stop.tv_nsec - wall_start.tv_nsec) / 1e6;
+
+    const sim_stats_t* stats = sim_get_stats();
+    printf("%u nodes, %u s simulated in %.1f ms (%lu events)\n", (unsigned) sim_get_node_count(), SIM_DURATION_SECONDS,
+        wall_ms, (unsigned long) stats->events_processed);
+    printf("tx attempts %u, backoffs %u, frames transmitted %u\n", tx_attempts, backoffs, stats->frames_transmitted);
+    printf("frames received %u, collided %u, missed %u\n", stats->frames_received, stats->frames_collided,
+        stats->frames_missed);
+
+    assert(stats->frames_transmitted > 0);
+    assert(stats->frames_received > 0);
+
+    printf("Simulator test done!\n");
+    exit(0);
+}
+
+void bootstrap()
+{
+    // a single node has nobody to talk to
+    assert(sim_get_node_count() > 1);
+
+    NG(_rng_state) = 0x12345678 + sim_get_node_id();
+
+    hwradio_init_args_t init_args = {
+        .alloc_packet_cb = alloc_packet,
+        .release_packet_cb = release_packet,
+        .rx_packet_cb = packet_received,
+        .tx_packet_cb = packet_transmitted,
+    };
+
+    error_t rtc = hw_radio_init(&init_args);
+    assert(rtc == SUCCESS);
+    hw_radio_set_center_freq(CENTER_FREQ);
+    hw_radio_set_bitrate(BITRATE);
+    hw_radio_set_preamble_size(PREAMBLE_SIZE);
+    hw_radio_set_sync_word(sync_word, sizeof(sync_word));
+    hw_radio_set_payload_length(PAYLOAD_LENGTH);
+    hw_radio_set_opmode(HW_STATE_RX);
+
+    sched_register_task(&start_tx);
+    timer_post_task_delay(&start_tx, 1 + next_random() % TX_INTERVAL_MAX);
+
+    if(sim_get_node_id() == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &wall_start);
+        sched_register_task(&finish);
+        timer_post_task_delay(&finish, SIM_DURATION_SECONDS * TIMER_TICKS_PER_SEC);
+    }
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Dialog capacity test of the D7AP stack on the NATIVE simulator. Every simulated node runs a full D7AP stack,
+ * starting from the default system files. Node 0 is a gateway doing a continuous foreground scan, the other nodes
+ * periodically send a report to it which has to be acknowledged. After SIM_DURATION_SECONDS of virtual time the
+ * dialog results, the CSMA-CA channel assessments and the medium statistics are reported.
+ *
+ * Configure the number of nodes with -DPLATFORM_NATIVE_SIM_NODES=<n>, with n at least 2.
+ */
+#include "d7ap.h"
+#include "d7ap_fs.h"
+#include "hwblockdevice.h"
+#include "platform.h"
+#include "random.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "sim.h"
+#include "ng.h"
+#include "assert.h"
+#include "errors.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SIM_DURATION_SECONDS 300
+#define REPORT_INTERVAL_MAX (60 * TIMER_TICKS_PER_SEC)
+#define REPORT_LENGTH 8
+#define GATEWAY_ACCESS_CLASS 0x01 // access profile 0 of the default system files: continuous foreground scan
+#define GATEWAY_UID { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } // hw_get_unique_id() of node 0
+
+const char _GIT_SHA1[] = "0000000";
+const char _APP_NAME[] = "simd7a";
+
+// the default system files (fs/d7ap_fs_data.c)
+extern uint8_t d7ap_fs_metadata[];
+extern uint8_t d7ap_files_data[];
+
+static uint8_t NGDEF(_client_id);
+static sim_time_t NGDEF(_report_time);
+
+// aggregated over all nodes
+static uint32_t reports_sent = 0;
+static uint32_t reports_acked = 0;
+static uint32_t reports_failed = 0;
+static uint32_t reports_received = 0;
+static sim_time_t dialog_time_total = 0;
+static sim_time_t dialog_time_max = 0;
+static struct timespec wall_start;
+
+static void send_report(void *arg)
+{
+    uint8_t report[REPORT_LENGTH] = { sim_get_node_id() & 0xFF, sim_get_node_id() >> 8 };
+    d7ap_session_config_t config = {
+        .qos.qos_resp_mode = SESSION_RESP_MODE_ANY,
+        .dormant_timeout = 0,
+        .addressee.ctrl.nls_method = AES_NONE,
+        .addressee.ctrl.id_type = ID_TYPE_UID,
+        .addressee.access_class = GATEWAY_ACCESS_CLASS,
+        .addressee.id = GATEWAY_UID,
+    };
+
+    uint16_t trans_id;
+    NG(_report_time) = sim_get_time();
+    error_t rtc = d7ap_send(NG(_client_id), &config, report, sizeof(report), 0, &trans_id);
+    assert(rtc == SUCCESS);
+    reports_sent++;
+}
+
+static void report_transmitted(uint16_t trans_id, error_t error)
+{
+    if(error == SUCCESS)
+    {
+        sim_time_t dialog_time = sim_get_time() - NG(_report_time);
+        dialog_time_total += dialog_time;
+        if(dialog_time > dialog_time_max)
+            dialog_time_max = dialog_time;
+
+        reports_acked++;
+    }
+    else
+        reports_failed++;
+
+    timer_post_task_delay(&send_report, 1 + get_rnd() % REPORT_INTERVAL_MAX);
+}
+
+static void ack_received(uint16_t trans_id, uint8_t* payload, uint8_t len, d7ap_session_result_t result)
+{
+}
+
+static bool report_received(uint8_t* payload, uint8_t len, d7ap_session_result_t result, bool response_expected)
+{
+    assert(sim_get_node_id() == 0);
+    assert(len == REPORT_LENGTH);
+    uint16_t sender = payload[0] | (payload[1] << 8);
+    assert(sender > 0 && sender < sim_get_node_count());
+    reports_received++;
+
+    // no response payload, the stack acknowledges the request right away
+    return false;
+}
+
+static void finish(void *arg)
+{
+    struct timespec wall_stop;
+    clock_gettime(CLOCK_MONOTONIC, &wall_stop);
+    double wall_ms = (wall_stop.tv_sec - wall_start.tv_sec) * 1e3 + (wall_stop.tv_nsec - wall_start.tv_nsec) / 1e6;
+
+    const sim_stats_t* stats = sim_get_stats();
+    printf("%u nodes, %u s simulated in %.1f ms (%lu events)\n", (unsigned) sim_get_node_count(), SIM_DURATION_SECONDS,
+        wall_ms, (unsigned long) stats->events_processed);
+    printf("reports sent %u, acknowledged %u, failed %u, received by the gateway %u\n", reports_sent, reports_acked,
+        reports_failed, reports_received);
+    if(reports_acked > 0)
+        printf("dialog duration: average %.1f ms, max %.1f ms\n",
+            1000.0 * dialog_time_total / reports_acked / SIM_TICKS_PER_SECOND,
+            1000.0 * dialog_time_max / SIM_TICKS_PER_SECOND);
+    printf("CCA: %u channel assessments, %u found the channel busy\n", stats->rssi_measurements, stats->rssi_busy);
+    printf("frames transmitted %u, received %u, collided %u, missed %u\n", stats->frames_transmitted,
+        stats->frames_received, stats->frames_collided, stats->frames_missed);
+
+    assert(reports_acked > 0);
+    assert(reports_received >= reports_acked);
+
+    printf("D7AP simulator test done!\n");
+    exit(0);
+}
+
+void bootstrap()
+{
+    // a single node has nobody to talk to
+    assert(sim_get_node_count() > 1);
+
+    // every node starts from the default system files, d7ap_fs_init() gives it its own UID
+    blockdevice_program(PLATFORM_METADATA_BLOCKDEVICE, d7ap_fs_metadata, 0, PLATFORM_METADATA_BLOCKDEVICE->size);
+    blockdevice_program(PLATFORM_PERMANENT_BLOCKDEVICE, d7ap_files_data, 0, PLATFORM_PERMANENT_BLOCKDEVICE->size);
+    d7ap_fs_init();
+    d7ap_init();
+
+    d7ap_resource_desc_t desc = {
+        .receive_cb = ack_received,
+        .transmitted_cb = report_transmitted,
+        .unsolicited_cb = report_received,
+    };
+
+    NG(_client_id) = d7ap_register(&desc);
+
+    if(sim_get_node_id() == 0)
+    {
+        d7ap_set_access_class(GATEWAY_ACCESS_CLASS);
+
+        clock_gettime(CLOCK_MONOTONIC, &wall_start);
+        sched_register_task(&finish);
+        timer_post_task_delay(&finish, SIM_DURATION_SECONDS * TIMER_TICKS_PER_SEC);
+    }
+    else
+    {
+        sched_register_task(&send_report);
+        timer_post_task_delay(&send_report, 1 + get_rnd() % REPORT_INTERVAL_MAX);
+    }
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Functional checks and benchmark of the framework timer queue.
+ *
+ * The timer API is benchmarked with the backend selected at build time (FRAMEWORK_TIMER_BACKEND). Next, both queue
+ * backends are compared in the same run on the same workload, through queue_linear.c and queue_heap.c. The watchdog
+ * of the framework keeps one timer event pending, so to run all load levels use for example:
+ *   cmake -DPLATFORM=NATIVE -DTEST_TIMER=ON -DFRAMEWORK_TIMER_STACK_SIZE=513 ..
+ * Load levels which do not fit in the free timer events are skipped.
+ * Posted events are never due during the benchmark, since the simulated clock only advances while the node sleeps.
+ *
+ * With the LINEAR backend posting and finding the next deadline scan the whole pool, but cancelling stops at the
+ * pending event and only clears it. At low load levels the pending events sit at the start of the pool, so this is
+ * cheaper than the hash lookup, the hash table deletion and the heap reordering which HEAP needs to cancel.
+ */
+#include "timer.h"
+#include "queue_backends.h"
+#include "scheduler.h"
+#include "assert.h"
+#include "errors.h"
+#include "framework_defs.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCHMARK_ITERATIONS 100000
+
+static const uint32_t load_levels[] = { 8, 64, 512 };
+
+static task_t tasks[FRAMEWORK_TIMER_STACK_SIZE];
+// the number of timer events which are not used by the framework itself
+static uint32_t free_events;
+
+timer_event queue_timers[FRAMEWORK_TIMER_STACK_SIZE];
+static uint32_t rng_state = 0x12345678;
+
+void dummy_task(void *arg)
+{
+}
+
+static uint32_t next_random()
+{
+    // xorshift32, we need a deterministic sequence to compare runs
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static timer_tick_t random_fire_time()
+{
+    return 1000 + (next_random() % 1000000);
+}
+
+static double elapsed_ns(struct timespec* start, struct timespec* stop)
+{
+    return (stop->tv_sec - start->tv_sec) * 1e9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+static void test_semantics()
+{
+    assert(timer_post_task_prio(tasks[0], 5000, DEFAULT_PRIORITY, 0, NULL) == SUCCESS);
+    assert(timer_is_task_scheduled(tasks[0]));
+    // rescheduling with the same priority only updates the fire time
+    assert(timer_post_task_prio(tasks[0], 6000, DEFAULT_PRIORITY, 0, NULL) == SUCCESS);
+    // rescheduling with another priority is refused
+    assert(timer_post_task_prio(tasks[0], 6000, MAX_PRIORITY, 0, NULL) == EALREADY);
+    assert(timer_post_task_prio(tasks[0], 6000, MIN_PRIORITY + 1, 0, NULL) == EINVAL);
+
+    // the framework itself can have events pending as well (e.g. the watchdog), so fill up the remaining slots
+    uint32_t posted = 1;
+    while(posted < FRAMEWORK_TIMER_STACK_SIZE
+          && timer_post_task_prio(tasks[posted], random_fire_time(), DEFAULT_PRIORITY, 0, NULL) == SUCCESS)
+        posted++;
+
+    assert(timer_post_task_prio(&dummy_task, 5000, DEFAULT_PRIORITY, 0, NULL) == ENOMEM);
+    free_events = posted;
+
+    for(uint32_t i = 0; i < posted; i++)
+    {
+        assert(timer_cancel_task(tasks[i]) == SUCCESS);
+        assert(!timer_is_task_scheduled(tasks[i]));
+        assert(timer_cancel_task(tasks[i]) == EALREADY);
+    }
+
+    printf("Timer semantics tests passed!\n");
+}
+
+static void benchmark(uint32_t pending)
+{
+    struct timespec start, stop;
+    double post_ns = 0, cancel_ns = 0, lookup_ns = 0;
+
+    for(uint32_t i = 0; i < pending; i++)
+        assert(timer_post_task_prio(tasks[i], random_fire_time(), DEFAULT_PRIORITY, 0, NULL) == SUCCESS);
+
+    // churn: cancel a random pending event and post it again with a new fire time
+    for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        task_t task = tasks[next_random() % pending];
+        timer_tick_t fire_time = random_fire_time();
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        error_t rtc = timer_cancel_task(task);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        cancel_ns += elapsed_ns(&start, &stop);
+        assert(rtc == SUCCESS);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        rtc = timer_post_task_prio(task, fire_time, DEFAULT_PRIORITY, 0, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        post_ns += elapsed_ns(&start, &stop);
+        assert(rtc == SUCCESS);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bool scheduled = timer_is_task_scheduled(task);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        lookup_ns += elapsed_ns(&start, &stop);
+        assert(scheduled);
+    }
+
+    for(uint32_t i = 0; i < pending; i++)
+        assert(timer_cancel_task(tasks[i]) == SUCCESS);
+
+    printf("%-6s %4u pending: post %7.1f ns, cancel %7.1f ns, lookup %7.1f ns\n", FRAMEWORK_TIMER_BACKEND_NAME, pending,
+        post_ns / BENCHMARK_ITERATIONS, cancel_ns / BENCHMARK_ITERATIONS, lookup_ns / BENCHMARK_ITERATIONS);
+}
+
+static uint32_t queue_post(const queue_backend_t* backend, task_t task, timer_tick_t fire_time)
+{
+    // the same steps as timer_post_task_prio()
+    uint32_t index = backend->find(task);
+    if(index != NO_EVENT)
+    {
+        queue_timers[index].next_event = fire_time;
+        backend->update(index);
+        return index;
+    }
+
+    index = backend->alloc();
+    assert(index != NO_EVENT);
+    queue_timers[index].f = task;
+    queue_timers[index].next_event = fire_time;
+    queue_timers[index].priority = DEFAULT_PRIORITY;
+    backend->insert(index);
+    return index;
+}
+
+static void benchmark_queue(const queue_backend_t* backend, uint32_t pending)
+{
+    struct timespec start, stop;
+    double post_ns = 0, cancel_ns = 0, peek_ns = 0;
+
+    backend->init();
+    rng_state = 0x12345678;
+    for(uint32_t i = 0; i < pending; i++)
+        queue_post(backend, tasks[i], random_fire_time());
+
+    // the same churn as benchmark(), followed by the search for the next deadline done by timer.c after every change
+    for(uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        task_t task = tasks[next_random() % pending];
+        timer_tick_t fire_time = random_fire_time();
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint32_t index = backend->find(task);
+        backend->remove(index);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        cancel_ns += elapsed_ns(&start, &stop);
+        assert(index != NO_EVENT);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        queue_post(backend, task, fire_time);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        post_ns += elapsed_ns(&start, &stop);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        index = backend->peek(0);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        peek_ns += elapsed_ns(&start, &stop);
+        assert(index != NO_EVENT);
+    }
+
+    printf("queue %-6s %4u pending: post %7.1f ns, cancel %7.1f ns, next deadline %7.1f ns\n", backend->name, pending,
+        post_ns / BENCHMARK_ITERATIONS, cancel_ns / BENCHMARK_ITERATIONS, peek_ns / BENCHMARK_ITERATIONS);
+}
+
+static task_t queue_next_task(const queue_backend_t* backend, uint32_t pending)
+{
+    backend->init();
+    rng_state = 0x87654321;
+    for(uint32_t i = 0; i < pending; i++)
+        queue_post(backend, tasks[i], random_fire_time());
+
+    return queue_timers[backend->peek(0)].f;
+}
+
+static void compare_queue_backends(uint32_t pending)
+{
+    // both backends have to agree on the next deadline
+    assert(queue_next_task(&linear_queue_backend, pending) == queue_next_task(&heap_queue_backend, pending));
+
+    benchmark_queue(&linear_queue_backend, pending);
+    benchmark_queue(&heap_queue_backend, pending);
+}
+
+void bootstrap()
+{
+    // the tasks are only used as keys in the timer queue and are never executed,
+    // so distinct addresses within dummy_task are sufficient
+    for(uint32_t i = 0; i < FRAMEWORK_TIMER_STACK_SIZE; i++)
+        tasks[i] = (task_t)((uintptr_t)&dummy_task + i + 1);
+
+    test_semantics();
+
+    for(uint32_t i = 0; i < sizeof(load_levels) / sizeof(load_levels[0]); i++)
+    {
+        if(load_levels[i] > free_events)
+        {
+            printf("skipping %u pending events, only %u of the %u timer events are free\n", load_levels[i], free_events,
+                FRAMEWORK_TIMER_STACK_SIZE);
+            continue;
+        }
+
+        benchmark(load_levels[i]);
+    }
+
+    for(uint32_t i = 0; i < sizeof(load_levels) / sizeof(load_levels[0]); i++)
+    {
+        if(load_levels[i] <= FRAMEWORK_TIMER_STACK_SIZE)
+            compare_queue_backends(load_levels[i]);
+    }
+
+    printf("All timer tests passed!\n");
+    exit(0);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Both timer queue backends, linked into the timer test under their own names (see queue_linear.c and queue_heap.c)
+ * so they can be compared in one run. They share the event pool queue_timers, which is separate from the pool of the
+ * framework timer.
+ */
+#ifndef QUEUE_BACKENDS_H_
+#define QUEUE_BACKENDS_H_
+
+#include "timer_queue.h"
+
+#ifdef NODE_GLOBALS
+#error "the timer test is built for a single node"
+#endif
+
+typedef struct
+{
+    const char* name;
+    void (*init)();
+    uint32_t (*find)(task_t task);
+    uint32_t (*alloc)();
+    void (*insert)(uint32_t index);
+    void (*update)(uint32_t index);
+    void (*remove)(uint32_t index);
+    uint32_t (*peek)(timer_tick_t counter);
+} queue_backend_t;
+
+extern timer_event queue_timers[FRAMEWORK_TIMER_STACK_SIZE];
+
+extern const queue_backend_t linear_queue_backend;
+extern const queue_backend_t heap_queue_backend;
+
+#endif /* QUEUE_BACKENDS_H_ */
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// the HEAP timer queue backend, renamed so it can be linked next to the framework timer and the other backend
+// NG(timers) of a single node build, the backends use queue_timers instead of the pool of the framework timer
+#define __ng_single_timers__ queue_timers
+#define timer_queue_init heap_queue_init
+#define timer_queue_find heap_queue_find
+#define timer_queue_alloc heap_queue_alloc
+#define timer_queue_insert heap_queue_insert
+#define timer_queue_update heap_queue_update
+#define timer_queue_remove heap_queue_remove
+#define timer_queue_peek heap_queue_peek
+
+#include "timer_queue_heap.c"
+#include "queue_backends.h"
+
+const queue_backend_t heap_queue_backend = {
+    .name = "HEAP",
+    .init = &heap_queue_init,
+    .find = &heap_queue_find,
+    .alloc = &heap_queue_alloc,
+    .insert = &heap_queue_insert,
+    .update = &heap_queue_update,
+    .remove = &heap_queue_remove,
+    .peek = &heap_queue_peek,
+};
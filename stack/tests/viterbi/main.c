@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2015-2021 University of Antwerp, Aloxy NV.
+ *
+ * This file is part of Sub-IoT.
+ * See https://github.com/Sub-IoT/Sub-IoT-Stack for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fec.h"
+#include "assert.h"
+#include "stdio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PACKET_SIZE 255
+#define BUFFER_SIZE (2 * (MAX_PACKET_SIZE + 3))
+#define BENCHMARK_BYTES (4 * 1024 * 1024)
+
+static uint8_t original[MAX_PACKET_SIZE];
+static uint8_t encoded[BUFFER_SIZE];
+static uint8_t buffer[BUFFER_SIZE];
+static uint8_t decoded[BUFFER_SIZE];
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static inline uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint16_t encode(const uint8_t* data, uint16_t length)
+{
+    memcpy(encoded, data, length);
+    uint16_t encoded_length = fec_encode(encoded, length);
+    assert(encoded_length == 2 * (length + 2 + length % 2));
+    return encoded_length;
+}
+
+static void test_vector()
+{
+    uint8_t input[] = {0x19,0x00,0x80,0x00,0x0B,0x57,0x00,0x00,0x07,0x8C,0x63,0x20,0x00,0x0B,0x57,0x00,0x00,0x07,0x8F,0x52,0x41,0x07,0x00,0x00,0xD0,0x81};
+    uint16_t encoded_length = encode(input, sizeof(input));
+    assert(encoded_length == 56);
+
+    memcpy(buffer, encoded, encoded_length);
+    uint16_t decoded_length = fec_decode_packet(buffer, encoded_length, sizeof(buffer));
+    assert(decoded_length == encoded_length / 2);
+    assert(memcmp(buffer, input, sizeof(input)) == 0);
+    printf("FEC vector OK\n");
+}
+
+static void test_roundtrip()
+{
+    for (uint16_t length = 1; length <= MAX_PACKET_SIZE; length++) {
+        for (uint16_t i = 0; i < length; i++)
+            original[i] = next_random();
+
+        uint16_t encoded_length = encode(original, length);
+        memcpy(buffer, encoded, encoded_length);
+        uint16_t decoded_length = fec_decode_packet(buffer, encoded_length, sizeof(buffer));
+        assert(decoded_length == encoded_length / 2);
+        assert(memcmp(buffer, original, length) == 0);
+
+        // isolated bit errors are corrected
+        memcpy(buffer, encoded, encoded_length);
+        for (uint16_t i = 0; i < encoded_length; i += 16)
+            buffer[i + next_random() % 16 % (encoded_length - i)] ^= 1 << (next_random() % 8);
+
+        fec_decode_packet(buffer, encoded_length, sizeof(buffer));
+        assert(memcmp(buffer, original, length) == 0);
+    }
+
+    // invalid lengths are rejected
+    assert(fec_decode_packet(buffer, 6, sizeof(buffer)) == 0);
+    assert(fec_decode_packet(buffer, 8, 4) == 0);
+    printf("FEC roundtrip OK\n");
+}
+
+static void test_encode_copy()
+{
+    // encoding into a separate buffer gives the same result as encoding in place
+    for (uint16_t length = 1; length <= MAX_PACKET_SIZE; length++) {
+        for (uint16_t i = 0; i < length; i++)
+            original[i] = next_random();
+
+        uint16_t encoded_length = encode(original, length);
+        memset(buffer, 0, sizeof(buffer));
+        assert(fec_encode_copy(buffer, original, length) == encoded_length);
+        assert(memcmp(buffer, encoded, encoded_length) == 0);
+    }
+
+    printf("FEC encode copy OK\n");
+}
+
+static void test_streaming()
+{
+    for (uint16_t round = 0; round < 1000; round++) {
+        uint16_t length = 1 + next_random() % MAX_PACKET_SIZE;
+        for (uint16_t i = 0; i < length; i++)
+            original[i] = next_random();
+
+        uint16_t encoded_length = encode(original, length);
+
+        // feed the packet in random chunks, as received from the radio FIFO
+        fec_decoder_t decoder;
+        fec_decoder_init(&decoder, decoded, sizeof(decoded));
+        uint16_t pos = 0;
+        while (pos < encoded_length) {
+            uint16_t chunk = next_random() % 20;
+            if (chunk > encoded_length - pos)
+                chunk = encoded_length - pos;
+
+            fec_decoder_update(&decoder, encoded + pos, chunk);
+            pos += chunk;
+            assert(decoder.output_length == (pos / 4) * 2 - (pos >= 4));
+        }
+
+        assert(fec_decoder_final(&decoder) == encoded_length / 2);
+
+        memcpy(buffer, encoded, encoded_length);
+        fec_decode_packet(buffer, encoded_length, sizeof(buffer));
+        assert(memcmp(decoded, buffer, encoded_length / 2) == 0);
+        assert(memcmp(decoded, original, length) == 0);
+    }
+
+    printf("FEC streaming OK\n");
+}
+
+static void benchmark(uint16_t length)
+{
+    struct timespec start, stop;
+    uint16_t encoded_length = encode(original, length);
+    uint32_t rounds = BENCHMARK_BYTES / encoded_length;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t cycles = read_cycles();
+    for (uint32_t i = 0; i < rounds; i++) {
+        memcpy(buffer, encoded, encoded_length);
+        fec_decode_packet(buffer, encoded_length, sizeof(buffer));
+    }
+    cycles = read_cycles() - cycles;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double bytes = (double) rounds * encoded_length;
+    double ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+    printf("decode %4u encoded bytes: %7.2f ns/byte, %7.2f cycles/byte\n", encoded_length, ns / bytes, cycles / bytes);
+}
+
+int main()
+{
+    test_vector();
+    test_roundtrip();
+    test_encode_copy();
+    test_streaming();
+
+    const uint16_t lengths[] = { 8, 64, 255 };
+    for (uint8_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+        benchmark(lengths[i]);
+
+    printf("All FEC tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+
+# Decodes the output of the binary log backend (FRAMEWORK_LOG_BINARY) of the framework.
+#
+# The target only sends the id of the format string and the raw arguments of a log call, the format strings are read
+# from the ELF file of the application which is running on the target. Bytes which are not part of a log record (for
+# example plain printf() output) are passed through unchanged. The record layout is documented in
+# framework/components/log/log.c.
+
+import argparse
+import re
+import struct
+import sys
+
+from signal import signal, SIGPIPE, SIG_DFL
+signal(SIGPIPE, SIG_DFL)
+
+RECORD_SYNC = 0xA5
+RECORD_HEADER_SIZE = 6
+RECORD_MAX_SIZE = 64
+
+KIND_STRING = 0x01
+KIND_STACK_STRING = 0x02
+KIND_ERROR_STRING = 0x03
+KIND_DATA = 0x04
+KIND_TRUNCATED = 0x80
+
+STACK_LAYERS = {
+  0x01: "PHY", 0x02: "DLL", 0x03: "MAC", 0x04: "NWL", 0x05: "TRANS", 0x06: "SESSION", 0x07: "D7AP", 0x08: "ALP",
+  0x10: "FWK", 0x11: "EM"
+}
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|z|j|t|L)?([diuxXocpsfFeEgGaA%])")
+
+class ElfFile:
+  """Just enough of an ELF parser to resolve the format strings"""
+
+  def __init__(self, path):
+    with open(path, "rb") as f:
+      self.data = f.read()
+
+    if self.data[:4] != b"\x7fELF":
+      raise ValueError("{0} is not an ELF file".format(path))
+
+    self.is_64 = self.data[4] == 2
+    self.endian = "<" if self.data[5] == 1 else ">"
+    if self.is_64:
+      shoff, = struct.unpack_from(self.endian + "Q", self.data, 0x28)
+      shentsize, shnum = struct.unpack_from(self.endian + "HH", self.data, 0x3A)
+    else:
+      shoff, = struct.unpack_from(self.endian + "I", self.data, 0x20)
+      shentsize, shnum = struct.unpack_from(self.endian + "HH", self.data, 0x2E)
+
+    self.sections = []
+    for i in range(shnum):
+      offset = shoff + i * shentsize
+      if self.is_64:
+        _, type, flags, addr, file_offset, size, link = struct.unpack_from(self.endian + "IIQQQQI", self.data, offset)
+      else:
+        _, type, flags, addr, file_offset, size, link = struct.unpack_from(self.endian + "IIIIIII", self.data, offset)
+
+      self.sections.append((type, flags, addr, file_offset, size, link))
+
+  def symbol(self, name):
+    SHT_SYMTAB = 2
+    for type, _, _, file_offset, size, link in self.sections:
+      if type != SHT_SYMTAB:
+        continue
+
+      strtab_offset = self.sections[link][3]
+      entry_size = 24 if self.is_64 else 16
+      for offset in range(file_offset, file_offset + size, entry_size):
+        if self.is_64:
+          name_offset, _, _, _, value, _ = struct.unpack_from(self.endian + "IBBHQQ", self.data, offset)
+        else:
+          name_offset, value, _, _, _, _ = struct.unpack_from(self.endian + "IIIBBH", self.data, offset)
+
+        end = self.data.index(b"\0", strtab_offset + name_offset)
+        if self.data[strtab_offset + name_offset:end] == name.encode():
+          return value
+
+    raise KeyError("symbol {0} not found, is the application built with FRAMEWORK_LOG_BINARY?".format(name))
+
+  def string(self, address):
+    SHT_PROGBITS = 1
+    SHF_ALLOC = 2
+    for type, flags, addr, file_offset, size, _ in self.sections:
+      if type == SHT_PROGBITS and flags & SHF_ALLOC and addr <= address < addr + size:
+        start = file_offset + address - addr
+        end = self.data.find(b"\0", start, file_offset + size)
+        if end < 0:
+          return None
+
+        return self.data[start:end].decode("utf-8", "replace")
+
+    return None
+
+class Decoder:
+  def __init__(self, elf, output):
+    self.elf = elf
+    self.output = output
+    self.anchor = elf.symbol("log_format_anchor")
+    self.formats = {}
+    self.buffer = b""
+    self.expected_counter = None
+    self.data = []
+    self.lost = 0
+
+  def format(self, format_id):
+    if format_id not in self.formats:
+      self.formats[format_id] = self.elf.string(self.anchor + format_id)
+
+    return self.formats[format_id]
+
+  def feed(self, data):
+    self.buffer += data
+    while self.buffer:
+      sync = self.buffer.find(bytes([RECORD_SYNC]))
+      if sync < 0:
+        self.text(self.buffer)
+        self.buffer = b""
+        return
+
+      self.text(self.buffer[:sync])
+      self.buffer = self.buffer[sync:]
+      if len(self.buffer) < 2 or len(self.buffer) < self.buffer[1] + 2:
+        return # wait for the rest of the record
+
+      length = self.buffer[1] + 2
+      if not self.record(self.buffer[:length]):
+        # not a record, only the sync byte is passed through as text
+        self.text(self.buffer[:1])
+        length = 1
+
+      self.buffer = self.buffer[length:]
+
+  def text(self, data):
+    if data:
+      self.output.write(data.decode("utf-8", "replace"))
+
+  def record(self, record):
+    if len(record) < RECORD_HEADER_SIZE or len(record) > RECORD_MAX_SIZE:
+      return False
+
+    kind = record[2] & ~KIND_TRUNCATED
+    layer = record[3]
+    counter, = struct.unpack_from(self.elf.endian + "H", record, 4)
+    if kind == KIND_DATA:
+      message = self.decode_data(record[RECORD_HEADER_SIZE:], layer)
+    elif kind in (KIND_STRING, KIND_STACK_STRING, KIND_ERROR_STRING) and len(record) >= RECORD_HEADER_SIZE + 4:
+      format_id, = struct.unpack_from(self.elf.endian + "i", record, RECORD_HEADER_SIZE)
+      format = self.format(format_id)
+      if format is None:
+        return False
+
+      message = self.decode_args(format, record[RECORD_HEADER_SIZE + 4:])
+      if record[2] & KIND_TRUNCATED:
+        message += " [truncated]"
+    else:
+      return False
+
+    if self.expected_counter is not None and counter != self.expected_counter:
+      lost = (counter - self.expected_counter) & 0xFFFF
+      self.lost += lost
+      self.output.write("\n*** {0} log record(s) lost".format(lost))
+
+    self.expected_counter = (counter + 1) & 0xFFFF
+    if message is None:
+      return True # more data follows
+
+    if kind == KIND_STACK_STRING:
+      prefix = "[{0:03d}] {1}: ".format(counter, STACK_LAYERS.get(layer, layer))
+    elif kind == KIND_ERROR_STRING:
+      prefix = "[{0:03d}] ERROR: ".format(counter)
+    else:
+      prefix = "[{0:03d}] ".format(counter)
+
+    self.output.write("\n" + prefix + message)
+    self.output.flush()
+    return True
+
+  def decode_data(self, data, more):
+    self.data.append(data)
+    if more:
+      return None
+
+    message = " ".join("{0:02X}".format(b) for b in b"".join(self.data))
+    self.data = []
+    return message
+
+  def decode_args(self, format, args):
+    endian = self.elf.endian
+    offset = [0]
+
+    def take(size, code):
+      value, = struct.unpack_from(endian + code, args, offset[0])
+      offset[0] += size
+      return value
+
+    def convert(match):
+      flags, width, precision, modifier, conversion = match.groups()
+      if conversion == "%":
+        return "%"
+
+      try:
+        if width == "*":
+          width = str(take(4, "i"))
+        if precision == "*":
+          precision = str(take(4, "i"))
+
+        signed = conversion in "di"
+        if conversion in "fFeEgGaA":
+          value = take(8, "d")
+          if conversion in "aA":
+            return value.hex()
+        elif conversion == "s":
+          length = take(1, "B")
+          value = args[offset[0]:offset[0] + length].decode("utf-8", "replace")
+          if len(value) < length:
+            raise struct.error("string argument incomplete")
+          offset[0] += length
+        elif conversion == "p":
+          value = take(4, "I")
+          conversion = "x"
+          flags = "#" + flags
+        elif modifier in ("ll", "j"):
+          value = take(8, "q" if signed else "Q")
+        else:
+          value = take(4, "i" if signed else "I")
+          if conversion == "c":
+            value = chr(value & 0xFF)
+      except struct.error:
+        return match.group(0) # the argument did not fit in the record
+
+      spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "") + conversion
+      return spec % value
+
+    return CONVERSION.sub(convert, format)
+
+def read_source(config):
+  if config.serial:
+    import serial
+    port = serial.Serial(config.serial, config.baudrate)
+    while True:
+      yield port.read(port.in_waiting or 1)
+  else:
+    source = sys.stdin.buffer if config.input == "-" else open(config.input, "rb")
+    while True:
+      data = source.read1(4096) if hasattr(source, "read1") else source.read(4096)
+      if not data:
+        return
+      yield data
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(
+    description="Decodes the binary log records of a Sub-IoT application."
+  )
+
+  parser.add_argument("elf", help="the ELF file of the application running on the target")
+  parser.add_argument("input", nargs="?", default="-", help="file with the log output, stdin by default")
+  parser.add_argument("-s", "--serial", help="read the log output from this serial port instead")
+  parser.add_argument("-b", "--baudrate", help="baudrate of the serial port", type=int, default=115200)
+  config = parser.parse_args()
+
+  decoder = Decoder(ElfFile(config.elf), sys.stdout)
+  try:
+    for data in read_source(config):
+      decoder.feed(data)
+  except KeyboardInterrupt:
+    pass
+
+  decoder.text(decoder.buffer)
+  sys.stdout.write("\n")
+  if decoder.lost:
+    sys.stderr.write("{0} log record(s) lost\n".format(decoder.lost))